@@ -0,0 +1,63 @@
+// MockOllama.cpp
+//
+// Stand-alone mock Ollama server for running the app, or anything else speaking the Ollama
+// API, without a model:
+//
+//   g++ -O2 -std=c++14 -Isrc bench/MockOllama.cpp src/MockOllamaServer.cpp src/StreamingInference.cpp
+//       src/TcpSocket.cpp -lpthread -o mock_ollama
+//
+// Usage: mock_ollama [--port <n>] [--latency-ms <mean>] [--spread-ms <n>] [--distribution fixed|uniform|lognormal]
+//                    [--token-ms <n>] [--image-ms <n>] [--slots <n>] [--error-rate <0..1>] [--seed <n>]
+// Serves until stdin closes or a line is entered, then prints the request statistics.
+
+#include "MockOllamaServer.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+int main(int argc, char** argv) {
+    int port = 11434;
+    MockOllamaServer::Settings settings;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--port") && i + 1 < argc) port = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--latency-ms") && i + 1 < argc) settings.firstTokenLatency.meanMs = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--spread-ms") && i + 1 < argc) settings.firstTokenLatency.spreadMs = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--distribution") && i + 1 < argc) {
+            std::string name = argv[++i];
+            settings.firstTokenLatency.distribution = name == "uniform" ? MockLatency::Uniform :
+                name == "lognormal" ? MockLatency::LogNormal : MockLatency::Fixed;
+        }
+        else if (!strcmp(argv[i], "--token-ms") && i + 1 < argc) settings.tokenInterval = MockLatency(atof(argv[++i]));
+        else if (!strcmp(argv[i], "--image-ms") && i + 1 < argc) settings.imageLatency = MockLatency(atof(argv[++i]));
+        else if (!strcmp(argv[i], "--slots") && i + 1 < argc) settings.slots = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--error-rate") && i + 1 < argc) settings.errorRate = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--seed") && i + 1 < argc) settings.seed = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        else {
+            fprintf(stderr, "usage: %s [--port <n>] [--latency-ms <mean>] [--spread-ms <n>] [--distribution fixed|uniform|lognormal]"
+                " [--token-ms <n>] [--image-ms <n>] [--slots <n>] [--error-rate <0..1>] [--seed <n>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    MockOllamaServer server;
+    server.setSettings(settings);
+    if (!server.start(port)) {
+        fprintf(stderr, "Couldn't listen on port %d\n", port);
+        return 1;
+    }
+
+    printf("mock ollama on 127.0.0.1:%d, press enter to stop\n", server.getPort());
+    std::string line;
+    std::getline(std::cin, line);
+    server.stop();
+
+    MockOllamaServer::Stats stats = server.getStats();
+    printf("%llu requests, %llu images, %llu errors, %llu streamed, %d max concurrent\n",
+        static_cast<unsigned long long>(stats.requests), static_cast<unsigned long long>(stats.images),
+        static_cast<unsigned long long>(stats.errors), static_cast<unsigned long long>(stats.streamed), stats.maxActive);
+    return 0;
+}
@@ -0,0 +1,189 @@
+// SessionServer.cpp
+//
+// Headless multi-session server: hosts one drawing session per TCP connection (see
+// SessionListener), or replays a recorded session into many local sessions at once:
+//
+//   g++ -O2 -std=c++14 -Isrc bench/SessionServer.cpp src/SessionManager.cpp src/WorkStealingPool.cpp
+//       src/SoftwareRasterizer.cpp src/VectorDrawing.cpp src/StrokeMemoryPool.cpp src/StrokeGeometry.cpp
+//       src/SpatialIndex.cpp src/TiledCanvas.cpp src/VectorPayload.cpp src/SessionRecording.cpp
+//       src/InterpretationTrigger.cpp src/InferenceStage.cpp src/PerfCounters.cpp src/StreamingInference.cpp
+//       src/InferenceBackend.cpp src/BatchingBackend.cpp src/MockOllamaServer.cpp src/TcpSocket.cpp
+//       -lpthread -o session_server
+//
+// Usage: session_server [--port <n>] [--public] [--threads <n>] [--inference-threads <n>]
+//                       [--ollama <host:port> | --mock] [--model <name>] [--vector]
+//                       [--batch-ms <n>] [--max-batch <n>] [--replay <file.vsession> --sessions <n>]
+// Serves until stdin closes or a line is entered; a replay runs once at the recorded pace.
+// Prints the session statistics at the end.
+//
+// --max-batch above 1 batches the sessions' canvases (see BatchingBackend); a batch can't be
+// larger than --inference-threads, the requests waiting for the model at once.
+
+#include "SessionManager.h"
+#include "BatchingBackend.h"
+#include "MockOllamaServer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+    // Posts the recording to every session at the recorded pace, each session offset a little
+    // so their strokes don't start in lockstep
+    void replay(SessionManager& manager, const std::vector<InputEvent>& events, size_t sessionCount) {
+        typedef std::chrono::steady_clock Clock;
+
+        struct Scheduled {
+            double time;
+            SessionManager::SessionId session;
+            size_t event;
+
+            bool operator<(const Scheduled& other) const { return time < other.time; }
+        };
+
+        std::vector<Scheduled> schedule;
+        double start = events.front().time;
+        for (size_t i = 0; i < sessionCount; ++i) {
+            SessionManager::SessionId session = manager.openSession();
+            double offset = 0.05 * i;
+            for (size_t e = 0; e < events.size(); ++e) {
+                Scheduled entry = { events[e].time - start + offset, session, e };
+                schedule.push_back(entry);
+            }
+        }
+        std::stable_sort(schedule.begin(), schedule.end());
+
+        Clock::time_point replayStart = Clock::now();
+        for (const Scheduled& entry : schedule) {
+            std::this_thread::sleep_until(replayStart + std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(entry.time)));
+            manager.post(entry.session, events[entry.event]);
+        }
+        manager.drain();
+    }
+
+    void printStats(const SessionManager& manager, double seconds) {
+        SessionManager::Stats stats = manager.getStats();
+        const SessionManager::Timings& timings = manager.getTimings();
+
+        printf("%zu sessions, %llu events, %llu rejected, %llu turns, %llu interpretations, %llu results, %llu failed, %llu coalesced\n",
+            stats.sessions, static_cast<unsigned long long>(stats.events), static_cast<unsigned long long>(stats.rejected),
+            static_cast<unsigned long long>(stats.turns), static_cast<unsigned long long>(stats.interpretations),
+            static_cast<unsigned long long>(stats.results), static_cast<unsigned long long>(stats.failures),
+            static_cast<unsigned long long>(stats.coalesced));
+        printf("workers: %llu tasks, %llu stolen, %.1f%% busy\n", static_cast<unsigned long long>(stats.workers.executed),
+            static_cast<unsigned long long>(stats.workers.stolen),
+            seconds > 0 ? 100.0 * stats.workers.busySeconds / (seconds * manager.getWorkerCount()) : 0.0);
+
+        const RingHistogram* histograms[] = { &timings.inputLatency, &timings.turn, &timings.capture, &timings.model,
+            &timings.interpretation };
+        const char* names[] = { "input latency", "turn", "capture", "model", "interpretation" };
+        for (size_t i = 0; i < 5; ++i) {
+            float mean, p95, max;
+            histograms[i]->getSummary(mean, p95, max);
+            printf("  %-16s mean %8.2f ms, p95 %8.2f ms, max %8.2f ms\n", names[i], mean, p95, max);
+        }
+    }
+
+}
+
+int main(int argc, char** argv) {
+    int port = 7400;
+    bool loopbackOnly = true;
+    bool mock = false;
+    std::string ollamaHost = "127.0.0.1";
+    int ollamaPort = 11434;
+    std::string replayPath;
+    size_t sessionCount = 1;
+    BatchingBackend::Settings batching(20.0, 1);
+    SessionManager::Settings settings;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--port") && i + 1 < argc) port = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--public")) loopbackOnly = false;
+        else if (!strcmp(argv[i], "--threads") && i + 1 < argc) settings.workerThreads = strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--inference-threads") && i + 1 < argc) settings.inferenceThreads = strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--mock")) mock = true;
+        else if (!strcmp(argv[i], "--ollama") && i + 1 < argc) {
+            std::string address = argv[++i];
+            size_t colon = address.rfind(':');
+            ollamaHost = address.substr(0, colon);
+            if (colon != std::string::npos) ollamaPort = atoi(address.c_str() + colon + 1);
+        }
+        else if (!strcmp(argv[i], "--model") && i + 1 < argc) settings.model = argv[++i];
+        else if (!strcmp(argv[i], "--vector")) settings.vectorPayload = true;
+        else if (!strcmp(argv[i], "--batch-ms") && i + 1 < argc) batching.windowMillis = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--max-batch") && i + 1 < argc) batching.maxBatch = strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--replay") && i + 1 < argc) replayPath = argv[++i];
+        else if (!strcmp(argv[i], "--sessions") && i + 1 < argc) sessionCount = strtoul(argv[++i], nullptr, 10);
+        else {
+            fprintf(stderr, "usage: %s [--port <n>] [--public] [--threads <n>] [--inference-threads <n>]"
+                " [--ollama <host:port> | --mock] [--model <name>] [--vector] [--batch-ms <n>] [--max-batch <n>]"
+                " [--replay <file.vsession> --sessions <n>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    MockOllamaServer mockServer;
+    if (mock) {
+        if (!mockServer.start()) {
+            fprintf(stderr, "Couldn't start the mock inference server\n");
+            return 1;
+        }
+        ollamaHost = "127.0.0.1";
+        ollamaPort = mockServer.getPort();
+    }
+
+    InferenceBackendRef backend = std::make_shared<OllamaHttpBackend>(ollamaHost, ollamaPort);
+    std::shared_ptr<BatchingBackend> batcher;
+    if (batching.maxBatch > 1) {
+        batcher = std::make_shared<BatchingBackend>(backend, batching);
+        backend = batcher;
+    }
+
+    SessionManager manager(backend, settings);
+    printf("%zu workers, model %s at %s:%d\n", manager.getWorkerCount(), settings.model.c_str(), ollamaHost.c_str(), ollamaPort);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if (!replayPath.empty()) {
+        std::vector<InputEvent> events;
+        if (!SessionRecorder::load(replayPath, events) || events.empty()) {
+            fprintf(stderr, "Couldn't load %s\n", replayPath.c_str());
+            return 1;
+        }
+
+        printf("replaying %zu events into %zu sessions\n", events.size(), sessionCount);
+        replay(manager, events, sessionCount);
+    }
+    else {
+        SessionListener listener(manager);
+        if (!listener.start(port, loopbackOnly)) {
+            fprintf(stderr, "Couldn't listen on port %d\n", port);
+            return 1;
+        }
+
+        printf("sessions on port %d, press enter to stop\n", listener.getPort());
+        std::string line;
+        std::getline(std::cin, line);
+        listener.stop();
+    }
+
+    printStats(manager, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    if (batcher) {
+        BatchingBackend::Stats stats = batcher->getStats();
+        printf("batches: %llu, mean size %.2f, %llu resplit, sizes", static_cast<unsigned long long>(stats.batches),
+            stats.meanBatchSize(), static_cast<unsigned long long>(stats.resplit));
+        for (size_t size = 1; size < stats.batchSizes.size(); ++size) {
+            if (stats.batchSizes[size] > 0) printf(" %zu:%llu", size, static_cast<unsigned long long>(stats.batchSizes[size]));
+        }
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,1933 @@
+// VdrawBench.cpp
+//
+// Microbenchmarks for the vdraw hot paths. Headless and Cinder-free, so it builds on the
+// Linux perf hosts as well as Windows:
+//
+//   g++ -O2 -Wall -std=c++14 -Isrc bench/VdrawBench.cpp src/VectorDrawing.cpp src/StrokeMemoryPool.cpp
+//       src/DrawingDocument.cpp src/PointCodec.cpp src/StrokeGeometry.cpp src/VectorPayload.cpp src/VectorExport.cpp
+//       src/SpatialIndex.cpp src/TiledCanvas.cpp
+//       src/SessionRecording.cpp src/InterpretationTrigger.cpp
+//       src/Tracing.cpp src/SemanticSmoother.cpp src/InferenceStage.cpp src/PerfCounters.cpp
+//       src/StreamingInference.cpp src/InferenceBackend.cpp src/MockOllamaServer.cpp src/TcpSocket.cpp
+//       src/WorkStealingPool.cpp src/SoftwareRasterizer.cpp src/SessionManager.cpp src/BatchingBackend.cpp
+//       src/OscOutputQueue.cpp src/SessionJournal.cpp src/SpscRingBuffer.cpp -lpthread -o vdraw_bench
+//
+// Usage: vdraw_bench [--filter <substring>] [--max-points <n>] [--out <file.json>] [--results <file>]
+// --results replays a recorded stream of interpretation results (one per line) through the smoother.
+// Results are written as JSON (stdout by default) for tracking regressions over time.
+// Cases also check their results (codec round trips, document reloads, undo and redo, journal
+// replay, batch demultiplexing); the run exits with status 1 when any check fails.
+
+#include "VectorDrawing.h"
+#include "DrawingDocument.h"
+#include "PointCodec.h"
+#include "StrokeGeometry.h"
+#include "VectorPayload.h"
+#include "VectorExport.h"
+#include "SpatialIndex.h"
+#include "TiledCanvas.h"
+#include "SessionRecording.h"
+#include "SessionJournal.h"
+#include "ThreadSafeList.h"
+#include "Tracing.h"
+#include "SemanticSmoother.h"
+#include "InferenceStage.h"
+#include "InferenceBackend.h"
+#include "BatchingBackend.h"
+#include "MockOllamaServer.h"
+#include "SessionManager.h"
+#include "OscOutputQueue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <Psapi.h>
+#pragma comment(lib, "Psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+//-------------------------------------------------------------------------
+// Heap allocation counting
+//-------------------------------------------------------------------------
+static std::atomic<size_t> heapAllocations(0);
+
+// The whole set is replaced, so every form is counted and frees with the allocator it came
+// from. The free stays out of line: inlined into a delete expression, GCC takes free() on the
+// memory of a new expression for a mismatch.
+#if defined(__GNUC__)
+#define BENCH_NOINLINE __attribute__((noinline))
+#else
+#define BENCH_NOINLINE
+#endif
+
+static void* countedAllocate(size_t bytes) {
+    heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(bytes ? bytes : 1)) return p;
+    throw std::bad_alloc();
+}
+
+BENCH_NOINLINE static void countedFree(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void* operator new(size_t bytes) {
+    return countedAllocate(bytes);
+}
+
+void* operator new[](size_t bytes) {
+    return countedAllocate(bytes);
+}
+
+void operator delete(void* pointer) noexcept {
+    countedFree(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    countedFree(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    countedFree(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept {
+    countedFree(pointer);
+}
+
+static size_t peakResidentBytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+}
+
+//-------------------------------------------------------------------------
+// Harness
+//-------------------------------------------------------------------------
+namespace {
+
+    typedef std::chrono::steady_clock Clock;
+
+    struct Result {
+        std::string name;
+        std::string params;     // JSON object body, e.g. "\"points\": 1000"
+        size_t iterations;
+        double nsPerOp;
+        double opsPerSecond;
+        std::string extra;      // Additional JSON members
+    };
+
+    struct Options {
+        std::string filter;
+        size_t maxPoints;
+        std::string outPath;
+        std::string resultsPath;
+
+        Options() : maxPoints(1000000) {}
+    };
+
+    Options options;
+    std::vector<Result> results;
+    size_t failedChecks = 0;
+
+    bool enabled(const std::string& name) {
+        return options.filter.empty() || name.find(options.filter) != std::string::npos;
+    }
+
+    // Records iterations of opsPerIteration operations that took elapsed seconds in total
+    void report(const std::string& name, const std::string& params, size_t iterations, size_t opsPerIteration,
+        double elapsed, const std::string& extra = "") {
+        double ops = static_cast<double>(iterations) * opsPerIteration;
+        Result result;
+        result.name = name;
+        result.params = params;
+        result.iterations = iterations;
+        result.nsPerOp = elapsed * 1e9 / ops;
+        result.opsPerSecond = ops / elapsed;
+        result.extra = extra;
+        results.push_back(result);
+
+        fprintf(stderr, "%-32s %-40s %12.1f ns/op %14.0f ops/s\n", name.c_str(), params.c_str(), result.nsPerOp, result.opsPerSecond);
+    }
+
+    // Runs body (which performs opsPerIteration operations) until minSeconds have elapsed
+    void measure(const std::string& name, const std::string& params, size_t opsPerIteration,
+        const std::function<void()>& body, const std::string& extra = "", double minSeconds = 0.2) {
+        size_t iterations = 0;
+        double elapsed = 0;
+
+        do {
+            Clock::time_point start = Clock::now();
+            body();
+            elapsed += std::chrono::duration<double>(Clock::now() - start).count();
+            iterations++;
+        } while (elapsed < minSeconds);
+
+        report(name, params, iterations, opsPerIteration, elapsed, extra);
+    }
+
+    // Correctness check alongside the timings; a failure is reported and fails the run
+    void check(bool condition, const std::string& name, const std::string& detail = "") {
+        if (condition) return;
+        failedChecks++;
+        fprintf(stderr, "CHECK FAILED %s%s%s\n", name.c_str(), detail.empty() ? "" : ": ", detail.c_str());
+    }
+
+    // Order-sensitive hash of every layer's strokes (style and raw points), to compare drawings
+    uint64_t fingerprint(const vdraw::Drawing& drawing) {
+        uint64_t hash = 14695981039346656037ull;
+        auto mix = [&hash](const void* data, size_t bytes) {
+            const uint8_t* p = static_cast<const uint8_t*>(data);
+            for (size_t i = 0; i < bytes; ++i) hash = (hash ^ p[i]) * 1099511628211ull;
+        };
+
+        for (size_t i = 0; i < drawing.getLayerCount(); ++i) {
+            const std::vector<vdraw::Stroke*>& strokes = drawing.getLayer(i).getStrokes();
+            uint64_t count = strokes.size();
+            mix(&count, sizeof(count));
+            for (const vdraw::Stroke* stroke : strokes) {
+                vdraw::Color color = stroke->getColor();
+                float width = stroke->getBaseWidth();
+                int smoothing = stroke->getSmoothing();
+                mix(&color.r, sizeof(float)); mix(&color.g, sizeof(float)); mix(&color.b, sizeof(float)); mix(&color.a, sizeof(float));
+                mix(&width, sizeof(width));
+                mix(&smoothing, sizeof(smoothing));
+                // Field by field, the struct has padding
+                for (const vdraw::StrokePoint& point : stroke->getRawPoints()) {
+                    mix(&point.position.x, sizeof(float));
+                    mix(&point.position.y, sizeof(float));
+                    mix(&point.pressure, sizeof(float));
+                    mix(&point.timestamp, sizeof(double));
+                }
+            }
+        }
+        return hash;
+    }
+
+    std::string param(const char* key, size_t value) {
+        return "\"" + std::string(key) + "\": " + std::to_string(value);
+    }
+
+    std::string param(const char* key, const char* value) {
+        return "\"" + std::string(key) + "\": \"" + value + "\"";
+    }
+
+    void writeJson(FILE* out) {
+        fprintf(out, "{\n  \"suite\": \"vdraw\",\n  \"peak_rss_bytes\": %zu,\n  \"failed_checks\": %zu,\n  \"benchmarks\": [\n",
+            peakResidentBytes(), failedChecks);
+        for (size_t i = 0; i < results.size(); ++i) {
+            const Result& r = results[i];
+            fprintf(out, "    {\"name\": \"%s\", \"params\": {%s}, \"iterations\": %zu, \"ns_per_op\": %.3f, \"ops_per_sec\": %.1f%s%s}%s\n",
+                r.name.c_str(), r.params.c_str(), r.iterations, r.nsPerOp, r.opsPerSecond,
+                r.extra.empty() ? "" : ", ", r.extra.c_str(), i + 1 < results.size() ? "," : "");
+        }
+        fprintf(out, "  ]\n}\n");
+    }
+
+    //-------------------------------------------------------------------------
+    // Stroke generators
+    //-------------------------------------------------------------------------
+    enum StrokeShape { Line, Spiral, Scribble };
+    const char* shapeNames[] = { "line", "spiral", "scribble" };
+
+    // Mouse-like samples at 60 Hz with a few pixels between samples
+    std::vector<vdraw::StrokePoint> makeStroke(size_t count, StrokeShape shape, unsigned seed = 1) {
+        std::vector<vdraw::StrokePoint> points;
+        points.reserve(count);
+        srand(seed);
+
+        float x = 512, y = 512;
+        for (size_t i = 0; i < count; ++i) {
+            double t = i / 60.0;
+            switch (shape) {
+            case Line:
+                x = 10.0f + 3.0f * (i % 1000);
+                y = 10.0f + 0.5f * (i % 1000);
+                break;
+            case Spiral: {
+                float angle = i * 0.05f;
+                float radius = 10.0f + std::fmod(i * 0.2f, 500.0f);
+                x = 512 + radius * std::cos(angle);
+                y = 512 + radius * std::sin(angle);
+                break;
+            }
+            case Scribble:
+                x = std::min(1535.0f, std::max(0.0f, x + (rand() % 13 - 6)));
+                y = std::min(1535.0f, std::max(0.0f, y + (rand() % 13 - 6)));
+                break;
+            }
+            points.push_back(vdraw::StrokePoint(vdraw::Vec2(x, y), 0.5f + (i % 10) * 0.05f, t));
+        }
+        return points;
+    }
+
+    std::vector<size_t> strokeLengths() {
+        std::vector<size_t> lengths;
+        for (size_t n = 100; n <= options.maxPoints; n *= 10) {
+            lengths.push_back(n);
+        }
+        return lengths;
+    }
+
+    //-------------------------------------------------------------------------
+    // Benchmarks
+    //-------------------------------------------------------------------------
+    void benchAddPoint() {
+        if (!enabled("stroke_add_point")) return;
+
+        for (size_t length : strokeLengths()) {
+            auto points = makeStroke(length, Scribble);
+            for (int smoothing = 0; smoothing <= 10; smoothing += (smoothing < 2 ? 1 : 4)) {
+                measure("stroke_add_point", param("points", length) + ", " + param("smoothing", smoothing), length, [&]() {
+                    vdraw::Stroke stroke;
+                    stroke.setSmoothing(smoothing);
+                    for (const auto& point : points) {
+                        stroke.addPoint(point);
+                    }
+                });
+            }
+        }
+    }
+
+    void benchAddPointsBatched() {
+        if (!enabled("stroke_add_points_batch")) return;
+
+        for (size_t length : strokeLengths()) {
+            auto points = makeStroke(length, Scribble);
+            for (size_t batch : { 1, 8, 64, 1024 }) {
+                measure("stroke_add_points_batch", param("points", length) + ", " + param("batch", batch) + ", " + param("smoothing", 4), length, [&]() {
+                    vdraw::Stroke stroke;
+                    stroke.setSmoothing(4);
+                    for (size_t i = 0; i < points.size(); i += batch) {
+                        stroke.addPoints(points.data() + i, std::min(batch, points.size() - i));
+                    }
+                });
+            }
+        }
+    }
+
+    void benchUpdateProcessedPoints() {
+        if (!enabled("stroke_update_processed")) return;
+
+        // Changing the smoothing level reprocesses the whole stroke
+        for (size_t length : strokeLengths()) {
+            vdraw::Stroke stroke;
+            stroke.addPoints(makeStroke(length, Spiral));
+            int level = 0;
+            measure("stroke_update_processed", param("points", length) + ", " + param("smoothing", 5), length, [&]() {
+                stroke.setSmoothing(level);
+                level = level == 5 ? 4 : 5;
+            });
+        }
+    }
+
+    void benchGetWidthAt() {
+        if (!enabled("stroke_get_width_at")) return;
+
+        for (size_t length : strokeLengths()) {
+            for (int dynamic = 0; dynamic <= 1; ++dynamic) {
+                vdraw::Stroke stroke(vdraw::Color(0, 0, 0), 4.0f);
+                stroke.setDynamicWidth(dynamic != 0);
+                stroke.addPoints(makeStroke(length, Spiral));
+
+                volatile float sink = 0;
+                measure("stroke_get_width_at", param("points", length) + ", " + param("dynamic", dynamic), length, [&]() {
+                    float total = 0;
+                    for (size_t i = 0; i < length; ++i) {
+                        total += stroke.getWidthAt(i);
+                    }
+                    sink = total;
+                });
+            }
+        }
+    }
+
+    void benchDrawingStrokes() {
+        if (!enabled("drawing_begin_continue")) return;
+
+        for (size_t length : strokeLengths()) {
+            if (length > 100000) break;
+            auto points = makeStroke(length, Scribble);
+            const size_t strokeLength = 100;
+
+            measure("drawing_begin_continue", param("points", length) + ", " + param("stroke_length", strokeLength), length, [&]() {
+                vdraw::Drawing drawing;
+                for (size_t i = 0; i < points.size(); ++i) {
+                    const auto& p = points[i];
+                    if (i % strokeLength == 0) {
+                        drawing.endStroke();
+                        drawing.beginStroke(p.position, p.pressure, p.timestamp);
+                    }
+                    else {
+                        drawing.continueStroke(p.position, p.pressure, p.timestamp);
+                    }
+                }
+                drawing.endStroke();
+            });
+        }
+    }
+
+    void benchHistory() {
+        if (!enabled("drawing_history")) return;
+
+        for (size_t strokes : { 1000, 10000 }) {
+            vdraw::Drawing drawing;
+            auto points = makeStroke(50, Scribble);
+            for (size_t i = 0; i < strokes; ++i) {
+                drawing.beginStroke(points[0].position, 1.0f, 0);
+                drawing.continueStroke(points.data() + 1, points.size() - 1);
+                drawing.endStroke();
+            }
+
+            measure("drawing_history_undo_redo", param("strokes", strokes), strokes * 2, [&]() {
+                for (size_t i = 0; i < strokes; ++i) drawing.undo();
+                for (size_t i = 0; i < strokes; ++i) drawing.redo();
+            });
+
+            measure("drawing_history_clear_undo", param("strokes", strokes), 2, [&]() {
+                drawing.clearDrawing();
+                drawing.undo();
+            });
+        }
+    }
+
+    void benchThreadSafeList() {
+        if (!enabled("thread_safe_list")) return;
+
+        for (int threads : { 1, 2, 4, 8 }) {
+            const size_t operations = 20000;
+            measure("thread_safe_list_push_pop", param("threads", threads), operations * threads, [&]() {
+                ThreadSafeList<std::string> list;
+                std::vector<std::thread> workers;
+                for (int t = 0; t < threads; ++t) {
+                    workers.emplace_back([&list, operations]() {
+                        for (size_t i = 0; i < operations; ++i) {
+                            list.push_front("a drawing of a house with a tree");
+                            if (list.size() > 30) list.pop_back();
+                        }
+                    });
+                }
+                for (auto& worker : workers) worker.join();
+            });
+
+            // forEach of a 30 entry history (as drawn each frame) while writers contend
+            measure("thread_safe_list_for_each", param("writers", threads), 1000, [&]() {
+                ThreadSafeList<std::string> list;
+                for (int i = 0; i < 30; ++i) list.push_back("a drawing of a house with a tree");
+
+                std::atomic<bool> done(false);
+                std::vector<std::thread> writers;
+                for (int t = 0; t < threads; ++t) {
+                    writers.emplace_back([&]() {
+                        while (!done) {
+                            list.push_front("a sailboat on the ocean");
+                            list.pop_back();
+                        }
+                    });
+                }
+
+                size_t total = 0;
+                for (int i = 0; i < 1000; ++i) {
+                    list.forEach([&total](const std::string& line) { total += line.size(); });
+                }
+
+                done = true;
+                for (auto& writer : writers) writer.join();
+            });
+        }
+    }
+
+    void benchLongSession() {
+        if (!enabled("long_session")) return;
+
+        // A day-long kiosk session: many short strokes, periodic clears, bounded history
+        const size_t strokes = 50000;
+        auto points = makeStroke(200, Scribble);
+
+        size_t allocationsBefore = heapAllocations.load();
+        vdraw::PoolStats stats;
+        measure("long_session_replay", param("strokes", strokes) + ", " + param("history_limit", 1000), strokes, [&]() {
+            vdraw::Drawing drawing;
+            drawing.setHistoryLimit(1000);
+            for (size_t i = 0; i < strokes; ++i) {
+                size_t length = 20 + (i * 37) % 180;
+                drawing.beginStroke(points[0].position, 1.0f, 0);
+                drawing.continueStroke(points.data() + 1, length - 1);
+                drawing.endStroke();
+                if (i % 500 == 499) drawing.clearDrawing();
+                if (i % 7 == 0) drawing.undo();
+            }
+            stats = drawing.getMemoryStats();
+        }, "", 0);
+        size_t allocations = heapAllocations.load() - allocationsBefore;
+
+        results.back().extra = "\"heap_allocations\": " + std::to_string(allocations) +
+            ", \"pool_chunk_allocations\": " + std::to_string(stats.chunkAllocations) +
+            ", \"pool_block_allocations\": " + std::to_string(stats.blockAllocations) +
+            ", \"pool_peak_reserved_bytes\": " + std::to_string(stats.peakBytesReserved) +
+            ", \"pool_peak_in_use_bytes\": " + std::to_string(stats.peakBytesInUse) +
+            ", \"peak_rss_bytes\": " + std::to_string(peakResidentBytes());
+    }
+
+    void benchDocument() {
+        if (!enabled("document")) return;
+
+        size_t total = std::min<size_t>(options.maxPoints, 1000000);
+        size_t perStroke = 1000;
+        vdraw::Drawing drawing;
+        auto points = makeStroke(perStroke, Spiral);
+        for (size_t i = 0; i < total / perStroke; ++i) {
+            drawing.beginStroke(points[0].position, 1.0f, 0);
+            drawing.continueStroke(points.data() + 1, points.size() - 1);
+            drawing.endStroke();
+        }
+
+        const std::string path = "vdraw_bench.vdraw";
+        measure("document_save", param("points", total), total, [&]() {
+            vdraw::DrawingDocumentWriter::save(drawing, path);
+        });
+
+        // Open and touch every point, so the cost includes faulting the mapping in
+        measure("document_open_mapped", param("points", total), total, [&]() {
+            vdraw::DrawingDocument document;
+            document.open(path);
+            volatile float sink = 0;
+            document.forEachStroke([&sink](const vdraw::StrokeView& view) {
+                for (size_t i = 0; i < view.processedCount; ++i) sink = sink + view.processedPoints[i].position.x;
+            });
+        });
+
+        measure("document_load_into_drawing", param("points", total), total, [&]() {
+            vdraw::DrawingDocument document;
+            document.open(path);
+            vdraw::Drawing loaded;
+            document.loadInto(loaded);
+        });
+
+        {
+            vdraw::DrawingDocument document;
+            check(document.open(path), "document_open", path);
+            check(document.getStrokeCount() == drawing.getStrokes().size() && document.getPointCount() >= total,
+                "document_counts", std::to_string(document.getStrokeCount()) + " strokes, " + std::to_string(document.getPointCount()) + " points");
+            vdraw::Drawing loaded;
+            document.loadInto(loaded);
+            check(fingerprint(loaded) == fingerprint(drawing), "document_round_trip", "loaded strokes differ from the saved ones");
+        }
+
+        remove(path.c_str());
+    }
+
+    void benchJournal() {
+        if (!enabled("journal")) return;
+
+        // A session journaled across restarts and compactions, drawing, erasing and clearing, and
+        // undoing and redoing on either side of each snapshot. Every restart replays the journal,
+        // which must rebuild the live drawing and its history.
+        size_t strokes = std::max<size_t>(std::min<size_t>(options.maxPoints / 100, 2000), 50);
+        auto points = makeStroke(100, Scribble);
+        const std::string path = "vdraw_bench.journal";
+        remove(path.c_str());
+
+        const size_t historyLimit = 100;
+        std::unique_ptr<vdraw::Drawing> live(new vdraw::Drawing());
+        size_t sessions = 4;
+        double elapsed = 0;
+        uint64_t compactedBytes = 0;
+        for (size_t session = 0; session < sessions; ++session) {
+            std::unique_ptr<vdraw::Drawing> restored(new vdraw::Drawing());
+            restored->setHistoryLimit(historyLimit);
+            vdraw::SessionJournal journal;
+            journal.setGroupCommitInterval(1);
+            // Small enough for the later sessions to compact while drawing
+            journal.setCompactionThreshold(session < 2 ? 64ull * 1024 * 1024 : 64 * 1024);
+            check(journal.start(path, *restored), "journal_start", path);
+            check(fingerprint(*restored) == fingerprint(*live), "journal_replay",
+                "session " + std::to_string(session) + " restored a different drawing");
+            live = std::move(restored);
+
+            // Undo past the restart's snapshot, then redo part of it: the history comes back with
+            // the strokes, redoable commands included, so the next replay must agree on what was undone
+            size_t before = live->getStrokes().size();
+            for (int undo = 0; undo < 30; ++undo) live->undo();
+            check(session == 0 || live->getStrokes().size() < before, "journal_undo_after_snapshot",
+                "session " + std::to_string(session) + " restored no history");
+            for (int redo = 0; redo < 10; ++redo) live->redo();
+
+            Clock::time_point start = Clock::now();
+            std::vector<vdraw::StrokePoint> shifted(points);
+            for (size_t i = 0; i < strokes; ++i) {
+                // Spread out, so the eraser only reaches a few strokes, and stamped, which tells
+                // each stroke apart in the fingerprint
+                vdraw::Vec2 offset(static_cast<float>(i % 16) * 64.0f, static_cast<float>(i / 16 % 16) * 64.0f);
+                for (size_t p = 0; p < points.size(); ++p) {
+                    shifted[p].position = points[p].position + offset;
+                    shifted[p].timestamp = static_cast<double>(session * strokes + i) + points[p].timestamp;
+                }
+                live->beginStroke(shifted[0].position, 1.0f, shifted[0].timestamp);
+                live->continueStroke(shifted.data() + 1, shifted.size() - 1);
+                live->endStroke();
+                if (i % 5 == 4) live->undo();
+                if (i % 10 == 9) live->redo();
+                if (i % 17 == 16) { live->undo(); live->undo(); }
+                if (i % 23 == 22) {
+                    live->beginErase(shifted[50].position, 8.0f);
+                    live->continueErase(shifted[60].position);
+                    live->endErase();
+                }
+                // Undone again, a clear left standing would hide what is below it from the fingerprint
+                if (i % 211 == 210) { live->clearDrawing(); live->undo(); }
+                // Undo across the compactions the later sessions make as they draw
+                if (i % 97 == 96) { for (int undo = 0; undo < 12; ++undo) live->undo(); }
+            }
+            // Leaves a clear and a stroke to redo for the next restart's snapshot
+            live->clearDrawing();
+            live->undo();
+            live->undo();
+            elapsed += std::chrono::duration<double>(Clock::now() - start).count();
+            journal.stop();
+            check(!journal.hasFailed(), "journal_writes", "session " + std::to_string(session));
+            compactedBytes = journal.getJournalBytes();
+        }
+
+        report("journal_record", param("strokes", strokes * sessions), 1, strokes * sessions * points.size(), elapsed,
+            "\"journal_bytes\": " + std::to_string(compactedBytes));
+
+        vdraw::Drawing replayed;
+        replayed.setHistoryLimit(historyLimit);
+        check(vdraw::SessionJournal::replay(path, replayed) > 0 && fingerprint(replayed) == fingerprint(*live),
+            "journal_replay_final", "replay differs from the live drawing");
+        for (int undo = 0; undo < 50; ++undo) { replayed.undo(); live->undo(); }
+        check(fingerprint(replayed) == fingerprint(*live), "journal_replay_undo", "undo after replay differs");
+        for (int redo = 0; redo < 20; ++redo) { replayed.redo(); live->redo(); }
+        check(fingerprint(replayed) == fingerprint(*live), "journal_replay_redo", "redo after replay differs");
+        remove(path.c_str());
+    }
+
+    void benchVectorExport() {
+        if (!enabled("vector_export")) return;
+
+        size_t total = std::min<size_t>(options.maxPoints, 1000000);
+        size_t perStroke = 1000;
+        vdraw::Drawing drawing;
+        for (size_t i = 0; i < total / perStroke; ++i) {
+            auto points = makeStroke(perStroke, i % 2 ? Scribble : Spiral, static_cast<unsigned>(i + 1));
+            drawing.addStroke(points.data(), points.size(), vdraw::Color(0, 0, 0), 2.0f);
+        }
+
+        const char* paths[] = { "vdraw_bench.svg", "vdraw_bench.pdf" };
+        const float tolerances[] = { 0.0f, 0.25f, 1.0f };
+        for (const char* path : paths) {
+            for (float tolerance : tolerances) {
+                vdraw::VectorExportSettings settings(tolerance);
+                uint64_t bytes = 0;
+                size_t pointsWritten = 0;
+                size_t allocations = 0;
+
+                // Allocations stay constant per export however many points are written
+                measure("vector_export", param("points", total) + ", " + param("format", path + 12) +
+                    ", \"tolerance\": " + std::to_string(tolerance), total, [&]() {
+                    size_t allocationsBefore = heapAllocations.load();
+                    vdraw::VectorExporter exporter(vdraw::VectorExporter::formatFor(path), settings);
+                    exporter.open(path, 1536.0f, 1536.0f);
+                    for (const vdraw::Stroke* stroke : drawing.getStrokes()) {
+                        exporter.writeStroke(*stroke);
+                    }
+                    bytes = exporter.getBytesWritten();
+                    pointsWritten = exporter.getPointsWritten();
+                    exporter.close();
+                    allocations = heapAllocations.load() - allocationsBefore;
+                });
+                results.back().extra = "\"bytes\": " + std::to_string(bytes) +
+                    ", \"points_written\": " + std::to_string(pointsWritten) +
+                    ", \"heap_allocations\": " + std::to_string(allocations);
+                remove(path);
+            }
+        }
+    }
+
+    // Brute-force reference for the spatial index: topmost stroke within reach of position
+    const vdraw::Stroke* linearHitTest(const vdraw::Drawing& drawing, const vdraw::Vec2& position, float tolerance) {
+        const auto& strokes = drawing.getStrokes();
+        for (size_t s = strokes.size(); s-- > 0;) {
+            const vdraw::PointBuffer& points = strokes[s]->getProcessedPoints();
+            for (size_t i = 0; i == 0 || i + 1 < points.size(); ++i) {
+                size_t next = std::min(i + 1, points.size() - 1);
+                float reach = std::max(strokes[s]->getWidthAt(i), strokes[s]->getWidthAt(next)) * 0.5f + tolerance;
+                if (vdraw::distanceToSegmentSquared(position, points[i].position, points[next].position) <= reach * reach) {
+                    return strokes[s];
+                }
+            }
+        }
+        return nullptr;
+    }
+
+    // 100-segment scribbles at constant density over a square of the returned side, so the
+    // canvas grows with the drawing
+    float scatterScribbles(size_t segments, std::vector<std::vector<vdraw::StrokePoint>>& shapes) {
+        size_t strokes = segments / 100;
+        float side = 100.0f * std::sqrt(static_cast<float>(strokes));
+        shapes.clear();
+        srand(7);
+        for (size_t i = 0; i < strokes; ++i) {
+            auto points = makeStroke(101, Scribble, static_cast<unsigned>(i + 1));
+            vdraw::Vec2 offset(static_cast<float>(rand() % static_cast<int>(side)) - 512.0f, static_cast<float>(rand() % static_cast<int>(side)) - 512.0f);
+            for (auto& point : points) point.position = point.position + offset;
+            shapes.push_back(points);
+        }
+        return side;
+    }
+
+    void benchSpatialIndex() {
+        if (!enabled("spatial")) return;
+
+        for (size_t segments = 10000; segments <= std::min<size_t>(options.maxPoints, 1000000); segments *= 10) {
+            std::vector<std::vector<vdraw::StrokePoint>> shapes;
+            float side = scatterScribbles(segments, shapes);
+
+            std::unique_ptr<vdraw::Drawing> drawing;
+            measure("spatial_index_build", param("segments", segments), segments, [&]() {
+                drawing.reset(new vdraw::Drawing());
+                for (const auto& points : shapes) {
+                    drawing->addStroke(points.data(), points.size(), vdraw::Color(0, 0, 0), 2.0f);
+                }
+            }, "", 0);
+            const vdraw::SpatialIndex& index = drawing->getSpatialIndex();
+            results.back().extra = "\"entries\": " + std::to_string(index.getEntryCount()) + ", \"nodes\": " + std::to_string(index.getNodeCount());
+
+            std::vector<vdraw::Vec2> probes;
+            for (size_t i = 0; i < 1000; ++i) {
+                probes.push_back(vdraw::Vec2(static_cast<float>(rand() % static_cast<int>(side)), static_cast<float>(rand() % static_cast<int>(side))));
+            }
+
+            size_t hits = 0;
+            measure("spatial_hit_test", param("segments", segments), probes.size(), [&]() {
+                hits = 0;
+                for (const auto& probe : probes) {
+                    hits += drawing->hitTest(probe, 4.0f) ? 1 : 0;
+                }
+            });
+            results.back().extra = "\"hit_rate\": " + std::to_string(hits / static_cast<double>(probes.size()));
+
+            if (segments <= 100000) {
+                size_t linearHits = 0;
+                measure("spatial_hit_test_linear", param("segments", segments), probes.size(), [&]() {
+                    linearHits = 0;
+                    for (const auto& probe : probes) {
+                        linearHits += linearHitTest(*drawing, probe, 4.0f) ? 1 : 0;
+                    }
+                });
+                results.back().extra = "\"matches_index\": " + std::string(linearHits == hits ? "true" : "false");
+            }
+
+            size_t found = 0;
+            std::vector<const vdraw::Stroke*> selected;
+            measure("spatial_query_rect", param("segments", segments) + ", " + param("rect", 256), probes.size(), [&]() {
+                found = 0;
+                for (const auto& probe : probes) {
+                    vdraw::Bounds rect;
+                    rect.include(probe);
+                    rect.include(probe + vdraw::Vec2(256.0f, 256.0f));
+                    selected.clear();
+                    drawing->queryStrokes(rect, selected);
+                    found += selected.size();
+                }
+            });
+            results.back().extra = "\"strokes_per_query\": " + std::to_string(found / static_cast<double>(probes.size()));
+        }
+    }
+
+    // Eraser gestures, and undo and redo of each, should cost the same however large the
+    // drawing is: the index finds the strokes under the eraser and undo swaps only those back
+    void benchErase() {
+        if (!enabled("erase")) return;
+
+        for (size_t segments = 10000; segments <= std::min<size_t>(options.maxPoints, 1000000); segments *= 10) {
+            std::vector<std::vector<vdraw::StrokePoint>> shapes;
+            float side = scatterScribbles(segments, shapes);
+
+            vdraw::Drawing drawing;
+            drawing.setHistoryLimit(0);
+            for (const auto& points : shapes) {
+                drawing.addStroke(points.data(), points.size(), vdraw::Color(0, 0, 0), 2.0f);
+            }
+            shapes.clear();
+
+            // A 100 px swipe per gesture, eleven input events apart
+            const size_t gestures = 200;
+            std::vector<vdraw::Vec2> starts;
+            for (size_t i = 0; i < gestures; ++i) {
+                starts.push_back(vdraw::Vec2(static_cast<float>(rand() % static_cast<int>(side)), static_cast<float>(rand() % static_cast<int>(side))));
+            }
+
+            uint64_t before = fingerprint(drawing);
+            double eraseSeconds = 0, undoSeconds = 0, redoSeconds = 0;
+            size_t erased = 0;
+            for (const auto& start : starts) {
+                Clock::time_point begin = Clock::now();
+                bool changed = drawing.beginErase(start, 12.0f);
+                for (int step = 1; step <= 10; ++step) {
+                    changed |= drawing.continueErase(start + vdraw::Vec2(10.0f * step, 3.0f * step));
+                }
+                drawing.endErase();
+                Clock::time_point erasedAt = Clock::now();
+                eraseSeconds += std::chrono::duration<double>(erasedAt - begin).count();
+                if (!changed) continue;
+                erased++;
+
+                drawing.undo();
+                Clock::time_point undoneAt = Clock::now();
+                drawing.redo();
+                undoSeconds += std::chrono::duration<double>(undoneAt - erasedAt).count();
+                redoSeconds += std::chrono::duration<double>(Clock::now() - undoneAt).count();
+            }
+
+            // Undoing every gesture restores the drawing exactly, redoing them all returns to the erased one
+            uint64_t after = fingerprint(drawing);
+            for (size_t i = 0; i < erased; ++i) drawing.undo();
+            check(fingerprint(drawing) == before, "erase_undo_restores", param("segments", segments));
+            for (size_t i = 0; i < erased; ++i) drawing.redo();
+            check(fingerprint(drawing) == after, "erase_redo_reapplies", param("segments", segments));
+            check(erased == 0 || after != before, "erase_changes_drawing", param("segments", segments));
+
+            std::string extra = "\"strokes\": " + std::to_string(drawing.getStrokes().size()) +
+                ", \"erasing_gestures\": " + std::to_string(erased);
+            report("erase_gesture", param("segments", segments), 1, gestures, eraseSeconds, extra);
+            report("erase_undo", param("segments", segments), 1, std::max<size_t>(erased, 1), undoSeconds, extra);
+            report("erase_redo", param("segments", segments), 1, std::max<size_t>(erased, 1), redoSeconds, extra);
+        }
+    }
+
+    // Triangle-strip vertices for a stroke as DrawingApp::renderStroke emits them, drawing
+    // the level of detail for tolerance
+    void tessellateStroke(const vdraw::Stroke& stroke, float tolerance, std::vector<vdraw::Vec2>& vertices) {
+        const vdraw::PointBuffer& points = stroke.getProcessedPoints();
+        const vdraw::IndexBuffer* lod = stroke.getLod(tolerance);
+        size_t count = lod ? lod->size() : points.size();
+        for (size_t k = 1; k < count; ++k) {
+            size_t i = lod ? (*lod)[k] : k;
+            size_t previous = lod ? (*lod)[k - 1] : k - 1;
+            vdraw::Vec2 delta = points[i].position - points[previous].position;
+            float length = std::max(1e-6f, std::sqrt(delta.x * delta.x + delta.y * delta.y));
+            vdraw::Vec2 perp(-delta.y / length, delta.x / length);
+            float half1 = stroke.getWidthAt(previous) * 0.5f;
+            float half2 = stroke.getWidthAt(i) * 0.5f;
+            vertices.push_back(points[previous].position + perp * half1);
+            vertices.push_back(points[previous].position - perp * half1);
+            vertices.push_back(points[i].position + perp * half2);
+            vertices.push_back(points[i].position - perp * half2);
+        }
+    }
+
+    // Rendering a 1536 px canvas on screen, as the 512 px Spout sketch and as a 192 px thumbnail
+    void benchLod() {
+        if (!enabled("lod")) return;
+
+        size_t strokeCount = std::max<size_t>(1, std::min<size_t>(options.maxPoints, 200000) / 1000);
+        vdraw::Drawing drawing;
+        for (size_t i = 0; i < strokeCount; ++i) {
+            auto points = makeStroke(1000, static_cast<StrokeShape>(i % 3), static_cast<unsigned>(i + 1));
+            drawing.setDynamicWidth(i % 2 == 1);
+            drawing.beginStroke(points[0].position, points[0].pressure, points[0].timestamp);
+            drawing.continueStroke(points.data() + 1, points.size() - 1);
+            drawing.endStroke();
+        }
+        size_t totalPoints = strokeCount * 1000;
+
+        const size_t sizes[] = { 1536, 512, 192 };
+        std::vector<vdraw::Vec2> vertices;
+        vertices.reserve(totalPoints * 4);
+        for (size_t size : sizes) {
+            float tolerance = size < 1536 ? vdraw::lodTolerance(size / 1536.0f) : 0.0f;
+
+            // Building is lazy, so the first pass at a scale pays for the levels it needs
+            Clock::time_point start = Clock::now();
+            for (const vdraw::Stroke* stroke : drawing.getStrokes()) {
+                stroke->getLod(tolerance);
+            }
+            double buildSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+            size_t drawn = 0;
+            measure("lod_tessellate", param("points", totalPoints) + ", " + param("target_px", size), totalPoints, [&]() {
+                vertices.clear();
+                for (const vdraw::Stroke* stroke : drawing.getStrokes()) {
+                    tessellateStroke(*stroke, tolerance, vertices);
+                }
+                drawn = vertices.size() / 4 + drawing.getStrokes().size();
+            });
+            results.back().extra = "\"points_drawn\": " + std::to_string(drawn) +
+                ", \"fraction_drawn\": " + std::to_string(drawn / static_cast<double>(totalPoints)) +
+                ", \"build_ms\": " + std::to_string(buildSeconds * 1000.0);
+        }
+
+        // Fresh strokes asked for their levels by several threads at once, coarse and fine in
+        // different orders, as SoftwareRasterizer's workers do: each level is built once and
+        // the pointers handed out stay the ones the stroke keeps
+        vdraw::Drawing shared;
+        for (size_t i = 0; i < 64; ++i) {
+            auto points = makeStroke(1000, static_cast<StrokeShape>(i % 3), static_cast<unsigned>(i + 1));
+            shared.addStroke(points.data(), points.size(), vdraw::Color(0, 0, 0), 2.0f);
+        }
+        const float tolerances[] = { 0.25f, 1.0f, 4.0f, 64.0f, 0.5f, 16.0f };
+        const size_t threadCount = 4;
+        std::vector<std::vector<const vdraw::IndexBuffer*>> seen(threadCount);
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < threadCount; ++t) {
+            threads.push_back(std::thread([&, t]() {
+                for (const vdraw::Stroke* stroke : shared.getStrokes()) {
+                    for (size_t k = 0; k < 6; ++k) {
+                        seen[t].push_back(stroke->getLod(tolerances[(k + t) % 6]));
+                    }
+                }
+            }));
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        bool consistent = true;
+        for (size_t t = 0; t < threadCount; ++t) {
+            size_t next = 0;
+            for (const vdraw::Stroke* stroke : shared.getStrokes()) {
+                for (size_t k = 0; k < 6; ++k) {
+                    const vdraw::IndexBuffer* lod = stroke->getLod(tolerances[(k + t) % 6]);
+                    consistent = consistent && lod && seen[t][next++] == lod;
+                }
+            }
+        }
+        check(consistent, "lod_concurrent_build", "a level handed to a thread differs from the one the stroke kept");
+    }
+
+    // Panning a window across a large drawing and back on the tiled canvas. Tiles entering the
+    // view are rendered as DrawingApp::renderTile does (queried and tessellated), the rest come
+    // from the cache, and memory stays within the budget rather than growing with the drawing.
+    void benchTiledCanvas() {
+        if (!enabled("tiled_canvas")) return;
+
+        size_t segments = std::max<size_t>(10000, std::min<size_t>(options.maxPoints, 1000000));
+        std::vector<std::vector<vdraw::StrokePoint>> shapes;
+        float side = scatterScribbles(segments, shapes);
+
+        vdraw::Drawing drawing;
+        for (const auto& points : shapes) {
+            drawing.addStroke(points.data(), points.size(), vdraw::Color(0, 0, 0), 2.0f);
+        }
+        shapes.clear();
+
+        const float width = 1536.0f, height = 1024.0f;
+        const float zooms[] = { 1.0f, 0.25f };
+        std::vector<vdraw::Tile*> visible;
+        std::vector<const vdraw::Stroke*> strokes;
+        std::vector<vdraw::Vec2> vertices;
+        for (float zoom : zooms) {
+            vdraw::TiledCanvas tiles;
+            vdraw::ViewTransform view;
+            view.zoom = zoom;
+
+            // 16 screen px per frame along the diagonal
+            float step = 16.0f / zoom;
+            size_t steps = std::max<size_t>(1, static_cast<size_t>(std::max(0.0f, side - width / zoom) / step));
+            size_t rendered = 0, peakBytes = 0;
+            Clock::time_point start = Clock::now();
+            for (size_t frame = 0; frame < steps * 2; ++frame) {
+                float along = (frame < steps ? frame : steps * 2 - frame) * step;
+                view.origin = vdraw::Vec2(along, along * 0.5f);
+
+                visible.clear();
+                tiles.acquire(view, width, height, visible);
+                for (vdraw::Tile* tile : visible) {
+                    if (!tile->dirty) continue;
+                    float tolerance = tile->scale < 1.0f ? vdraw::lodTolerance(tile->scale) : 0.0f;
+                    strokes.clear();
+                    vertices.clear();
+                    drawing.queryStrokes(tile->area, strokes);
+                    for (const vdraw::Stroke* stroke : strokes) {
+                        tessellateStroke(*stroke, tolerance, vertices);
+                    }
+                    tile->dirty = false;
+                    rendered++;
+                }
+                peakBytes = std::max(peakBytes, tiles.getResidentBytes());
+            }
+            double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+            double fullBytes = static_cast<double>(side * zoom) * (side * zoom) * 4.0;
+            std::string extra = "\"tiles_rendered_per_frame\": " + std::to_string(rendered / static_cast<double>(steps * 2)) +
+                ", \"evictions\": " + std::to_string(tiles.getEvictions()) +
+                ", \"peak_tile_mb\": " + std::to_string(peakBytes / (1024.0 * 1024.0)) +
+                ", \"single_raster_mb\": " + std::to_string(fullBytes / (1024.0 * 1024.0));
+            report("tiled_canvas_pan", param("segments", segments) + ", " + param("zoom_pct", static_cast<size_t>(zoom * 100)),
+                1, steps * 2, elapsed, extra);
+        }
+    }
+
+    void benchLayerEdit() {
+        if (!enabled("layer_edit")) return;
+
+        size_t segments = std::max<size_t>(10000, std::min<size_t>(options.maxPoints, 200000));
+        std::vector<std::vector<vdraw::StrokePoint>> shapes;
+        scatterScribbles(segments, shapes);
+
+        const float width = 1536.0f, height = 1024.0f;
+        const size_t layerCounts[] = { 1, 4 };
+        std::vector<vdraw::Tile*> visible;
+        std::vector<const vdraw::Stroke*> strokes;
+        std::vector<vdraw::Vec2> vertices;
+        for (size_t layerCount : layerCounts) {
+            // The scribbles dealt round the layers; the edits go to the top one
+            vdraw::Drawing drawing;
+            for (size_t i = 1; i < layerCount; ++i) {
+                drawing.addLayer("Layer " + std::to_string(i + 1));
+            }
+            for (size_t i = 0; i < shapes.size(); ++i) {
+                drawing.setActiveLayer(i % layerCount);
+                drawing.addStroke(shapes[i].data(), shapes[i].size(), vdraw::Color(0, 0, 0), 2.0f);
+            }
+            drawing.setActiveLayer(layerCount - 1);
+
+            // One tile cache per layer, as in DrawingApp
+            std::vector<std::unique_ptr<vdraw::TiledCanvas>> caches;
+            std::vector<uint64_t> revisions(layerCount, ~0ull);
+            for (size_t i = 0; i < layerCount; ++i) {
+                caches.push_back(std::make_unique<vdraw::TiledCanvas>());
+            }
+
+            vdraw::ViewTransform view;
+            size_t tessellated = 0;
+            auto compose = [&]() {
+                for (size_t i = 0; i < layerCount; ++i) {
+                    const vdraw::Layer& layer = drawing.getLayer(i);
+                    if (revisions[i] != layer.getRevision()) {
+                        caches[i]->invalidateAll();
+                        revisions[i] = layer.getRevision();
+                    }
+                    visible.clear();
+                    caches[i]->acquire(view, width, height, visible);
+                    for (vdraw::Tile* tile : visible) {
+                        if (!tile->dirty) continue;
+                        strokes.clear();
+                        vertices.clear();
+                        layer.queryStrokes(tile->area, strokes);
+                        for (const vdraw::Stroke* stroke : strokes) {
+                            tessellateStroke(*stroke, 0.0f, vertices);
+                        }
+                        tessellated += strokes.size();
+                        tile->dirty = false;
+                    }
+                }
+            };
+            compose();
+
+            const size_t edits = 200;
+            uint64_t before = fingerprint(drawing);
+            std::vector<uint64_t> layerRevisions;
+            for (size_t i = 0; i < layerCount; ++i) layerRevisions.push_back(drawing.getLayer(i).getRevision());
+            tessellated = 0;
+            Clock::time_point start = Clock::now();
+            for (size_t edit = 0; edit < edits; ++edit) {
+                if (edit % 2 == 0) drawing.undo();
+                else drawing.redo();
+                compose();
+            }
+            double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+            // An even number of alternating edits leaves the drawing as it was, and only the
+            // edited layer's revision moves, so only its tiles were rendered again
+            check(fingerprint(drawing) == before, "layer_edit_undo_redo", param("layers", layerCount));
+            for (size_t i = 0; i + 1 < layerCount; ++i) {
+                check(drawing.getLayer(i).getRevision() == layerRevisions[i], "layer_edit_other_layers_untouched",
+                    param("layer", i));
+            }
+            check(drawing.getLayer(layerCount - 1).getRevision() != layerRevisions[layerCount - 1], "layer_edit_revision",
+                param("layers", layerCount));
+
+            report("layer_edit", param("segments", segments) + ", " + param("layers", layerCount), 1, edits, elapsed,
+                "\"strokes_rendered_per_edit\": " + std::to_string(tessellated / static_cast<double>(edits)));
+        }
+    }
+
+    void benchCodec() {
+        if (!enabled("codec")) return;
+
+        size_t total = std::min<size_t>(options.maxPoints, 1000000);
+        for (int shape = 0; shape <= Scribble; ++shape) {
+            auto points = makeStroke(total, static_cast<StrokeShape>(shape));
+            std::vector<uint8_t> encoded;
+
+            measure("codec_encode", param("points", total) + ", " + param("shape", shapeNames[shape]), total, [&]() {
+                encoded.clear();
+                vdraw::PointEncoder encoder;
+                encoder.encode(points.data(), points.size(), encoded);
+            });
+
+            std::vector<vdraw::StrokePoint> decoded;
+            decoded.reserve(total);
+            measure("codec_decode", param("points", total) + ", " + param("shape", shapeNames[shape]), total, [&]() {
+                decoded.clear();
+                vdraw::PointDecoder decoder;
+                decoder.decode(encoded.data(), encoded.size(), decoded);
+            }, "\"bytes_per_point\": " + std::to_string(encoded.size() / static_cast<double>(total)) +
+                ", \"compression_ratio\": " + std::to_string(total * sizeof(vdraw::StrokePoint) / static_cast<double>(encoded.size())));
+
+            // The codec is lossy only up to rounding to its grid: half a step of each quantity
+            decoded.clear();
+            vdraw::PointDecoder decoder;
+            size_t consumed = decoder.decode(encoded.data(), encoded.size(), decoded);
+            check(consumed == encoded.size() && decoded.size() == points.size(), "codec_round_trip_count",
+                std::string(shapeNames[shape]) + ": " + std::to_string(decoded.size()) + " of " + std::to_string(points.size()));
+
+            vdraw::PointCodecSettings grid;
+            double positionError = 0, pressureError = 0, timeError = 0;
+            for (size_t i = 0; i < std::min(points.size(), decoded.size()); ++i) {
+                positionError = std::max(positionError, static_cast<double>(std::max(
+                    std::fabs(decoded[i].position.x - points[i].position.x), std::fabs(decoded[i].position.y - points[i].position.y))));
+                pressureError = std::max(pressureError, static_cast<double>(std::fabs(decoded[i].pressure - points[i].pressure)));
+                timeError = std::max(timeError, std::fabs(decoded[i].timestamp - points[i].timestamp));
+            }
+            check(positionError <= 0.5 / grid.positionScale + 1e-3 && pressureError <= 0.5 / grid.pressureScale + 1e-5 &&
+                timeError <= 0.5 / grid.timeScale + 1e-9, "codec_round_trip_error",
+                std::string(shapeNames[shape]) + ": position " + std::to_string(positionError) + ", pressure " +
+                std::to_string(pressureError) + ", time " + std::to_string(timeError));
+        }
+    }
+
+    void benchVectorPayload() {
+        if (!enabled("simplify_polyline") && !enabled("vector_payload")) return;
+
+        size_t total = std::min<size_t>(options.maxPoints, 100000);
+        for (int shape = 0; shape <= Scribble && enabled("simplify_polyline"); ++shape) {
+            auto points = makeStroke(total, static_cast<StrokeShape>(shape));
+            std::vector<size_t> kept;
+            kept.reserve(total);
+
+            measure("simplify_polyline", param("points", total) + ", " + param("shape", shapeNames[shape]), total, [&]() {
+                kept.clear();
+                vdraw::simplifyPolyline(points.data(), points.size(), 1.0f, kept);
+            });
+            results.back().extra = "\"points_kept\": " + std::to_string(kept.size());
+        }
+
+        if (!enabled("vector_payload")) return;
+
+        // 200-sample strokes on a 1536 pixel canvas, against the 512x512 RGBA frame the image path reads back
+        const size_t frameBytes = 512 * 512 * 4;
+        for (size_t strokes = 10; strokes <= 1000 && strokes * 200 <= options.maxPoints; strokes *= 10) {
+            for (int shape = Spiral; shape <= Scribble; ++shape) {
+                vdraw::Drawing drawing;
+                for (size_t i = 0; i < strokes; ++i) {
+                    auto points = makeStroke(200, static_cast<StrokeShape>(shape), static_cast<unsigned>(i + 1));
+                    drawing.addStroke(points.data(), points.size(), vdraw::Color(0, 0, 0), 2.0f);
+                }
+
+                vdraw::VectorPayloadEncoder encoder;
+                vdraw::VectorPayloadStats stats;
+                std::string payload;
+                measure("vector_payload_encode", param("strokes", strokes) + ", " + param("shape", shapeNames[shape]), 1, [&]() {
+                    payload = encoder.encode(drawing, 1536.0f, 1536.0f, &stats);
+                });
+                results.back().extra = "\"bytes\": " + std::to_string(stats.bytes) +
+                    ", \"tolerance\": " + std::to_string(stats.tolerance) +
+                    ", \"strokes_kept\": " + std::to_string(stats.strokesKept) +
+                    ", \"points_in\": " + std::to_string(stats.pointsIn) +
+                    ", \"points_out\": " + std::to_string(stats.pointsOut) +
+                    ", \"raw_points_ratio\": " + std::to_string(stats.pointsIn * sizeof(vdraw::StrokePoint) / static_cast<double>(stats.bytes)) +
+                    ", \"rgba_frame_ratio\": " + std::to_string(frameBytes / static_cast<double>(stats.bytes));
+            }
+        }
+
+        // A short stroke in the area and a long one off it: with a budget for one stroke, the
+        // payload must be the visible one alone rather than whatever dropping leaves
+        {
+            std::vector<vdraw::StrokePoint> inside, outside;
+            for (int i = 0; i < 20; ++i) {
+                inside.push_back(vdraw::StrokePoint(vdraw::Vec2(10.0f + i, 20.0f + (i % 3)), 1.0f, i * 0.01));
+            }
+            for (int i = 0; i < 200; ++i) {
+                outside.push_back(vdraw::StrokePoint(vdraw::Vec2(500.0f + i * 10.0f, 600.0f + (i % 7) * 20.0f), 1.0f, i * 0.01));
+            }
+            vdraw::Bounds area;
+            area.min = vdraw::Vec2(0.0f, 0.0f);
+            area.max = vdraw::Vec2(100.0f, 100.0f);
+
+            vdraw::Drawing alone, both;
+            alone.addStroke(inside.data(), inside.size(), vdraw::Color(0, 0, 0), 2.0f);
+            both.addStroke(inside.data(), inside.size(), vdraw::Color(0, 0, 0), 2.0f);
+            both.addStroke(outside.data(), outside.size(), vdraw::Color(0, 0, 0), 2.0f);
+
+            vdraw::VectorPayloadEncoder encoder;
+            std::string expected = encoder.encode(alone, area);
+            encoder.setSettings(vdraw::VectorPayloadSettings(expected.size(), 100.0f, 0.5f, 0.5f));
+            vdraw::VectorPayloadStats stats;
+            std::string payload = encoder.encode(both, area, &stats);
+            check(payload == expected && stats.strokes == 1 && stats.strokesKept == 1, "vector_payload_area_culling",
+                std::to_string(stats.strokes) + " strokes encoded, " + std::to_string(stats.strokesKept) + " kept, " +
+                std::to_string(payload.size()) + " bytes against " + std::to_string(expected.size()));
+        }
+    }
+
+    void benchSessionReplay() {
+        if (!enabled("session_replay")) return;
+
+        // Synthetic session: 500 strokes of 100 samples with a few style/undo keys
+        std::vector<InputEvent> events;
+        auto points = makeStroke(500 * 100, Scribble);
+        for (size_t i = 0; i < points.size(); ++i) {
+            InputEvent event;
+            event.time = points[i].timestamp;
+            event.x = points[i].position.x;
+            event.y = points[i].position.y;
+            event.type = i % 100 == 0 ? InputEvent::MouseDown : InputEvent::MouseDrag;
+            events.push_back(event);
+            if (i % 100 == 99) {
+                event.type = InputEvent::MouseUp;
+                events.push_back(event);
+            }
+            if (i % 5000 == 4999) {
+                event.type = InputEvent::KeyDown;
+                event.keyCode = 'z';
+                event.modifiers = InputEvent::Control;
+                events.push_back(event);
+            }
+        }
+
+        SessionReplayer replayer;
+        replayer.setEvents(events);
+        ReplayStats stats;
+        measure("session_replay_max_speed", param("events", events.size()), events.size(), [&]() {
+            vdraw::Drawing drawing;
+            InterpretationTrigger trigger;
+            stats = replayer.run(drawing, trigger, false);
+        });
+        results.back().extra = "\"interpretations\": " + std::to_string(stats.interpretations) +
+            ", \"continue_stroke_mean_us\": " + std::to_string(stats.continueStroke.meanMs() * 1000.0) +
+            ", \"trigger_mean_us\": " + std::to_string(stats.trigger.meanMs() * 1000.0);
+    }
+
+    void benchTracing() {
+        if (!enabled("trace_span")) return;
+
+        // Budget is < 100 ns per span, including both clock reads, which take most of it
+        const size_t spans = 100000;
+        for (int enabledTracing = 1; enabledTracing >= 0; --enabledTracing) {
+            Tracer::get().setEnabled(enabledTracing != 0);
+            measure("trace_span", param("enabled", enabledTracing), spans, [&]() {
+                for (size_t i = 0; i < spans; ++i) {
+                    TraceSpan span("bench", i);
+                }
+            });
+        }
+        Tracer::get().setEnabled(true);
+        Tracer::get().clear();
+
+        // Threads writing round their rings while stats are read: a span read half-overwritten
+        // would pair one stage's name with the other's duration
+        std::atomic<bool> writing(true);
+        std::vector<std::thread> writers;
+        for (int t = 0; t < 4; ++t) {
+            writers.push_back(std::thread([&]() {
+                // Without the clock reads, so the writer laps the ring about as fast as it is read
+                int64_t start = Tracer::now();
+                for (size_t i = 0; writing.load() || i < 4 * Tracer::eventsPerThread; ++i) {
+                    // Not a divisor of the ring size, so each slot alternates stages lap after lap
+                    if (i % 3 == 0) {
+                        Tracer::get().record("trace_short", i, start, start + 1000);
+                    }
+                    else {
+                        Tracer::get().record("trace_long", i, start, start + 2000000);
+                    }
+                }
+            }));
+        }
+        bool consistent = true;
+        size_t reads = 0;
+        for (Clock::time_point end = Clock::now() + std::chrono::milliseconds(200); Clock::now() < end; ++reads) {
+            for (const StageStats& stats : Tracer::get().getStageStats()) {
+                if (stats.name != "trace_short" && stats.name != "trace_long") continue;
+                double expected = stats.name == "trace_short" ? 0.001 : 2.0;
+                consistent = consistent && stats.p50Ms == expected && stats.maxMs == expected;
+            }
+        }
+        writing = false;
+        for (auto& writer : writers) {
+            writer.join();
+        }
+        check(consistent && reads > 0, "trace_concurrent_export", "a span read while its ring was written came back torn");
+        Tracer::get().clear();
+    }
+
+    // Results from a session drawing a cat, then a house, then a sailboat
+    const char* recordedResults[] = {
+        "a cat sitting down", "a drawing of a cat", "a cat with pointy ears", "a small animal, possibly a cat",
+        "a cat face with whiskers", "a fox", "a cat", "a cat sitting on a mat", "cat with a long tail",
+        "a simple sketch of a cat", "a house", "a cat next to a house", "a house with a roof", "a small house",
+        "a house with a door and windows", "a building", "a house with a chimney", "a cottage",
+        "a house on a hill", "a house with a tree", "a boat", "a sailboat", "a house by the water",
+        "a sailboat on the ocean", "a boat with a sail", "a ship", "a sailboat with two sails",
+        "a sailing boat on waves", "a small sailboat", "a boat on the sea"
+    };
+
+    void benchSemanticSmoother() {
+        if (!enabled("semantic_smoother")) return;
+
+        std::vector<std::string> stream(std::begin(recordedResults), std::end(recordedResults));
+        const char* source = "builtin";
+        if (!options.resultsPath.empty()) {
+            std::ifstream file(options.resultsPath);
+            std::vector<std::string> loaded;
+            std::string line;
+            while (std::getline(file, line)) {
+                if (!line.empty()) loaded.push_back(line);
+            }
+            if (!loaded.empty()) {
+                stream.swap(loaded);
+                source = "recorded";
+            }
+        }
+
+        // A full 30 entry history is the steady state in the app
+        size_t switches = 0;
+        measure("semantic_smoother_add", param("results", stream.size()) + ", " + param("source", source), stream.size(), [&]() {
+            SemanticSmoother smoother;
+            std::string previous;
+            switches = 0;
+            for (const auto& result : stream) {
+                const std::string& average = smoother.add(result);
+                if (average != previous) switches++;
+                previous = average;
+            }
+        });
+        results.back().extra = "\"average_changes\": " + std::to_string(switches);
+
+        SemanticSmoother smoother;
+        volatile float sink = 0;
+        measure("semantic_smoother_similarity", param("source", source), stream.size(), [&]() {
+            for (size_t i = 0; i < stream.size(); ++i) {
+                sink = smoother.similarity(stream[i], stream[(i + 1) % stream.size()]);
+            }
+        });
+    }
+
+    void benchTriggerPolicy() {
+        if (!enabled("trigger_policy")) return;
+
+        // 200 strokes of 100 samples at 60 Hz with a pause after each, and an undo now and then
+        std::vector<InputEvent> events;
+        auto points = makeStroke(200 * 100, Scribble);
+        double time = 0;
+        for (size_t i = 0; i < points.size(); ++i) {
+            InputEvent event;
+            event.time = time;
+            event.x = points[i].position.x;
+            event.y = points[i].position.y;
+            event.type = i % 100 == 0 ? InputEvent::MouseDown : InputEvent::MouseDrag;
+            events.push_back(event);
+            time += 1.0 / 60.0;
+
+            if (i % 100 == 99) {
+                event.type = InputEvent::MouseUp;
+                events.push_back(event);
+                time += 0.2 + (i / 100 % 5) * 0.3;
+            }
+            if (i % 2000 == 1999) {
+                event.type = InputEvent::KeyDown;
+                event.keyCode = 'z';
+                event.modifiers = InputEvent::Control;
+                events.push_back(event);
+            }
+        }
+
+        const char* policyNames[] = { "distance", "adaptive" };
+        const double serviceTimes[] = { 0.3, 1.5 };
+        for (double service : serviceTimes) {
+            for (int adaptive = 0; adaptive <= 1; ++adaptive) {
+                // Service time varies +-30% around the mean, repeatably
+                SessionReplayer replayer;
+                replayer.setEvents(events);
+                replayer.setSimulatedModel([service](size_t n) {
+                    return service * (0.7 + 0.6 * ((n * 2654435761u) % 1000) / 1000.0);
+                });
+
+                ReplayStats stats;
+                measure("trigger_policy_replay", param("policy", policyNames[adaptive]) + ", " + param("service_ms", service * 1000),
+                    events.size(), [&]() {
+                    vdraw::Drawing drawing;
+                    InterpretationTrigger trigger;
+                    if (adaptive) trigger.setPolicy(std::make_shared<AdaptiveTriggerPolicy>());
+                    stats = replayer.run(drawing, trigger, false);
+                }, "", 0);
+
+                results.back().extra = "\"interpretations\": " + std::to_string(stats.interpretations) +
+                    ", \"completed\": " + std::to_string(stats.completed) +
+                    ", \"coalesced\": " + std::to_string(stats.coalesced) +
+                    ", \"utilization\": " + std::to_string(stats.utilization()) +
+                    ", \"session_seconds\": " + std::to_string(stats.sessionSeconds);
+            }
+        }
+    }
+
+    void benchMockInference() {
+        if (!enabled("mock_inference")) return;
+
+        {
+            // A newer request that fails mustn't make the older one's result stale
+            InferenceStage stage("check", 2);
+            std::vector<std::string> delivered;
+            auto keep = [&delivered](const std::string& result) { delivered.push_back(result); };
+            uint64_t older = stage.submit([](uint64_t) {}, keep);
+            uint64_t newer = stage.submit([](uint64_t) {}, keep);
+            stage.complete(newer, "", false);
+            stage.complete(older, "a cat");
+            InferenceStage::Stats stats = stage.getStats();
+            check(delivered.size() == 1 && delivered[0] == "a cat" && stats.failed == 1 && stats.stale == 0,
+                "inference_failed_not_stale", std::to_string(delivered.size()) + " delivered");
+        }
+
+        MockOllamaServer server;
+        if (!server.start()) {
+            fprintf(stderr, "Couldn't start the mock inference server\n");
+            return;
+        }
+
+        // Client and server overhead alone: no model latency
+        MockOllamaServer::Settings settings;
+        settings.firstTokenLatency = MockLatency(0.0);
+        settings.tokenInterval = MockLatency(0.0);
+        server.setSettings(settings);
+
+        for (int streaming = 0; streaming <= 1; ++streaming) {
+            OllamaHttpBackend backend("127.0.0.1", server.getPort());
+            backend.getClient().setStreaming(streaming != 0);
+
+            InferenceRequest request;
+            request.model = "mock";
+            request.prompt = "describe the drawing";
+            request.images.push_back(std::string(64 * 1024, 'A'));
+
+            const size_t calls = 20;
+            measure("mock_inference_roundtrip", param("streaming", streaming), calls, [&]() {
+                std::string response, error;
+                for (size_t i = 0; i < calls; ++i) {
+                    backend.generate(request, nullptr, response, error);
+                }
+            });
+        }
+
+        // Strokes trigger interpretations faster than the model answers, as in the app. Shows how
+        // the vision stage coalesces, and the latency from trigger to delivered description.
+        settings.firstTokenLatency = MockLatency(120.0, 40.0, MockLatency::LogNormal);
+        settings.tokenInterval = MockLatency(5.0, 2.0, MockLatency::Uniform);
+        settings.errorRate = 0.05;
+
+        const size_t submissions = 40;
+        const int intervalMillis = 30;
+        for (int limit = 1; limit <= 2; ++limit) {
+            // Let connections from the previous run finish, they count towards server_max_active
+            while (server.getStats().active > 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            server.setSettings(settings);
+            server.resetStats();
+            auto backend = std::make_shared<OllamaHttpBackend>("127.0.0.1", server.getPort());
+
+            InferenceStage stage("vision", limit);
+            std::mutex latencyMutex;
+            std::vector<double> latencies;
+            std::atomic<uint64_t> finished(0);
+
+            measure("mock_inference_pipeline", param("max_in_flight", limit) + ", " + param("interval_ms", intervalMillis),
+                submissions, [&]() {
+                for (size_t i = 0; i < submissions; ++i) {
+                    Clock::time_point submitted = Clock::now();
+                    stage.submit([&stage, &finished, backend](uint64_t sequence) {
+                        std::thread([&stage, &finished, backend, sequence]() {
+                            InferenceRequest request;
+                            request.model = "mock";
+                            request.prompt = "describe the drawing";
+                            std::string response, error;
+                            bool ok = backend->generate(request, nullptr, response, error);
+                            stage.complete(sequence, response, ok);
+                            finished++;
+                        }).detach();
+                    }, [&, submitted](const std::string&) {
+                        std::lock_guard<std::mutex> lock(latencyMutex);
+                        latencies.push_back(std::chrono::duration<double, std::milli>(Clock::now() - submitted).count());
+                    });
+                    std::this_thread::sleep_for(std::chrono::milliseconds(intervalMillis));
+                }
+
+                // Every launched request has a worker thread that must be done with the stage
+                while (true) {
+                    InferenceStage::Stats stats = stage.getStats();
+                    if (!stats.waiting && finished == stats.launched) break;
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+            }, "", 0);
+
+            InferenceStage::Stats stats = stage.getStats();
+            MockOllamaServer::Stats serverStats = server.getStats();
+            std::sort(latencies.begin(), latencies.end());
+            double mean = 0;
+            for (double latency : latencies) mean += latency;
+            mean = latencies.empty() ? 0 : mean / latencies.size();
+            double p95 = latencies.empty() ? 0 : latencies[std::min(latencies.size() - 1, latencies.size() * 95 / 100)];
+
+            char extra[512];
+            snprintf(extra, sizeof(extra),
+                "\"launched\": %llu, \"coalesced\": %llu, \"stale\": %llu, \"delivered\": %llu, \"server_errors\": %llu, "
+                "\"server_max_active\": %d, \"deliver_latency_mean_ms\": %.1f, \"deliver_latency_p95_ms\": %.1f",
+                static_cast<unsigned long long>(stats.launched), static_cast<unsigned long long>(stats.coalesced),
+                static_cast<unsigned long long>(stats.stale), static_cast<unsigned long long>(stats.delivered),
+                static_cast<unsigned long long>(serverStats.errors), serverStats.maxActive, mean, p95);
+            results.back().extra = extra;
+        }
+
+        server.stop();
+    }
+
+    // Describes each image as its own text: numbered lines for several, unless numbered is off,
+    // when it answers a batch with one line that can't be split
+    class EchoBackend : public InferenceBackend {
+    public:
+        EchoBackend(bool numbered) : numbered(numbered) {}
+
+        std::string getName() const override { return "echo"; }
+
+        bool generate(const InferenceRequest& request, const FragmentCallback&, std::string& response, std::string&) override {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            response.clear();
+            if (request.images.size() == 1) {
+                response = request.images[0];
+                return true;
+            }
+            for (size_t i = 0; i < request.images.size(); ++i) {
+                if (numbered) response += (i > 0 ? "\n" : "") + std::to_string(i + 1) + ". " + request.images[i];
+                else response += (i > 0 ? " " : "") + request.images[i];
+            }
+            return true;
+        }
+
+    private:
+        bool numbered;
+    };
+
+    // Every caller of a batch gets the line for its own image back, also when the response
+    // doesn't split and the requests are sent again one by one
+    void checkBatchDemultiplexing() {
+        std::vector<std::string> lines;
+        check(BatchingBackend::splitResponse("Here you go:\n2) a dog \n Image 1: a cat\n3. a boat\n", 3, lines) &&
+            lines[0] == "a cat" && lines[1] == "a dog" && lines[2] == "a boat", "batching_split_response");
+        check(!BatchingBackend::splitResponse("1. a cat\n3. a boat", 3, lines), "batching_split_incomplete");
+
+        for (int numbered = 1; numbered >= 0; --numbered) {
+            BatchingBackend backend(std::make_shared<EchoBackend>(numbered != 0), BatchingBackend::Settings(5.0, 8));
+            std::atomic<size_t> mismatched(0);
+            std::vector<std::thread> threads;
+            for (size_t caller = 0; caller < 16; ++caller) {
+                threads.emplace_back([&, caller]() {
+                    for (size_t i = 0; i < 10; ++i) {
+                        InferenceRequest request;
+                        request.model = "echo";
+                        request.prompt = "describe the drawing";
+                        request.images.push_back("canvas-" + std::to_string(caller) + "-" + std::to_string(i));
+                        std::string response, error;
+                        if (!backend.generate(request, nullptr, response, error) || response != request.images[0]) mismatched++;
+                    }
+                });
+            }
+            for (auto& thread : threads) thread.join();
+
+            BatchingBackend::Stats stats = backend.getStats();
+            check(mismatched == 0, "batching_demultiplex", std::to_string(mismatched.load()) + " of 160 responses went to the wrong caller" +
+                (numbered ? "" : " after resplitting"));
+            check(stats.batches < stats.requests && (numbered ? stats.resplit == 0 : stats.resplit > 0), "batching_batches",
+                std::to_string(stats.batches) + " batches, " + std::to_string(stats.resplit) + " resplit");
+        }
+    }
+
+    void benchInferenceBatching() {
+        if (!enabled("inference_batching")) return;
+
+        checkBatchDemultiplexing();
+
+        MockOllamaServer server;
+        if (!server.start()) {
+            fprintf(stderr, "Couldn't start the mock inference server\n");
+            return;
+        }
+
+        // A model server working on two requests at a time, where each extra image of a request
+        // costs a fraction of a request
+        MockOllamaServer::Settings settings;
+        settings.firstTokenLatency = MockLatency(100.0);
+        settings.tokenInterval = MockLatency(0.0);
+        settings.imageLatency = MockLatency(10.0);
+        settings.slots = 2;
+        server.setSettings(settings);
+
+        // Closed loop: each caller sends its next canvas as soon as the previous one is described
+        const size_t callers = 24;
+        const double seconds = 1.5;
+        const BatchingBackend::Settings cases[] = {
+            BatchingBackend::Settings(0.0, 1), BatchingBackend::Settings(5.0, 8), BatchingBackend::Settings(20.0, 8),
+            BatchingBackend::Settings(20.0, 16)
+        };
+
+        for (const BatchingBackend::Settings& batching : cases) {
+            while (server.getStats().active > 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            BatchingBackend backend(std::make_shared<OllamaHttpBackend>("127.0.0.1", server.getPort()), batching);
+
+            std::mutex latencyMutex;
+            std::vector<double> latencies;
+            std::atomic<size_t> failed(0);
+            Clock::time_point start = Clock::now();
+            Clock::time_point end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+
+            std::vector<std::thread> threads;
+            for (size_t i = 0; i < callers; ++i) {
+                threads.emplace_back([&]() {
+                    InferenceRequest request;
+                    request.model = "mock";
+                    request.prompt = "describe the drawing";
+                    request.images.push_back(std::string(4096, 'A'));
+
+                    while (Clock::now() < end) {
+                        Clock::time_point sent = Clock::now();
+                        std::string response, error;
+                        if (!backend.generate(request, nullptr, response, error)) failed++;
+
+                        std::lock_guard<std::mutex> lock(latencyMutex);
+                        latencies.push_back(std::chrono::duration<double, std::milli>(Clock::now() - sent).count());
+                    }
+                });
+            }
+            for (auto& thread : threads) thread.join();
+            double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+            std::sort(latencies.begin(), latencies.end());
+            double p50 = latencies.empty() ? 0 : latencies[latencies.size() / 2];
+            double p95 = latencies.empty() ? 0 : latencies[std::min(latencies.size() - 1, latencies.size() * 95 / 100)];
+
+            BatchingBackend::Stats stats = backend.getStats();
+            std::string histogram;
+            for (size_t size = 1; size < stats.batchSizes.size(); ++size) {
+                histogram += (size > 1 ? ", " : "") + std::to_string(stats.batchSizes[size]);
+            }
+
+            char extra[512];
+            snprintf(extra, sizeof(extra),
+                "\"requests\": %zu, \"failed\": %zu, \"latency_p50_ms\": %.1f, \"latency_p95_ms\": %.1f, "
+                "\"batches\": %llu, \"mean_batch_size\": %.2f, \"resplit\": %llu, \"batch_size_histogram\": [%s]",
+                latencies.size(), failed.load(), p50, p95, static_cast<unsigned long long>(stats.batches),
+                stats.meanBatchSize(), static_cast<unsigned long long>(stats.resplit), histogram.c_str());
+            report("inference_batching", param("window_ms", static_cast<size_t>(batching.windowMillis)) + ", " +
+                param("max_batch", batching.maxBatch) + ", " + param("callers", callers), 1, latencies.size(), elapsed, extra);
+        }
+
+        server.stop();
+    }
+
+    // Answers after a fixed delay, like a model server with room for every request
+    class DelayBackend : public InferenceBackend {
+    public:
+        DelayBackend(double millis) : millis(millis) {}
+
+        std::string getName() const override { return "delay"; }
+
+        bool generate(const InferenceRequest&, const FragmentCallback&, std::string& response, std::string&) override {
+            std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(millis));
+            response = "a sketch";
+            return true;
+        }
+
+    private:
+        double millis;
+    };
+
+    void benchSessionServer() {
+        if (!enabled("session_server")) return;
+
+        // Every session draws in real time at 60 Hz: one second strokes of 5 px steps with
+        // 0.3 s pauses, interpreted every 230 px, i.e. about one description per second
+        const double seconds = 3.0;
+        const double frameRate = 60.0;
+        const size_t strokeFrames = 60;
+        const size_t cycleFrames = 78;
+        const float step = 5.0f;
+        const float interval = 230.0f;
+        const double targetRate = step * frameRate * strokeFrames / cycleFrames / interval;
+
+        const size_t sessionCounts[] = { 4, 16, 64 };
+        for (size_t sessionCount : sessionCounts) {
+            size_t threads = std::max(1u, std::thread::hardware_concurrency());
+            SessionManager::Settings settings;
+            settings.workerThreads = threads;
+            settings.inferenceThreads = 16;
+            settings.makePolicy = [interval]() { return std::make_shared<DistanceTriggerPolicy>(interval); };
+            std::unique_ptr<SessionManager> manager(new SessionManager(std::make_shared<DelayBackend>(250.0), settings));
+
+            struct Pen {
+                SessionManager::SessionId id;
+                float x, y, angle;
+            };
+            std::vector<Pen> pens;
+            for (size_t i = 0; i < sessionCount; ++i) {
+                Pen pen = { manager->openSession(), 300.0f + (i * 97) % 900, 300.0f + (i * 61) % 900, i * 0.7f };
+                pens.push_back(pen);
+            }
+
+            size_t frames = static_cast<size_t>(seconds * frameRate);
+            Clock::time_point start = Clock::now();
+            for (size_t frame = 0; frame < frames; ++frame) {
+                std::this_thread::sleep_until(start + std::chrono::duration_cast<Clock::duration>(
+                    std::chrono::duration<double>(frame / frameRate)));
+
+                for (size_t i = 0; i < pens.size(); ++i) {
+                    Pen& pen = pens[i];
+                    size_t phase = (frame + i * 7) % cycleFrames;
+                    if (phase > strokeFrames) continue;
+
+                    InputEvent event;
+                    event.time = frame / frameRate;
+                    event.type = phase == 0 ? InputEvent::MouseDown : phase == strokeFrames ? InputEvent::MouseUp : InputEvent::MouseDrag;
+                    pen.angle += 0.15f * std::sin(frame * 0.05f + i);
+                    pen.x = std::min(1500.0f, std::max(36.0f, pen.x + step * std::cos(pen.angle)));
+                    pen.y = std::min(1500.0f, std::max(36.0f, pen.y + step * std::sin(pen.angle)));
+                    event.x = pen.x;
+                    event.y = pen.y;
+
+                    // Input isn't held up for a session that falls behind, it shows as rejected
+                    manager->post(pen.id, event, false);
+                }
+            }
+            manager->drain();
+            double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+            SessionManager::Stats stats = manager->getStats();
+            const SessionManager::Timings& timings = manager->getTimings();
+            float inputMean, inputP95, inputMax, turnMean, turnP95, turnMax, captureMean, captureP95, captureMax;
+            float interpretMean, interpretP95, interpretMax;
+            timings.inputLatency.getSummary(inputMean, inputP95, inputMax);
+            timings.turn.getSummary(turnMean, turnP95, turnMax);
+            timings.capture.getSummary(captureMean, captureP95, captureMax);
+            timings.interpretation.getSummary(interpretMean, interpretP95, interpretMax);
+
+            // Worker time per session-second of drawing gives the sessions one core can host
+            double busy = stats.workers.busySeconds;
+            double sessionSeconds = sessionCount * seconds;
+
+            char extra[768];
+            snprintf(extra, sizeof(extra),
+                "\"target_rate\": %.2f, \"achieved_rate\": %.2f, \"interpretations\": %llu, \"coalesced\": %llu, "
+                "\"rejected\": %llu, \"input_latency_p95_ms\": %.2f, \"turn_p95_ms\": %.2f, \"capture_mean_ms\": %.2f, "
+                "\"interpretation_p95_ms\": %.1f, \"stolen\": %llu, \"worker_utilization\": %.3f, \"sessions_per_core\": %.1f",
+                targetRate, stats.results / sessionSeconds, static_cast<unsigned long long>(stats.interpretations),
+                static_cast<unsigned long long>(stats.coalesced), static_cast<unsigned long long>(stats.rejected),
+                inputP95, turnP95, captureMean, interpretP95, static_cast<unsigned long long>(stats.workers.stolen),
+                busy / (threads * elapsed), busy > 0 ? sessionSeconds / busy : 0.0);
+            report("session_server_load", param("sessions", sessionCount) + ", " + param("workers", threads), 1,
+                stats.events, elapsed, extra);
+
+            manager.reset();
+        }
+    }
+
+    void benchOscOutput() {
+        if (!enabled("osc_output")) return;
+
+        // A streamed description updating the prompt every 250 us from the inference thread,
+        // while the UI thread sends a trigger every 5 ms. Each packet costs the socket 100 us.
+        const size_t updates = 2000;
+        const auto updateInterval = std::chrono::microseconds(250);
+        const auto triggerInterval = std::chrono::milliseconds(5);
+        const auto packetCost = std::chrono::microseconds(100);
+
+        struct Case {
+            const char* mode;
+            bool queued;
+            bool coalesce;
+        };
+        const Case cases[] = { { "direct", false, false }, { "queue", true, false }, { "queue_coalesce", true, true } };
+
+        for (const Case& c : cases) {
+            // The post time rides along as the last argument, the transport measures delivery latency
+            std::mutex deliveredMutex;
+            std::vector<double> latencies;
+            size_t promptsDelivered = 0;
+            size_t packetsSent = 0;
+            OscOutputQueue::Transport transport = [&](const std::vector<OscMessage>& packet) {
+                std::this_thread::sleep_for(packetCost);
+                int64_t now = Clock::now().time_since_epoch().count();
+                std::lock_guard<std::mutex> lock(deliveredMutex);
+                packetsSent++;
+                for (const OscMessage& message : packet) {
+                    latencies.push_back((now - std::stoll(message.arguments.back())) / 1e6);
+                    if (message.address == "/prompt") promptsDelivered++;
+                }
+                return true;
+            };
+
+            OscOutputQueue queue;
+            if (c.coalesce) queue.setPolicy("/prompt", OscOutputQueue::Policy(true, 20.0));
+            if (c.queued) queue.start(transport);
+
+            // Direct sends share the socket, as the app's callers did before the queue
+            std::mutex socketMutex;
+            auto send = [&](const OscMessage& message) {
+                if (c.queued) {
+                    queue.post(message);
+                    return;
+                }
+                std::lock_guard<std::mutex> lock(socketMutex);
+                transport(std::vector<OscMessage>(1, message));
+            };
+
+            std::vector<double> callerMicros;
+            std::mutex callerMutex;
+            auto timedSend = [&](const OscMessage& message) {
+                Clock::time_point start = Clock::now();
+                send(message);
+                double micros = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+                std::lock_guard<std::mutex> lock(callerMutex);
+                callerMicros.push_back(micros);
+            };
+
+            std::atomic<bool> streaming(true);
+            Clock::time_point start = Clock::now();
+            std::thread ui([&]() {
+                while (streaming.load()) {
+                    timedSend(OscMessage("/t", { std::to_string(Clock::now().time_since_epoch().count()) }));
+                    std::this_thread::sleep_for(triggerInterval);
+                }
+            });
+
+            Clock::time_point next = start;
+            for (size_t i = 0; i < updates; ++i) {
+                std::string stamp = std::to_string(Clock::now().time_since_epoch().count());
+                timedSend(OscMessage("/prompt", { "a cat sitting on a " + std::to_string(i), stamp }));
+                next += updateInterval;
+                std::this_thread::sleep_until(next);
+            }
+            streaming.store(false);
+            ui.join();
+            queue.stop();
+            double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+            std::sort(callerMicros.begin(), callerMicros.end());
+            std::sort(latencies.begin(), latencies.end());
+            double callerMean = 0;
+            for (double micros : callerMicros) callerMean += micros;
+            callerMean /= std::max<size_t>(callerMicros.size(), 1);
+            double callerP99 = callerMicros.empty() ? 0 : callerMicros[std::min(callerMicros.size() - 1, callerMicros.size() * 99 / 100)];
+            double latencyP50 = latencies.empty() ? 0 : latencies[latencies.size() / 2];
+            double latencyP95 = latencies.empty() ? 0 : latencies[std::min(latencies.size() - 1, latencies.size() * 95 / 100)];
+
+            OscOutputQueue::Stats stats = queue.getStats();
+            char extra[512];
+            snprintf(extra, sizeof(extra),
+                "\"caller_mean_us\": %.2f, \"caller_p99_us\": %.2f, \"caller_max_us\": %.1f, \"delivered\": %zu, "
+                "\"prompts_delivered\": %zu, \"packets\": %zu, \"bundles\": %llu, \"coalesced\": %llu, \"dropped\": %llu, "
+                "\"latency_p50_ms\": %.2f, \"latency_p95_ms\": %.2f",
+                callerMean, callerP99, callerMicros.empty() ? 0.0 : callerMicros.back(), latencies.size(), promptsDelivered,
+                packetsSent, static_cast<unsigned long long>(stats.bundles), static_cast<unsigned long long>(stats.coalesced),
+                static_cast<unsigned long long>(stats.dropped), latencyP50, latencyP95);
+            report("osc_output", param("mode", c.mode) + ", " + param("updates", updates), 1, callerMicros.size(), elapsed, extra);
+        }
+
+        // Posting while the queue stops: every message is sent or counted as dropped
+        for (int round = 0; round < 20; ++round) {
+            std::atomic<uint64_t> transported(0);
+            OscOutputQueue queue;
+            queue.start([&transported](const std::vector<OscMessage>& packet) {
+                transported += packet.size();
+                return true;
+            });
+
+            std::atomic<bool> posting(true);
+            std::vector<std::thread> posters;
+            for (int t = 0; t < 4; ++t) {
+                posters.emplace_back([&queue, &posting]() {
+                    while (posting.load()) queue.post(OscMessage("/t"));
+                });
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            queue.stop();
+            posting.store(false);
+            for (std::thread& poster : posters) poster.join();
+
+            OscOutputQueue::Stats stats = queue.getStats();
+            check(stats.posted == stats.sent + stats.dropped && stats.sent == transported.load(), "osc_stop_accounting",
+                std::to_string(stats.posted) + " posted, " + std::to_string(stats.sent) + " sent, " + std::to_string(stats.dropped) + " dropped");
+        }
+    }
+
+} // namespace
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--filter") && i + 1 < argc) options.filter = argv[++i];
+        else if (!strcmp(argv[i], "--max-points") && i + 1 < argc) options.maxPoints = strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--out") && i + 1 < argc) options.outPath = argv[++i];
+        else if (!strcmp(argv[i], "--results") && i + 1 < argc) options.resultsPath = argv[++i];
+        else {
+            fprintf(stderr, "usage: %s [--filter <substring>] [--max-points <n>] [--out <file.json>] [--results <file>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    benchAddPoint();
+    benchAddPointsBatched();
+    benchUpdateProcessedPoints();
+    benchGetWidthAt();
+    benchDrawingStrokes();
+    benchHistory();
+    benchThreadSafeList();
+    benchLongSession();
+    benchDocument();
+    benchJournal();
+    benchVectorExport();
+    benchSpatialIndex();
+    benchErase();
+    benchLod();
+    benchTiledCanvas();
+    benchLayerEdit();
+    benchCodec();
+    benchVectorPayload();
+    benchSessionReplay();
+    benchTracing();
+    benchSemanticSmoother();
+    benchTriggerPolicy();
+    benchMockInference();
+    benchInferenceBatching();
+    benchSessionServer();
+    benchOscOutput();
+
+    FILE* out = options.outPath.empty() ? stdout : fopen(options.outPath.c_str(), "w");
+    if (!out) {
+        fprintf(stderr, "Couldn't open %s\n", options.outPath.c_str());
+        return 1;
+    }
+    writeJson(out);
+    if (out != stdout) fclose(out);
+
+    if (failedChecks > 0) {
+        fprintf(stderr, "%zu checks failed\n", failedChecks);
+        return 1;
+    }
+    return 0;
+}
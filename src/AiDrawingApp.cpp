@@ -1,30 +1,58 @@
 #include "AiDrawingApp.h"
+#include "OllamaCinderBackend.h"
+#include "cinder/ImageIo.h"
+
 using namespace cinder::gl;
 
-AiDrawingApp::AiDrawingApp() : spoutOutSketch("", app::getWindowSize()), spoutOutViewport("", app::getWindowSize()), showText(true)
+AiDrawingApp::AiDrawingApp() : spoutOutSketch("", app::getWindowSize()), spoutOutViewport("", app::getWindowSize()), showText(true),
+    visionStage("vision", 1), textStage("text", 1), promptRequestId(0), promptSentNanos(0), promptLoopStartNanos(0), traceFilename("trace.json"),
+    lastFrameSeconds(0), resultsOverlayGeneration(0), streamingInference(true), lastForwardedRequestId(0), backendKind(BackendOllamaHttp),
+    inferenceBatching(false), vectorPayload(false)
 {       
     showDrawing = false;
     showSpoutTexture = true;
     sendPrompt = true;
     showText = true;
     doContinuousGeneration = true;
+    localSemanticAverage = true;
+}
+
+AiDrawingApp::~AiDrawingApp()
+{
+    // Waits for the requests in flight, which complete through the stages and OSC
+    std::unique_ptr<WorkStealingPool> pool;
+    {
+        std::lock_guard<std::mutex> lock(inferencePoolMutex);
+        pool = std::move(inferencePool);
+    }
+    pool.reset();
+    oscOutput.stop();
+    drawing.removeObserver(&trigger);
 }
 
 using protocol = asio::ip::udp;
 void AiDrawingApp::setup()
 {
+    Tracer::get().setThreadName("main");
+
     result = "";
     semanticAverage = "";
     semanticAverageDt = 0;
-    ready = true;
     
     // Initialize stroke tracking
-    totalStrokeDistance = 0.0f;
-    strokeDistanceSinceLastInterpretation = 0.0f;
-    hasActiveStroke = false;
-    minimumStrokeDistanceForInterpretation = 100.0f; // pixels
+    trigger.setMinimumDistance(100.0f); // pixels, for the distance policy
+
+    inferencePool.reset(new WorkStealingPool(visionBatchSize + 1));
+
+    // Paced to the measured service time of the vision stage (Shift+F2 switches to fixed distance)
+    AdaptiveTriggerPolicy::Settings triggerSettings;
+    triggerSettings.maxInFlight = visionStage.getMaxInFlight();
+    adaptiveTrigger = std::make_shared<AdaptiveTriggerPolicy>(triggerSettings);
+    trigger.setPolicy(adaptiveTrigger);
+    drawing.addObserver(&trigger);
     doStreaming = true;
     prompt = "provide a concise, but creative description of what is being drawn, no more than 10 words"; 
+    vectorPrompt = "The SVG below is a sketch. " + prompt + ":\n";
 
     DrawingApp::setup();
     createConsole();
@@ -32,6 +60,11 @@ void AiDrawingApp::setup()
     model = "llava:7b";
     ollama.setVisionModel(model);
 
+    bool mockInference = false;
+    for (const auto& arg : getCommandLineArgs())
+        mockInference |= arg == "--mock-inference";
+    selectBackend(mockInference ? BackendMock : BackendOllamaHttp);
+
     bool touchDesigner = false;
 
     if (touchDesigner)
@@ -57,10 +90,44 @@ void AiDrawingApp::setup()
         cout << "Couldn't load font" << endl;
         font = Font("Arial", fontSize);
     }
+
+    resultsOverlay.setFont(font);
+    resultsOverlay.setPadding(0);
+
+    try {
+        hud.setup(Font("Consolas", 16));
+    }
+    catch (const std::exception& e) {
+        hud.setup(Font("Courier New", 16));
+    }
     
     sender = new osc::SenderUdp(localPort, destinationHost, destinationPort);
     sender->bind();
 
+    oscOutput.setPolicy(addressPrompt, OscOutputQueue::Policy(true, promptIntervalMillis, propertyPrompt.empty() ? 0 : 1));
+    oscOutput.start([this](const std::vector<OscMessage>& packet) {
+        try
+        {
+            if (packet.size() == 1)
+            {
+                sender->send(toOscMessage(packet[0]));
+            }
+            else
+            {
+                osc::Bundle bundle;
+                for (const OscMessage& message : packet)
+                    bundle.append(toOscMessage(message));
+                sender->send(bundle);
+            }
+            return true;
+        }
+        catch (const std::exception& e)
+        {
+            cout << "Couldn't send OSC: " << e.what() << endl;
+            return false;
+        }
+    });
+
     receiver = new osc::ReceiverUdp(receiverPort);
 
     receiver->setListener("/fps",
@@ -88,96 +155,280 @@ void AiDrawingApp::setup()
     spoutOutViewport.getSpoutSender().CreateSender(spoutOutViewportName.c_str(), dimensions.x, dimensions.y);
 
     //spoutIn.getSpoutReceiver().SetActiveSender(spoutInName.c_str());
-    sender->send(osc::Message("/x"));
+    sendOsc("/x");
     //spoutStartReceiver();
 }
 
 void AiDrawingApp::sendOsc(string op, string property, string value)
 {
-    osc::Message msg(op);
-    msg.append(property);
-    msg.append(value);
-    sender->send(msg);
+    oscOutput.post(OscMessage(op, { property, value }));
 }
 
 void AiDrawingApp::sendOsc(string op, string message)
 {
-    osc::Message msg(op);
-    msg.append(message);
-    sender->send(msg);
+    oscOutput.post(OscMessage(op, { message }));
+}
+
+void AiDrawingApp::sendOsc(string op)
+{
+    oscOutput.post(OscMessage(op));
+}
+
+osc::Message AiDrawingApp::toOscMessage(const OscMessage& message)
+{
+    osc::Message msg(message.address);
+    for (const string& argument : message.arguments)
+        msg.append(argument);
+    return msg;
 }
 
 void AiDrawingApp::mouseDown(ci::app::MouseEvent event)
 {
     DrawingApp::mouseDown(event);
     
-    hasActiveStroke = true;
-    lastStrokePos = event.getPos();
+    // An eraser gesture reaches the trigger as a drawing edit, see InterpretationTrigger::eraseEnded,
+    // and panning doesn't draw
+    if (!isMouseDown || drawing.isErasing()) return;
+    trigger.strokeBegan(toDrawing(event.getPos()));
 }
 
 void AiDrawingApp::mouseDrag(ci::app::MouseEvent event)
 {
     DrawingApp::mouseDrag(event);
     
-    updateStrokeDistance(event.getPos());
+    if (isMouseDown && !drawing.isErasing())
+        updateStrokeDistance(toDrawing(event.getPos()));
 
-    if (doStreaming && hasSignificantDrawing()) {
-        cout << "Significant drawing detected (" << strokeDistanceSinceLastInterpretation << " pixels), interpreting canvas..." << endl;
-        interpretCanvas(true);
-        resetStrokeDistance();
-    }
+    interpretIfSignificant();
 }
 
 void AiDrawingApp::mouseUp(ci::app::MouseEvent event)
 {
     DrawingApp::mouseUp(event);
+    if (event.isRight()) return;
     
-    hasActiveStroke = false;
+    trigger.strokeEnded();
     
     // Check if we should interpret after this stroke
-    if (doStreaming && hasSignificantDrawing()) {
-        cout << "Significant drawing detected (" << strokeDistanceSinceLastInterpretation << " pixels), interpreting canvas..." << endl;
-        interpretCanvas(true);
-        resetStrokeDistance();
-    } else if (doStreaming) {
-        cout << "Stroke distance: " << strokeDistanceSinceLastInterpretation << " pixels (minimum: " << minimumStrokeDistanceForInterpretation << ")" << endl;
+    if (!interpretIfSignificant() && doStreaming) {
+        cout << "Stroke distance: " << trigger.getDistanceSinceLastInterpretation() << " pixels, ink " << trigger.getChangeSinceLastInterpretation()
+            << " (" << trigger.getPolicy()->getName() << " trigger)" << endl;
     }
 }
 
-void AiDrawingApp::callback(const std::string& result)
+void AiDrawingApp::update()
+{
+    DrawingApp::update();
+
+    // Time-based policies can fire between input events, e.g. once the model is free again
+    interpretIfSignificant();
+}
+
+bool AiDrawingApp::interpretIfSignificant()
+{
+    if (!doStreaming || !hasSignificantDrawing())
+        return false;
+
+    cout << "Significant drawing detected (" << trigger.getDistanceSinceLastInterpretation() << " pixels, ink " << trigger.getChangeSinceLastInterpretation() << "), interpreting canvas..." << endl;
+    interpretCanvas(true);
+    resetStrokeDistance();
+    return true;
+}
+
+void AiDrawingApp::toggleTriggerPolicy()
+{
+    trigger.setPolicy(trigger.getPolicy() == adaptiveTrigger ? nullptr : adaptiveTrigger);
+    cout << "interpretation trigger: " << trigger.getPolicy()->getName() << endl;
+}
+
+void AiDrawingApp::callback(const std::string& result, uint64_t requestId, int64_t startNanos, bool vectorRequest)
 {
-    dt = ci::app::getElapsedSeconds() * 1000.0 - currentMillis;
+    // Failed requests complete with an empty result so the stage moves on
+    if (result.empty())
+        return;
+
+    TraceSpan span("callback", requestId);
+
+    int64_t completeNanos = Tracer::now();
+    Tracer::get().record(vectorRequest ? "complete_vector" : "complete", requestId, startNanos, completeNanos);
+    float elapsedMillis = (completeNanos - startNanos) / 1e6f;
+    PerfCounters::get().timeToComplete.add(elapsedMillis);
+    (vectorRequest ? PerfCounters::get().vectorComplete : PerfCounters::get().imageComplete).add(elapsedMillis);
+
     results.push_front(result);
     if (results.size() > 30)
         results.pop_back();
     
-    this->result = result;
+    {
+        std::lock_guard<std::mutex> lock(resultMutex);
+        dt = elapsedMillis;
+        this->result = result;
+    }
     //cout << dt << " ms" << endl;
     //cout << "[" << result << "]" << endl;
 
+    {
+        TraceSpan smootherSpan("semantic_smoother", requestId);
+        std::lock_guard<std::mutex> lock(semanticAverageMutex);
+        smoother.add(result);
+    }
+
     // Calculate semantic average when we get a new interpretation
-    calculateSemanticAverage();
+    calculateSemanticAverage(requestId);
     
-    if (sendPrompt)
+    // Refines the streamed prefix, skipped when the prefix already was the whole description
+    forwardPrompt(result, requestId, startNanos);
+}
+
+bool AiDrawingApp::forwardPrompt(const string& text, uint64_t requestId, int64_t startNanos)
+{
+    if (!sendPrompt)
+        return false;
+
+    std::lock_guard<std::mutex> lock(forwardMutex);
+
+    // Request ids increase with submission order, so a late prefix never overwrites a newer prompt
+    if (requestId < lastForwardedRequestId || (requestId == lastForwardedRequestId && text == lastForwardedPrompt))
+        return false;
+
     {
+        TraceSpan oscSpan("osc_post", requestId);
         if (propertyPrompt.size() > 0)
-            sendOsc(addressPrompt, propertyPrompt, result + injectionPrompt);
+            sendOsc(addressPrompt, propertyPrompt, text + injectionPrompt);
         else
-            sendOsc(addressPrompt, result + injectionPrompt);
+            sendOsc(addressPrompt, text + injectionPrompt);
+    }
+
+    int64_t sentNanos = Tracer::now();
+    if (requestId != lastForwardedRequestId)
+    {
+        Tracer::get().record("first_prompt", requestId, startNanos, sentNanos);
+        PerfCounters::get().timeToFirstPrompt.add((sentNanos - startNanos) / 1e6f);
     }
+    lastForwardedRequestId = requestId;
+    lastForwardedPrompt = text;
+
+    // draw() closes the loop when the next generated frame arrives over Spout
+    promptSentNanos = sentNanos;
+    promptLoopStartNanos = startNanos;
+    promptRequestId = requestId;
+    return true;
+}
 
-    ready = true;
+// Base64 PNG, the image format of the Ollama API
+static string encodeImage(const Surface8u& surface)
+{
+    DataTargetBufferRef target = DataTargetBuffer::create();
+    writeImage(target, surface, ImageTarget::Options(), "png");
+    BufferRef buffer = target->getBuffer();
+    return OllamaStreamClient::encodeBase64(static_cast<const uint8_t*>(buffer->getData()), buffer->getSize());
 }
 
-void AiDrawingApp::calculateSemanticAverage()
+void AiDrawingApp::describeCanvas(InferenceRequest request, const Surface8u& surface, uint64_t sequence, int64_t startNanos, bool streaming)
+{
+    runInference([this, request, surface, sequence, startNanos, streaming]() mutable {
+        uint64_t requestId = request.requestId;
+        int64_t sentNanos = Tracer::now();
+
+        if (surface.getData())
+        {
+            TraceSpan span("encode", requestId);
+            request.images.push_back(encodeImage(surface));
+            PerfCounters::get().imagePayload.add(request.images.back().size() / 1024.0f);
+        }
+
+        string partial;
+        bool prefixSent = false;
+        auto onFragment = [&](const string& fragment) {
+            if (prefixSent || !streaming)
+                return;
+
+            partial += fragment;
+            string prefix;
+            if (prefixDetector.find(partial, prefix))
+            {
+                prefixSent = true;
+                forwardPrompt(prefix, requestId, startNanos);
+            }
+        };
+
+        string response;
+        string error;
+        bool ok = getBackend()->generate(request, onFragment, response, error);
+        int64_t completedNanos = Tracer::now();
+        Tracer::get().record("inference", requestId, sentNanos, completedNanos);
+
+        // Straight to the adaptive policy, which keeps its estimate current while the distance policy is active
+        if (ok)
+            adaptiveTrigger->interpretationCompleted((completedNanos - sentNanos) / 1e9);
+        else
+            cout << "inference failed: " << error << endl;
+
+        visionStage.complete(sequence, response, ok);
+    });
+}
+
+void AiDrawingApp::runInference(WorkStealingPool::Task task)
+{
+    std::lock_guard<std::mutex> lock(inferencePoolMutex);
+    if (inferencePool)
+        inferencePool->submit(std::move(task));
+}
+
+void AiDrawingApp::calculateSemanticAverage(uint64_t requestId)
 {
     if (results.size() == 0) {
         return;
     }
-    
-    cout << "computing semantic average..." << endl;
-    semanticAverageStartMillis = ci::app::getElapsedSeconds() * 1000.0;
-    
+
+    if (localSemanticAverage) {
+        // The smoother already has the newest result, so this costs microseconds instead of an LLM round trip
+        string average;
+        {
+            std::lock_guard<std::mutex> lock(semanticAverageMutex);
+            semanticAverageStartMillis = ci::app::getElapsedSeconds() * 1000.0;
+            average = smoother.getAverage();
+        }
+        semanticAverageCallback(average);
+        return;
+    }
+
+    // While an average is running this waits, replacing any older waiting request. The
+    // prompt is built at launch, so it always covers the newest results.
+    textStage.submit([this, requestId](uint64_t sequence) {
+        cout << "computing semantic average..." << endl;
+        string prompt = buildSemanticAveragePrompt();
+
+        InferenceRequest request;
+        request.model = model;
+        request.prompt = prompt;
+        request.requestId = requestId;
+
+        runInference([this, sequence, request]() {
+            int64_t sentNanos = Tracer::now();
+            string response;
+            string error;
+            bool ok = getBackend()->generate(request, nullptr, response, error);
+            if (!ok)
+                cout << "semantic average failed: " << error << endl;
+
+            Tracer::get().record("semantic_average", request.requestId, sentNanos, Tracer::now());
+            textStage.complete(sequence, response, ok);
+        });
+    }, [this](const std::string& result) {
+        this->semanticAverageCallback(result);
+    });
+}
+
+string AiDrawingApp::buildSemanticAveragePrompt()
+{
+    string semanticAverage;
+    {
+        std::lock_guard<std::mutex> lock(semanticAverageMutex);
+        semanticAverage = this->semanticAverage;
+        semanticAverageStartMillis = ci::app::getElapsedSeconds() * 1000.0;
+    }
+
     string prompt = "Given these drawing interpretation results (most recent first), provide a single concise description that represents the semantic average or most likely interpretation of what is being drawn. Weight more recent results higher:\n\n";
     
     int index = 0;
@@ -193,10 +444,14 @@ void AiDrawingApp::calculateSemanticAverage()
     } else {
         prompt += "\nBased on these results, what is most likely being drawn? Respond with a brief, clear description (2-4 words):";
     }
-    
-    ollama.sendPrompt(prompt, [this](const std::string& result, void* userData) {
-        this->semanticAverageCallback(result);
-    }, this);
+
+    return prompt;
+}
+
+string AiDrawingApp::getSemanticAverage()
+{
+    std::lock_guard<std::mutex> lock(semanticAverageMutex);
+    return semanticAverage;
 }
 
 bool AiDrawingApp::isSemanticallySimilar(const string& newResult, const string& previousAverage)
@@ -210,55 +465,33 @@ bool AiDrawingApp::isSemanticallySimilar(const string& newResult, const string&
         return true;
     }
     
-    // Convert to lowercase for comparison
-    string newLower = newResult;
-    string prevLower = previousAverage;
-    transform(newLower.begin(), newLower.end(), newLower.begin(), ::tolower);
-    transform(prevLower.begin(), prevLower.end(), prevLower.begin(), ::tolower);
-    
-    // Check if one is contained in the other (e.g. "cat" vs "cat drawing")
-    if (newLower.find(prevLower) != string::npos || prevLower.find(newLower) != string::npos) {
-        return true;
-    }
-    
-    // Check for common word overlap (simple approach)
-    // Split by spaces and check if main words overlap
-    size_t newSpacePos = newLower.find(' ');
-    size_t prevSpacePos = prevLower.find(' ');
-    
-    if (newSpacePos != string::npos && prevSpacePos != string::npos) {
-        string newFirstWord = newLower.substr(0, newSpacePos);
-        string prevFirstWord = prevLower.substr(0, prevSpacePos);
-        if (newFirstWord == prevFirstWord && newFirstWord.length() > 2) {
-            return true;
-        }
-    }
-    
-    return false;
+    // Compare hashed word and character n-grams, which ignores filler words ("a drawing of")
+    // and tolerates plurals and reordering
+    return smoother.similarity(newResult, previousAverage) >= 0.5f;
 }
 
 void AiDrawingApp::resetStrokeDistance()
 {
-    strokeDistanceSinceLastInterpretation = 0.0f;
+    trigger.reset(ci::app::getElapsedSeconds());
 }
 
-void AiDrawingApp::updateStrokeDistance(const ci::vec2& newPos)
+void AiDrawingApp::updateStrokeDistance(const vdraw::Vec2& newPos)
 {
-    if (hasActiveStroke) {
-        float distance = ci::distance(lastStrokePos, newPos);
-        totalStrokeDistance += distance;
-        strokeDistanceSinceLastInterpretation += distance;
-    }
-    lastStrokePos = newPos;
+    trigger.strokeMoved(newPos);
 }
 
 bool AiDrawingApp::hasSignificantDrawing()
 {
-    return strokeDistanceSinceLastInterpretation >= minimumStrokeDistanceForInterpretation;
+    return trigger.shouldInterpret(ci::app::getElapsedSeconds(), visionStage.getStats().inFlight);
 }
 
 void AiDrawingApp::semanticAverageCallback(const string& result)
 {
+    if (result.empty())
+        return;
+
+    // Only called for the newest average, textStage drops results that arrive out of order
+    std::lock_guard<std::mutex> lock(semanticAverageMutex);
     semanticAverageDt = ci::app::getElapsedSeconds() * 1000.0 - semanticAverageStartMillis;
     
     // Mechanical check to reduce jitter even if Ollama didn't follow instructions perfectly
@@ -279,7 +512,7 @@ bool AiDrawingApp::spoutStartReceiver(string spoutInName)
     unsigned int w;
     unsigned int h;
 
-    sender->send(osc::Message("/s"));
+    sendOsc("/s");
 
     //spoutIn.getSpoutReceiver().GetSenderCount();
 
@@ -300,27 +533,151 @@ bool AiDrawingApp::spoutStartReceiver(string spoutInName)
 
 void AiDrawingApp::interpretCanvas(bool async)
 {
-    if (!ready)
-        return;
-
-    Surface8u surface = captureDrawingAsTexture(true)->createSource();
-    cout << "sending canvas to " << ollama.getVisionModel() << "..." << endl;
-    currentMillis = ci::app::getElapsedSeconds() * 1000.0;
+    uint64_t requestId = Tracer::get().newRequestId();
+    int64_t startNanos = Tracer::now();
+
+    InferenceRequest request;
+    request.model = model;
+    request.prompt = prompt;
+    request.requestId = requestId;
+
+    // The vector payload is complete here, the image is encoded on the inference thread
+    Surface8u surface;
+    bool vectorRequest = vectorPayload;
+    if (vectorRequest)
+    {
+        TraceSpan span("vectorize", requestId);
+        vdraw::VectorPayloadStats stats;
+        // The area the view shows, as the captured image would
+        ivec2 canvasSize = canvasFbo->getSize();
+        vdraw::Bounds area = view.visibleArea((float)canvasSize.x, (float)canvasSize.y);
+        request.prompt = vectorPrompt + payloadEncoder.encode(drawing, area, &stats);
+        PerfCounters::get().vectorPayload.add(stats.bytes / 1024.0f);
+    }
+    else
+    {
+        TraceSpan span("capture", requestId);
+        surface = captureDrawingAtSize(inferenceDimensions)->createSource();
+    }
 
     if (async)
     {
-        ready = false;
-        ollama.sendImageForInference(surface, prompt, [this](const std::string& result, void* userData) {
-            this->callback(result);
-        }, this);
+        // While a description is running this canvas waits, replacing any older waiting canvas.
+        // Launching from the completion thread is fine since the canvas and settings were captured here.
+        int64_t submittedNanos = Tracer::now();
+        bool streaming = streamingInference;
+        visionStage.submit([this, request, surface, requestId, startNanos, submittedNanos, streaming](uint64_t sequence) {
+            Tracer::get().record("vision_wait", requestId, submittedNanos, Tracer::now());
+            cout << "sending canvas to " << getBackend()->getName() << "..." << endl;
+            describeCanvas(request, surface, sequence, startNanos, streaming);
+        }, [this, requestId, startNanos, vectorRequest](const std::string& result) {
+            this->callback(result, requestId, startNanos, vectorRequest);
+        });
     }
     else
     {
-        ready = false;
-        result = ollama.sendImageForInferenceSync(surface, prompt);
+        InferenceBackendRef backend = getBackend();
+        cout << "sending canvas to " << backend->getName() << "..." << endl;
+        currentMillis = ci::app::getElapsedSeconds() * 1000.0;
+
+        if (!vectorRequest)
+            request.images.push_back(encodeImage(surface));
+
+        TraceSpan span("inference", requestId);
+        string response;
+        string error;
+        if (!backend->generate(request, nullptr, response, error))
+            cout << "inference failed: " << error << endl;
         cout << ci::app::getElapsedSeconds() * 1000.0 - currentMillis << " ms" << endl;
-        cout << "result: " << result << endl;
-        ready = true;
+        cout << "result: " << response << endl;
+
+        std::lock_guard<std::mutex> lock(resultMutex);
+        result = response;
+    }
+}
+
+void AiDrawingApp::selectBackend(BackendKind kind)
+{
+    InferenceBackendRef selected;
+    switch (kind)
+    {
+    case BackendOllamaClient:
+        selected = std::make_shared<OllamaCinderBackend>(ollama);
+        break;
+
+    case BackendMock:
+        if (!mockServer.isRunning() && !mockServer.start())
+        {
+            cout << "Couldn't start the mock inference server" << endl;
+            return;
+        }
+        selected = std::make_shared<OllamaHttpBackend>("127.0.0.1", mockServer.getPort());
+        break;
+
+    default:
+        selected = std::make_shared<OllamaHttpBackend>();
+        break;
+    }
+
+    if (inferenceBatching)
+        selected = std::make_shared<BatchingBackend>(selected, BatchingBackend::Settings(30.0, visionBatchSize));
+
+    // Requests already running keep the backend they started with
+    std::lock_guard<std::mutex> lock(backendMutex);
+    backend = selected;
+    backendKind = kind;
+    cout << "inference backend: " << backend->getName() << endl;
+}
+
+void AiDrawingApp::setInferenceBatching(bool enabled)
+{
+    inferenceBatching = enabled;
+    visionStage.setMaxInFlight(enabled ? static_cast<int>(visionBatchSize) : 1);
+
+    // The adaptive policy paces to the stage's capacity
+    AdaptiveTriggerPolicy::Settings settings = adaptiveTrigger->getSettings();
+    settings.maxInFlight = visionStage.getMaxInFlight();
+    adaptiveTrigger->setSettings(settings);
+
+    selectBackend(backendKind);
+    cout << "inferenceBatching: " << inferenceBatching << endl;
+}
+
+InferenceBackendRef AiDrawingApp::getBackend()
+{
+    std::lock_guard<std::mutex> lock(backendMutex);
+    return backend;
+}
+
+void AiDrawingApp::writeTrace()
+{
+    cout << Tracer::get().formatStageStats();
+
+    if (Tracer::get().writeChromeTrace(traceFilename))
+        cout << "Trace written to " << traceFilename << " (open in chrome://tracing or ui.perfetto.dev)" << endl;
+    else
+        cout << "Couldn't write " << traceFilename << endl;
+}
+
+void AiDrawingApp::updateResultsOverlay()
+{
+    // Read the generation before copying, so a result arriving mid-copy triggers another rebuild
+    uint64_t generation = results.getGeneration();
+    if (generation == resultsOverlayGeneration)
+    {
+        PerfCounters::get().overlayCache.hit();
+        return;
+    }
+
+    PerfCounters::get().overlayCache.miss();
+    resultsOverlayGeneration = generation;
+
+    vector<string> lines = results.getAllAsVector();
+    resultsOverlay.setLineCount(lines.size());
+    for (size_t i = 0; i < lines.size(); ++i)
+    {
+        ColorA color = i == 0 ? ColorA(0, 0, 0, 1.0f) : ColorA(0, 0, 0, 0.3f);
+        resultsOverlay.setLine(i, lines[i], color);
     }
 }
 
@@ -340,19 +697,53 @@ void AiDrawingApp::keyDown(KeyEvent event) {
     case KeyEvent::KEY_RETURN: interpretCanvas(false); break;
 
     case KeyEvent::KEY_F1: variableToggle(&showDrawing, "showDrawing"); break;
-    case KeyEvent::KEY_F2: variableToggle(&doStreaming, "doStreaming"); break;
+    case KeyEvent::KEY_F2:
+        if (event.isShiftDown())
+            toggleTriggerPolicy();
+        else
+            variableToggle(&doStreaming, "doStreaming");
+        break;
     case KeyEvent::KEY_t: variableToggle(&showText, "showText");  break;
-    case KeyEvent::KEY_o: variableToggle(&showSpoutTexture, "showSpoutTexture"); break;
-    case KeyEvent::KEY_F3: variableToggle(&sendPrompt, "sendPrompt"); break;
+    case KeyEvent::KEY_o:
+        if (event.isControlDown() || event.isMetaDown())
+            DrawingApp::keyDown(event);
+        else
+            variableToggle(&showSpoutTexture, "showSpoutTexture");
+        break;
+    case KeyEvent::KEY_F3:
+        if (event.isShiftDown())
+            variableToggle(&vectorPayload, "vectorPayload");
+        else
+            variableToggle(&sendPrompt, "sendPrompt");
+        break;
 
-    case KeyEvent::KEY_F5: variableToggle(&doContinuousGeneration, "doContinuousGeneration"); break;
+    case KeyEvent::KEY_F5:
+        if (event.isShiftDown())
+            setInferenceBatching(!inferenceBatching);
+        else
+            variableToggle(&doContinuousGeneration, "doContinuousGeneration");
+        break;
+    case KeyEvent::KEY_F7: writeTrace(); break;
+    case KeyEvent::KEY_F8: hud.toggle(); break;
+    case KeyEvent::KEY_F10:
+        if (event.isShiftDown())
+            selectBackend(static_cast<BackendKind>((backendKind + 1) % BackendCount));
+        else
+            variableToggle(&streamingInference, "streamingInference");
+        break;
 
     case KeyEvent::KEY_F6: 
         spoutOutSketch.sendTexture(texSolid);
+        PerfCounters::get().spoutFramesSent++;
         break;
 
 
-    case KeyEvent::KEY_F4: calculateSemanticAverage(); break;
+    case KeyEvent::KEY_F4:
+        if (event.isShiftDown())
+            variableToggle(&localSemanticAverage, "localSemanticAverage");
+        else
+            calculateSemanticAverage();
+        break;
 
     //case KeyEvent::KEY_1: sender->send(osc::Message("/s") ); break;
     //case KeyEvent::KEY_2: sender->send(osc::Message("/S") ); break;
@@ -361,10 +752,17 @@ void AiDrawingApp::keyDown(KeyEvent event) {
     case KeyEvent::KEY_F12: spoutIn.getSpoutReceiver().SelectSenderPanel(); break;
 //    case KeyEvent::KEY_6: spoutStartReceiver(); break;
     
-    case KeyEvent::KEY_F11: sender->send(osc::Message("/x")); break;
-    case KeyEvent::KEY_TAB: sender->send(osc::Message("/t")); break;
+    case KeyEvent::KEY_F11: sendOsc("/x"); break;
+    case KeyEvent::KEY_TAB: sendOsc("/t"); break;
 
-    case KeyEvent::KEY_DELETE: results.clear(); DrawingApp::keyDown(event); break;
+    case KeyEvent::KEY_DELETE:
+        results.clear();
+        {
+            std::lock_guard<std::mutex> lock(semanticAverageMutex);
+            smoother.clear();
+        }
+        DrawingApp::keyDown(event);
+        break;
 
     default: DrawingApp::keyDown(event); break;
 
@@ -374,14 +772,19 @@ void AiDrawingApp::keyDown(KeyEvent event) {
 
 void AiDrawingApp::draw() {
 
+    TraceSpan frameSpan("frame");
+
+    double frameSeconds = ci::app::getElapsedSeconds();
+    if (lastFrameSeconds > 0)
+        PerfCounters::get().frameTime.add(static_cast<float>((frameSeconds - lastFrameSeconds) * 1000.0));
+    lastFrameSeconds = frameSeconds;
+
     gl::enableAlphaBlending();
 
     float lineHeight = fontSize * 1.2f;
     int x = 10;
     int y = 10;
 
-    int i = 0;
-
     float s1 = 0.5;
     float s2 = 1;
     //gl::clear(Color(s1, s1, s1));
@@ -401,30 +804,37 @@ void AiDrawingApp::draw() {
         }
     }
 
+    // Layers bottom first: the generated image, the sketch composited from its own
+    // layers, then the stroke being drawn. Each is a cached texture drawn as one quad.
+    if (!matchingSpoutName)
+        generatedLayer.reset();
+
     if (showSpoutTexture)
     {
-//        cout << "!" << endl;
-        //cout << "[" << spoutIn.getSenderName() + " | " << spoutInName + " | " << matchingSpoutName << endl;
+        Texture2dRef texSpout;
+        {
+            TraceSpan span("spout_receive");
+            texSpout = spoutIn.receiveTexture();
+        }
 
-        Texture2dRef texSpout = spoutIn.receiveTexture();
         if (texSpout && matchingSpoutName)
         {
-            float wf = this->getWindowWidth() / texSpout->getWidth();
-            float hf = this->getWindowHeight() / texSpout->getHeight();
-                
-                
-            //auto v = cout << v << endl;
-
-            gl::pushMatrices();
-
-            gl::scale(wf, hf);
-            gl::draw(texSpout);
-
-            gl::popMatrices();
-
+            PerfCounters::get().spoutFramesReceived++;
+            generatedLayer = texSpout;
+
+            // The first generated frame after a prompt was sent completes that request
+            uint64_t requestId = promptRequestId.exchange(0);
+            if (requestId != 0)
+            {
+                int64_t nowNanos = Tracer::now();
+                Tracer::get().record("image_return", requestId, promptSentNanos, nowNanos);
+                Tracer::get().record("loop", requestId, promptLoopStartNanos, nowNanos);
+            }
         }
-        else
-            gl::color(ColorA(s2, s2, s2));
+
+        // Between frames the last one received stays up
+        if (generatedLayer)
+            gl::draw(generatedLayer, Rectf(getWindowBounds()));
     }
 
     if (showDrawing)
@@ -439,13 +849,15 @@ void AiDrawingApp::draw() {
         gl::draw(texTransparent);
     }
 
-    texSolid = captureDrawingAsTexture(true);
+    texSolid = captureDrawingAtSize(spoutDimensions);
 
 
     if (doContinuousGeneration)
     {
 //        auto texSolid = captureDrawingAsTexture(true);
+        TraceSpan span("spout_send");
         spoutOutSketch.sendTexture(texSolid);
+        PerfCounters::get().spoutFramesSent++;
     }
 
     //if (doStreaming && hasSignificantDrawing() && !isMouseDown) {
@@ -469,23 +881,29 @@ void AiDrawingApp::draw() {
         //}
 
         //// Show stroke distance progress
-        //string strokeInfo = "Stroke: " + to_string((int)strokeDistanceSinceLastInterpretation) + "/" + to_string((int)minimumStrokeDistanceForInterpretation) + " px";
+        //string strokeInfo = "Stroke: " + to_string((int)trigger.getDistanceSinceLastInterpretation()) + "/" + to_string((int)trigger.getMinimumDistance()) + " px";
         //ColorA strokeColor = hasSignificantDrawing() ? ColorA(0, 1, 0, 1) : ColorA(0.5f, 0.5f, 0.5f, 1);
         //drawString(strokeInfo, ci::vec2(x, y), strokeColor, font);
         //y += lineHeight;
 
         y += lineHeight;
 
-        results.forEach([&y, this, lineHeight, x, &i](const std::string& line) {
-            ColorA color = i++ == 0 ? ColorA(0, 0, 0, 1.0f) : ColorA(0, 0, 0, 0.3f);
-            drawString(line, ci::vec2(x, y), color, font);
-            y += lineHeight;
-            });
+        updateResultsOverlay();
+        resultsOverlay.draw(ci::vec2(x, y));
     }
     gl::disableAlphaBlending();
 
     //for video capture in TouchDesigner
     spoutOutViewport.sendViewport();
 
+    // After the viewport is sent, so the HUD stays out of captured video
+    if (hud.isVisible())
+    {
+        double hudStart = ci::app::getElapsedSeconds();
+        hud.update(hudStart, drawing);
+        hud.draw(vec2(getWindowWidth() * 0.6f, 10));
+        PerfCounters::get().hudDraw.add(static_cast<float>((ci::app::getElapsedSeconds() - hudStart) * 1000.0));
+    }
+
     params->draw();
 }
\ No newline at end of file
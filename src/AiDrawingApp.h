@@ -2,6 +2,18 @@
 #include "DrawingApp.h"
 #include <OllamaClient/OllamaClientCinder.h>
 #include "ThreadSafeList.h"
+#include "InterpretationTrigger.h"
+#include "Tracing.h"
+#include "PerfHud.h"
+#include "InferenceStage.h"
+#include "SemanticSmoother.h"
+#include "StreamingInference.h"
+#include "InferenceBackend.h"
+#include "BatchingBackend.h"
+#include "MockOllamaServer.h"
+#include "OscOutputQueue.h"
+#include "VectorPayload.h"
+#include "WorkStealingPool.h"
 
 #include "CiSpoutOut.h"
 #include "CiSpoutIn.h"
@@ -14,38 +26,112 @@ using namespace std;
 class AiDrawingApp : public DrawingApp {
 public:
 	AiDrawingApp();
+	~AiDrawingApp();
 
 	void setup() override;
 	void mouseDown(ci::app::MouseEvent event) override;
 	void mouseDrag(ci::app::MouseEvent event) override;
 	void mouseUp(ci::app::MouseEvent event) override;
+	void update() override;
 	void interpretCanvas(bool async = true);
 	void keyDown(KeyEvent event) override;
 	void draw() override;
 
+	// Posted to oscOutput, so the caller never waits on the socket
 	void sendOsc(string op, string property, string value);
 	void sendOsc(string op, string message);
-	void callback(const string& result);
+	void sendOsc(string op);
+	void callback(const string& result, uint64_t requestId, int64_t startNanos, bool vectorRequest = false);
+	std::mutex resultMutex;	// Guards result and dt, written by whichever thread completes a description
 	string result;
 	
-	void calculateSemanticAverage();
+	void calculateSemanticAverage(uint64_t requestId = 0);
+	string buildSemanticAveragePrompt();
+	string getSemanticAverage();
 	bool isSemanticallySimilar(const string& newResult, const string& previousAverage);
 	
 	// Drawing detection methods
 	void resetStrokeDistance();
-	void updateStrokeDistance(const ci::vec2& newPos);
+	void updateStrokeDistance(const vdraw::Vec2& newPos);
 	bool hasSignificantDrawing();
 	void semanticAverageCallback(const string& result);
+	std::mutex semanticAverageMutex;	// Guards the fields below, written from inference callbacks
 	string semanticAverage;
 	double semanticAverageStartMillis;
 	float semanticAverageDt;
 
-	// Stroke tracking for meaningful drawing detection
-	float totalStrokeDistance;
-	float strokeDistanceSinceLastInterpretation;
-	ci::vec2 lastStrokePos;
-	bool hasActiveStroke;
-	float minimumStrokeDistanceForInterpretation;
+	// In-process averaging of the recent results (default), or an LLM prompt through textStage (Shift+F4 toggles)
+	SemanticSmoother smoother;
+	bool localSemanticAverage;
+
+	// Vision description and semantic averaging run as separate pipeline stages, so the
+	// next description can start while the previous one is still being averaged
+	InferenceStage visionStage;
+	InferenceStage textStage;
+
+	// Streams the description token by token and forwards a stable prefix as the prompt before
+	// the model finishes, the complete description refines it (F10 toggles). Only read on the
+	// main thread; a request streams as the setting was when it was made.
+	bool streamingInference;
+	StablePrefixDetector prefixDetector;
+	// PNG-encodes the surface into the request unless it carries a vector payload already
+	void describeCanvas(InferenceRequest request, const Surface8u& surface, uint64_t sequence, int64_t startNanos, bool streaming);
+
+	// Backends block until the model is done, so both stages run their requests on a pool: a
+	// worker for each description the vision stage runs at once, and one for the text stage.
+	// Joined first on shutdown, while everything the requests complete into still exists;
+	// requests launched after that began are dropped.
+	void runInference(WorkStealingPool::Task task);
+	std::mutex inferencePoolMutex;
+	std::unique_ptr<WorkStealingPool> inferencePool;
+
+	// The canvas is rendered for the vision model at this size, which it downscales further anyway
+	glm::ivec2 inferenceDimensions = glm::ivec2(512, 512);
+
+	// Sends the strokes as a size-bounded SVG in the prompt instead of the rendered canvas,
+	// skipping the readback and PNG encoding (Shift+F3 toggles)
+	bool vectorPayload;
+	vdraw::VectorPayloadEncoder payloadEncoder;
+	string vectorPrompt;
+
+	// Model backend used by both stages: Ollama over HTTP (default), the bundled Ollama client,
+	// or the in-process mock server (Shift+F10 cycles, --mock-inference starts with the mock)
+	enum BackendKind { BackendOllamaHttp, BackendOllamaClient, BackendMock, BackendCount };
+	void selectBackend(BackendKind kind);
+	InferenceBackendRef getBackend();
+	std::mutex backendMutex;
+	InferenceBackendRef backend;
+	BackendKind backendKind;
+	MockOllamaServer mockServer;
+
+	// Lets the vision stage run visionBatchSize descriptions at once and sends their canvases
+	// to the model together, as one batched request (Shift+F5 toggles)
+	bool inferenceBatching;
+	size_t visionBatchSize = 4;
+	void setInferenceBatching(bool enabled);
+
+	// Sends text as the prompt unless a newer request already sent one or it is unchanged
+	bool forwardPrompt(const string& text, uint64_t requestId, int64_t startNanos);
+	std::mutex forwardMutex;
+	uint64_t lastForwardedRequestId;
+	string lastForwardedPrompt;
+
+	// Stroke tracking for meaningful drawing detection, observes the drawing for canvas changes
+	InterpretationTrigger trigger;
+	std::shared_ptr<AdaptiveTriggerPolicy> adaptiveTrigger;
+	bool interpretIfSignificant();
+	void toggleTriggerPolicy();
+
+	// Latency tracing, the request id follows one interpretation through every stage
+	void writeTrace();
+	std::atomic<uint64_t> promptRequestId;	// Prompt waiting for the next Spout frame
+	std::atomic<int64_t> promptSentNanos;
+	std::atomic<int64_t> promptLoopStartNanos;
+	string traceFilename;
+
+	// Performance overlay (F8)
+	PerfHud hud;
+	double lastFrameSeconds;
 
 	// on-screen text
 	Font font;
@@ -54,7 +140,12 @@ public:
 	ThreadSafeList<string> results;
 	bool showText;
 
-	//Spout
+	// results rendered once per change (tracked by the list's generation) and drawn as one quad
+	TextOverlay resultsOverlay;
+	uint64_t resultsOverlayGeneration;
+	void updateResultsOverlay();
+
+	//Spout, the sketch is rendered at spoutDimensions rather than copied from the canvas
 	glm::ivec2 spoutDimensions = glm::ivec2(512, 512);
 	SpoutOut spoutOutSketch;
 	SpoutOut spoutOutViewport;
@@ -65,6 +156,8 @@ public:
 
 	SpoutIn	spoutIn;
 	bool showSpoutTexture;
+	// Last frame received, drawn as the bottom layer until the next one arrives (O toggles)
+	cinder::gl::TextureRef generatedLayer;
 	string spoutInName = "StreamDiffusion";
 	bool spoutInConnected = false;
 	bool spoutStartReceiver(string spoutInName = "");
@@ -72,6 +165,11 @@ public:
 	//OSC
 	osc::SenderUdp* sender;
 	osc::ReceiverUdp* receiver;
+	// Sends every message from its own thread; streamed prompt updates replace the one waiting
+	// and go out at most once per promptIntervalMillis
+	OscOutputQueue oscOutput;
+	double promptIntervalMillis = 50.0;
+	static osc::Message toOscMessage(const OscMessage& message);
 	const string destinationHost = "127.0.0.1";
 	const int destinationPort = 7000;
 	const int localPort = 7001;
@@ -83,7 +181,6 @@ public:
 	bool sendPrompt;
 
 protected:
-	bool ready;
 	bool doStreaming;
 	double currentMillis;
 	string model;
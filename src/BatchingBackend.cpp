@@ -0,0 +1,231 @@
+#include "BatchingBackend.h"
+#include "PerfCounters.h"
+
+#include <algorithm>
+#include <cctype>
+
+BatchingBackend::Settings::Settings(double windowMillis, size_t maxBatch)
+    : windowMillis(windowMillis), maxBatch(maxBatch) {
+}
+
+double BatchingBackend::Stats::meanBatchSize() const {
+    uint64_t requests = 0;
+    for (size_t size = 0; size < batchSizes.size(); ++size) {
+        requests += size * batchSizes[size];
+    }
+    return batches > 0 ? static_cast<double>(requests) / batches : 0.0;
+}
+
+BatchingBackend::BatchingBackend(const InferenceBackendRef& inner, const Settings& settings)
+    : inner(inner), settings(settings) {
+    resetStats();
+}
+
+std::string BatchingBackend::getName() const {
+    return inner->getName() + " (batched)";
+}
+
+bool BatchingBackend::generate(const InferenceRequest& request, const FragmentCallback& onFragment,
+    std::string& response, std::string& error) {
+    std::unique_lock<std::mutex> lock(mutex);
+    stats.requests++;
+
+    if (request.images.size() != 1) {
+        stats.passedThrough++;
+        lock.unlock();
+        return inner->generate(request, onFragment, response, error);
+    }
+
+    if (settings.maxBatch <= 1) {
+        recordBatch(1);
+        lock.unlock();
+        bool ok = inner->generate(request, onFragment, response, error);
+        if (!ok) {
+            std::lock_guard<std::mutex> failureLock(mutex);
+            stats.failures++;
+        }
+        return ok;
+    }
+
+    // Join the open batch for this model and prompt, or lead a new one
+    std::shared_ptr<Batch> batch;
+    for (const auto& candidate : open) {
+        if (candidate->model == request.model && candidate->prompt == request.prompt) {
+            batch = candidate;
+            break;
+        }
+    }
+
+    bool leader = !batch;
+    if (leader) {
+        batch = std::make_shared<Batch>();
+        batch->model = request.model;
+        batch->prompt = request.prompt;
+        batch->maxSize = settings.maxBatch;
+        batch->closed = false;
+        batch->done = false;
+        batch->ok = false;
+        batch->resplit = false;
+        open.push_back(batch);
+    }
+
+    size_t index = batch->requests.size();
+    batch->requests.push_back(&request);
+    if (batch->requests.size() >= batch->maxSize) {
+        batch->closed = true;
+        open.erase(std::find(open.begin(), open.end(), batch));
+        changed.notify_all();
+    }
+
+    if (leader) {
+        Clock::time_point deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double, std::milli>(settings.windowMillis));
+        changed.wait_until(lock, deadline, [&]() { return batch->closed; });
+        if (!batch->closed) {
+            batch->closed = true;
+            open.erase(std::find(open.begin(), open.end(), batch));
+        }
+
+        lock.unlock();
+        dispatch(*batch);
+        lock.lock();
+    }
+    else {
+        changed.wait(lock, [&]() { return batch->done; });
+    }
+
+    if (batch->resplit) {
+        lock.unlock();
+        return inner->generate(request, onFragment, response, error);
+    }
+
+    error = batch->error;
+    if (!batch->ok) {
+        return false;
+    }
+
+    response = batch->results[index];
+    lock.unlock();
+    if (onFragment) {
+        onFragment(response);
+    }
+    return true;
+}
+
+void BatchingBackend::setSettings(const Settings& settings) {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->settings = settings;
+}
+
+BatchingBackend::Settings BatchingBackend::getSettings() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return settings;
+}
+
+InferenceBackendRef BatchingBackend::getInner() const {
+    return inner;
+}
+
+BatchingBackend::Stats BatchingBackend::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void BatchingBackend::resetStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    stats = Stats();
+}
+
+std::string BatchingBackend::combinePrompt(const std::string& prompt, size_t count) {
+    std::string n = std::to_string(count);
+    return "The " + n + " images are separate drawings. For each image, in order: " + prompt +
+        ". Answer with exactly " + n + " lines, numbered 1. to " + n + ". with one line per image, and nothing else.";
+}
+
+bool BatchingBackend::splitResponse(const std::string& response, size_t count, std::vector<std::string>& results) {
+    results.assign(count, std::string());
+    size_t found = 0;
+
+    size_t start = 0;
+    while (start < response.size()) {
+        size_t end = response.find('\n', start);
+        if (end == std::string::npos) end = response.size();
+
+        // "3. text", "3) text", "3: text", optionally after "Image "
+        size_t i = start;
+        while (i < end && isspace(static_cast<unsigned char>(response[i]))) i++;
+        if (response.compare(i, 6, "Image ") == 0 || response.compare(i, 6, "image ") == 0) i += 6;
+
+        size_t number = 0;
+        size_t digits = 0;
+        while (i < end && isdigit(static_cast<unsigned char>(response[i])) && digits < 4) {
+            number = number * 10 + (response[i++] - '0');
+            digits++;
+        }
+
+        if (digits > 0 && i < end && (response[i] == '.' || response[i] == ')' || response[i] == ':') &&
+            number >= 1 && number <= count) {
+            i++;
+            size_t last = end;
+            while (i < last && isspace(static_cast<unsigned char>(response[i]))) i++;
+            while (last > i && isspace(static_cast<unsigned char>(response[last - 1]))) last--;
+
+            std::string& result = results[number - 1];
+            if (result.empty() && last > i) {
+                result = response.substr(i, last - i);
+                found++;
+            }
+        }
+        start = end + 1;
+    }
+
+    return found == count;
+}
+
+void BatchingBackend::dispatch(Batch& batch) {
+    size_t size = batch.requests.size();
+    bool ok;
+    bool resplit = false;
+    std::string response;
+    std::string error;
+    std::vector<std::string> results;
+
+    if (size == 1) {
+        // Nobody joined: the request goes out as it is
+        ok = inner->generate(*batch.requests[0], nullptr, response, error);
+        results.push_back(response);
+    }
+    else {
+        InferenceRequest combined;
+        combined.model = batch.model;
+        combined.prompt = combinePrompt(batch.prompt, size);
+        combined.requestId = batch.requests[0]->requestId;
+        for (const InferenceRequest* request : batch.requests) {
+            combined.images.push_back(request->images[0]);
+        }
+
+        ok = inner->generate(combined, nullptr, response, error);
+        resplit = ok && !splitResponse(response, size, results);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    recordBatch(size);
+    if (!ok) stats.failures++;
+    if (resplit) stats.resplit++;
+
+    batch.ok = ok;
+    batch.resplit = resplit;
+    batch.error = error;
+    batch.results.swap(results);
+    batch.done = true;
+    changed.notify_all();
+}
+
+void BatchingBackend::recordBatch(size_t size) {
+    stats.batches++;
+    if (stats.batchSizes.size() <= size) {
+        stats.batchSizes.resize(size + 1, 0);
+    }
+    stats.batchSizes[size]++;
+    PerfCounters::get().inferenceBatchSize.add(static_cast<float>(size));
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "InferenceBackend.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Batches canvas requests in front of another backend. Concurrent single-image requests with
+// the same model and prompt (e.g. the canvases of many sessions, or several in flight from one
+// app) are gathered for up to windowMillis, or until maxBatch have arrived, and sent as one
+// request with all the images, asking for one numbered line per image. The lines are handed
+// back to the callers in order. A model server spends much less per image that way than on
+// the same images one request at a time.
+//
+// The first request of a batch leads it: its caller waits out the window and sends the batch,
+// the others wait for their line, so no thread of its own is needed. A longer window and a
+// larger maxBatch trade latency for throughput; maxBatch 1 sends every request on its own.
+// Requests that can't share a batch (text only, several images) pass straight through, and
+// when a response can't be split into the expected lines each request is sent again alone.
+//
+// Batched requests don't stream: their caller's fragment callback gets the whole line once.
+class BatchingBackend : public InferenceBackend {
+public:
+    struct Settings {
+        double windowMillis;    // Longest the first request of a batch waits for others
+        size_t maxBatch;        // A batch this size goes out at once
+
+        Settings(double windowMillis = 20.0, size_t maxBatch = 8);
+    };
+
+    struct Stats {
+        uint64_t requests;
+        uint64_t batches;       // Requests sent to the inner backend for batchable requests, of any size
+        uint64_t passedThrough; // Not batchable
+        uint64_t resplit;       // Batches whose response didn't split, sent again request by request
+        uint64_t failures;      // Batches the inner backend failed
+        std::vector<uint64_t> batchSizes;  // batchSizes[n]: batches of n requests
+
+        double meanBatchSize() const;
+    };
+
+    BatchingBackend(const InferenceBackendRef& inner, const Settings& settings = Settings());
+
+    std::string getName() const override;
+    bool generate(const InferenceRequest& request, const FragmentCallback& onFragment,
+        std::string& response, std::string& error) override;
+
+    // Applies to batches opened afterwards
+    void setSettings(const Settings& settings);
+    Settings getSettings() const;
+
+    InferenceBackendRef getInner() const;
+
+    Stats getStats() const;
+    void resetStats();
+
+    // The prompt of a batch of count images, each to be described as prompt asks
+    static std::string combinePrompt(const std::string& prompt, size_t count);
+
+    // Splits a response into count results by their line numbers, false unless all are found
+    static bool splitResponse(const std::string& response, size_t count, std::vector<std::string>& results);
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Batch {
+        std::string model;
+        std::string prompt;
+        std::vector<const InferenceRequest*> requests;     // Callers wait until done, so their requests stay valid
+        size_t maxSize;
+        bool closed;        // Taking no more requests
+        bool done;
+        bool ok;
+        bool resplit;
+        std::vector<std::string> results;
+        std::string error;
+    };
+
+    // Sends the batch and wakes its callers, called by its leader without the lock held
+    void dispatch(Batch& batch);
+
+    void recordBatch(size_t size);
+
+    InferenceBackendRef inner;
+
+    mutable std::mutex mutex;   // Guards the fields below
+    std::condition_variable changed;
+    Settings settings;
+    std::vector<std::shared_ptr<Batch>> open;
+    Stats stats;
+};
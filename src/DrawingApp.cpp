@@ -1,4 +1,7 @@
 #include "DrawingApp.h"
+#include "DrawingDocument.h"
+#include "StrokeGeometry.h"
+#include "VectorExport.h"
 #include "cinder/Utilities.h"
 #include "cinder/Timeline.h"
 #include "cinder/ip/Flip.h"
@@ -7,26 +10,44 @@ using namespace ci;
 using namespace ci::app;
 using namespace std;
 
+namespace {
+
+    gl::Fbo::Format canvasFormat() {
+        gl::Fbo::Format fboFormat;
+        fboFormat.colorTexture();  // Ensure color attachment is accessible as a texture
+        fboFormat.setColorTextureFormat(gl::Texture2d::Format().internalFormat(GL_RGBA8));
+        return fboFormat;
+    }
+
+} // namespace
+
 DrawingApp::DrawingApp()
     : currentColor(0, 0, 0),
     strokeWidth(10.0f),
     smoothingLevel(0),
-    dynamicWidth(false), showDrawing(true), isMouseDown(false) {
+    dynamicWidth(false), eraserMode(false), eraserRadius(12.0f), showDrawing(true), isMouseDown(false), scaledCanvasValid(false),
+    journalFilename("session.vjournal"), journalFailureReported(false), canvasDirty(true), isPanning(false), layerIndex(0), layerVisible(true), layerOpacity(1.0f) {
 }
 
 void DrawingApp::setup() {
+    // Bound undo history so long sessions release old strokes
+    drawing.setHistoryLimit(1000);
+
+    // Restore the previous session (e.g. after a crash) and journal this one
+    if (!journal.start(journalFilename, drawing)) {
+        console() << "Couldn't open session journal: " << journalFilename << std::endl;
+    }
+
     // Setup the drawing with initial values
     drawing.setColor(vdraw::Color(currentColor.r, currentColor.g, currentColor.b));
     drawing.setStrokeWidth(strokeWidth);
     drawing.setSmoothing(smoothingLevel);
     drawing.setDynamicWidth(dynamicWidth);
+    syncLayerParams();
 
     // Create FBO with same size as window
     auto windowSize = getWindowSize();
-    gl::Fbo::Format fboFormat;
-    fboFormat.colorTexture();  // Ensure color attachment is accessible as a texture
-    fboFormat.setColorTextureFormat(gl::Texture2d::Format().internalFormat(GL_RGBA8));
-    canvasFbo = gl::Fbo::create(windowSize.x, windowSize.y, fboFormat);
+    canvasFbo = gl::Fbo::create(windowSize.x, windowSize.y, canvasFormat());
 
     // Initialize canvas with white background
     resetCanvas();
@@ -65,6 +86,33 @@ void DrawingApp::setupParams() {
         .updateFn([this]() {
         drawing.setDynamicWidth(dynamicWidth);
             });
+
+    params->addParam("Eraser", &eraserMode);
+    params->addParam("Eraser Radius", &eraserRadius)
+        .min(2.0f)
+        .max(100.0f)
+        .step(1.0f);
+
+    params->addParam("Layer", &layerIndex)
+        .min(0)
+        .updateFn([this]() {
+        selectLayer(static_cast<size_t>(layerIndex));
+            });
+
+    params->addParam("Layer Visible", &layerVisible)
+        .updateFn([this]() {
+        drawing.setLayerVisible(drawing.getActiveLayer(), layerVisible);
+        invalidateCanvas();
+            });
+
+    params->addParam("Layer Opacity", &layerOpacity)
+        .min(0.0f)
+        .max(1.0f)
+        .step(0.05f)
+        .updateFn([this]() {
+        drawing.setLayerOpacity(drawing.getActiveLayer(), layerOpacity);
+        invalidateCanvas();
+            });
 }
 
 double DrawingApp::getCurrentTime() {
@@ -72,7 +120,14 @@ double DrawingApp::getCurrentTime() {
 }
 
 void DrawingApp::mouseDown(MouseEvent event) {
-    vec2 pos = event.getPos();
+    if (event.isRight()) {
+        // Pan the view; not recorded, since replay runs in drawing coordinates
+        isPanning = true;
+        panFrom = event.getPos();
+        return;
+    }
+
+    vdraw::Vec2 point = toDrawing(event.getPos());
     float pressure = 1.0f; // Default pressure if not available
 
 #if defined(CINDER_COCOA_TOUCH) //|| defined(CINDER_MSW_DESKTOP)
@@ -82,13 +137,34 @@ void DrawingApp::mouseDown(MouseEvent event) {
     }
 #endif
 
-    drawing.beginStroke(vdraw::Vec2(pos.x, pos.y), pressure, getCurrentTime());
-
+    recordMouseEvent(InputEvent::MouseDown, event, point, pressure);
     isMouseDown = true;
+    LayerCache& cache = updateLayerCache(getActiveLayer());
+
+    if (eraserMode) {
+        // The radius stays the same on screen whatever the zoom
+        vdraw::Bounds changed;
+        if (drawing.beginErase(point, eraserRadius / view.zoom, &changed)) {
+            redrawRegion(changed);
+        }
+        return;
+    }
+
+    // A single point draws nothing yet
+    drawing.beginStroke(point, pressure, getCurrentTime());
+    cache.revision = getActiveLayer().getRevision();
 }
 
 void DrawingApp::mouseDrag(MouseEvent event) {
-    vec2 pos = event.getPos();
+    if (isPanning) {
+        vec2 pos = event.getPos();
+        view.pan(vdraw::Vec2(pos.x - panFrom.x, pos.y - panFrom.y));
+        panFrom = pos;
+        invalidateCanvas();
+        return;
+    }
+
+    vdraw::Vec2 point = toDrawing(event.getPos());
     float pressure = 1.0f; // Default pressure if not available
 
 #if defined(CINDER_COCOA_TOUCH) //|| defined(CINDER_MSW_DESKTOP)
@@ -98,42 +174,112 @@ void DrawingApp::mouseDrag(MouseEvent event) {
     }
 #endif
 
-    drawing.continueStroke(vdraw::Vec2(pos.x, pos.y), pressure, getCurrentTime());
+    recordMouseEvent(InputEvent::MouseDrag, event, point, pressure);
+    LayerCache& cache = updateLayerCache(getActiveLayer());
 
-    // Draw the active stroke (with safety check)
+    if (eraserMode) {
+        vdraw::Bounds changed;
+        if (drawing.continueErase(point, &changed)) {
+            redrawRegion(changed);
+        }
+        return;
+    }
+
+    drawing.continueStroke(point, pressure, getCurrentTime());
+
+    // Draw the active stroke into the view, and into the active layer's tiles under its new
+    // end, rather than rendering them again (with safety check)
     const auto& strokes = drawing.getStrokes();
     if (!strokes.empty()) {
-        gl::ScopedFramebuffer fbScp(canvasFbo);
-        gl::ScopedViewport viewport(vec2(0), canvasFbo->getSize());
-        gl::ScopedMatrices matrices;
-        gl::setMatricesWindow(canvasFbo->getSize());
+        const vdraw::Stroke& stroke = *strokes.back();
+        const vdraw::Layer& layer = getActiveLayer();
 
-        // Only render the active stroke
-        renderStroke(*strokes.back());
+        // Under other layers the view is composited again from the tiles instead
+        if (!isActiveLayerOnTop()) {
+            invalidateCanvas();
+        }
+        else {
+            gl::ScopedFramebuffer fbScp(canvasFbo);
+            gl::ScopedViewport viewport(vec2(0), canvasFbo->getSize());
+            gl::ScopedMatrices matrices;
+            gl::setMatricesWindow(canvasFbo->getSize());
+            applyView();
+
+            // Only render the active stroke
+            renderStroke(stroke);
+        }
+
+        // The segments smoothing may have moved since the last drag
+        const auto& points = stroke.getProcessedPoints();
+        size_t window = static_cast<size_t>(stroke.getSmoothing()) + 2;
+        vdraw::Bounds changed;
+        for (size_t i = points.size() > window ? points.size() - window : 0; i < points.size(); ++i) {
+            changed.include(points[i].position, stroke.getWidthAt(i) * 0.5f + 1.0f);
+        }
+
+        drawnTiles.clear();
+        cache.tiles.invalidate(changed, vdraw::TiledCanvas::levelFor(view.zoom), drawnTiles);
+        for (vdraw::Tile* tile : drawnTiles) {
+            renderTile(cache, layer, *tile, &stroke);
+        }
+        cache.revision = layer.getRevision();
 
         // Reset color state to white
         gl::color(ColorA(1, 1, 1, 1));
+
+        invalidateCaptures();
     }
 }
 
 
 void DrawingApp::mouseUp(MouseEvent event) {
-    drawing.endStroke();
+    if (event.isRight()) {
+        isPanning = false;
+        return;
+    }
+
+    recordMouseEvent(InputEvent::MouseUp, event, toDrawing(event.getPos()), 1.0f);
+    if (drawing.isErasing()) {
+        drawing.endErase();
+    }
+    else {
+        drawing.endStroke();
+    }
 
     isMouseDown = false;
 }
 
+void DrawingApp::mouseWheel(MouseEvent event) {
+    // Zoom about the cursor
+    vec2 pos = event.getPos();
+    view.zoomAt(vdraw::Vec2(pos.x, pos.y), std::pow(1.1f, event.getWheelIncrement()), 1.0f / 16.0f, 16.0f);
+    invalidateCanvas();
+}
+
 void DrawingApp::keyDown(KeyEvent event) {
+    recordKeyEvent(event);
+
+    if (event.getCode() == KeyEvent::KEY_F9) {
+        toggleRecording();
+    }
+
     // Delegate to handler methods
     handleColorKeys(event);
     handleStrokeKeys(event);
     handleUndoRedoKeys(event);
+    handleLayerKeys(event);
 
-    // Handle clear drawing
+    // Handle clear drawing (of the active layer)
     if (event.getCode() == KeyEvent::KEY_DELETE ||
         event.getCode() == KeyEvent::KEY_BACKSPACE) {
         drawing.clearDrawing();
-        resetCanvas();
+        invalidateCanvas();
+    }
+
+    // Reset the view with Home
+    if (event.getCode() == KeyEvent::KEY_HOME) {
+        view = vdraw::ViewTransform();
+        invalidateCanvas();
     }
 
     if (event.getCode() == KeyEvent::KEY_p)
@@ -151,11 +297,68 @@ void DrawingApp::keyDown(KeyEvent event) {
     if (event.getCode() == KeyEvent::KEY_SPACE && (event.isControlDown() || event.isMetaDown())) {
         // Generate filename with timestamp
         auto timestamp = (int)time(nullptr);
-        std::string filename = "drawing_" + std::to_string(timestamp) + ".png";
+        std::string filename = "drawing_" + std::to_string(timestamp);
+
+        // Save drawing, plus the vector document so the session can be reloaded
+        saveDrawingToDisk(filename + ".png");
+        saveDocumentToDisk(filename + ".vdraw");
+    }
+
+    // Export the strokes as SVG and PDF for print with Ctrl+E
+    if (event.getCode() == KeyEvent::KEY_e && (event.isControlDown() || event.isMetaDown())) {
+        std::string filename = "drawing_" + std::to_string((int)time(nullptr));
+        exportVectorToDisk(filename + ".svg");
+        exportVectorToDisk(filename + ".pdf");
+    }
+
+    // Open a vector document with Ctrl+O
+    if (event.getCode() == KeyEvent::KEY_o && (event.isControlDown() || event.isMetaDown())) {
+        auto path = getOpenFilePath("", { "vdraw" });
+        if (!path.empty()) {
+            loadDocumentFromDisk(path.string());
+        }
+    }
+}
+
+void DrawingApp::recordMouseEvent(InputEvent::Type type, MouseEvent event, const vdraw::Vec2& position, float pressure) {
+    if (!recorder.isRecording()) return;
+
+    InputEvent input;
+    input.time = getCurrentTime();
+    input.type = type;
+    input.x = position.x;
+    input.y = position.y;
+    input.pressure = pressure;
+    input.modifiers = (event.isShiftDown() ? InputEvent::Shift : 0) | (event.isControlDown() ? InputEvent::Control : 0) |
+        (event.isAltDown() ? InputEvent::Alt : 0) | (event.isMetaDown() ? InputEvent::Meta : 0);
+    recorder.record(input);
+}
 
-        // Save drawing
-        saveDrawingToDisk(filename);
+void DrawingApp::recordKeyEvent(KeyEvent event) {
+    if (!recorder.isRecording()) return;
+
+    InputEvent input;
+    input.time = getCurrentTime();
+    input.type = InputEvent::KeyDown;
+    input.keyCode = event.getCode();
+    input.modifiers = (event.isShiftDown() ? InputEvent::Shift : 0) | (event.isControlDown() ? InputEvent::Control : 0) |
+        (event.isAltDown() ? InputEvent::Alt : 0) | (event.isMetaDown() ? InputEvent::Meta : 0);
+    recorder.record(input);
+}
+
+void DrawingApp::toggleRecording() {
+    if (!recorder.isRecording()) {
+        recorder.start();
+        console() << "Recording session..." << std::endl;
+        return;
     }
+
+    recorder.stop();
+    std::string filename = "session_" + std::to_string((int)time(nullptr)) + ".vsession";
+    if (recorder.save(filename))
+        console() << "Saved " << recorder.getEvents().size() << " events to: " << filename << std::endl;
+    else
+        console() << "Error saving session: " << filename << std::endl;
 }
 
 void DrawingApp::handleColorKeys(KeyEvent event) {
@@ -217,6 +420,15 @@ void DrawingApp::handleStrokeKeys(KeyEvent event) {
         drawing.setDynamicWidth(dynamicWidth);
         break;
 
+    case KeyEvent::KEY_e:
+        // Toggle the eraser, unless Ctrl/Cmd+E (export)
+        if (!(event.isControlDown() || event.isMetaDown())) {
+            drawing.endErase();
+            eraserMode = !eraserMode;
+            cout << "eraser " << (eraserMode ? "true" : "false") << endl;
+        }
+        break;
+
     case KeyEvent::KEY_a:
         // Only if not combined with Ctrl/Cmd
         if (!(event.isControlDown() || event.isMetaDown())) {
@@ -227,9 +439,11 @@ void DrawingApp::handleStrokeKeys(KeyEvent event) {
         break;
 
     case KeyEvent::KEY_z:
-        // Decrease smoothing
-        smoothingLevel = max(smoothingLevel - 1, 0);
-        drawing.setSmoothing(smoothingLevel);
+        // Decrease smoothing, unless Ctrl/Cmd+Z (undo)
+        if (!(event.isControlDown() || event.isMetaDown())) {
+            smoothingLevel = max(smoothingLevel - 1, 0);
+            drawing.setSmoothing(smoothingLevel);
+        }
         break;
     }
 }
@@ -238,25 +452,83 @@ void DrawingApp::handleUndoRedoKeys(KeyEvent event) {
     if (event.isControlDown() || event.isMetaDown()) {
         switch (event.getCode()) {
         case KeyEvent::KEY_z:
-            // Undo
+            // Undo, within the active layer
             drawing.undo();
-            resetCanvas();
+            invalidateCanvas();
             break;
 
         case KeyEvent::KEY_y:
             // Redo
             drawing.redo();
-            resetCanvas();
+            invalidateCanvas();
             break;
         }
     }
 }
 
+void DrawingApp::handleLayerKeys(KeyEvent event) {
+    if (event.isControlDown() || event.isMetaDown()) {
+        return;
+    }
+
+    size_t active = drawing.getActiveLayer();
+    switch (event.getCode()) {
+    case KeyEvent::KEY_l:
+        if (event.isShiftDown()) {
+            // Remove the active layer; its cache goes with the next composite
+            drawing.removeLayer(active);
+            syncLayerParams();
+        }
+        else {
+            // New layer on top, drawn on from now on
+            selectLayer(drawing.addLayer("Layer " + std::to_string(drawing.getLayerCount() + 1)));
+        }
+        invalidateCanvas();
+        break;
+
+    case KeyEvent::KEY_LEFTBRACKET:
+        if (active > 0) {
+            selectLayer(active - 1);
+        }
+        break;
+
+    case KeyEvent::KEY_RIGHTBRACKET:
+        selectLayer(active + 1);
+        break;
+
+    case KeyEvent::KEY_h:
+        // Hide or show the active layer
+        drawing.setLayerVisible(active, !drawing.getLayer(active).isVisible());
+        syncLayerParams();
+        invalidateCanvas();
+        break;
+    }
+}
+
+void DrawingApp::selectLayer(size_t index) {
+    drawing.setActiveLayer(std::min(index, drawing.getLayerCount() - 1));
+    syncLayerParams();
+    cout << "layer " << drawing.getActiveLayer() + 1 << " of " << drawing.getLayerCount() << endl;
+}
+
+void DrawingApp::syncLayerParams() {
+    const vdraw::Layer& layer = drawing.getLayer(drawing.getActiveLayer());
+    layerIndex = static_cast<int>(drawing.getActiveLayer());
+    layerVisible = layer.isVisible();
+    layerOpacity = layer.getOpacity();
+}
+
 void DrawingApp::update() {
-    // No per-frame updates needed
+    // The journal writes on its own thread, so its failures are picked up here
+    if (journal.hasFailed() && !journalFailureReported) {
+        console() << "Session journal write failed, recent changes may not be recoverable: " << journalFilename << std::endl;
+        journalFailureReported = true;
+    }
 }
 
 void DrawingApp::draw() {
+    ensureCanvas();
+
     // Clear the screen
     gl::clear(Color(1, 1, 1));
 
@@ -271,60 +543,188 @@ void DrawingApp::draw() {
 }
 
 void DrawingApp::resize() {
-    // Recreate FBO with new window size
+    // Recreate FBO with new window size. The view is composited again from the tiles, so
+    // it stays at full resolution rather than stretching the old pixels.
     auto windowSize = getWindowSize();
-    gl::Fbo::Format fboFormat;
-    fboFormat.colorTexture();
+    canvasFbo = gl::Fbo::create(windowSize.x, windowSize.y, canvasFormat());
+    invalidateCanvas();
+}
 
-    // Create new FBO
-    auto newFbo = gl::Fbo::create(windowSize.x, windowSize.y, fboFormat);
+void DrawingApp::resetCanvas() {
+    // Every tile of every layer is rendered again from the strokes when next shown
+    for (auto& entry : layerCaches) {
+        entry.second->tiles.invalidateAll();
+    }
+    invalidateCanvas();
+}
 
-    // Copy existing content if we had a previous FBO
-    if (canvasFbo) {
-        gl::ScopedFramebuffer fbScp(newFbo);
-        gl::ScopedViewport viewport(vec2(0), newFbo->getSize());
-        gl::ScopedMatrices matrices;
-        gl::setMatricesWindow(newFbo->getSize());
+void DrawingApp::redrawRegion(const vdraw::Bounds& region) {
+    if (region.isEmpty()) return;
+    auto found = layerCaches.find(getActiveLayer().getId());
+    if (found != layerCaches.end()) {
+        found->second->tiles.invalidate(region);
+        found->second->revision = getActiveLayer().getRevision();
+    }
+    invalidateCanvas();
+}
 
-        // Clear the new FBO to white
-        gl::clear(Color(1, 1, 1));
+DrawingApp::LayerCache& DrawingApp::updateLayerCache(const vdraw::Layer& layer) {
+    auto& cache = layerCaches[layer.getId()];
+    if (!cache) {
+        cache = std::make_unique<LayerCache>();
+    }
+    else if (cache->revision != layer.getRevision()) {
+        cache->tiles.invalidateAll();
+    }
+    cache->revision = layer.getRevision();
+    return *cache;
+}
+
+const vdraw::Layer& DrawingApp::getActiveLayer() const {
+    return drawing.getLayer(drawing.getActiveLayer());
+}
 
-        // Draw the old FBO content stretched to the new size
-        gl::draw(canvasFbo->getColorTexture(), newFbo->getBounds());
+bool DrawingApp::isActiveLayerOnTop() const {
+    size_t active = drawing.getActiveLayer();
+    const vdraw::Layer& layer = drawing.getLayer(active);
+    if (!layer.isVisible() || layer.getOpacity() < 1.0f) {
+        return false;
+    }
+    for (size_t i = active + 1; i < drawing.getLayerCount(); ++i) {
+        if (drawing.getLayer(i).isVisible()) {
+            return false;
+        }
     }
+    return true;
+}
 
-    // Replace the old FBO with the new one
-    canvasFbo = newFbo;
+void DrawingApp::invalidateCanvas() {
+    canvasDirty = true;
+    invalidateCaptures();
+}
 
-    // If we didn't have a previous FBO, make sure to initialize it
-    if (!canvasFbo) {
-        resetCanvas();
+void DrawingApp::ensureCanvas() {
+    if (canvasDirty) {
+        composeCanvas();
     }
 }
 
-void DrawingApp::resetCanvas() {
-    // Clear the canvas to transparent
+void DrawingApp::composeCanvas() {
+    double start = getElapsedSeconds();
+    PerfCounters& counters = PerfCounters::get();
+    auto size = canvasFbo->getSize();
+
+    // Drop the caches of removed layers
+    for (auto entry = layerCaches.begin(); entry != layerCaches.end();) {
+        bool found = false;
+        for (size_t i = 0; i < drawing.getLayerCount() && !found; ++i) {
+            found = drawing.getLayer(i).getId() == entry->first;
+        }
+        entry = found ? std::next(entry) : layerCaches.erase(entry);
+    }
+
     gl::ScopedFramebuffer fbScp(canvasFbo);
-    gl::ScopedViewport viewport(vec2(0), canvasFbo->getSize());
+    gl::ScopedViewport viewport(vec2(0), size);
     gl::ScopedMatrices matrices;
-    gl::setMatricesWindow(canvasFbo->getSize());
+    gl::setMatricesWindow(size);
+    gl::clear(ColorA(0, 0, 0, 0));
 
-    // Enable alpha blending within the FBO context
-    gl::enableAlphaBlending();
+    // Bottom layer first; hidden layers keep their tiles for when they are shown again
+    size_t rendered = 0;
+    for (size_t i = 0; i < drawing.getLayerCount(); ++i) {
+        const vdraw::Layer& layer = drawing.getLayer(i);
+        if (!layer.isVisible()) {
+            continue;
+        }
 
-    // Clear to transparent (R, G, B, Alpha)
-    gl::clear(ColorA(0, 0, 0, 0));
+        LayerCache& cache = updateLayerCache(layer);
+        int tileSize = cache.tiles.getTileSize();
+        visibleTiles.clear();
+        cache.tiles.acquire(view, (float)size.x, (float)size.y, visibleTiles);
 
-    // Redraw all strokes
-    for (const auto& stroke : drawing.getStrokes()) {
+        // Render the tiles that are new or out of date; a slot keeps its FBO across evictions
+        for (vdraw::Tile* tile : visibleTiles) {
+            if (tile->slot >= cache.tileFbos.size()) {
+                cache.tileFbos.resize(tile->slot + 1);
+            }
+            if (!cache.tileFbos[tile->slot]) {
+                cache.tileFbos[tile->slot] = gl::Fbo::create(tileSize, tileSize, canvasFormat());
+            }
+            if (tile->dirty) {
+                renderTile(cache, layer, *tile);
+                rendered++;
+            }
+        }
+
+        // Tiles of a layer don't overlap; layers blend over the ones below at their opacity
+        gl::enableAlphaBlending();
+        gl::color(ColorA(1, 1, 1, layer.getOpacity()));
+        for (const vdraw::Tile* tile : visibleTiles) {
+            vdraw::Vec2 topLeft = view.toScreen(tile->area.min);
+            vdraw::Vec2 bottomRight = view.toScreen(tile->area.max);
+            gl::draw(cache.tileFbos[tile->slot]->getColorTexture(), Rectf(topLeft.x, topLeft.y, bottomRight.x, bottomRight.y));
+        }
+        gl::disableAlphaBlending();
+    }
+    gl::color(ColorA(1, 1, 1, 1));
+
+    if (rendered > 0) {
+        counters.tileRender.add(static_cast<float>((getElapsedSeconds() - start) * 1000.0));
+    }
+
+    canvasDirty = false;
+    invalidateCaptures();
+
+    size_t resident = 0, bytes = 0;
+    for (const auto& entry : layerCaches) {
+        resident += entry.second->tiles.getResidentCount();
+        bytes += entry.second->tiles.getResidentBytes();
+    }
+    counters.tilesResident = static_cast<int>(resident);
+    counters.tileBytes = bytes;
+    counters.canvasRebuild.add(static_cast<float>((getElapsedSeconds() - start) * 1000.0));
+}
+
+void DrawingApp::renderTile(LayerCache& cache, const vdraw::Layer& layer, vdraw::Tile& tile, const vdraw::Stroke* stroke) {
+    int tileSize = cache.tiles.getTileSize();
+    gl::ScopedFramebuffer fbScp(cache.tileFbos[tile.slot]);
+    gl::ScopedViewport viewport(vec2(0), ivec2(tileSize));
+    gl::ScopedMatrices matrices;
+    gl::setMatricesWindow(tileSize, tileSize);
+    gl::scale(tile.scale, tile.scale);
+    gl::translate(-tile.area.min.x, -tile.area.min.y);
+
+    if (stroke) {
         renderStroke(*stroke);
+        return;
+    }
+
+    gl::enableAlphaBlending();
+    gl::clear(ColorA(0, 0, 0, 0));
+
+    // The layer's strokes crossing the tile, in drawing order, clipped by its viewport.
+    // Tiles below full resolution draw each at the detail they can show.
+    float tolerance = tile.scale < 1.0f ? vdraw::lodTolerance(tile.scale) : 0.0f;
+    tileStrokes.clear();
+    layer.queryStrokes(tile.area, tileStrokes);
+    for (const vdraw::Stroke* tileStroke : tileStrokes) {
+        renderStroke(*tileStroke, tolerance);
     }
 
-    // Restore blending state
     gl::disableAlphaBlending();
+    tile.dirty = false;
+}
+
+vdraw::Vec2 DrawingApp::toDrawing(const vec2& screen) const {
+    return view.toDrawing(vdraw::Vec2(screen.x, screen.y));
+}
+
+void DrawingApp::applyView() {
+    gl::scale(view.zoom, view.zoom);
+    gl::translate(-view.origin.x, -view.origin.y);
 }
 
-void DrawingApp::renderStroke(const vdraw::Stroke& stroke) {
+void DrawingApp::renderStroke(const vdraw::Stroke& stroke, float tolerance) {
     const auto& points = stroke.getProcessedPoints();
     if (points.size() < 2) return;
 
@@ -332,12 +732,18 @@ void DrawingApp::renderStroke(const vdraw::Stroke& stroke) {
     vdraw::Color color = stroke.getColor();
     gl::color(ColorA(color.r, color.g, color.b, color.a));
 
+    // The points to draw at this tolerance, or all of them
+    const vdraw::IndexBuffer* lod = stroke.getLod(tolerance);
+    size_t count = lod ? lod->size() : points.size();
+
     // For line segments
-    for (size_t i = 1; i < points.size(); ++i) {
-        const auto& p1 = points[i - 1];
+    for (size_t k = 1; k < count; ++k) {
+        size_t i = lod ? (*lod)[k] : k;
+        size_t previous = lod ? (*lod)[k - 1] : k - 1;
+        const auto& p1 = points[previous];
         const auto& p2 = points[i];
 
-        float width1 = stroke.getWidthAt(i - 1);
+        float width1 = stroke.getWidthAt(previous);
         float width2 = stroke.getWidthAt(i);
 
         // Draw line segment with varying width
@@ -467,21 +873,26 @@ ci::gl::TextureRef DrawingApp::convertTransparentFboToSolidTexture(const ci::gl:
 
 ci::gl::TextureRef DrawingApp::captureLatestStrokeAsTexture()
 {
+    // One FBO reused every frame while drawing, recreated when the window size changes
     auto windowSize = getWindowSize();
-    gl::Fbo::Format fboFormat;
-    fboFormat.colorTexture();
-    auto newFbo = gl::Fbo::create(windowSize.x, windowSize.y, fboFormat);
+    if (!liveStrokeFbo || liveStrokeFbo->getSize() != windowSize) {
+        gl::Fbo::Format fboFormat;
+        fboFormat.colorTexture();
+        liveStrokeFbo = gl::Fbo::create(windowSize.x, windowSize.y, fboFormat);
+    }
+
+    gl::ScopedFramebuffer fbScp(liveStrokeFbo);
+    gl::clear(ColorA(0, 0, 0, 0));
 
     // Draw the active stroke (with safety check)
     const auto& strokes = drawing.getStrokes();
     if (!strokes.empty()) {
-        gl::ScopedFramebuffer fbScp(newFbo);
-        gl::ScopedViewport viewport(vec2(0), newFbo->getSize());
+        gl::ScopedViewport viewport(vec2(0), liveStrokeFbo->getSize());
         gl::ScopedMatrices matrices;
-        gl::setMatricesWindow(newFbo->getSize());
+        gl::setMatricesWindow(liveStrokeFbo->getSize());
+        applyView();
+
 
-//        gl::clear(Color(1, 1, 1));
-        
         auto colorLive = vdraw::Color(137 / 255.f, 216 / 255.f, 238 / 255.f);
 
         auto activeStroke = *strokes.back();
@@ -495,18 +906,93 @@ ci::gl::TextureRef DrawingApp::captureLatestStrokeAsTexture()
         gl::color(ColorA(1, 1, 1, 1));
     }
 
-    return newFbo->getColorTexture();
+    return liveStrokeFbo->getColorTexture();
 }
 
 ci::gl::TextureRef DrawingApp::captureDrawingAsTexture(bool solid) {
+    ensureCanvas();
 
-    if (solid)
-        return convertTransparentFboToSolidTexture(canvasFbo);
-    else
+    if (!solid)
         return canvasFbo->getColorTexture();
+
+    // The composite is requested every frame for Spout, but only changes with the canvas
+    PerfCounters& counters = PerfCounters::get();
+    if (solidCanvasCache) {
+        counters.captureCache.hit();
+        return solidCanvasCache;
+    }
+
+    counters.captureCache.miss();
+    double start = getElapsedSeconds();
+    solidCanvasCache = convertTransparentFboToSolidTexture(canvasFbo);
+    counters.capture.add(static_cast<float>((getElapsedSeconds() - start) * 1000.0));
+
+    return solidCanvasCache;
+}
+
+ci::gl::TextureRef DrawingApp::captureDrawingAtSize(const ivec2& size) {
+    if (size == canvasFbo->getSize()) {
+        return captureDrawingAsTexture(true);
+    }
+
+    PerfCounters& counters = PerfCounters::get();
+    if (scaledCanvasValid && scaledCanvasFbo && scaledCanvasFbo->getSize() == size) {
+        counters.captureCache.hit();
+        return scaledCanvasFbo->getColorTexture();
+    }
+
+    counters.captureCache.miss();
+    double start = getElapsedSeconds();
+
+    if (!scaledCanvasFbo || scaledCanvasFbo->getSize() != size) {
+        scaledCanvasFbo = gl::Fbo::create(size.x, size.y, canvasFormat());
+    }
+
+    {
+        gl::ScopedFramebuffer fbScp(scaledCanvasFbo);
+        gl::ScopedViewport viewport(vec2(0), size);
+        gl::ScopedMatrices matrices;
+        gl::setMatricesWindow(size);
+
+        // The view scaled to the target, strokes at the detail that scale can show
+        vec2 scale = vec2(size) / vec2(canvasFbo->getSize());
+        gl::scale(scale.x, scale.y);
+        applyView();
+        float tolerance = vdraw::lodTolerance(std::max(scale.x, scale.y) * view.zoom);
+
+        // The visible layers bottom first, straight from the strokes; layer opacity only
+        // applies to the composited canvas
+        gl::enableAlphaBlending();
+        gl::clear(Color(1, 1, 1));
+        vdraw::Bounds area = view.visibleArea((float)canvasFbo->getWidth(), (float)canvasFbo->getHeight());
+        for (size_t i = 0; i < drawing.getLayerCount(); ++i) {
+            const vdraw::Layer& layer = drawing.getLayer(i);
+            if (!layer.isVisible()) {
+                continue;
+            }
+            tileStrokes.clear();
+            layer.queryStrokes(area, tileStrokes);
+            for (const vdraw::Stroke* stroke : tileStrokes) {
+                renderStroke(*stroke, tolerance);
+            }
+        }
+        gl::disableAlphaBlending();
+        gl::color(ColorA(1, 1, 1, 1));
+    }
+
+    scaledCanvasValid = true;
+    counters.capture.add(static_cast<float>((getElapsedSeconds() - start) * 1000.0));
+    return scaledCanvasFbo->getColorTexture();
+}
+
+void DrawingApp::invalidateCaptures() {
+    solidCanvasCache.reset();
+    scaledCanvasValid = false;
 }
 
 ci::Surface8u DrawingApp::captureDrawingAsSurface() {
+    ensureCanvas();
+
     // Create a surface of the appropriate size
     auto size = canvasFbo->getSize();
     ci::Surface8u result(size.x, size.y, true); // Use alpha channel
@@ -543,4 +1029,48 @@ void DrawingApp::saveDrawingToDisk(const std::string& filename) {
     catch (std::exception& e) {
         console() << "Error saving drawing: " << e.what() << std::endl;
     }
+}
+
+bool DrawingApp::exportVectorToDisk(const std::string& filename) {
+    // What the view shows, panned and zoomed
+    auto size = canvasFbo->getSize();
+    bool success = vdraw::VectorExporter::save(drawing, filename, view.visibleArea((float)size.x, (float)size.y));
+
+    if (success)
+        console() << "Exported drawing to: " << filename << std::endl;
+    else
+        console() << "Error exporting drawing: " << filename << std::endl;
+
+    return success;
+}
+
+bool DrawingApp::saveDocumentToDisk(const std::string& filename) {
+    bool success = vdraw::DrawingDocumentWriter::save(drawing, filename);
+
+    if (success)
+        console() << "Saved document to: " << filename << std::endl;
+    else
+        console() << "Error saving document: " << filename << std::endl;
+
+    return success;
+}
+
+bool DrawingApp::loadDocumentFromDisk(const std::string& filename) {
+    vdraw::DrawingDocument document;
+    if (!document.open(filename)) {
+        console() << "Error loading document: " << filename << std::endl;
+        return false;
+    }
+
+    // The document's layers replace the drawing's
+    while (drawing.getLayerCount() > 1) {
+        drawing.removeLayer(drawing.getLayerCount() - 1);
+    }
+    drawing.clearDrawing();
+    document.loadInto(drawing);
+    syncLayerParams();
+    resetCanvas();
+
+    console() << "Loaded " << document.getStrokeCount() << " strokes from: " << filename << std::endl;
+    return true;
 }
\ No newline at end of file
@@ -8,9 +8,15 @@
 #include "cinder/params/Params.h"
 
 #include "VectorDrawing.h"
+#include "SessionJournal.h"
+#include "SessionRecording.h"
+#include "PerfCounters.h"
+#include "TiledCanvas.h"
 
 #include <Windows.h>
+#include <memory>
 #include <string>
+#include <unordered_map>
 
 using namespace std;
 class DrawingApp : public CinderApp {
@@ -22,6 +28,7 @@ public:
     void mouseDown(ci::app::MouseEvent event) override;
     void mouseDrag(ci::app::MouseEvent event) override;
     void mouseUp(ci::app::MouseEvent event) override;
+    void mouseWheel(ci::app::MouseEvent event) override;
     void keyDown(ci::app::KeyEvent event) override;
     void update() override;
     void draw() override;
@@ -39,20 +46,85 @@ public:
         const ci::ColorA& backgroundColor = ci::ColorA(1, 1, 1, 1));
 
 
+    // The active layer's last stroke highlighted, over transparent
     ci::gl::TextureRef captureLatestStrokeAsTexture();
 
     // Create texture/surface from drawing
     ci::gl::TextureRef captureDrawingAsTexture(bool solid = false);
+
+    // The view rendered on white straight at size, e.g. 512x512 for Spout, with each
+    // stroke at the level of detail the scale can show. Cached until the canvas changes.
+    ci::gl::TextureRef captureDrawingAtSize(const ci::ivec2& size);
     ci::Surface8u captureDrawingAsSurface();
     void saveDrawingToDisk(const std::string& filename);
 
+    // Resolution-independent SVG or PDF (by extension) of the strokes, streamed to disk
+    bool exportVectorToDisk(const std::string& filename);
+
+    // Vector document (.vdraw) persistence
+    bool saveDocumentToDisk(const std::string& filename);
+    bool loadDocumentFromDisk(const std::string& filename);
+
 protected:
     // Core drawing functionality
     vdraw::Drawing drawing;
 
-    // FBO for capturing drawing
+    // Crash-safe journal of the drawing (declared after it so it detaches first)
+    vdraw::SessionJournal journal;
+    std::string journalFilename;
+    bool journalFailureReported;
+
+    // Input recording for deterministic replay (F9 toggles)
+    SessionRecorder recorder;
+    // Recorded at position in drawing coordinates, so replay doesn't depend on the view
+    void recordMouseEvent(InputEvent::Type type, ci::app::MouseEvent event, const vdraw::Vec2& position, float pressure);
+    void recordKeyEvent(ci::app::KeyEvent event);
+    void toggleRecording();
+
+    // FBO for capturing drawing: the view composited from the tiles, sized to the window
     ci::gl::FboRef canvasFboTransparent;
     ci::gl::FboRef canvasFbo;
+    bool canvasDirty;
+
+    // Raster backing store of one layer of the infinite canvas, one FBO per tile slot.
+    // Tiles are rendered from the layer's strokes on demand, so memory follows the area
+    // viewed rather than the drawing's extent.
+    struct LayerCache {
+        vdraw::TiledCanvas tiles;
+        std::vector<ci::gl::FboRef> tileFbos;
+        uint64_t revision = 0;  // Of the layer, when the tiles were last brought up to date
+    };
+
+    // Keyed by vdraw::Layer::getId. A layer whose revision moved on without the cache
+    // following has all its tiles rendered again, while the other layers keep theirs.
+    std::unordered_map<uint64_t, std::unique_ptr<LayerCache>> layerCaches;
+
+    // The layer's cache, every tile dirtied if the layer changed since it was last brought
+    // up to date. Incremental updates call this before changing the layer and set the
+    // revision after drawing the change into the tiles.
+    LayerCache& updateLayerCache(const vdraw::Layer& layer);
+    const vdraw::Layer& getActiveLayer() const;
+    std::vector<vdraw::Tile*> visibleTiles;
+    std::vector<vdraw::Tile*> drawnTiles;
+    std::vector<const vdraw::Stroke*> tileStrokes;
+
+    // Pan (right drag), zoom (wheel) and reset (Home)
+    vdraw::ViewTransform view;
+    bool isPanning;
+    ci::vec2 panFrom;
+    vdraw::Vec2 toDrawing(const ci::vec2& screen) const;
+    void applyView();
+
+    // Target of captureLatestStrokeAsTexture
+    ci::gl::FboRef liveStrokeFbo;
+
+    // Opaque copy of the canvas, reset whenever canvasFbo is drawn to
+    ci::gl::TextureRef solidCanvasCache;
+
+    // Rendering for captureDrawingAtSize, valid until the canvas changes
+    ci::gl::FboRef scaledCanvasFbo;
+    bool scaledCanvasValid;
+    void invalidateCaptures();
 
     bool isMouseDown;
 
@@ -62,15 +134,46 @@ protected:
     int smoothingLevel;
     bool dynamicWidth;
 
+    // Eraser mode (E): dragging erases ink instead of drawing
+    bool eraserMode;
+    float eraserRadius;
+
     bool showDrawing;
 
     ci::params::InterfaceGlRef params;
 
     // Helper methods
     double getCurrentTime();
-    virtual void renderStroke(const vdraw::Stroke& stroke);
+    // tolerance > 0 draws the stroke's level of detail, see vdraw::Stroke::getLod
+    virtual void renderStroke(const vdraw::Stroke& stroke, float tolerance = 0.0f);
     virtual void resetCanvas();
 
+    // Re-renders only the active layer's tiles within region, e.g. after erasing there. The
+    // layer must not have changed elsewhere since its cache was last brought up to date.
+    void redrawRegion(const vdraw::Bounds& region);
+
+    // Renders the dirty tiles of the view and composites the visible layers into canvasFbo
+    void composeCanvas();
+    void ensureCanvas();
+
+    // The view must be composited again, e.g. after panning or a tile changed
+    void invalidateCanvas();
+
+    // Renders the layer's strokes over the tile, or just draws stroke into it when given
+    void renderTile(LayerCache& cache, const vdraw::Layer& layer, vdraw::Tile& tile, const vdraw::Stroke* stroke = nullptr);
+
+    // Whether the active layer shows unblended above every other, so new ink can be drawn
+    // straight into the composited view
+    bool isActiveLayerOnTop() const;
+
+    // Layers: L adds one (Shift+L removes the active one), [ and ] select, H hides/shows
+    int layerIndex;
+    bool layerVisible;
+    float layerOpacity;
+    void selectLayer(size_t index);
+    void syncLayerParams();
+    virtual void handleLayerKeys(ci::app::KeyEvent event);
+
     // Initialize UI parameters
     virtual void setupParams();
 
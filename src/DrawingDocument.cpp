@@ -0,0 +1,429 @@
+// DrawingDocument.cpp
+#include "DrawingDocument.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace vdraw {
+
+    // Points are written and mapped in their in-memory layout
+    static_assert(sizeof(StrokePoint) == 24, "StrokePoint layout changed, bump document::version");
+    static_assert(offsetof(StrokePoint, position) == 0, "StrokePoint layout changed, bump document::version");
+    static_assert(offsetof(StrokePoint, pressure) == 8, "StrokePoint layout changed, bump document::version");
+    static_assert(offsetof(StrokePoint, timestamp) == 16, "StrokePoint layout changed, bump document::version");
+    static_assert(std::is_trivially_copyable<StrokePoint>::value, "StrokePoint must be trivially copyable");
+    static_assert(sizeof(document::DocumentHeader) == 48, "Unexpected header padding");
+    static_assert(sizeof(document::StyleRecord) == 32, "Unexpected style record padding");
+    static_assert(sizeof(document::StrokeRecord) == 32, "Unexpected stroke record padding");
+    static_assert(sizeof(document::LayerRecord) == 64, "Unexpected layer record padding");
+
+    //-------------------------------------------------------------------------
+    // StrokeView Implementation
+    //-------------------------------------------------------------------------
+    float StrokeView::getWidthAt(size_t index) const {
+        return computeWidthAt(processedPoints, processedCount, index, baseWidth, dynamicWidth);
+    }
+
+    //-------------------------------------------------------------------------
+    // MappedFile Implementation
+    //-------------------------------------------------------------------------
+#ifdef _WIN32
+    MappedFile::MappedFile()
+        : mappedData(nullptr), mappedSize(0), fileHandle(INVALID_HANDLE_VALUE), mappingHandle(nullptr) {
+    }
+#else
+    MappedFile::MappedFile()
+        : mappedData(nullptr), mappedSize(0), fileDescriptor(-1) {
+    }
+#endif
+
+    MappedFile::~MappedFile() {
+        close();
+    }
+
+    bool MappedFile::open(const std::string& path) {
+        close();
+
+#ifdef _WIN32
+        fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (fileHandle == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0) {
+            close();
+            return false;
+        }
+
+        mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mappingHandle) {
+            close();
+            return false;
+        }
+
+        mappedData = static_cast<const uint8_t*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+        mappedSize = static_cast<size_t>(fileSize.QuadPart);
+#else
+        fileDescriptor = ::open(path.c_str(), O_RDONLY);
+        if (fileDescriptor < 0) {
+            return false;
+        }
+
+        struct stat fileStat;
+        if (fstat(fileDescriptor, &fileStat) != 0 || fileStat.st_size == 0) {
+            close();
+            return false;
+        }
+
+        void* mapping = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+        mappedData = mapping == MAP_FAILED ? nullptr : static_cast<const uint8_t*>(mapping);
+        mappedSize = static_cast<size_t>(fileStat.st_size);
+#endif
+
+        if (!mappedData) {
+            close();
+            return false;
+        }
+
+        return true;
+    }
+
+    void MappedFile::close() {
+#ifdef _WIN32
+        if (mappedData) UnmapViewOfFile(mappedData);
+        if (mappingHandle) CloseHandle(mappingHandle);
+        if (fileHandle != INVALID_HANDLE_VALUE) CloseHandle(fileHandle);
+        mappingHandle = nullptr;
+        fileHandle = INVALID_HANDLE_VALUE;
+#else
+        if (mappedData) munmap(const_cast<uint8_t*>(mappedData), mappedSize);
+        if (fileDescriptor >= 0) ::close(fileDescriptor);
+        fileDescriptor = -1;
+#endif
+        mappedData = nullptr;
+        mappedSize = 0;
+    }
+
+    const uint8_t* MappedFile::data() const {
+        return mappedData;
+    }
+
+    size_t MappedFile::size() const {
+        return mappedSize;
+    }
+
+    //-------------------------------------------------------------------------
+    // DrawingDocumentWriter Implementation
+    //-------------------------------------------------------------------------
+    DrawingDocumentWriter::DrawingDocumentWriter()
+        : file(nullptr), offset(0), pointCount(0), failed(false) {
+    }
+
+    DrawingDocumentWriter::~DrawingDocumentWriter() {
+        close();
+    }
+
+    bool DrawingDocumentWriter::open(const std::string& path) {
+        close();
+
+        file = fopen(path.c_str(), "wb");
+        if (!file) {
+            return false;
+        }
+
+        offset = 0;
+        pointCount = 0;
+        failed = false;
+        styles.clear();
+        strokeRecords.clear();
+        layerRecords.clear();
+
+        // Placeholder, rewritten with the final counts and offsets on close
+        document::DocumentHeader header = {};
+        return write(&header, sizeof(header));
+    }
+
+    bool DrawingDocumentWriter::writeLayer(const Layer& layer) {
+        if (!file) {
+            return false;
+        }
+
+        document::LayerRecord record = {};
+        record.opacity = layer.getOpacity();
+        record.visible = layer.isVisible() ? 1 : 0;
+        const std::string& name = layer.getName();
+        memcpy(record.name, name.data(), std::min(name.size(), sizeof(record.name) - 1));
+        layerRecords.push_back(record);
+        return true;
+    }
+
+    bool DrawingDocumentWriter::writeStroke(const Stroke& stroke, uint32_t layer) {
+        if (!file || stroke.isEmpty()) {
+            return false;
+        }
+
+        const auto& raw = stroke.getRawPoints();
+        const auto& processed = stroke.getProcessedPoints();
+
+        document::StrokeRecord record = {};
+        record.rawOffset = offset;
+        record.rawCount = static_cast<uint32_t>(raw.size());
+        write(raw.data(), raw.size() * sizeof(StrokePoint));
+
+        record.processedOffset = offset;
+        record.processedCount = static_cast<uint32_t>(processed.size());
+        write(processed.data(), processed.size() * sizeof(StrokePoint));
+
+        record.styleIndex = styleIndexFor(stroke);
+        record.layer = layer;
+        strokeRecords.push_back(record);
+        pointCount += raw.size();
+
+        return !failed;
+    }
+
+    bool DrawingDocumentWriter::close() {
+        if (!file) {
+            return false;
+        }
+
+        document::DocumentHeader header = {};
+        header.magic = document::magic;
+        header.version = document::version;
+        header.pointSize = sizeof(StrokePoint);
+        header.strokeCount = static_cast<uint32_t>(strokeRecords.size());
+        header.styleCount = static_cast<uint32_t>(styles.size());
+        header.layerCount = static_cast<uint32_t>(layerRecords.size());
+        header.pointCount = pointCount;
+
+        header.styleTableOffset = offset;
+        write(styles.data(), styles.size() * sizeof(document::StyleRecord));
+
+        header.strokeTableOffset = offset;
+        write(strokeRecords.data(), strokeRecords.size() * sizeof(document::StrokeRecord));
+        write(layerRecords.data(), layerRecords.size() * sizeof(document::LayerRecord));
+
+        if (fseek(file, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, file) != 1) {
+            failed = true;
+        }
+
+        if (fclose(file) != 0) {
+            failed = true;
+        }
+        file = nullptr;
+
+        return !failed;
+    }
+
+    bool DrawingDocumentWriter::isOpen() const {
+        return file != nullptr;
+    }
+
+    bool DrawingDocumentWriter::save(const Drawing& drawing, const std::string& path) {
+        DrawingDocumentWriter writer;
+        if (!writer.open(path)) {
+            return false;
+        }
+
+        for (size_t i = 0; i < drawing.getLayerCount(); ++i) {
+            const Layer& layer = drawing.getLayer(i);
+            writer.writeLayer(layer);
+            for (const Stroke* stroke : layer.getStrokes()) {
+                writer.writeStroke(*stroke, static_cast<uint32_t>(i));
+            }
+        }
+
+        return writer.close();
+    }
+
+    bool DrawingDocumentWriter::write(const void* data, size_t bytes) {
+        if (bytes > 0 && fwrite(data, 1, bytes, file) != bytes) {
+            failed = true;
+        }
+        offset += bytes;
+        return !failed;
+    }
+
+    uint32_t DrawingDocumentWriter::styleIndexFor(const Stroke& stroke) {
+        Color color = stroke.getColor();
+
+        document::StyleRecord style = {};
+        style.r = color.r;
+        style.g = color.g;
+        style.b = color.b;
+        style.a = color.a;
+        style.baseWidth = stroke.getBaseWidth();
+        style.dynamicWidth = stroke.getDynamicWidth() ? 1 : 0;
+        style.smoothing = stroke.getSmoothing();
+
+        // Few distinct styles per session, so a linear search is enough
+        for (size_t i = 0; i < styles.size(); ++i) {
+            if (memcmp(&styles[i], &style, sizeof(style)) == 0) {
+                return static_cast<uint32_t>(i);
+            }
+        }
+
+        styles.push_back(style);
+        return static_cast<uint32_t>(styles.size() - 1);
+    }
+
+    //-------------------------------------------------------------------------
+    // DrawingDocument Implementation
+    //-------------------------------------------------------------------------
+    DrawingDocument::DrawingDocument()
+        : header(nullptr), styles(nullptr), strokeRecords(nullptr), layerRecords(nullptr) {
+    }
+
+    bool DrawingDocument::open(const std::string& path) {
+        close();
+
+        if (!file.open(path)) {
+            return false;
+        }
+
+        if (!validate()) {
+            close();
+            return false;
+        }
+
+        const uint8_t* base = file.data();
+        header = reinterpret_cast<const document::DocumentHeader*>(base);
+        styles = reinterpret_cast<const document::StyleRecord*>(base + header->styleTableOffset);
+        strokeRecords = reinterpret_cast<const document::StrokeRecord*>(base + header->strokeTableOffset);
+        layerRecords = header->layerCount > 0 ?
+            reinterpret_cast<const document::LayerRecord*>(strokeRecords + header->strokeCount) : nullptr;
+        return true;
+    }
+
+    void DrawingDocument::close() {
+        file.close();
+        header = nullptr;
+        styles = nullptr;
+        strokeRecords = nullptr;
+        layerRecords = nullptr;
+    }
+
+    bool DrawingDocument::isOpen() const {
+        return header != nullptr;
+    }
+
+    size_t DrawingDocument::getStrokeCount() const {
+        return header ? header->strokeCount : 0;
+    }
+
+    size_t DrawingDocument::getPointCount() const {
+        return header ? static_cast<size_t>(header->pointCount) : 0;
+    }
+
+    StrokeView DrawingDocument::getStroke(size_t index) const {
+        const document::StrokeRecord& record = strokeRecords[index];
+        const document::StyleRecord& style = styles[record.styleIndex];
+        const uint8_t* base = file.data();
+
+        StrokeView view;
+        view.rawPoints = reinterpret_cast<const StrokePoint*>(base + record.rawOffset);
+        view.rawCount = record.rawCount;
+        view.processedPoints = reinterpret_cast<const StrokePoint*>(base + record.processedOffset);
+        view.processedCount = record.processedCount;
+        view.color = Color(style.r, style.g, style.b, style.a);
+        view.baseWidth = style.baseWidth;
+        view.dynamicWidth = style.dynamicWidth != 0;
+        view.smoothing = style.smoothing;
+        view.layer = record.layer;
+        return view;
+    }
+
+    size_t DrawingDocument::getLayerCount() const {
+        return header && header->layerCount > 0 ? header->layerCount : 1;
+    }
+
+    LayerView DrawingDocument::getLayer(size_t index) const {
+        LayerView view;
+        view.visible = true;
+        view.opacity = 1.0f;
+        if (layerRecords) {
+            const document::LayerRecord& record = layerRecords[index];
+            view.name.assign(record.name, std::find(record.name, record.name + sizeof(record.name), '\0'));
+            view.visible = record.visible != 0;
+            view.opacity = record.opacity;
+        }
+        return view;
+    }
+
+    void DrawingDocument::forEachStroke(const std::function<void(const StrokeView&)>& callback) const {
+        for (size_t i = 0; i < getStrokeCount(); ++i) {
+            callback(getStroke(i));
+        }
+    }
+
+    void DrawingDocument::loadInto(Drawing& drawing) const {
+        size_t active = drawing.getActiveLayer();
+        std::vector<size_t> targets;
+        for (size_t i = 0; i < getLayerCount(); ++i) {
+            LayerView layer = getLayer(i);
+            targets.push_back(i == 0 ? active : drawing.addLayer(layer.name));
+            drawing.setLayerVisible(targets.back(), layer.visible);
+            drawing.setLayerOpacity(targets.back(), layer.opacity);
+        }
+
+        // Strokes are written layer by layer, so this switches once per layer
+        forEachStroke([&drawing, &targets](const StrokeView& view) {
+            drawing.setActiveLayer(targets[view.layer]);
+            drawing.addStroke(view.rawPoints, view.rawCount, view.color, view.baseWidth,
+                view.dynamicWidth, view.smoothing);
+        });
+        drawing.setActiveLayer(active);
+    }
+
+    bool DrawingDocument::validate() const {
+        const uint8_t* base = file.data();
+        uint64_t size = file.size();
+
+        if (size < sizeof(document::DocumentHeader)) {
+            return false;
+        }
+
+        const auto* h = reinterpret_cast<const document::DocumentHeader*>(base);
+        if (h->magic != document::magic || h->version < 1 || h->version > document::version || h->pointSize != sizeof(StrokePoint)) {
+            return false;
+        }
+        uint32_t layerCount = h->version >= 2 ? h->layerCount : 0;
+
+        // Tables and point blocks must lie inside the file and be aligned for in-place access
+        auto inBounds = [size](uint64_t offset, uint64_t count, uint64_t elementSize) {
+            return offset % 8 == 0 && offset <= size && count <= (size - offset) / elementSize;
+        };
+
+        if (!inBounds(h->styleTableOffset, h->styleCount, sizeof(document::StyleRecord)) ||
+            !inBounds(h->strokeTableOffset, h->strokeCount, sizeof(document::StrokeRecord)) ||
+            !inBounds(h->strokeTableOffset + static_cast<uint64_t>(h->strokeCount) * sizeof(document::StrokeRecord), layerCount,
+                sizeof(document::LayerRecord))) {
+            return false;
+        }
+
+        const auto* records = reinterpret_cast<const document::StrokeRecord*>(base + h->strokeTableOffset);
+        for (uint32_t i = 0; i < h->strokeCount; ++i) {
+            if (records[i].styleIndex >= h->styleCount || records[i].layer >= std::max<uint32_t>(layerCount, 1) ||
+                !inBounds(records[i].rawOffset, records[i].rawCount, sizeof(StrokePoint)) ||
+                !inBounds(records[i].processedOffset, records[i].processedCount, sizeof(StrokePoint))) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+} // namespace vdraw
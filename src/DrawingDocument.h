@@ -0,0 +1,182 @@
+// DrawingDocument.h
+#pragma once
+
+#include "VectorDrawing.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace vdraw {
+
+    // Binary stroke document (.vdraw), little-endian, every block 8-byte aligned:
+    //
+    //   DocumentHeader
+    //   point blocks     raw and processed StrokePoints of each stroke, stored contiguously
+    //   style table      StyleRecord[styleCount]
+    //   stroke table     StrokeRecord[strokeCount]
+    //   layer table      LayerRecord[layerCount], right after the stroke table (version 2)
+    //
+    // Points are stored in their in-memory layout so a mapped document can be read in place.
+    // Version 1 documents have no layers and read as a single layer.
+    namespace document {
+
+        const uint32_t magic = 0x57524456;  // "VDRW"
+        const uint32_t version = 2;
+
+        struct DocumentHeader {
+            uint32_t magic;
+            uint32_t version;
+            uint32_t pointSize;
+            uint32_t strokeCount;
+            uint32_t styleCount;
+            uint32_t layerCount;        // Reserved (0) in version 1
+            uint64_t styleTableOffset;
+            uint64_t strokeTableOffset;
+            uint64_t pointCount;
+        };
+
+        struct StyleRecord {
+            float r, g, b, a;
+            float baseWidth;
+            uint32_t dynamicWidth;
+            int32_t smoothing;
+            uint32_t reserved;
+        };
+
+        struct StrokeRecord {
+            uint64_t rawOffset;
+            uint64_t processedOffset;
+            uint32_t rawCount;
+            uint32_t processedCount;
+            uint32_t styleIndex;
+            uint32_t layer;             // Reserved (0) in version 1
+        };
+
+        struct LayerRecord {
+            float opacity;
+            uint32_t visible;
+            uint32_t reserved[2];
+            char name[48];              // Null-terminated, truncated to fit
+        };
+
+    } // namespace document
+
+    // Read-only stroke whose points live in a mapped document
+    struct StrokeView {
+        const StrokePoint* rawPoints;
+        size_t rawCount;
+        const StrokePoint* processedPoints;
+        size_t processedCount;
+        Color color;
+        float baseWidth;
+        bool dynamicWidth;
+        int smoothing;
+        size_t layer;
+
+        float getWidthAt(size_t index) const;
+    };
+
+    struct LayerView {
+        std::string name;
+        bool visible;
+        float opacity;
+    };
+
+    // Read-only file mapping
+    class MappedFile {
+    public:
+        MappedFile();
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        bool open(const std::string& path);
+        void close();
+
+        const uint8_t* data() const;
+        size_t size() const;
+
+    private:
+        const uint8_t* mappedData;
+        size_t mappedSize;
+#ifdef _WIN32
+        void* fileHandle;
+        void* mappingHandle;
+#else
+        int fileDescriptor;
+#endif
+    };
+
+    // Writes a document incrementally: point blocks are appended as strokes are written,
+    // the tables and header are written on close()
+    class DrawingDocumentWriter {
+    public:
+        DrawingDocumentWriter();
+        ~DrawingDocumentWriter();
+
+        DrawingDocumentWriter(const DrawingDocumentWriter&) = delete;
+        DrawingDocumentWriter& operator=(const DrawingDocumentWriter&) = delete;
+
+        bool open(const std::string& path);
+
+        // Layers are numbered in the order they are written; strokes name theirs
+        bool writeLayer(const Layer& layer);
+        bool writeStroke(const Stroke& stroke, uint32_t layer = 0);
+        bool close();
+
+        bool isOpen() const;
+
+        // Write every layer of a drawing and its strokes to path
+        static bool save(const Drawing& drawing, const std::string& path);
+
+    private:
+        FILE* file;
+        uint64_t offset;
+        uint64_t pointCount;
+        bool failed;
+        std::vector<document::StyleRecord> styles;
+        std::vector<document::StrokeRecord> strokeRecords;
+        std::vector<document::LayerRecord> layerRecords;
+
+        bool write(const void* data, size_t bytes);
+        uint32_t styleIndexFor(const Stroke& stroke);
+    };
+
+    // A mapped document. Strokes are exposed as views into the mapping without copying;
+    // loadInto() copies them into a Drawing for editing.
+    class DrawingDocument {
+    public:
+        DrawingDocument();
+
+        bool open(const std::string& path);
+        void close();
+
+        bool isOpen() const;
+        size_t getStrokeCount() const;
+        size_t getPointCount() const;
+        StrokeView getStroke(size_t index) const;
+
+        // At least one; a version 1 document has a single unnamed layer
+        size_t getLayerCount() const;
+        LayerView getLayer(size_t index) const;
+
+        void forEachStroke(const std::function<void(const StrokeView&)>& callback) const;
+
+        // Append the document's strokes to a drawing: the first layer's to the active layer,
+        // the others' to layers added on top, which keeps the active layer
+        void loadInto(Drawing& drawing) const;
+
+    private:
+        MappedFile file;
+        const document::DocumentHeader* header;
+        const document::StyleRecord* styles;
+        const document::StrokeRecord* strokeRecords;
+        const document::LayerRecord* layerRecords;
+
+        bool validate() const;
+    };
+
+} // namespace vdraw
@@ -0,0 +1,14 @@
+#include "InferenceBackend.h"
+
+OllamaHttpBackend::OllamaHttpBackend(const std::string& host, int port)
+    : client(host, port) {
+}
+
+std::string OllamaHttpBackend::getName() const {
+    return "ollama http " + client.getHost() + ":" + std::to_string(client.getPort());
+}
+
+bool OllamaHttpBackend::generate(const InferenceRequest& request, const FragmentCallback& onFragment,
+    std::string& response, std::string& error) {
+    return client.generate(request.model, request.prompt, request.images, onFragment, response, error);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "StreamingInference.h"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// One vision or text generation. Images are base64 encoded (PNG or JPEG), as the Ollama API takes them.
+struct InferenceRequest {
+    std::string model;
+    std::string prompt;
+    std::vector<std::string> images;
+    uint64_t requestId;     // Tracing id of the interpretation this belongs to
+
+    InferenceRequest() : requestId(0) {}
+};
+
+// Vision/text model behind the interpretation pipeline. generate() blocks until the
+// response is complete, so callers run it on a worker thread; backends must allow
+// concurrent calls.
+class InferenceBackend {
+public:
+    // Receives each generated fragment as it arrives, backends that can't stream pass the whole response once
+    typedef std::function<void(const std::string& fragment)> FragmentCallback;
+
+    virtual ~InferenceBackend() = default;
+
+    virtual std::string getName() const = 0;
+
+    // Returns the complete response, or false with error set
+    virtual bool generate(const InferenceRequest& request, const FragmentCallback& onFragment,
+        std::string& response, std::string& error) = 0;
+};
+
+typedef std::shared_ptr<InferenceBackend> InferenceBackendRef;
+
+// Talks to an Ollama server (or MockOllamaServer) over HTTP, streaming when enabled
+class OllamaHttpBackend : public InferenceBackend {
+public:
+    OllamaHttpBackend(const std::string& host = "127.0.0.1", int port = 11434);
+
+    std::string getName() const override;
+    bool generate(const InferenceRequest& request, const FragmentCallback& onFragment,
+        std::string& response, std::string& error) override;
+
+    // Configure before sharing the backend between threads
+    OllamaStreamClient& getClient() { return client; }
+
+private:
+    OllamaStreamClient client;
+};
@@ -0,0 +1,141 @@
+#include "InferenceStage.h"
+#include "PerfCounters.h"
+
+#include <algorithm>
+
+InferenceStage::InferenceStage(const std::string& name, int maxInFlight)
+    : name(name), maxInFlight(std::max(1, maxInFlight)), nextSequence(0), lastDelivered(0), hasWaiting(false) {
+    stats = Stats();
+}
+
+uint64_t InferenceStage::submit(const Launch& launch, const Deliver& deliver) {
+    PerfCounters& counters = PerfCounters::get();
+    std::unique_lock<std::mutex> lock(mutex);
+
+    uint64_t sequence = ++nextSequence;
+    stats.submitted++;
+
+    if (static_cast<int>(inFlight.size()) < maxInFlight) {
+        inFlight[sequence] = deliver;
+        stats.launched++;
+        lock.unlock();
+
+        counters.inferenceInFlight++;
+        launch(sequence);
+        return sequence;
+    }
+
+    if (hasWaiting) {
+        stats.coalesced++;
+        counters.inferenceCoalesced++;
+    }
+    else {
+        counters.inferencePending++;
+    }
+
+    waiting.sequence = sequence;
+    waiting.launch = launch;
+    waiting.deliver = deliver;
+    hasWaiting = true;
+
+    return sequence;
+}
+
+void InferenceStage::complete(uint64_t sequence, const std::string& result, bool ok) {
+    PerfCounters& counters = PerfCounters::get();
+    Deliver deliver;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = inFlight.find(sequence);
+        if (it == inFlight.end()) return;
+
+        deliver = std::move(it->second);
+        inFlight.erase(it);
+    }
+    counters.inferenceInFlight--;
+
+    if (!ok || result.empty()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stats.failed++;
+        }
+        launchWaiting();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> deliverLock(deliverMutex);
+
+        bool stale;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stale = sequence < lastDelivered;
+            if (stale) {
+                stats.stale++;
+            }
+            else {
+                lastDelivered = sequence;
+                stats.delivered++;
+            }
+        }
+
+        if (stale) {
+            counters.inferenceStale++;
+        }
+        else if (deliver) {
+            deliver(result);
+        }
+    }
+
+    launchWaiting();
+}
+
+void InferenceStage::launchWaiting() {
+    Request request;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!hasWaiting || static_cast<int>(inFlight.size()) >= maxInFlight) return;
+
+        request = std::move(waiting);
+        waiting = Request();
+        hasWaiting = false;
+        inFlight[request.sequence] = request.deliver;
+        stats.launched++;
+    }
+
+    PerfCounters::get().inferencePending--;
+    PerfCounters::get().inferenceInFlight++;
+    request.launch(request.sequence);
+}
+
+void InferenceStage::setMaxInFlight(int maxInFlight) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->maxInFlight = std::max(1, maxInFlight);
+    }
+    launchWaiting();
+}
+
+int InferenceStage::getMaxInFlight() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return maxInFlight;
+}
+
+const std::string& InferenceStage::getName() const {
+    return name;
+}
+
+uint64_t InferenceStage::getLastDelivered() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return lastDelivered;
+}
+
+InferenceStage::Stats InferenceStage::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    Stats current = stats;
+    current.inFlight = static_cast<int>(inFlight.size());
+    current.waiting = hasWaiting;
+    return current;
+}
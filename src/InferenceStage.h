@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+
+// One stage of the interpretation pipeline (vision description, semantic averaging).
+// Requests are numbered in submission order and at most maxInFlight run at once. A request
+// submitted while the stage is full waits, replacing any request already waiting, so the
+// stage catches up with the newest input instead of working through a backlog. Results
+// that arrive after a newer result has been delivered are discarded. A failed request isn't
+// delivered and doesn't make older results stale, they are still better than nothing.
+class InferenceStage {
+public:
+    // Starts the request, which must eventually call complete(sequence, result, ok) from any thread
+    typedef std::function<void(uint64_t sequence)> Launch;
+    typedef std::function<void(const std::string& result)> Deliver;
+
+    struct Stats {
+        uint64_t submitted;
+        uint64_t launched;
+        uint64_t coalesced;     // Replaced while waiting, never launched
+        uint64_t stale;         // Completed after a newer result was delivered
+        uint64_t failed;        // Completed without a result, not delivered
+        uint64_t delivered;
+        int inFlight;
+        bool waiting;
+    };
+
+    InferenceStage(const std::string& name, int maxInFlight = 1);
+
+    // Returns the request's sequence number
+    uint64_t submit(const Launch& launch, const Deliver& deliver);
+    // ok false, or an empty result, completes the request without delivering it
+    void complete(uint64_t sequence, const std::string& result, bool ok = true);
+
+    void setMaxInFlight(int maxInFlight);
+    int getMaxInFlight() const;
+
+    const std::string& getName() const;
+    uint64_t getLastDelivered() const;
+    Stats getStats() const;
+
+private:
+    struct Request {
+        uint64_t sequence;
+        Launch launch;
+        Deliver deliver;
+    };
+
+    // Launches the waiting request if there is room, called without the lock held
+    void launchWaiting();
+
+    std::string name;
+    int maxInFlight;
+
+    mutable std::mutex mutex;
+    uint64_t nextSequence;
+    uint64_t lastDelivered;
+    std::map<uint64_t, Deliver> inFlight;
+    Request waiting;
+    bool hasWaiting;
+    Stats stats;
+
+    // Serializes delivery, so results are applied in sequence order
+    std::mutex deliverMutex;
+};
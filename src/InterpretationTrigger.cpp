@@ -0,0 +1,228 @@
+#include "InterpretationTrigger.h"
+
+#include <algorithm>
+
+namespace {
+
+    // Undo, redo, clear and erasing change the canvas by an unknown amount, counted as this much ink
+    // (a 100 pixel stroke at the default width)
+    const float editChange = 1000.0f;
+
+    float inkBetween(const vdraw::Stroke& stroke, size_t first, size_t end) {
+        const vdraw::PointBuffer& points = stroke.getRawPoints();
+        float length = 0.0f;
+        for (size_t i = std::max<size_t>(first, 1); i < end; ++i) {
+            length += points[i - 1].position.distanceTo(points[i].position);
+        }
+        return length * stroke.getBaseWidth();
+    }
+
+} // namespace
+
+TriggerState::TriggerState()
+    : secondsSinceLastInterpretation(0), distance(0), change(0), inFlight(0), strokeActive(false) {
+}
+
+//-------------------------------------------------------------------------
+// DistanceTriggerPolicy
+//-------------------------------------------------------------------------
+DistanceTriggerPolicy::DistanceTriggerPolicy(float minimumDistance)
+    : minimumDistance(minimumDistance) {
+}
+
+const char* DistanceTriggerPolicy::getName() const {
+    return "distance";
+}
+
+bool DistanceTriggerPolicy::shouldInterpret(const TriggerState& state) const {
+    return state.distance >= minimumDistance;
+}
+
+void DistanceTriggerPolicy::setMinimumDistance(float pixels) {
+    minimumDistance = pixels;
+}
+
+float DistanceTriggerPolicy::getMinimumDistance() const {
+    return minimumDistance;
+}
+
+//-------------------------------------------------------------------------
+// AdaptiveTriggerPolicy
+//-------------------------------------------------------------------------
+AdaptiveTriggerPolicy::Settings::Settings()
+    : targetUtilization(0.9f), maxRequestsPerSecond(4.0f), maxInFlight(1),
+    significantDistance(100.0f), significantChange(editChange), minimumDistance(20.0f), minimumChange(200.0f),
+    initialServiceSeconds(1.0), smoothing(0.2) {
+}
+
+AdaptiveTriggerPolicy::AdaptiveTriggerPolicy(const Settings& settings)
+    : settings(settings), serviceEstimate(settings.initialServiceSeconds) {
+}
+
+const char* AdaptiveTriggerPolicy::getName() const {
+    return "adaptive";
+}
+
+bool AdaptiveTriggerPolicy::shouldInterpret(const TriggerState& state) const {
+    Settings settings;
+    double serviceEstimate;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        settings = this->settings;
+        serviceEstimate = this->serviceEstimate;
+    }
+
+    // Waiting requests only go stale, the canvas is captured when the model is free instead
+    if (state.inFlight >= settings.maxInFlight) return false;
+
+    if (state.distance < settings.minimumDistance && state.change < settings.minimumChange) return false;
+
+    double elapsed = state.secondsSinceLastInterpretation;
+    if (elapsed * settings.maxRequestsPerSecond < 1.0) return false;
+
+    // One interval's worth of significance is needed: a significant change after a full
+    // interval, twice that after half an interval, and so on
+    double significance = state.distance / settings.significantDistance + state.change / settings.significantChange;
+    return significance * elapsed >= targetInterval(settings, serviceEstimate);
+}
+
+void AdaptiveTriggerPolicy::interpretationCompleted(double serviceSeconds) {
+    std::lock_guard<std::mutex> lock(mutex);
+    serviceEstimate += settings.smoothing * (serviceSeconds - serviceEstimate);
+}
+
+double AdaptiveTriggerPolicy::getServiceEstimate() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return serviceEstimate;
+}
+
+double AdaptiveTriggerPolicy::getTargetInterval() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return targetInterval(settings, serviceEstimate);
+}
+
+void AdaptiveTriggerPolicy::setSettings(const Settings& settings) {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->settings = settings;
+}
+
+AdaptiveTriggerPolicy::Settings AdaptiveTriggerPolicy::getSettings() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return settings;
+}
+
+double AdaptiveTriggerPolicy::targetInterval(const Settings& settings, double serviceEstimate) {
+    double interval = serviceEstimate / (std::max(1, settings.maxInFlight) * settings.targetUtilization);
+    return std::max(interval, 1.0 / settings.maxRequestsPerSecond);
+}
+
+//-------------------------------------------------------------------------
+// InterpretationTrigger
+//-------------------------------------------------------------------------
+InterpretationTrigger::InterpretationTrigger(float minimumDistance)
+    : distancePolicy(std::make_shared<DistanceTriggerPolicy>(minimumDistance)), totalDistance(0.0f),
+    distanceSinceLastInterpretation(0.0f), changeSinceLastInterpretation(0.0f), lastInterpretationTime(0), strokeActive(false) {
+    policy = distancePolicy;
+}
+
+void InterpretationTrigger::strokeBegan(const vdraw::Vec2& position) {
+    strokeActive = true;
+    lastPosition = position;
+}
+
+void InterpretationTrigger::strokeMoved(const vdraw::Vec2& position) {
+    if (strokeActive) {
+        float distance = lastPosition.distanceTo(position);
+        totalDistance += distance;
+        distanceSinceLastInterpretation += distance;
+    }
+    lastPosition = position;
+}
+
+void InterpretationTrigger::strokeEnded() {
+    strokeActive = false;
+}
+
+bool InterpretationTrigger::shouldInterpret(double time, int inFlight) const {
+    return policy->shouldInterpret(getState(time, inFlight));
+}
+
+void InterpretationTrigger::reset(double time) {
+    distanceSinceLastInterpretation = 0.0f;
+    changeSinceLastInterpretation = 0.0f;
+    lastInterpretationTime = time;
+}
+
+void InterpretationTrigger::interpretationCompleted(double serviceSeconds) {
+    policy->interpretationCompleted(serviceSeconds);
+}
+
+void InterpretationTrigger::setPolicy(const std::shared_ptr<TriggerPolicy>& policy) {
+    this->policy = policy ? policy : distancePolicy;
+}
+
+std::shared_ptr<TriggerPolicy> InterpretationTrigger::getPolicy() const {
+    return policy;
+}
+
+void InterpretationTrigger::setMinimumDistance(float pixels) {
+    distancePolicy->setMinimumDistance(pixels);
+}
+
+float InterpretationTrigger::getMinimumDistance() const {
+    return distancePolicy->getMinimumDistance();
+}
+
+float InterpretationTrigger::getDistanceSinceLastInterpretation() const {
+    return distanceSinceLastInterpretation;
+}
+
+float InterpretationTrigger::getChangeSinceLastInterpretation() const {
+    return changeSinceLastInterpretation;
+}
+
+float InterpretationTrigger::getTotalDistance() const {
+    return totalDistance;
+}
+
+bool InterpretationTrigger::isStrokeActive() const {
+    return strokeActive;
+}
+
+TriggerState InterpretationTrigger::getState(double time, int inFlight) const {
+    TriggerState state;
+    state.secondsSinceLastInterpretation = time - lastInterpretationTime;
+    state.distance = distanceSinceLastInterpretation;
+    state.change = changeSinceLastInterpretation;
+    state.inFlight = inFlight;
+    state.strokeActive = strokeActive;
+    return state;
+}
+
+void InterpretationTrigger::strokeBegan(const vdraw::Stroke& stroke) {
+    changeSinceLastInterpretation += inkBetween(stroke, 0, stroke.getRawPoints().size());
+}
+
+void InterpretationTrigger::strokeContinued(const vdraw::Stroke& stroke, size_t firstNewPoint) {
+    changeSinceLastInterpretation += inkBetween(stroke, firstNewPoint, stroke.getRawPoints().size());
+}
+
+void InterpretationTrigger::drawingCleared() {
+    addEdit();
+}
+
+void InterpretationTrigger::eraseEnded(bool erased) {
+    if (erased) addEdit();
+}
+
+void InterpretationTrigger::undone() {
+    addEdit();
+}
+
+void InterpretationTrigger::redone() {
+    addEdit();
+}
+
+void InterpretationTrigger::addEdit() {
+    changeSinceLastInterpretation = std::max(changeSinceLastInterpretation, editChange);
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include "VectorDrawing.h"
+
+#include <memory>
+#include <mutex>
+
+// What a trigger policy decides on, gathered by InterpretationTrigger
+struct TriggerState {
+    double secondsSinceLastInterpretation;
+    float distance;         // Stroke distance since the last interpretation, in pixels
+    float change;           // Ink added since the last interpretation (length * width, in square pixels)
+    int inFlight;           // Interpretations currently running
+    bool strokeActive;
+
+    TriggerState();
+};
+
+// Decides from a TriggerState whether to interpret the canvas now
+class TriggerPolicy {
+public:
+    virtual ~TriggerPolicy() {}
+
+    virtual const char* getName() const = 0;
+    virtual bool shouldInterpret(const TriggerState& state) const = 0;
+
+    // Measured time from sending the canvas to receiving the description, may be called from any thread
+    virtual void interpretationCompleted(double serviceSeconds) {}
+};
+
+// Interprets every minimumDistance pixels of stroke, regardless of the model
+class DistanceTriggerPolicy : public TriggerPolicy {
+public:
+    DistanceTriggerPolicy(float minimumDistance = 100.0f);
+
+    const char* getName() const override;
+    bool shouldInterpret(const TriggerState& state) const override;
+
+    void setMinimumDistance(float pixels);
+    float getMinimumDistance() const;
+
+private:
+    float minimumDistance;
+};
+
+// Paces interpretations to the model. A moving estimate of the service time gives the target
+// interval, the time at which the model would be busy targetUtilization of the time. New ink
+// is weighed against that interval: a large change goes out early, a small one waits longer.
+// Nothing is sent while the model is busy, so there is never a backlog, and sub-threshold
+// wiggles are never sent at all.
+class AdaptiveTriggerPolicy : public TriggerPolicy {
+public:
+    struct Settings {
+        float targetUtilization;        // Fraction of time the model should be busy
+        float maxRequestsPerSecond;     // Upper bound however fast the model is
+        int maxInFlight;                // Concurrent interpretations the model can serve
+        float significantDistance;      // Stroke distance that alone justifies one interval
+        float significantChange;        // Ink that alone justifies one interval
+        float minimumDistance;          // Below both minimums nothing is sent
+        float minimumChange;
+        double initialServiceSeconds;   // Estimate until the first measurement
+        double smoothing;               // Weight of each new measurement in the moving estimate
+
+        Settings();
+    };
+
+    AdaptiveTriggerPolicy(const Settings& settings = Settings());
+
+    const char* getName() const override;
+    bool shouldInterpret(const TriggerState& state) const override;
+    void interpretationCompleted(double serviceSeconds) override;
+
+    double getServiceEstimate() const;
+
+    // Interval between interpretations that keeps the model at the target utilization
+    double getTargetInterval() const;
+
+    // Any thread, e.g. the UI thread while inference threads report completions
+    void setSettings(const Settings& settings);
+    Settings getSettings() const;
+
+private:
+    static double targetInterval(const Settings& settings, double serviceEstimate);
+
+    mutable std::mutex mutex;   // Guards settings and serviceEstimate, used from inference threads
+    Settings settings;
+    double serviceEstimate;
+};
+
+// Decides when enough has been drawn to send the canvas for interpretation.
+// Tracks strokes and canvas changes, the policy makes the decision.
+// Free of Cinder so the same logic runs in the app and in headless session replay.
+//
+// Also observes the drawing (see vdraw::Drawing::addObserver) to measure the ink added;
+// undo, redo, clear and each eraser gesture count as one significant change.
+class InterpretationTrigger : public vdraw::DrawingObserver {
+public:
+    InterpretationTrigger(float minimumDistance = 100.0f);
+
+    // Stroke tracking
+    void strokeBegan(const vdraw::Vec2& position);
+    void strokeMoved(const vdraw::Vec2& position);
+    void strokeEnded();
+
+    // Asks the policy, time in seconds on the same clock as reset()
+    bool shouldInterpret(double time, int inFlight = 0) const;
+
+    // Call when an interpretation is sent, restarts the distance and change counts
+    void reset(double time = 0);
+
+    // Forwarded to the current policy; not synchronized with setPolicy
+    void interpretationCompleted(double serviceSeconds);
+
+    void setPolicy(const std::shared_ptr<TriggerPolicy>& policy);
+    std::shared_ptr<TriggerPolicy> getPolicy() const;
+
+    // Applies to the default DistanceTriggerPolicy
+    void setMinimumDistance(float pixels);
+    float getMinimumDistance() const;
+
+    float getDistanceSinceLastInterpretation() const;
+    float getChangeSinceLastInterpretation() const;
+    float getTotalDistance() const;
+    bool isStrokeActive() const;
+
+    TriggerState getState(double time, int inFlight = 0) const;
+
+    // vdraw::DrawingObserver
+    void strokeBegan(const vdraw::Stroke& stroke) override;
+    void strokeContinued(const vdraw::Stroke& stroke, size_t firstNewPoint) override;
+    void drawingCleared() override;
+    void eraseEnded(bool erased) override;
+    void undone() override;
+    void redone() override;
+
+private:
+    std::shared_ptr<TriggerPolicy> policy;
+    std::shared_ptr<DistanceTriggerPolicy> distancePolicy;
+
+    float totalDistance;
+    float distanceSinceLastInterpretation;
+    float changeSinceLastInterpretation;
+    double lastInterpretationTime;
+    vdraw::Vec2 lastPosition;
+    bool strokeActive;
+
+    void addEdit();
+};
@@ -0,0 +1,295 @@
+#include "MockOllamaServer.h"
+#include "StreamingInference.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+
+MockOllamaServer::Settings::Settings()
+    : firstTokenLatency(300.0, 100.0, MockLatency::LogNormal), tokenInterval(20.0), slots(0), errorRate(0.0), seed(1) {
+    responses = {
+        "a cat sitting on a windowsill",
+        "a small house with a red roof",
+        "a tree next to a river",
+        "a smiling face with round glasses",
+        "a sailboat on calm water",
+        "a mountain range at sunset",
+    };
+}
+
+MockOllamaServer::MockOllamaServer()
+    : listener(tcp::invalidSocket), port(0), running(false), openConnections(0), busySlots(0), random(1), nextResponse(0) {
+    stats = Stats();
+}
+
+MockOllamaServer::~MockOllamaServer() {
+    stop();
+}
+
+bool MockOllamaServer::start(int port) {
+    if (running) return true;
+
+    std::string error;
+    listener = tcp::listenOn(port, this->port, error);
+    if (listener == tcp::invalidSocket) return false;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        random.seed(settings.seed);
+        nextResponse = 0;
+    }
+
+    running = true;
+    acceptThread = std::thread(&MockOllamaServer::acceptLoop, this);
+    return true;
+}
+
+void MockOllamaServer::stop() {
+    if (!running) return;
+
+    // The accept loop polls running, connections finish their current response
+    running = false;
+    acceptThread.join();
+
+    std::unique_lock<std::mutex> lock(connectionsMutex);
+    connectionsClosed.wait(lock, [this]() { return openConnections == 0; });
+
+    tcp::closeSocket(listener);
+    listener = tcp::invalidSocket;
+}
+
+bool MockOllamaServer::isRunning() const {
+    return running;
+}
+
+int MockOllamaServer::getPort() const {
+    return port;
+}
+
+void MockOllamaServer::setSettings(const Settings& settings) {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->settings = settings;
+    random.seed(settings.seed);
+    nextResponse = 0;
+}
+
+MockOllamaServer::Settings MockOllamaServer::getSettings() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return settings;
+}
+
+MockOllamaServer::Stats MockOllamaServer::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void MockOllamaServer::resetStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    int active = stats.active;
+    stats = Stats();
+    stats.active = active;
+    stats.maxActive = active;
+}
+
+void MockOllamaServer::acceptLoop() {
+    while (running) {
+        tcp::SocketHandle connection = tcp::acceptConnection(listener, 50);
+        if (connection == tcp::invalidSocket) continue;
+
+        tcp::setTimeout(connection, 10);
+        {
+            std::lock_guard<std::mutex> lock(connectionsMutex);
+            openConnections++;
+        }
+
+        // One thread per connection, like a server that doesn't queue requests; stop() waits for them
+        std::thread([this, connection]() {
+            serve(connection);
+            tcp::closeSocket(connection);
+
+            std::lock_guard<std::mutex> lock(connectionsMutex);
+            if (--openConnections == 0) connectionsClosed.notify_all();
+        }).detach();
+    }
+}
+
+void MockOllamaServer::serve(tcp::SocketHandle connection) {
+    // Read the headers, then Content-Length bytes of body
+    std::string request;
+    char buffer[16384];
+    size_t headerEnd = std::string::npos;
+    size_t contentLength = 0;
+
+    while (true) {
+        if (headerEnd == std::string::npos) {
+            headerEnd = request.find("\r\n\r\n");
+            if (headerEnd != std::string::npos) {
+                std::string headers = request.substr(0, headerEnd);
+                std::transform(headers.begin(), headers.end(), headers.begin(), ::tolower);
+                size_t field = headers.find("content-length:");
+                if (field != std::string::npos) contentLength = strtoul(headers.c_str() + field + 15, nullptr, 10);
+                headerEnd += 4;
+            }
+        }
+        if (headerEnd != std::string::npos && request.size() >= headerEnd + contentLength) break;
+
+        int n = tcp::receive(connection, buffer, sizeof(buffer));
+        if (n <= 0) return;
+        request.append(buffer, n);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.requests++;
+        stats.bytesReceived += request.size();
+        stats.maxActive = std::max(stats.maxActive, ++stats.active);
+    }
+
+    if (request.compare(0, 19, "POST /api/generate ") == 0) {
+        reply(connection, request.substr(headerEnd, contentLength));
+    }
+    else {
+        tcp::sendAll(connection, "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.active--;
+    }
+}
+
+void MockOllamaServer::reply(tcp::SocketHandle connection, const std::string& body) {
+    std::string model = "mock";
+    extractJsonString(body, "model", model);
+
+    bool stream = true;     // Ollama streams unless asked not to
+    extractJsonBool(body, "stream", stream);
+
+    // Images are base64 strings, which never contain quotes
+    size_t images = 0;
+    size_t list = body.find("\"images\":[");
+    if (list != std::string::npos) {
+        size_t end = body.find(']', list);
+        images = std::count(body.begin() + list + 10, end == std::string::npos ? body.end() : body.begin() + end, '"') / 2;
+    }
+
+    // Draw everything random for this request up front, so concurrent requests don't
+    // change each other's sequence
+    bool fail;
+    std::string text;
+    std::vector<double> intervals;
+    double firstToken;
+    int slots;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        fail = std::uniform_real_distribution<double>(0.0, 1.0)(random) < settings.errorRate;
+        firstToken = sample(settings.firstTokenLatency);
+        if (images > 1) {
+            for (size_t i = 0; i < images; ++i) {
+                text += (i > 0 ? "\n" : "") + std::to_string(i + 1) + ". " +
+                    (settings.responses.empty() ? "" : settings.responses[nextResponse++ % settings.responses.size()]);
+            }
+            for (size_t i = 1; i < images; ++i) firstToken += sample(settings.imageLatency);
+        }
+        else {
+            text = settings.responses.empty() ? "" : settings.responses[nextResponse++ % settings.responses.size()];
+        }
+
+        size_t words = std::count(text.begin(), text.end(), ' ') + 1;
+        for (size_t i = 1; i < words; ++i) intervals.push_back(sample(settings.tokenInterval));
+
+        slots = settings.slots;
+        stats.images += images;
+        if (fail) stats.errors++;
+        else if (stream) stats.streamed++;
+    }
+
+    // The model is busy with this request until its last token
+    struct Slot {
+        MockOllamaServer& server;
+        Slot(MockOllamaServer& server, int slots) : server(server) { server.acquireSlot(slots); }
+        ~Slot() { server.releaseSlot(); }
+    } slot(*this, slots);
+
+    sleepMillis(firstToken);
+
+    if (fail) {
+        std::string error = "{\"error\":\"mock inference failure\"}";
+        tcp::sendAll(connection, "HTTP/1.1 500 Internal Server Error\r\nContent-Type: application/json\r\nContent-Length: " +
+            std::to_string(error.size()) + "\r\nConnection: close\r\n\r\n" + error);
+        return;
+    }
+
+    std::string prefix = "{\"model\":" + quoteJsonString(model) + ",\"response\":";
+
+    if (!stream) {
+        for (double interval : intervals) sleepMillis(interval);
+
+        std::string line = prefix + quoteJsonString(text) + ",\"done\":true}";
+        tcp::sendAll(connection, "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: " +
+            std::to_string(line.size()) + "\r\nConnection: close\r\n\r\n" + line);
+        return;
+    }
+
+    if (!tcp::sendAll(connection, "HTTP/1.1 200 OK\r\nContent-Type: application/x-ndjson\r\nTransfer-Encoding: chunked\r\nConnection: close\r\n\r\n"))
+        return;
+
+    auto sendChunk = [&](const std::string& line) {
+        char size[16];
+        snprintf(size, sizeof(size), "%zx\r\n", line.size());
+        return tcp::sendAll(connection, size + line + "\r\n");
+    };
+
+    // One token per word, the way the model streams them
+    size_t start = 0;
+    for (size_t i = 0; start < text.size() || i == 0; ++i) {
+        if (i > 0 && i - 1 < intervals.size()) sleepMillis(intervals[i - 1]);
+
+        size_t end = text.find(' ', start + 1);
+        if (end == std::string::npos) end = text.size();
+
+        if (!sendChunk(prefix + quoteJsonString(text.substr(start, end - start)) + ",\"done\":false}\n")) return;
+        start = end;
+    }
+
+    sendChunk(prefix + "\"\",\"done\":true,\"done_reason\":\"stop\"}\n");
+    tcp::sendAll(connection, "0\r\n\r\n");
+}
+
+void MockOllamaServer::acquireSlot(int slots) {
+    std::unique_lock<std::mutex> lock(slotMutex);
+    slotFreed.wait(lock, [&]() { return slots <= 0 || busySlots < slots; });
+    busySlots++;
+}
+
+void MockOllamaServer::releaseSlot() {
+    {
+        std::lock_guard<std::mutex> lock(slotMutex);
+        busySlots--;
+    }
+    slotFreed.notify_all();
+}
+
+void MockOllamaServer::sleepMillis(double millis) const {
+    if (millis > 0.0) std::this_thread::sleep_for(std::chrono::microseconds(static_cast<int64_t>(millis * 1000.0)));
+}
+
+double MockOllamaServer::sample(const MockLatency& latency) {
+    switch (latency.distribution) {
+    case MockLatency::Uniform:
+        return std::uniform_real_distribution<double>(latency.meanMs - latency.spreadMs, latency.meanMs + latency.spreadMs)(random);
+
+    case MockLatency::LogNormal: {
+        if (latency.meanMs <= 0.0) return 0.0;
+
+        // Parameters of the underlying normal that give the requested mean and standard deviation
+        double variance = std::log(1.0 + (latency.spreadMs * latency.spreadMs) / (latency.meanMs * latency.meanMs));
+        double mu = std::log(latency.meanMs) - variance / 2.0;
+        return std::lognormal_distribution<double>(mu, std::sqrt(variance))(random);
+    }
+
+    default:
+        return latency.meanMs;
+    }
+}
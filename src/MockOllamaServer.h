@@ -0,0 +1,102 @@
+#pragma once
+
+#include "TcpSocket.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Latency distribution for the mock server, in milliseconds
+struct MockLatency {
+    enum Distribution { Fixed, Uniform, LogNormal };
+
+    Distribution distribution;
+    double meanMs;
+    double spreadMs;    // Uniform: half width around the mean, LogNormal: standard deviation
+
+    MockLatency(double meanMs = 0.0, double spreadMs = 0.0, Distribution distribution = Fixed)
+        : distribution(distribution), meanMs(meanMs), spreadMs(spreadMs) {}
+};
+
+// Local stand-in for the subset of the Ollama API the app uses (POST /api/generate, streaming
+// or not). Answers from a fixed list of descriptions with configurable latency and failures,
+// so the interpretation pipeline can be exercised and benchmarked without a GPU. Seeded, so
+// a run's sequence of latencies, errors and responses is repeatable.
+//
+// A request with several images is answered with one numbered line per image, the way
+// BatchingBackend asks for, and costs imageLatency per extra image. With slots set, requests
+// beyond that many wait for the model like on a real server, which is what makes a batch of
+// images cheaper than the same images sent one by one.
+class MockOllamaServer {
+public:
+    struct Settings {
+        MockLatency firstTokenLatency;      // Request received until the first token
+        MockLatency tokenInterval;          // Between streamed tokens (words)
+        MockLatency imageLatency;           // Added to the first token for each image after the first
+        int slots;                          // Requests the model works on at once, others wait; 0 for no limit
+        double errorRate;                   // Fraction of requests answered with HTTP 500
+        std::vector<std::string> responses; // Used in turn, one per request
+        uint32_t seed;
+
+        Settings();
+    };
+
+    struct Stats {
+        uint64_t requests;
+        uint64_t errors;
+        uint64_t streamed;
+        uint64_t bytesReceived;
+        uint64_t images;
+        int active;
+        int maxActive;      // Highest number of requests served concurrently
+    };
+
+    MockOllamaServer();
+    ~MockOllamaServer();
+
+    // Listens on 127.0.0.1, port 0 picks a free port (see getPort)
+    bool start(int port = 0);
+    void stop();
+    bool isRunning() const;
+    int getPort() const;
+
+    // Applies to requests received afterwards
+    void setSettings(const Settings& settings);
+    Settings getSettings() const;
+
+    Stats getStats() const;
+    void resetStats();
+
+private:
+    void acceptLoop();
+    void serve(tcp::SocketHandle connection);
+    void reply(tcp::SocketHandle connection, const std::string& body);
+    void sleepMillis(double millis) const;
+    double sample(const MockLatency& latency);
+    void acquireSlot(int slots);
+    void releaseSlot();
+
+    tcp::SocketHandle listener;
+    int port;
+    std::atomic<bool> running;
+    std::thread acceptThread;
+
+    std::mutex connectionsMutex;
+    std::condition_variable connectionsClosed;
+    int openConnections;
+
+    std::mutex slotMutex;
+    std::condition_variable slotFreed;
+    int busySlots;
+
+    mutable std::mutex mutex;   // Guards the fields below
+    Settings settings;
+    std::mt19937 random;
+    uint64_t nextResponse;
+    Stats stats;
+};
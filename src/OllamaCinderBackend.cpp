@@ -0,0 +1,46 @@
+#include "OllamaCinderBackend.h"
+
+#include "cinder/ImageIo.h"
+#include "cinder/Surface.h"
+
+#include <future>
+
+OllamaCinderBackend::OllamaCinderBackend(OllamaClientCinder& client)
+    : client(client) {
+}
+
+std::string OllamaCinderBackend::getName() const {
+    return "ollama client " + client.getVisionModel();
+}
+
+bool OllamaCinderBackend::generate(const InferenceRequest& request, const FragmentCallback& onFragment,
+    std::string& response, std::string& error) {
+    try {
+        if (!request.images.empty()) {
+            // The client takes a surface and encodes it itself, so the request image is decoded first
+            std::vector<uint8_t> png = OllamaStreamClient::decodeBase64(request.images.front());
+            ci::Surface8u surface = ci::loadImage(ci::DataSourceBuffer::create(ci::Buffer::create(png.data(), png.size())), ci::ImageSource::Options(), "png");
+            response = client.sendImageForInferenceSync(surface, request.prompt);
+        }
+        else {
+            std::promise<std::string> result;
+            std::future<std::string> text = result.get_future();
+            client.sendPrompt(request.prompt, [&result](const std::string& text, void* userData) {
+                result.set_value(text);
+            }, nullptr);
+            response = text.get();
+        }
+    }
+    catch (const std::exception& e) {
+        error = e.what();
+        return false;
+    }
+
+    if (response.empty()) {
+        error = "Empty response";
+        return false;
+    }
+
+    if (onFragment) onFragment(response);
+    return true;
+}
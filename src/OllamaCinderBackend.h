@@ -0,0 +1,18 @@
+#pragma once
+
+#include "InferenceBackend.h"
+#include <OllamaClient/OllamaClientCinder.h>
+
+// The bundled OllamaClientCinder behind the backend interface. It doesn't stream, so the
+// whole response is passed as one fragment, and it always uses the client's configured model.
+class OllamaCinderBackend : public InferenceBackend {
+public:
+    explicit OllamaCinderBackend(OllamaClientCinder& client);
+
+    std::string getName() const override;
+    bool generate(const InferenceRequest& request, const FragmentCallback& onFragment,
+        std::string& response, std::string& error) override;
+
+private:
+    OllamaClientCinder& client;
+};
@@ -0,0 +1,313 @@
+#include "OscOutputQueue.h"
+#include "PerfCounters.h"
+
+#include <algorithm>
+
+OscMessage::OscMessage(const std::string& address, const std::vector<std::string>& arguments)
+    : address(address), arguments(arguments) {
+}
+
+OscOutputQueue::Policy::Policy(bool coalesce, double minIntervalMillis, size_t keyArguments)
+    : coalesce(coalesce), minIntervalMillis(minIntervalMillis), keyArguments(keyArguments) {
+}
+
+OscOutputQueue::Settings::Settings()
+    : capacity(1024), tickMillis(2.0), maxBundle(16), maxPendingPerKey(64) {
+}
+
+OscOutputQueue::OscOutputQueue(const Settings& settings)
+    : settings(settings), enqueuePosition(0), dequeuePosition(0), nextSequence(0), running(false), posting(0), idle(false),
+    posted(0), sent(0), packets(0), bundles(0), coalesced(0), dropped(0), failed(0) {
+    size_t size = 2;
+    while (size < settings.capacity) {
+        size <<= 1;
+    }
+    cells.reset(new Cell[size]);
+    for (size_t i = 0; i < size; ++i) {
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    mask = size - 1;
+}
+
+OscOutputQueue::~OscOutputQueue() {
+    stop();
+}
+
+bool OscOutputQueue::start(const Transport& transport) {
+    if (running.load()) return false;
+
+    this->transport = transport;
+    running.store(true);
+    sender = std::thread(&OscOutputQueue::senderLoop, this);
+    return true;
+}
+
+void OscOutputQueue::stop() {
+    if (!running.exchange(false)) return;
+
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        wake.notify_one();
+    }
+    sender.join();
+
+    // Posted as the queue stopped: a post that saw it running may push after the sender's
+    // last look, any post from here on sees it stopped
+    while (posting.load() > 0) {
+        std::this_thread::yield();
+    }
+    Entry entry;
+    while (pop(entry)) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        PerfCounters::get().oscDropped++;
+    }
+}
+
+bool OscOutputQueue::isRunning() const {
+    return running.load();
+}
+
+bool OscOutputQueue::post(const OscMessage& message) {
+    posted.fetch_add(1, std::memory_order_relaxed);
+
+    // Announced before checking running, so stop() either waits for this push or it is refused
+    posting.fetch_add(1);
+    bool pushed = running.load() && push(message);
+    posting.fetch_sub(1);
+    if (!pushed) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        PerfCounters::get().oscDropped++;
+        return false;
+    }
+
+    // Pairs with the fence in waitForWork: either the sender sees the message before it
+    // sleeps, or this sees it idle and wakes it
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (idle.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        wake.notify_one();
+    }
+    return true;
+}
+
+void OscOutputQueue::setPolicy(const std::string& address, const Policy& policy) {
+    std::lock_guard<std::mutex> lock(policyMutex);
+    policies[address] = policy;
+}
+
+const OscOutputQueue::Settings& OscOutputQueue::getSettings() const {
+    return settings;
+}
+
+OscOutputQueue::Stats OscOutputQueue::getStats() const {
+    Stats stats;
+    stats.posted = posted.load();
+    stats.sent = sent.load();
+    stats.packets = packets.load();
+    stats.bundles = bundles.load();
+    stats.coalesced = coalesced.load();
+    stats.dropped = dropped.load();
+    stats.failed = failed.load();
+    return stats;
+}
+
+//-------------------------------------------------------------------------
+// Queue: bounded, many producers and the sender as the only consumer. A cell's sequence
+// equals the position that may write it next, and position + 1 once written.
+//-------------------------------------------------------------------------
+bool OscOutputQueue::push(const OscMessage& message) {
+    uint64_t position = enqueuePosition.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+        cell = &cells[position & mask];
+        uint64_t sequence = cell->sequence.load(std::memory_order_acquire);
+        int64_t difference = static_cast<int64_t>(sequence - position);
+        if (difference == 0) {
+            if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+        }
+        else if (difference < 0) {
+            return false;   // Full: the sender hasn't taken this cell's last message yet
+        }
+        else {
+            position = enqueuePosition.load(std::memory_order_relaxed);
+        }
+    }
+
+    cell->entry.message = message;
+    cell->entry.posted = Clock::now();
+    cell->sequence.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+bool OscOutputQueue::pop(Entry& entry) {
+    Cell& cell = cells[dequeuePosition & mask];
+    if (cell.sequence.load(std::memory_order_acquire) != dequeuePosition + 1) return false;
+
+    entry.message = std::move(cell.entry.message);
+    entry.posted = cell.entry.posted;
+    cell.sequence.store(dequeuePosition + mask + 1, std::memory_order_release);
+    dequeuePosition++;
+    return true;
+}
+
+bool OscOutputQueue::hasQueued() const {
+    return cells[dequeuePosition & mask].sequence.load(std::memory_order_acquire) == dequeuePosition + 1;
+}
+
+//-------------------------------------------------------------------------
+// Sender
+//-------------------------------------------------------------------------
+void OscOutputQueue::senderLoop() {
+    Clock::duration tick = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double, std::milli>(settings.tickMillis));
+    Clock::time_point due = Clock::time_point::max();
+    std::vector<Entry> ready;
+    Entry entry;
+
+    while (true) {
+        waitForWork(due);
+
+        // Let the rest of the tick's messages arrive, to send them together
+        bool flush = !running.load();
+        if (!flush) {
+            std::this_thread::sleep_for(tick);
+        }
+
+        while (pop(entry)) {
+            take(entry);
+        }
+
+        due = collect(Clock::now(), flush, ready);
+        send(ready);
+
+        if (flush && !hasQueued()) break;
+    }
+}
+
+void OscOutputQueue::waitForWork(Clock::time_point due) {
+    std::unique_lock<std::mutex> lock(wakeMutex);
+    idle.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    auto woken = [this]() { return !running.load() || hasQueued(); };
+    if (due == Clock::time_point::max()) {
+        wake.wait(lock, woken);
+    }
+    else {
+        wake.wait_until(lock, due, woken);
+    }
+    idle.store(false, std::memory_order_relaxed);
+}
+
+void OscOutputQueue::take(Entry& entry) {
+    Policy policy = settings.defaultPolicy;
+    {
+        std::lock_guard<std::mutex> lock(policyMutex);
+        auto found = policies.find(entry.message.address);
+        if (found != policies.end()) policy = found->second;
+    }
+
+    auto inserted = pending.insert(std::make_pair(makeKey(entry.message, policy), Pending()));
+    Pending& waiting = inserted.first->second;
+    if (inserted.second) {
+        waiting.sentBefore = false;
+    }
+    waiting.policy = policy;
+
+    entry.sequence = nextSequence++;
+    if (policy.coalesce && !waiting.entries.empty()) {
+        // Keeps the place of the message it replaces
+        entry.sequence = waiting.entries.back().sequence;
+        waiting.entries.back() = std::move(entry);
+        coalesced.fetch_add(1, std::memory_order_relaxed);
+        PerfCounters::get().oscCoalesced++;
+        return;
+    }
+
+    waiting.entries.push_back(std::move(entry));
+    if (waiting.entries.size() > std::max<size_t>(settings.maxPendingPerKey, 1)) {
+        waiting.entries.pop_front();
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        PerfCounters::get().oscDropped++;
+    }
+}
+
+OscOutputQueue::Clock::time_point OscOutputQueue::collect(Clock::time_point now, bool flush, std::vector<Entry>& ready) {
+    Clock::time_point due = Clock::time_point::max();
+    ready.clear();
+
+    for (auto it = pending.begin(); it != pending.end(); ) {
+        Pending& waiting = it->second;
+        Clock::duration interval = std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double, std::milli>(waiting.policy.minIntervalMillis));
+        bool limited = !flush && waiting.policy.minIntervalMillis > 0.0;
+
+        while (!waiting.entries.empty()) {
+            if (limited && waiting.sentBefore && now - waiting.lastSent < interval) {
+                due = std::min(due, waiting.lastSent + interval);
+                break;
+            }
+            ready.push_back(std::move(waiting.entries.front()));
+            waiting.entries.pop_front();
+            waiting.lastSent = now;
+            waiting.sentBefore = true;
+        }
+
+        // Forget idle keys once their interval has passed, it no longer holds anything back
+        if (waiting.entries.empty() && (!limited || now - waiting.lastSent >= interval)) {
+            it = pending.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+
+    std::sort(ready.begin(), ready.end(), [](const Entry& a, const Entry& b) { return a.sequence < b.sequence; });
+    return due;
+}
+
+void OscOutputQueue::send(std::vector<Entry>& ready) {
+    PerfCounters& counters = PerfCounters::get();
+    std::vector<OscMessage> packet;
+    size_t maxBundle = std::max<size_t>(settings.maxBundle, 1);
+
+    for (size_t first = 0; first < ready.size(); first += maxBundle) {
+        size_t last = std::min(first + maxBundle, ready.size());
+        packet.clear();
+        for (size_t i = first; i < last; ++i) {
+            packet.push_back(std::move(ready[i].message));
+        }
+
+        bool ok = transport(packet);
+        Clock::time_point now = Clock::now();
+
+        packets.fetch_add(1, std::memory_order_relaxed);
+        if (packet.size() > 1) bundles.fetch_add(1, std::memory_order_relaxed);
+        if (!ok) {
+            failed.fetch_add(packet.size(), std::memory_order_relaxed);
+            continue;
+        }
+
+        sent.fetch_add(packet.size(), std::memory_order_relaxed);
+        for (size_t i = first; i < last; ++i) {
+            const OscMessage& message = packet[i - first];
+            size_t bytes = message.address.size();
+            for (const std::string& argument : message.arguments) {
+                bytes += argument.size();
+            }
+            counters.oscMessages++;
+            counters.oscBytes += bytes;
+            counters.oscLatency.add(std::chrono::duration<float, std::milli>(now - ready[i].posted).count());
+        }
+    }
+    ready.clear();
+}
+
+std::string OscOutputQueue::makeKey(const OscMessage& message, const Policy& policy) const {
+    std::string key = message.address;
+    for (size_t i = 0; i < policy.keyArguments && i < message.arguments.size(); ++i) {
+        key += '\0';
+        key += message.arguments[i];
+    }
+    return key;
+}
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// An OSC message with string arguments, which is all the app sends
+struct OscMessage {
+    std::string address;
+    std::vector<std::string> arguments;
+
+    OscMessage(const std::string& address = "", const std::vector<std::string>& arguments = std::vector<std::string>());
+};
+
+// Sends OSC messages from a thread of its own, so callers never wait on the socket. Any thread
+// posts into a bounded lock-free queue; when it is full the message is dropped and counted
+// rather than waited for.
+//
+// The sender works in ticks: messages posted within tickMillis of each other go out together,
+// as one OSC bundle of up to maxBundle messages. Per address (see Policy), a newer message can
+// replace one not yet sent, e.g. each streamed prompt supersedes the last, and messages can be
+// held to a minimum interval. Messages that aren't coalesced wait their turn, at most
+// maxPendingPerKey of them per address, the oldest dropped beyond that, so a message is sent
+// within a tick plus maxPendingPerKey intervals of being posted or not at all.
+class OscOutputQueue {
+public:
+    // Sends the messages of one packet on the sender thread: a single message, or a bundle
+    // when there are several. Returns false when the packet couldn't be sent.
+    typedef std::function<bool(const std::vector<OscMessage>& packet)> Transport;
+
+    struct Policy {
+        bool coalesce;              // A newer message replaces the one waiting
+        double minIntervalMillis;   // Between messages to the address, 0 for no limit
+        size_t keyArguments;        // Leading arguments that tell messages apart as well as the address,
+                                    // e.g. the property of "/project1/StreamDiffusionTD property value"
+
+        Policy(bool coalesce = false, double minIntervalMillis = 0.0, size_t keyArguments = 0);
+    };
+
+    struct Settings {
+        size_t capacity;            // Messages queued for the sender, rounded up to a power of two
+        double tickMillis;
+        size_t maxBundle;
+        size_t maxPendingPerKey;
+        Policy defaultPolicy;       // Of addresses without a policy of their own
+
+        Settings();
+    };
+
+    struct Stats {
+        uint64_t posted;
+        uint64_t sent;
+        uint64_t packets;
+        uint64_t bundles;           // Packets with more than one message
+        uint64_t coalesced;         // Replaced by a newer message before they were sent
+        uint64_t dropped;           // Queue full, too many waiting for their address, or not running
+        uint64_t failed;            // Messages of packets the transport couldn't send
+    };
+
+    OscOutputQueue(const Settings& settings = Settings());
+
+    // Sends what is still waiting, see stop()
+    ~OscOutputQueue();
+
+    OscOutputQueue(const OscOutputQueue&) = delete;
+    OscOutputQueue& operator=(const OscOutputQueue&) = delete;
+
+    bool start(const Transport& transport);
+
+    // Sends the messages still waiting, ignoring the rate limits, and stops the sender thread
+    void stop();
+
+    bool isRunning() const;
+
+    // Any thread. Returns false when the message is dropped.
+    bool post(const OscMessage& message);
+
+    // Applies to messages not yet sent
+    void setPolicy(const std::string& address, const Policy& policy);
+
+    const Settings& getSettings() const;
+    Stats getStats() const;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Entry {
+        OscMessage message;
+        Clock::time_point posted;
+        uint64_t sequence;  // Order of arrival at the sender
+    };
+
+    // A slot of the queue, sequence tells whose turn it is (producers' or the sender's)
+    struct Cell {
+        std::atomic<uint64_t> sequence;
+        Entry entry;
+    };
+
+    // Messages waiting for the sender, per address and key arguments
+    struct Pending {
+        Policy policy;
+        std::deque<Entry> entries;
+        Clock::time_point lastSent;
+        bool sentBefore;
+    };
+
+    bool push(const OscMessage& message);
+    bool pop(Entry& entry);
+    bool hasQueued() const;
+
+    void senderLoop();
+    void waitForWork(Clock::time_point due);
+    void take(Entry& entry);
+    Clock::time_point collect(Clock::time_point now, bool flush, std::vector<Entry>& ready);
+    void send(std::vector<Entry>& ready);
+    std::string makeKey(const OscMessage& message, const Policy& policy) const;
+
+    Settings settings;
+    Transport transport;
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+
+    // Padded onto separate cache lines so producers and the sender don't false-share
+    char padding0[64];
+    std::atomic<uint64_t> enqueuePosition;
+    char padding1[64];
+    uint64_t dequeuePosition;   // Sender thread only
+    char padding2[64];
+
+    // Sender thread only
+    std::map<std::string, Pending> pending;
+    uint64_t nextSequence;
+
+    mutable std::mutex policyMutex;     // Guards policies
+    std::map<std::string, Policy> policies;
+
+    std::thread sender;
+    std::atomic<bool> running;
+    std::atomic<int> posting;   // Posts between their running check and push, stop() waits them out
+    std::atomic<bool> idle;     // The sender is waiting for work, posters wake it
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+
+    std::atomic<uint64_t> posted;
+    std::atomic<uint64_t> sent;
+    std::atomic<uint64_t> packets;
+    std::atomic<uint64_t> bundles;
+    std::atomic<uint64_t> coalesced;
+    std::atomic<uint64_t> dropped;
+    std::atomic<uint64_t> failed;
+};
@@ -0,0 +1,79 @@
+#include "PerfCounters.h"
+
+#include <algorithm>
+
+//-------------------------------------------------------------------------
+// RingHistogram
+//-------------------------------------------------------------------------
+const size_t RingHistogram::capacity;
+
+RingHistogram::RingHistogram() : written(0) {
+    for (auto& sample : samples) {
+        sample.store(0.0f, std::memory_order_relaxed);
+    }
+}
+
+void RingHistogram::add(float value) {
+    uint64_t index = written.fetch_add(1, std::memory_order_relaxed);
+    samples[index % capacity].store(value, std::memory_order_relaxed);
+}
+
+size_t RingHistogram::copySamples(float* out, size_t maxCount) const {
+    uint64_t end = written.load(std::memory_order_relaxed);
+    size_t count = static_cast<size_t>(std::min<uint64_t>(std::min<uint64_t>(end, capacity), maxCount));
+
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = samples[(end - count + i) % capacity].load(std::memory_order_relaxed);
+    }
+    return count;
+}
+
+void RingHistogram::getSummary(float& mean, float& p95, float& max) const {
+    float sorted[capacity];
+    size_t count = copySamples(sorted, capacity);
+
+    mean = p95 = max = 0.0f;
+    if (count == 0) return;
+
+    float total = 0.0f;
+    for (size_t i = 0; i < count; ++i) {
+        total += sorted[i];
+    }
+    mean = total / count;
+
+    size_t rank = std::min(count - 1, static_cast<size_t>(count * 0.95f));
+    std::nth_element(sorted, sorted + rank, sorted + count);
+    p95 = sorted[rank];
+    max = *std::max_element(sorted, sorted + count);
+}
+
+float RingHistogram::getLast() const {
+    uint64_t end = written.load(std::memory_order_relaxed);
+    return end == 0 ? 0.0f : samples[(end - 1) % capacity].load(std::memory_order_relaxed);
+}
+
+uint64_t RingHistogram::getCount() const {
+    return written.load(std::memory_order_relaxed);
+}
+
+//-------------------------------------------------------------------------
+// CacheCounter
+//-------------------------------------------------------------------------
+float CacheCounter::getHitRate() const {
+    uint64_t h = hits.load(std::memory_order_relaxed);
+    uint64_t m = misses.load(std::memory_order_relaxed);
+    return h + m == 0 ? 0.0f : static_cast<float>(h) / (h + m);
+}
+
+//-------------------------------------------------------------------------
+// PerfCounters
+//-------------------------------------------------------------------------
+PerfCounters::PerfCounters()
+    : inferenceInFlight(0), inferencePending(0), tilesResident(0), tileBytes(0), inferenceCoalesced(0), inferenceStale(0), oscMessages(0), oscBytes(0),
+    oscCoalesced(0), oscDropped(0), spoutFramesSent(0), spoutFramesReceived(0) {
+}
+
+PerfCounters& PerfCounters::get() {
+    static PerfCounters counters;
+    return counters;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Fixed-size ring of recent samples, written lock-free from any thread
+class RingHistogram {
+public:
+    static const size_t capacity = 256;
+
+    RingHistogram();
+
+    void add(float value);
+
+    // Copies up to maxCount of the most recent samples, oldest first
+    size_t copySamples(float* out, size_t maxCount) const;
+
+    // Summary of the samples currently in the ring
+    void getSummary(float& mean, float& p95, float& max) const;
+
+    float getLast() const;
+    uint64_t getCount() const;
+
+private:
+    std::atomic<float> samples[capacity];
+    std::atomic<uint64_t> written;
+};
+
+struct CacheCounter {
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> misses;
+
+    CacheCounter() : hits(0), misses(0) {}
+
+    void hit() { hits.fetch_add(1, std::memory_order_relaxed); }
+    void miss() { misses.fetch_add(1, std::memory_order_relaxed); }
+    float getHitRate() const;
+};
+
+// Hot-path counters shown by the performance HUD. Updates are single relaxed atomics,
+// cheap enough to leave enabled in the drawing and inference paths.
+struct PerfCounters {
+    // Timings in milliseconds
+    RingHistogram frameTime;
+    RingHistogram canvasRebuild;
+    RingHistogram tileRender;           // Canvas tiles rendered from the strokes, per frame
+    RingHistogram capture;
+    RingHistogram hudDraw;
+    RingHistogram timeToFirstPrompt;    // Canvas capture until the first prompt goes out over OSC
+    RingHistogram timeToComplete;       // Canvas capture until the full description arrives
+    RingHistogram imageComplete;        // timeToComplete split by canvas payload
+    RingHistogram vectorComplete;
+
+    RingHistogram inferenceBatchSize;   // Requests per batch sent by BatchingBackend
+    RingHistogram oscLatency;           // OSC message posted until sent by OscOutputQueue
+
+    // Canvas payload sizes in KB: base64 PNG or SVG text
+    RingHistogram imagePayload;
+    RingHistogram vectorPayload;
+
+    // Gauges
+    std::atomic<int> inferenceInFlight;
+    std::atomic<int> inferencePending;
+    std::atomic<int> tilesResident;
+    std::atomic<uint64_t> tileBytes;    // Raster storage allocated for canvas tiles
+
+    // Monotonic counters, the HUD derives rates from them
+    std::atomic<uint64_t> inferenceCoalesced;
+    std::atomic<uint64_t> inferenceStale;
+    std::atomic<uint64_t> oscMessages;
+    std::atomic<uint64_t> oscBytes;
+    std::atomic<uint64_t> oscCoalesced;
+    std::atomic<uint64_t> oscDropped;
+    std::atomic<uint64_t> spoutFramesSent;
+    std::atomic<uint64_t> spoutFramesReceived;
+
+    CacheCounter captureCache;
+    CacheCounter overlayCache;
+
+    static PerfCounters& get();
+
+private:
+    PerfCounters();
+};
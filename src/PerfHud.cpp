@@ -0,0 +1,148 @@
+#include "PerfHud.h"
+
+#include <cstdarg>
+#include <cstdio>
+
+using namespace ci;
+
+namespace {
+    const ColorA textColor(1, 1, 1, 1);
+    const ColorA warningColor(1.0f, 0.6f, 0.3f, 1);
+}
+
+PerfHud::PerfHud()
+    : visible(false), refreshInterval(0.25), lastRefresh(-1.0),
+    lastOscMessages(0), lastOscBytes(0), lastSpoutSent(0), lastSpoutReceived(0) {
+}
+
+void PerfHud::setup(const Font& font) {
+    overlay.setFont(font);
+    overlay.setBackground(ColorA(0, 0, 0, 0.6f));
+}
+
+void PerfHud::update(double seconds, const vdraw::Drawing& drawing) {
+    if (!visible) return;
+
+    if (lastRefresh < 0.0 || seconds - lastRefresh >= refreshInterval) {
+        refresh(seconds, drawing);
+    }
+}
+
+void PerfHud::setLine(size_t index, const ColorA& color, const char* format, ...) {
+    char text[128];
+
+    va_list args;
+    va_start(args, format);
+    vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+
+    overlay.setLine(index, text, color);
+}
+
+void PerfHud::refresh(double seconds, const vdraw::Drawing& drawing) {
+    PerfCounters& counters = PerfCounters::get();
+    double elapsed = lastRefresh < 0.0 ? 0.0 : seconds - lastRefresh;
+    lastRefresh = seconds;
+
+    float mean, p95, max;
+    size_t line = 0;
+
+    counters.frameTime.getSummary(mean, p95, max);
+    // Highlight when the slow frames drop below 30 fps
+    setLine(line++, p95 > 1000.0f / 30.0f ? warningColor : textColor, "frame      %6.2f ms  p95 %6.2f  max %6.2f  (%.0f fps)",
+        mean, p95, max, mean > 0 ? 1000.0f / mean : 0.0f);
+
+    size_t strokes = 0, points = 0;
+    for (size_t i = 0; i < drawing.getLayerCount(); ++i) {
+        const auto& layerStrokes = drawing.getLayer(i).getStrokes();
+        strokes += layerStrokes.size();
+        for (const auto& stroke : layerStrokes) {
+            points += stroke->getRawPoints().size();
+        }
+    }
+    setLine(line++, textColor, "strokes    %6zu     points %zu  layers %zu", strokes, points, drawing.getLayerCount());
+
+    counters.canvasRebuild.getSummary(mean, p95, max);
+    setLine(line++, textColor, "rebuild    %6.2f ms  max %6.2f  (%llu total)", counters.canvasRebuild.getLast(), max,
+        static_cast<unsigned long long>(counters.canvasRebuild.getCount()));
+
+    counters.tileRender.getSummary(mean, p95, max);
+    setLine(line++, textColor, "tiles      %6d     %6.1f MB  render %6.2f ms  max %6.2f", counters.tilesResident.load(),
+        counters.tileBytes.load() / (1024.0 * 1024.0), mean, max);
+
+    counters.capture.getSummary(mean, p95, max);
+    setLine(line++, textColor, "capture    %6.2f ms  max %6.2f  cache hit %5.1f%%", mean, max, counters.captureCache.getHitRate() * 100.0f);
+
+    setLine(line++, textColor, "overlay    cache hit %5.1f%%", counters.overlayCache.getHitRate() * 100.0f);
+
+    setLine(line++, textColor, "inference  %d in flight  %d waiting  %llu coalesced  %llu stale",
+        counters.inferenceInFlight.load(), counters.inferencePending.load(),
+        static_cast<unsigned long long>(counters.inferenceCoalesced.load()),
+        static_cast<unsigned long long>(counters.inferenceStale.load()));
+
+    if (counters.inferenceBatchSize.getCount() > 0) {
+        counters.inferenceBatchSize.getSummary(mean, p95, max);
+        setLine(line++, textColor, "batches    size %5.2f  p95 %4.0f  max %4.0f  (%llu sent)", mean, p95, max,
+            static_cast<unsigned long long>(counters.inferenceBatchSize.getCount()));
+    }
+
+    float firstMean, completeMean;
+    counters.timeToFirstPrompt.getSummary(firstMean, p95, max);
+    counters.timeToComplete.getSummary(completeMean, p95, max);
+    setLine(line++, textColor, "prompt     first %6.0f ms  complete %6.0f ms", firstMean, completeMean);
+
+    float imageSize, vectorSize;
+    counters.imagePayload.getSummary(imageSize, p95, max);
+    counters.vectorPayload.getSummary(vectorSize, p95, max);
+    counters.imageComplete.getSummary(completeMean, p95, max);
+    counters.vectorComplete.getSummary(mean, p95, max);
+    setLine(line++, textColor, "payload    image %6.1f KB %6.0f ms  vector %6.1f KB %6.0f ms", imageSize, completeMean, vectorSize, mean);
+
+    uint64_t oscMessages = counters.oscMessages.load();
+    uint64_t oscBytes = counters.oscBytes.load();
+    uint64_t spoutSent = counters.spoutFramesSent.load();
+    uint64_t spoutReceived = counters.spoutFramesReceived.load();
+    double scale = elapsed > 0.0 ? 1.0 / elapsed : 0.0;
+
+    setLine(line++, textColor, "osc        %6.1f msg/s  %6.2f KB/s", (oscMessages - lastOscMessages) * scale, (oscBytes - lastOscBytes) * scale / 1024.0);
+    if (counters.oscLatency.getCount() > 0) {
+        counters.oscLatency.getSummary(mean, p95, max);
+        setLine(line++, textColor, "osc queue  %6.2f ms  p95 %6.2f  (%llu coalesced, %llu dropped)", mean, p95,
+            static_cast<unsigned long long>(counters.oscCoalesced.load()), static_cast<unsigned long long>(counters.oscDropped.load()));
+    }
+    setLine(line++, textColor, "spout      %6.1f out/s  %6.1f in/s", (spoutSent - lastSpoutSent) * scale, (spoutReceived - lastSpoutReceived) * scale);
+
+    counters.hudDraw.getSummary(mean, p95, max);
+    setLine(line++, textColor, "hud        %6.3f ms  max %6.3f", mean, max);
+
+    overlay.setLineCount(line);
+
+    lastOscMessages = oscMessages;
+    lastOscBytes = oscBytes;
+    lastSpoutSent = spoutSent;
+    lastSpoutReceived = spoutReceived;
+}
+
+void PerfHud::draw(const vec2& position) {
+    if (!visible) return;
+    overlay.draw(position);
+}
+
+void PerfHud::setVisible(bool visible) {
+    this->visible = visible;
+    if (visible) {
+        lastRefresh = -1.0;
+    }
+}
+
+bool PerfHud::isVisible() const {
+    return visible;
+}
+
+void PerfHud::toggle() {
+    setVisible(!visible);
+}
+
+void PerfHud::setRefreshInterval(double seconds) {
+    refreshInterval = seconds;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "PerfCounters.h"
+#include "TextOverlay.h"
+#include "VectorDrawing.h"
+
+// On-screen performance overlay fed by PerfCounters. The text is reformatted a few times
+// per second into fixed buffers; in between, drawing it is a single cached quad.
+class PerfHud {
+public:
+    PerfHud();
+
+    void setup(const ci::Font& font);
+
+    // Refreshes the text when the refresh interval has passed
+    void update(double seconds, const vdraw::Drawing& drawing);
+    void draw(const ci::vec2& position);
+
+    void setVisible(bool visible);
+    bool isVisible() const;
+    void toggle();
+
+    void setRefreshInterval(double seconds);
+
+private:
+    void refresh(double seconds, const vdraw::Drawing& drawing);
+    void setLine(size_t index, const ci::ColorA& color, const char* format, ...);
+
+    TextOverlay overlay;
+    bool visible;
+    double refreshInterval;
+    double lastRefresh;
+
+    // Counter values at the previous refresh, for rates
+    uint64_t lastOscMessages;
+    uint64_t lastOscBytes;
+    uint64_t lastSpoutSent;
+    uint64_t lastSpoutReceived;
+};
@@ -0,0 +1,161 @@
+// PointCodec.cpp
+#include "PointCodec.h"
+
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define VDRAW_CODEC_SSE2 1
+#endif
+
+namespace vdraw {
+
+    namespace {
+
+        inline uint64_t zigzag(int64_t value) {
+            return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+        }
+
+        inline int64_t unzigzag(uint64_t value) {
+            return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+        }
+
+        inline void putVarint(std::vector<uint8_t>& out, uint64_t value) {
+            while (value >= 0x80) {
+                out.push_back(static_cast<uint8_t>(value | 0x80));
+                value >>= 7;
+            }
+            out.push_back(static_cast<uint8_t>(value));
+        }
+
+        // Returns false if the varint runs past end
+        inline bool getVarint(const uint8_t*& cursor, const uint8_t* end, uint64_t& value) {
+            value = 0;
+            for (int shift = 0; cursor < end && shift < 64; shift += 7) {
+                uint8_t byte = *cursor++;
+                value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+                if (byte < 0x80) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+    } // namespace
+
+    PointCodecSettings::PointCodecSettings(float positionScale, float pressureScale, double timeScale)
+        : positionScale(positionScale), pressureScale(pressureScale), timeScale(timeScale) {
+    }
+
+    //-------------------------------------------------------------------------
+    // PointEncoder Implementation
+    //-------------------------------------------------------------------------
+    PointEncoder::PointEncoder(const PointCodecSettings& settings) : settings(settings) {
+        reset();
+    }
+
+    void PointEncoder::reset() {
+        lastX = lastY = lastTime = lastPressure = 0;
+    }
+
+    void PointEncoder::encode(const StrokePoint* points, size_t count, std::vector<uint8_t>& out) {
+        out.reserve(out.size() + count * 6);
+
+        for (size_t i = 0; i < count; ++i) {
+            const StrokePoint& point = points[i];
+            int64_t x = std::llround(point.position.x * settings.positionScale);
+            int64_t y = std::llround(point.position.y * settings.positionScale);
+            int64_t time = std::llround(point.timestamp * settings.timeScale);
+            int64_t pressure = std::llround(point.pressure * settings.pressureScale);
+
+            putVarint(out, zigzag(x - lastX));
+            putVarint(out, zigzag(y - lastY));
+            putVarint(out, zigzag(time - lastTime));
+            putVarint(out, zigzag(pressure - lastPressure));
+
+            lastX = x;
+            lastY = y;
+            lastTime = time;
+            lastPressure = pressure;
+        }
+    }
+
+    //-------------------------------------------------------------------------
+    // PointDecoder Implementation
+    //-------------------------------------------------------------------------
+    PointDecoder::PointDecoder(const PointCodecSettings& settings) : settings(settings) {
+        reset();
+    }
+
+    void PointDecoder::reset() {
+        lastX = lastY = lastTime = lastPressure = 0;
+    }
+
+    size_t PointDecoder::decode(const uint8_t* data, size_t size, std::vector<StrokePoint>& out) {
+        const uint8_t* cursor = data;
+        const uint8_t* end = data + size;
+
+        while (cursor < end) {
+#ifdef VDRAW_CODEC_SSE2
+            // Fast path: 16 single-byte varints (four whole points), the common case for
+            // smooth input. Check all continuation bits at once and unzigzag in 32-bit lanes.
+            if (end - cursor >= 16) {
+                __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cursor));
+                if (_mm_movemask_epi8(bytes) == 0) {
+                    const __m128i zero = _mm_setzero_si128();
+                    const __m128i one = _mm_set1_epi32(1);
+                    __m128i low = _mm_unpacklo_epi8(bytes, zero);
+                    __m128i high = _mm_unpackhi_epi8(bytes, zero);
+                    __m128i lanes[4] = {
+                        _mm_unpacklo_epi16(low, zero), _mm_unpackhi_epi16(low, zero),
+                        _mm_unpacklo_epi16(high, zero), _mm_unpackhi_epi16(high, zero)
+                    };
+
+                    // Each lane group is one point: dx, dy, dt, dpressure
+                    alignas(16) int32_t deltas[16];
+                    for (int i = 0; i < 4; ++i) {
+                        __m128i decoded = _mm_xor_si128(_mm_srli_epi32(lanes[i], 1),
+                            _mm_sub_epi32(zero, _mm_and_si128(lanes[i], one)));
+                        _mm_store_si128(reinterpret_cast<__m128i*>(deltas + i * 4), decoded);
+                    }
+
+                    for (int i = 0; i < 16; i += 4) {
+                        lastX += deltas[i];
+                        lastY += deltas[i + 1];
+                        lastTime += deltas[i + 2];
+                        lastPressure += deltas[i + 3];
+                        emit(out);
+                    }
+
+                    cursor += 16;
+                    continue;
+                }
+            }
+#endif
+            // Scalar path: one point, rolled back if it is incomplete
+            const uint8_t* start = cursor;
+            uint64_t dx, dy, dt, dp;
+            if (!getVarint(cursor, end, dx) || !getVarint(cursor, end, dy) ||
+                !getVarint(cursor, end, dt) || !getVarint(cursor, end, dp)) {
+                cursor = start;
+                break;
+            }
+
+            lastX += unzigzag(dx);
+            lastY += unzigzag(dy);
+            lastTime += unzigzag(dt);
+            lastPressure += unzigzag(dp);
+            emit(out);
+        }
+
+        return static_cast<size_t>(cursor - data);
+    }
+
+    void PointDecoder::emit(std::vector<StrokePoint>& out) const {
+        out.push_back(StrokePoint(
+            Vec2(lastX / settings.positionScale, lastY / settings.positionScale),
+            lastPressure / settings.pressureScale,
+            lastTime / settings.timeScale));
+    }
+
+} // namespace vdraw
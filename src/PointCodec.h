@@ -0,0 +1,58 @@
+// PointCodec.h
+#pragma once
+
+#include "VectorDrawing.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace vdraw {
+
+    // Quantization grid for the point codec
+    struct PointCodecSettings {
+        float positionScale;    // Grid steps per pixel (4 = quarter-pixel positions)
+        float pressureScale;    // Steps per unit pressure
+        double timeScale;       // Steps per second (1000 = millisecond timestamps)
+
+        PointCodecSettings(float positionScale = 4.0f, float pressureScale = 256.0f, double timeScale = 1000.0);
+    };
+
+    // Lossy point stream codec: positions, pressure and time are quantized to a grid,
+    // delta-encoded against the previous point and written as zigzag varints (x, y, t, pressure).
+    // Smooth mouse or pen input typically encodes at 4-6 bytes per point instead of 24.
+    //
+    // The encoder keeps its state between calls, so a stroke can be encoded as it grows;
+    // the matching decoder must see the same stream from the same reset point.
+    class PointEncoder {
+    public:
+        PointEncoder(const PointCodecSettings& settings = PointCodecSettings());
+
+        // Start a new stream; the next point is encoded relative to zero
+        void reset();
+
+        // Append the encoding of points to out
+        void encode(const StrokePoint* points, size_t count, std::vector<uint8_t>& out);
+
+    private:
+        PointCodecSettings settings;
+        int64_t lastX, lastY, lastTime, lastPressure;
+    };
+
+    class PointDecoder {
+    public:
+        PointDecoder(const PointCodecSettings& settings = PointCodecSettings());
+
+        void reset();
+
+        // Decode every complete point in data and append it to out.
+        // Returns the number of bytes consumed; an incomplete trailing point is left for the next call.
+        size_t decode(const uint8_t* data, size_t size, std::vector<StrokePoint>& out);
+
+    private:
+        PointCodecSettings settings;
+        int64_t lastX, lastY, lastTime, lastPressure;
+
+        void emit(std::vector<StrokePoint>& out) const;
+    };
+
+} // namespace vdraw
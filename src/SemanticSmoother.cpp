@@ -0,0 +1,179 @@
+#include "SemanticSmoother.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+
+namespace {
+
+    // Words that appear in nearly every description and say nothing about the subject
+    const char* stopWords[] = {
+        "a", "an", "the", "of", "with", "and", "in", "on", "at", "to", "is", "it", "its", "this", "that",
+        "some", "there", "what", "appears", "be", "being", "drawn", "drawing", "sketch", "image", "picture",
+        "simple", "depicts", "shows", "showing"
+    };
+
+    bool isStopWord(const std::string& word) {
+        for (const char* stop : stopWords) {
+            if (word == stop) return true;
+        }
+        return false;
+    }
+
+    uint32_t hashString(const std::string& text) {
+        uint32_t hash = 2166136261u;
+        for (unsigned char c : text) {
+            hash = (hash ^ c) * 16777619u;
+        }
+        return hash;
+    }
+
+    void tokenize(const std::string& text, std::vector<std::string>& words) {
+        words.clear();
+        std::string word;
+        for (char c : text) {
+            if (std::isalnum(static_cast<unsigned char>(c))) {
+                word += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            }
+            else if (!word.empty()) {
+                if (!isStopWord(word)) words.push_back(word);
+                word.clear();
+            }
+        }
+        if (!word.empty() && !isStopWord(word)) words.push_back(word);
+    }
+
+} // namespace
+
+SemanticSmoother::SemanticSmoother(size_t historySize, size_t dimensions)
+    : historySize(std::max<size_t>(1, historySize)), dimensions(std::max<size_t>(16, dimensions)),
+    recencyDecay(0.1f), switchMargin(0.05f) {
+}
+
+void SemanticSmoother::addFeature(const std::string& feature, float weight, std::vector<float>& out) const {
+    // The sign bit keeps hash collisions from biasing similarities upwards
+    uint32_t hash = hashString(feature);
+    out[hash % dimensions] += (hash & 0x80000000u) ? -weight : weight;
+}
+
+void SemanticSmoother::embed(const std::string& text, std::vector<float>& out) const {
+    out.assign(dimensions, 0.0f);
+
+    std::vector<std::string> words;
+    tokenize(text, words);
+
+    for (size_t i = 0; i < words.size(); ++i) {
+        addFeature(words[i], 1.0f, out);
+
+        if (i + 1 < words.size()) {
+            addFeature(words[i] + ' ' + words[i + 1], 0.5f, out);
+        }
+
+        // Character trigrams so plurals and small variations ("cat", "cats") still match
+        std::string padded = "^" + words[i] + "$";
+        for (size_t j = 0; j + 3 <= padded.size(); ++j) {
+            addFeature(padded.substr(j, 3), 0.25f, out);
+        }
+    }
+
+    float length = std::sqrt(dot(out, out));
+    if (length > 0.0f) {
+        for (float& value : out) {
+            value /= length;
+        }
+    }
+}
+
+float SemanticSmoother::dot(const std::vector<float>& a, const std::vector<float>& b) const {
+    float sum = 0.0f;
+    for (size_t i = 0; i < a.size() && i < b.size(); ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+const std::string& SemanticSmoother::add(const std::string& result) {
+    // Reuse the oldest entry's storage once the history is full
+    Entry entry;
+    if (history.size() >= historySize) {
+        entry = std::move(history.back());
+        history.pop_back();
+    }
+    entry.text = result;
+    embed(result, entry.vector);
+    history.push_front(std::move(entry));
+
+    centroid.assign(dimensions, 0.0f);
+    for (size_t i = 0; i < history.size(); ++i) {
+        float weight = 1.0f / (1.0f + recencyDecay * i);
+        const std::vector<float>& vector = history[i].vector;
+        for (size_t d = 0; d < dimensions; ++d) {
+            centroid[d] += vector[d] * weight;
+        }
+    }
+
+    // Nearest candidate to the centroid, preferring the most recent on ties
+    size_t best = 0;
+    float bestScore = -1e30f;
+    for (size_t i = 0; i < history.size(); ++i) {
+        float score = dot(history[i].vector, centroid);
+        if (score > bestScore + 1e-6f) {
+            best = i;
+            bestScore = score;
+        }
+    }
+
+    if (!average.empty()) {
+        float currentScore = dot(averageVector, centroid);
+        float total = 0.0f;
+        for (size_t i = 0; i < history.size(); ++i) {
+            total += 1.0f / (1.0f + recencyDecay * i);
+        }
+
+        // Scores scale with the total weight, so the margin does too
+        if (currentScore >= bestScore - switchMargin * total) {
+            return average;
+        }
+    }
+
+    average = history[best].text;
+    averageVector = history[best].vector;
+    return average;
+}
+
+const std::string& SemanticSmoother::getAverage() const {
+    return average;
+}
+
+size_t SemanticSmoother::getHistorySize() const {
+    return history.size();
+}
+
+void SemanticSmoother::clear() {
+    history.clear();
+    average.clear();
+    averageVector.clear();
+}
+
+float SemanticSmoother::similarity(const std::string& a, const std::string& b) const {
+    std::vector<float> va, vb;
+    embed(a, va);
+    embed(b, vb);
+    return std::max(0.0f, dot(va, vb));
+}
+
+void SemanticSmoother::setRecencyDecay(float decay) {
+    recencyDecay = std::max(0.0f, decay);
+}
+
+float SemanticSmoother::getRecencyDecay() const {
+    return recencyDecay;
+}
+
+void SemanticSmoother::setSwitchMargin(float margin) {
+    switchMargin = std::max(0.0f, margin);
+}
+
+float SemanticSmoother::getSwitchMargin() const {
+    return switchMargin;
+}
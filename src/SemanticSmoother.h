@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+// Smooths the stream of interpretation results without another LLM call. Each result is
+// embedded as a signed hashed bag of word unigrams, bigrams and character trigrams; the
+// recency-weighted centroid of the recent results picks the result that best represents
+// them. The current average is kept unless another candidate is clearly closer, which
+// suppresses prompt jitter the same way the averaging prompt asked the model to.
+class SemanticSmoother {
+public:
+    SemanticSmoother(size_t historySize = 30, size_t dimensions = 512);
+
+    // Adds the newest result and returns the updated average
+    const std::string& add(const std::string& result);
+
+    const std::string& getAverage() const;
+    size_t getHistorySize() const;
+    void clear();
+
+    // Cosine similarity of two strings' embeddings, from 0 (unrelated) to 1
+    float similarity(const std::string& a, const std::string& b) const;
+
+    // Weight of the i-th most recent result is 1 / (1 + decay * i)
+    void setRecencyDecay(float decay);
+    float getRecencyDecay() const;
+
+    // How much closer to the centroid a candidate must be to replace the current average
+    void setSwitchMargin(float margin);
+    float getSwitchMargin() const;
+
+    void embed(const std::string& text, std::vector<float>& out) const;
+
+private:
+    struct Entry {
+        std::string text;
+        std::vector<float> vector;
+    };
+
+    void addFeature(const std::string& feature, float weight, std::vector<float>& out) const;
+    float dot(const std::vector<float>& a, const std::vector<float>& b) const;
+
+    size_t historySize;
+    size_t dimensions;
+    float recencyDecay;
+    float switchMargin;
+
+    std::deque<Entry> history;     // Most recent first
+    std::vector<float> centroid;
+    std::string average;
+    std::vector<float> averageVector;
+};
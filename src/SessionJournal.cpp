@@ -0,0 +1,682 @@
+// SessionJournal.cpp
+#include "SessionJournal.h"
+#include "DrawingDocument.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace vdraw {
+
+    namespace {
+
+        const size_t recordHeaderSize = 3 * sizeof(uint32_t);
+
+        uint32_t checksum(const uint8_t* data, size_t bytes) {
+            uint32_t hash = 2166136261u;
+            for (size_t i = 0; i < bytes; ++i) {
+                hash = (hash ^ data[i]) * 16777619u;
+            }
+            return hash;
+        }
+
+        template <typename T>
+        void put(std::vector<uint8_t>& buffer, const T& value) {
+            const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+            buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+        }
+
+        template <typename T>
+        bool get(const uint8_t*& cursor, const uint8_t* end, T& value) {
+            if (static_cast<size_t>(end - cursor) < sizeof(T)) return false;
+            memcpy(&value, cursor, sizeof(T));
+            cursor += sizeof(T);
+            return true;
+        }
+
+        void putStyle(std::vector<uint8_t>& buffer, const Color& color, float width, bool dynamicWidth, int smoothing) {
+            put(buffer, color.r);
+            put(buffer, color.g);
+            put(buffer, color.b);
+            put(buffer, color.a);
+            put(buffer, width);
+            put(buffer, static_cast<uint32_t>(dynamicWidth ? 1 : 0));
+            put(buffer, static_cast<int32_t>(smoothing));
+        }
+
+        bool getStyle(const uint8_t*& cursor, const uint8_t* end, Color& color, float& width, bool& dynamicWidth, int& smoothing) {
+            uint32_t dynamic = 0;
+            int32_t level = 0;
+            bool ok = get(cursor, end, color.r) && get(cursor, end, color.g) && get(cursor, end, color.b) &&
+                get(cursor, end, color.a) && get(cursor, end, width) && get(cursor, end, dynamic) && get(cursor, end, level);
+            dynamicWidth = dynamic != 0;
+            smoothing = level;
+            return ok;
+        }
+
+        void putPoints(std::vector<uint8_t>& buffer, const StrokePoint* points, size_t count) {
+            put(buffer, static_cast<uint32_t>(count));
+            const uint8_t* bytes = reinterpret_cast<const uint8_t*>(points);
+            buffer.insert(buffer.end(), bytes, bytes + count * sizeof(StrokePoint));
+        }
+
+        bool getPoints(const uint8_t*& cursor, const uint8_t* end, std::vector<StrokePoint>& points) {
+            uint32_t count = 0;
+            if (!get(cursor, end, count) || static_cast<size_t>(end - cursor) / sizeof(StrokePoint) < count) {
+                return false;
+            }
+            points.resize(count);
+            memcpy(points.data(), cursor, count * sizeof(StrokePoint));
+            cursor += count * sizeof(StrokePoint);
+            return true;
+        }
+
+        void putName(std::vector<uint8_t>& buffer, const std::string& name) {
+            put(buffer, static_cast<uint32_t>(name.size()));
+            buffer.insert(buffer.end(), name.begin(), name.end());
+        }
+
+        bool getName(const uint8_t*& cursor, const uint8_t* end, std::string& name) {
+            uint32_t length = 0;
+            if (!get(cursor, end, length) || static_cast<size_t>(end - cursor) < length) {
+                return false;
+            }
+            name.assign(reinterpret_cast<const char*>(cursor), length);
+            cursor += length;
+            return true;
+        }
+
+        void putLayerProperties(std::vector<uint8_t>& buffer, const Layer& layer, size_t index) {
+            put(buffer, static_cast<uint32_t>(index));
+            put(buffer, static_cast<uint32_t>(layer.isVisible() ? 1 : 0));
+            put(buffer, layer.getOpacity());
+        }
+
+        void putRecord(std::vector<uint8_t>& buffer, SessionJournal::RecordType type, const std::vector<uint8_t>& payload) {
+            put(buffer, static_cast<uint32_t>(type));
+            put(buffer, static_cast<uint32_t>(payload.size()));
+            put(buffer, checksum(payload.data(), payload.size()));
+            buffer.insert(buffer.end(), payload.begin(), payload.end());
+        }
+
+        void syncFile(FILE* file) {
+            fflush(file);
+#ifdef _WIN32
+            _commit(_fileno(file));
+#else
+            fsync(fileno(file));
+#endif
+        }
+
+        bool replaceFile(const std::string& from, const std::string& to) {
+#ifdef _WIN32
+            return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+            return rename(from.c_str(), to.c_str()) == 0;
+#endif
+        }
+
+    } // namespace
+
+    SessionJournal::SessionJournal(size_t queueCapacity)
+        : queue(queueCapacity), pendingSnapshot(nullptr), drawing(nullptr), file(nullptr),
+        journalBytes(0), snapshotBytes(0), failed(false), compactionThreshold(64 * 1024 * 1024), groupCommitMillis(100), running(false) {
+    }
+
+    SessionJournal::~SessionJournal() {
+        stop();
+    }
+
+    bool SessionJournal::start(const std::string& path, Drawing& drawing) {
+        if (running) {
+            return false;
+        }
+
+        replay(path, drawing);
+
+        file = fopen(path.c_str(), "ab");
+        if (!file) {
+            return false;
+        }
+
+        fseek(file, 0, SEEK_END);
+        journalBytes = static_cast<uint64_t>(std::max(0L, ftell(file)));
+        snapshotBytes = 0;
+        failed = false;
+
+        this->path = path;
+        this->drawing = &drawing;
+        running = true;
+        writer = std::thread(&SessionJournal::writerLoop, this);
+
+        drawing.addObserver(this);
+
+        // Start from a compacted journal, which also drops any torn record at the end
+        requestSnapshot();
+        return true;
+    }
+
+    void SessionJournal::stop() {
+        if (!running) {
+            return;
+        }
+
+        drawing->removeObserver(this);
+
+        // Shutdown is the one place we wait for the writer to make room
+        while (!flushPending()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            running = false;
+        }
+        wake.notify_one();
+        writer.join();
+
+        delete pendingSnapshot.exchange(nullptr);
+
+        if (file) {
+            fclose(file);
+            file = nullptr;
+        }
+        drawing = nullptr;
+    }
+
+    bool SessionJournal::isRunning() const {
+        return running;
+    }
+
+    void SessionJournal::setCompactionThreshold(uint64_t bytes) {
+        compactionThreshold = bytes;
+    }
+
+    void SessionJournal::setGroupCommitInterval(int millis) {
+        groupCommitMillis = std::max(1, millis);
+    }
+
+    uint64_t SessionJournal::getJournalBytes() const {
+        return journalBytes;
+    }
+
+    bool SessionJournal::hasFailed() const {
+        return failed;
+    }
+
+    size_t SessionJournal::replay(const std::string& path, Drawing& drawing) {
+        MappedFile mapped;
+        if (!mapped.open(path)) {
+            return 0;
+        }
+
+        const uint8_t* cursor = mapped.data();
+        const uint8_t* end = cursor + mapped.size();
+        size_t applied = 0;
+        std::vector<StrokePoint> points;
+
+        while (static_cast<size_t>(end - cursor) >= recordHeaderSize) {
+            uint32_t type = 0, size = 0, sum = 0;
+            get(cursor, end, type);
+            get(cursor, end, size);
+            get(cursor, end, sum);
+
+            if (static_cast<size_t>(end - cursor) < size || checksum(cursor, size) != sum) {
+                break;
+            }
+
+            const uint8_t* payload = cursor;
+            const uint8_t* payloadEnd = cursor + size;
+            cursor = payloadEnd;
+
+            Color color;
+            float width = 0;
+            bool dynamicWidth = false;
+            int smoothing = 0;
+
+            switch (type) {
+            case BeginStroke: {
+                if (!getStyle(payload, payloadEnd, color, width, dynamicWidth, smoothing) ||
+                    !getPoints(payload, payloadEnd, points) || points.empty()) {
+                    return applied;
+                }
+
+                // Begin with the stroke's own style, then restore the drawing's current style
+                Color currentColor = drawing.getColor();
+                float currentWidth = drawing.getStrokeWidth();
+                bool currentDynamicWidth = drawing.getDynamicWidth();
+                int currentSmoothing = drawing.getSmoothing();
+
+                drawing.setColor(color);
+                drawing.setStrokeWidth(width);
+                drawing.setDynamicWidth(dynamicWidth);
+                drawing.setSmoothing(smoothing);
+
+                drawing.beginStroke(points[0].position, points[0].pressure, points[0].timestamp);
+                drawing.continueStroke(points.data() + 1, points.size() - 1);
+
+                drawing.setColor(currentColor);
+                drawing.setStrokeWidth(currentWidth);
+                drawing.setDynamicWidth(currentDynamicWidth);
+                drawing.setSmoothing(currentSmoothing);
+                break;
+            }
+            case ContinueStroke:
+                if (!getPoints(payload, payloadEnd, points)) {
+                    return applied;
+                }
+                drawing.continueStroke(points);
+                break;
+            case EndStroke: drawing.endStroke(); break;
+            case Undo: drawing.undo(); break;
+            case Redo: drawing.redo(); break;
+            case Clear: drawing.clearDrawing(); break;
+            case ClearHistory: drawing.clearHistory(); break;
+            case BeginErase: {
+                Vec2 position;
+                float radius = 0;
+                if (!get(payload, payloadEnd, position.x) || !get(payload, payloadEnd, position.y) ||
+                    !get(payload, payloadEnd, radius)) {
+                    return applied;
+                }
+                drawing.beginErase(position, radius);
+                break;
+            }
+            case ContinueErase: {
+                Vec2 position;
+                if (!get(payload, payloadEnd, position.x) || !get(payload, payloadEnd, position.y)) {
+                    return applied;
+                }
+                drawing.continueErase(position);
+                break;
+            }
+            case EndErase: drawing.endErase(); break;
+            case AddLayer: {
+                std::string name;
+                if (!getName(payload, payloadEnd, name)) {
+                    return applied;
+                }
+                drawing.addLayer(name);
+                break;
+            }
+            case RemoveLayer:
+            case SelectLayer: {
+                uint32_t index = 0;
+                if (!get(payload, payloadEnd, index)) {
+                    return applied;
+                }
+                if (type == RemoveLayer) {
+                    drawing.removeLayer(index);
+                }
+                else {
+                    drawing.setActiveLayer(index);
+                }
+                break;
+            }
+            case LayerProperties: {
+                uint32_t index = 0, visible = 0;
+                float opacity = 1.0f;
+                if (!get(payload, payloadEnd, index) || !get(payload, payloadEnd, visible) ||
+                    !get(payload, payloadEnd, opacity)) {
+                    return applied;
+                }
+                drawing.setLayerVisible(index, visible != 0);
+                drawing.setLayerOpacity(index, opacity);
+                break;
+            }
+            case Style:
+                if (!getStyle(payload, payloadEnd, color, width, dynamicWidth, smoothing)) {
+                    return applied;
+                }
+                drawing.setColor(color);
+                drawing.setStrokeWidth(width);
+                drawing.setDynamicWidth(dynamicWidth);
+                drawing.setSmoothing(smoothing);
+                break;
+            default:
+                return applied;
+            }
+
+            applied++;
+        }
+
+        return applied;
+    }
+
+    //-------------------------------------------------------------------------
+    // DrawingObserver (UI thread)
+    //-------------------------------------------------------------------------
+    void SessionJournal::strokeBegan(const Stroke& stroke) {
+        std::vector<uint8_t> payload;
+        putStyle(payload, stroke.getColor(), stroke.getBaseWidth(), stroke.getDynamicWidth(), stroke.getSmoothing());
+        putPoints(payload, stroke.getRawPoints().data(), stroke.getRawPoints().size());
+        append(BeginStroke, payload);
+    }
+
+    void SessionJournal::strokeContinued(const Stroke& stroke, size_t firstNewPoint) {
+        const auto& raw = stroke.getRawPoints();
+        std::vector<uint8_t> payload;
+        putPoints(payload, raw.data() + firstNewPoint, raw.size() - firstNewPoint);
+        append(ContinueStroke, payload);
+    }
+
+    void SessionJournal::strokeEnded(const Stroke& stroke) {
+        append(EndStroke, std::vector<uint8_t>());
+        compactIfNeeded();
+    }
+
+    void SessionJournal::drawingCleared() {
+        append(Clear, std::vector<uint8_t>());
+        compactIfNeeded();
+    }
+
+    void SessionJournal::eraseBegan(const Vec2& position, float radius) {
+        std::vector<uint8_t> payload;
+        put(payload, position.x);
+        put(payload, position.y);
+        put(payload, radius);
+        append(BeginErase, payload);
+    }
+
+    void SessionJournal::eraseContinued(const Vec2& position) {
+        std::vector<uint8_t> payload;
+        put(payload, position.x);
+        put(payload, position.y);
+        append(ContinueErase, payload);
+    }
+
+    void SessionJournal::eraseEnded(bool erased) {
+        append(EndErase, std::vector<uint8_t>());
+        compactIfNeeded();
+    }
+
+    void SessionJournal::undone() {
+        append(Undo, std::vector<uint8_t>());
+    }
+
+    void SessionJournal::redone() {
+        append(Redo, std::vector<uint8_t>());
+    }
+
+    void SessionJournal::styleChanged(const Color& color, float width, bool dynamicWidth, int smoothing) {
+        std::vector<uint8_t> payload;
+        putStyle(payload, color, width, dynamicWidth, smoothing);
+        append(Style, payload);
+    }
+
+    void SessionJournal::layerAdded(const Layer& layer, size_t index) {
+        std::vector<uint8_t> payload;
+        putName(payload, layer.getName());
+        append(AddLayer, payload);
+    }
+
+    void SessionJournal::layerRemoved(size_t index) {
+        std::vector<uint8_t> payload;
+        put(payload, static_cast<uint32_t>(index));
+        append(RemoveLayer, payload);
+        compactIfNeeded();
+    }
+
+    void SessionJournal::layerSelected(size_t index) {
+        std::vector<uint8_t> payload;
+        put(payload, static_cast<uint32_t>(index));
+        append(SelectLayer, payload);
+    }
+
+    void SessionJournal::layerChanged(const Layer& layer, size_t index) {
+        std::vector<uint8_t> payload;
+        putLayerProperties(payload, layer, index);
+        append(LayerProperties, payload);
+    }
+
+    void SessionJournal::append(RecordType type, const std::vector<uint8_t>& payload) {
+        record.clear();
+        putRecord(record, type, payload);
+        push(record.data(), record.size());
+    }
+
+    void SessionJournal::push(const uint8_t* data, size_t bytes) {
+        // Keep ordering: once anything is waiting in the overflow, append behind it
+        if (pending.empty() && queue.write(data, bytes)) {
+            return;
+        }
+
+        pending.insert(pending.end(), data, data + bytes);
+        flushPending();
+    }
+
+    bool SessionJournal::flushPending() {
+        // The writer only needs the byte stream, so the overflow can move across in pieces
+        size_t chunk = queue.capacity() / 4;
+        size_t flushed = 0;
+
+        while (flushed < pending.size()) {
+            size_t bytes = std::min(chunk, pending.size() - flushed);
+            if (!queue.write(pending.data() + flushed, bytes)) {
+                break;
+            }
+            flushed += bytes;
+        }
+
+        pending.erase(pending.begin(), pending.begin() + flushed);
+        return pending.empty();
+    }
+
+    void SessionJournal::compactIfNeeded() {
+        uint64_t queued = queue.getWritePosition() - queue.getReadPosition();
+        if (journalBytes + queued > std::max(compactionThreshold, 2 * snapshotBytes.load())) {
+            requestSnapshot();
+        }
+    }
+
+    void SessionJournal::requestSnapshot() {
+        // Only one snapshot in flight, and it must cover everything queued so far
+        if (pendingSnapshot.load() != nullptr || !flushPending()) {
+            return;
+        }
+
+        Snapshot* snapshot = new Snapshot();
+        snapshot->streamPosition = queue.getWritePosition();
+
+        std::vector<uint8_t> payload;
+        putStyle(payload, drawing->getColor(), drawing->getStrokeWidth(), drawing->getDynamicWidth(), drawing->getSmoothing());
+        putRecord(snapshot->records, Style, payload);
+
+        auto putStroke = [&payload](std::vector<uint8_t>& records, const Stroke& stroke) {
+            payload.clear();
+            putStyle(payload, stroke.getColor(), stroke.getBaseWidth(), stroke.getDynamicWidth(), stroke.getSmoothing());
+            putPoints(payload, stroke.getRawPoints().data(), stroke.getRawPoints().size());
+            putRecord(records, BeginStroke, payload);
+            putRecord(records, EndStroke, std::vector<uint8_t>());
+        };
+
+        // Each layer as it was before its oldest undoable command, then the commands as the
+        // operations that made them, so replay rebuilds the undo history along with the strokes.
+        // Replay starts from a drawing with its one initial layer, so only the layers above
+        // it are added.
+        std::vector<std::vector<uint8_t>> histories(drawing->getLayerCount());
+        for (size_t i = 0; i < drawing->getLayerCount(); ++i) {
+            const Layer& layer = drawing->getLayer(i);
+            if (i > 0) {
+                payload.clear();
+                putName(payload, layer.getName());
+                putRecord(snapshot->records, AddLayer, payload);
+            }
+
+            payload.clear();
+            putLayerProperties(payload, layer, i);
+            putRecord(snapshot->records, LayerProperties, payload);
+
+            payload.clear();
+            put(payload, static_cast<uint32_t>(i));
+            putRecord(snapshot->records, SelectLayer, payload);
+            putRecord(histories[i], SelectLayer, payload);
+
+            std::vector<uint8_t>& history = histories[i];
+            drawing->forEachHistoryStep(i, [&](const std::vector<Stroke*>& strokes) {
+                for (const Stroke* stroke : strokes) {
+                    putStroke(snapshot->records, *stroke);
+                }
+            }, [&](const HistoryStep& step) {
+                switch (step.type) {
+                case HistoryStep::AddStroke:
+                    putStroke(history, *step.stroke);
+                    break;
+                case HistoryStep::Clear:
+                    putRecord(history, Clear, std::vector<uint8_t>());
+                    break;
+                case HistoryStep::Erase:
+                    for (size_t p = 0; p < step.path->size(); ++p) {
+                        payload.clear();
+                        put(payload, (*step.path)[p].x);
+                        put(payload, (*step.path)[p].y);
+                        if (p == 0) {
+                            put(payload, step.radius);
+                        }
+                        putRecord(history, p == 0 ? BeginErase : ContinueErase, payload);
+                    }
+                    putRecord(history, EndErase, std::vector<uint8_t>());
+                    break;
+                }
+            });
+            for (size_t redo = 0; redo < layer.getRedoCount(); ++redo) {
+                putRecord(history, Undo, std::vector<uint8_t>());
+            }
+        }
+
+        // The base strokes went into the history as they were replayed, which now starts over
+        putRecord(snapshot->records, ClearHistory, std::vector<uint8_t>());
+        for (const std::vector<uint8_t>& history : histories) {
+            snapshot->records.insert(snapshot->records.end(), history.begin(), history.end());
+        }
+
+        payload.clear();
+        put(payload, static_cast<uint32_t>(drawing->getActiveLayer()));
+        putRecord(snapshot->records, SelectLayer, payload);
+
+        pendingSnapshot.store(snapshot);
+    }
+
+    //-------------------------------------------------------------------------
+    // Writer thread
+    //-------------------------------------------------------------------------
+    void SessionJournal::writerLoop() {
+        std::vector<uint8_t> chunk(64 * 1024);
+        bool stopping = false;
+
+        while (!stopping) {
+            {
+                std::unique_lock<std::mutex> lock(wakeMutex);
+                wake.wait_for(lock, std::chrono::milliseconds(groupCommitMillis), [this] { return !running; });
+                stopping = !running;
+            }
+
+            // Group commit: everything queued during the interval shares one fsync
+            bool wrote = false;
+            for (;;) {
+                uint64_t readStart = queue.getReadPosition();
+                size_t bytes = queue.read(chunk.data(), chunk.size());
+                uint64_t readEnd = readStart + bytes;
+
+                Snapshot* snapshot = pendingSnapshot.exchange(nullptr);
+                bool compacted = snapshot != nullptr;
+                if (compacted) {
+                    // Everything queued before the snapshot is superseded by it, but still goes
+                    // to the current journal first, which stays complete if the swap fails
+                    size_t before = static_cast<size_t>(std::min(readEnd, snapshot->streamPosition) - readStart);
+                    writeBytes(chunk.data(), before);
+                    while (readEnd < snapshot->streamPosition) {
+                        size_t read = queue.read(chunk.data(), static_cast<size_t>(std::min<uint64_t>(chunk.size(), snapshot->streamPosition - readEnd)));
+                        writeBytes(chunk.data(), read);
+                        readEnd += read;
+                    }
+
+                    if (!writeSnapshot(*snapshot)) {
+                        failed = true;
+                    }
+
+                    // What was read past the snapshot; nothing when the loop above had to read on
+                    writeBytes(chunk.data() + before, bytes - before);
+                    delete snapshot;
+                    wrote = true;
+                }
+                else {
+                    writeBytes(chunk.data(), bytes);
+                    wrote = wrote || bytes > 0;
+                }
+
+                if (bytes == 0 && !compacted) {
+                    break;
+                }
+            }
+
+            if (wrote && file) {
+                syncFile(file);
+            }
+        }
+    }
+
+    void SessionJournal::writeBytes(const uint8_t* data, size_t bytes) {
+        if (bytes == 0) {
+            return;
+        }
+        if (!file || fwrite(data, 1, bytes, file) != bytes) {
+            failed = true;
+            return;
+        }
+        journalBytes += bytes;
+    }
+
+    bool SessionJournal::writeSnapshot(const Snapshot& snapshot) {
+        // Write the snapshot beside the journal and swap it in atomically,
+        // so a crash leaves either the old journal or the complete snapshot
+        std::string snapshotPath = path + ".tmp";
+        FILE* snapshotFile = fopen(snapshotPath.c_str(), "wb");
+        if (!snapshotFile) {
+            return false;
+        }
+
+        bool written = fwrite(snapshot.records.data(), 1, snapshot.records.size(), snapshotFile) == snapshot.records.size();
+        syncFile(snapshotFile);
+        written = fclose(snapshotFile) == 0 && written;
+        if (!written) {
+            remove(snapshotPath.c_str());
+            return false;
+        }
+
+        // Windows can't replace a file that is open, so the journal is closed for the swap
+        // there; elsewhere it stays open, and on failure appending simply goes on
+        if (file) {
+            syncFile(file);
+        }
+#ifdef _WIN32
+        if (file) {
+            fclose(file);
+            file = nullptr;
+        }
+#endif
+        if (!replaceFile(snapshotPath, path)) {
+            remove(snapshotPath.c_str());
+#ifdef _WIN32
+            file = fopen(path.c_str(), "ab");
+#endif
+            return false;
+        }
+
+        if (file) {
+            fclose(file);
+        }
+        file = fopen(path.c_str(), "ab");
+        journalBytes = snapshot.records.size();
+        snapshotBytes = snapshot.records.size();
+        return file != nullptr;
+    }
+
+} // namespace vdraw
@@ -0,0 +1,133 @@
+// SessionJournal.h
+#pragma once
+
+#include "VectorDrawing.h"
+#include "SpscRingBuffer.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace vdraw {
+
+    // Append-only journal of drawing operations for crash recovery.
+    //
+    // The journal observes a Drawing on the UI thread and serializes each operation into
+    // a lock-free ring buffer. A background thread drains the ring, appends to the journal
+    // file and fsyncs once per group-commit interval, so the UI thread never touches disk.
+    // Once the file grows past the compaction threshold it is atomically replaced by a
+    // snapshot of the current layers, their strokes and their undo histories, written as the
+    // strokes before each history followed by the operations that made it.
+    //
+    // Record layout: uint32 type, uint32 payload size, uint32 FNV-1a checksum, payload.
+    // Replay stops at the first torn or corrupt record, e.g. after a power cut.
+    class SessionJournal : public DrawingObserver {
+    public:
+        enum RecordType : uint32_t {
+            BeginStroke = 1,
+            ContinueStroke,
+            EndStroke,
+            Undo,
+            Redo,
+            Clear,
+            Style,
+            BeginErase,
+            ContinueErase,
+            EndErase,
+            AddLayer,
+            RemoveLayer,
+            SelectLayer,
+            LayerProperties,
+            ClearHistory    // Within a snapshot, between the strokes and the histories
+        };
+
+        SessionJournal(size_t queueCapacity = 4 * 1024 * 1024);
+        ~SessionJournal();
+
+        SessionJournal(const SessionJournal&) = delete;
+        SessionJournal& operator=(const SessionJournal&) = delete;
+
+        // Replay the journal at path into drawing, then record all further changes to it
+        bool start(const std::string& path, Drawing& drawing);
+
+        // Write outstanding records and stop the writer thread
+        void stop();
+
+        bool isRunning() const;
+
+        // Compact into a snapshot once the journal file grows past this many bytes, and to at
+        // least twice the last snapshot, so a drawing larger than this isn't snapshot every record
+        void setCompactionThreshold(uint64_t bytes);
+
+        // How long the writer batches records between fsyncs
+        void setGroupCommitInterval(int millis);
+
+        uint64_t getJournalBytes() const;
+
+        // A write failed (e.g. the disk is full or a snapshot couldn't be swapped in); records
+        // may have been lost since. Stays set until the journal is started again.
+        bool hasFailed() const;
+
+        // Replay a journal into a drawing, returns the number of records applied
+        static size_t replay(const std::string& path, Drawing& drawing);
+
+        // DrawingObserver
+        void strokeBegan(const Stroke& stroke) override;
+        void strokeContinued(const Stroke& stroke, size_t firstNewPoint) override;
+        void strokeEnded(const Stroke& stroke) override;
+        void drawingCleared() override;
+        void eraseBegan(const Vec2& position, float radius) override;
+        void eraseContinued(const Vec2& position) override;
+        void eraseEnded(bool erased) override;
+        void undone() override;
+        void redone() override;
+        void styleChanged(const Color& color, float width, bool dynamicWidth, int smoothing) override;
+        void layerAdded(const Layer& layer, size_t index) override;
+        void layerRemoved(size_t index) override;
+        void layerSelected(size_t index) override;
+        void layerChanged(const Layer& layer, size_t index) override;
+
+    private:
+        // Snapshot serialized on the UI thread, written by the writer thread.
+        // Replaces everything queued before streamPosition.
+        struct Snapshot {
+            uint64_t streamPosition;
+            std::vector<uint8_t> records;
+        };
+
+        SpscRingBuffer queue;
+        std::vector<uint8_t> record;    // UI thread scratch
+        std::vector<uint8_t> pending;   // UI thread overflow when the ring is full
+        std::atomic<Snapshot*> pendingSnapshot;
+
+        std::string path;
+        Drawing* drawing;
+        FILE* file;
+        std::atomic<uint64_t> journalBytes;
+        std::atomic<uint64_t> snapshotBytes;    // Of the last snapshot swapped in
+        std::atomic<bool> failed;
+        uint64_t compactionThreshold;
+        int groupCommitMillis;
+
+        std::thread writer;
+        std::atomic<bool> running;
+        std::mutex wakeMutex;
+        std::condition_variable wake;
+
+        void append(RecordType type, const std::vector<uint8_t>& payload);
+        void push(const uint8_t* data, size_t bytes);
+        bool flushPending();
+        void compactIfNeeded();
+        void requestSnapshot();
+
+        void writerLoop();
+        void writeBytes(const uint8_t* data, size_t bytes);
+        bool writeSnapshot(const Snapshot& snapshot);
+    };
+
+} // namespace vdraw
@@ -0,0 +1,483 @@
+#include "SessionManager.h"
+
+#include <algorithm>
+
+namespace {
+
+    template <typename Duration>
+    float toMillis(Duration duration) {
+        return std::chrono::duration<float, std::milli>(duration).count();
+    }
+
+}
+
+//-------------------------------------------------------------------------
+// SessionManager
+//-------------------------------------------------------------------------
+SessionManager::Settings::Settings()
+    : workerThreads(0), inferenceThreads(8), inputCapacity(256), quantum(64), tickSeconds(1.0 / 30.0),
+    captureSize(512), canvasSize(1536.0f), vectorPayload(false), model("llava:7b"),
+    prompt("provide a concise, but creative description of what is being drawn, no more than 10 words") {
+    vectorPrompt = "The SVG below is a sketch. " + prompt + ":\n";
+}
+
+SessionManager::Session::Session(SessionId id)
+    : id(id), stage("session " + std::to_string(id), 1), scheduled(false), dirty(false), closed(false), requests(0) {
+    drawing.addObserver(&trigger);
+}
+
+SessionManager::SessionManager(const InferenceBackendRef& backend, const Settings& settings)
+    : backend(backend), settings(settings), start(Clock::now()), workers(settings.workerThreads),
+    inference(std::max<size_t>(1, settings.inferenceThreads)), nextId(1), events(0), rejected(0), turns(0),
+    interpretations(0), results(0), failures(0), closedCoalesced(0), running(true) {
+    ticker = std::thread(&SessionManager::tick, this);
+}
+
+SessionManager::~SessionManager() {
+    running = false;
+    ticker.join();
+
+    std::vector<SessionId> open;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& entry : sessions) open.push_back(entry.first);
+    }
+    for (SessionId id : open) {
+        closeSession(id);
+    }
+}
+
+SessionManager::SessionId SessionManager::openSession() {
+    std::lock_guard<std::mutex> lock(mutex);
+    SessionId id = nextId++;
+    SessionRef session = std::make_shared<Session>(id);
+
+    session->drawing.setColor(vdraw::Color(0, 0, 0));
+    session->drawing.setStrokeWidth(session->input.strokeWidth);
+    if (settings.makePolicy) {
+        session->trigger.setPolicy(settings.makePolicy());
+    }
+    else {
+        session->trigger.setPolicy(std::make_shared<AdaptiveTriggerPolicy>());
+    }
+    session->trigger.reset(now());
+
+    sessions[id] = session;
+    return id;
+}
+
+void SessionManager::closeSession(SessionId id) {
+    SessionRef session;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = sessions.find(id);
+        if (it == sessions.end()) return;
+        session = it->second;
+        sessions.erase(it);
+    }
+
+    // Out of the map the ticker no longer schedules it; posters still waiting give up
+    std::unique_lock<std::mutex> lock(session->mutex);
+    session->closed = true;
+    session->changed.notify_all();
+    session->changed.wait(lock, [&]() { return isIdle(*session); });
+
+    closedCoalesced += session->stage.getStats().coalesced;
+}
+
+bool SessionManager::post(SessionId id, const InputEvent& event, bool wait) {
+    SessionRef session;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = sessions.find(id);
+        if (it == sessions.end()) return false;
+        session = it->second;
+    }
+
+    std::unique_lock<std::mutex> lock(session->mutex);
+    while (!session->closed && session->queue.size() >= settings.inputCapacity) {
+        if (!wait) {
+            rejected++;
+            return false;
+        }
+        session->changed.wait(lock);
+    }
+    if (session->closed) return false;
+
+    PendingEvent pending;
+    pending.event = event;
+    pending.posted = Clock::now();
+    session->queue.push_back(pending);
+    events++;
+
+    // Scheduling under the lock keeps closeSession from seeing the session idle in between
+    if (!session->scheduled) {
+        session->scheduled = true;
+        schedule(session);
+    }
+    return true;
+}
+
+void SessionManager::drain() {
+    std::vector<SessionRef> open;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& entry : sessions) open.push_back(entry.second);
+    }
+
+    for (const SessionRef& session : open) {
+        std::unique_lock<std::mutex> lock(session->mutex);
+        session->changed.wait(lock, [&]() { return isIdle(*session); });
+    }
+}
+
+void SessionManager::setResultCallback(const ResultCallback& callback) {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->callback = callback;
+}
+
+const SessionManager::Settings& SessionManager::getSettings() const {
+    return settings;
+}
+
+size_t SessionManager::getWorkerCount() const {
+    return workers.getThreadCount();
+}
+
+SessionManager::Stats SessionManager::getStats() const {
+    Stats stats;
+    stats.events = events;
+    stats.rejected = rejected;
+    stats.turns = turns;
+    stats.interpretations = interpretations;
+    stats.results = results;
+    stats.failures = failures;
+    stats.coalesced = closedCoalesced;
+    stats.workers = workers.getStats();
+    stats.inference = inference.getStats();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.sessions = sessions.size();
+    for (const auto& entry : sessions) {
+        stats.coalesced += entry.second->stage.getStats().coalesced;
+    }
+    return stats;
+}
+
+const SessionManager::Timings& SessionManager::getTimings() const {
+    return timings;
+}
+
+void SessionManager::runTurn(const SessionRef& session) {
+    Clock::time_point turnStart = Clock::now();
+    std::vector<PendingEvent>& batch = session->batch;
+    {
+        std::lock_guard<std::mutex> lock(session->mutex);
+        size_t count = std::min(settings.quantum, session->queue.size());
+        batch.assign(session->queue.begin(), session->queue.begin() + count);
+        session->queue.erase(session->queue.begin(), session->queue.begin() + count);
+    }
+    session->changed.notify_all();
+
+    for (const PendingEvent& pending : batch) {
+        timings.inputLatency.add(toMillis(turnStart - pending.posted));
+        applyEvent(*session, pending.event);
+        if (pending.event.type == InputEvent::MouseDrag || pending.event.type == InputEvent::MouseUp) {
+            checkTrigger(session);
+        }
+    }
+
+    // Turns without input are the ticks, for policies that fire on time
+    if (batch.empty()) {
+        checkTrigger(session);
+    }
+
+    turns++;
+    timings.turn.add(toMillis(Clock::now() - turnStart));
+
+    std::lock_guard<std::mutex> lock(session->mutex);
+    session->dirty = session->trigger.getChangeSinceLastInterpretation() > 0 ||
+        session->trigger.getDistanceSinceLastInterpretation() > 0;
+
+    if (!session->queue.empty()) {
+        // More input arrived: continue behind the sessions that waited meanwhile
+        SessionRef self = session;
+        workers.submit([this, self]() { runTurn(self); }, true);
+        return;
+    }
+    session->scheduled = false;
+    session->changed.notify_all();
+}
+
+void SessionManager::applyEvent(Session& session, const InputEvent& event) {
+    vdraw::Drawing& drawing = session.drawing;
+    vdraw::Vec2 position(event.x, event.y);
+
+    switch (event.type) {
+    case InputEvent::MouseDown:
+        if (session.input.eraser) {
+            drawing.beginErase(position, session.input.eraserRadius);
+            break;
+        }
+        drawing.beginStroke(position, event.pressure, event.time);
+        session.trigger.strokeBegan(position);
+        break;
+
+    case InputEvent::MouseDrag:
+        if (session.input.eraser) {
+            drawing.continueErase(position);
+            break;
+        }
+        drawing.continueStroke(position, event.pressure, event.time);
+        session.trigger.strokeMoved(position);
+        break;
+
+    case InputEvent::MouseUp:
+        if (session.input.eraser) {
+            drawing.endErase();
+            break;
+        }
+        drawing.endStroke();
+        session.trigger.strokeEnded();
+        break;
+
+    case InputEvent::KeyDown:
+        SessionReplayer::handleKey(drawing, event, session.input);
+        break;
+    }
+}
+
+void SessionManager::checkTrigger(const SessionRef& session) {
+    double time = now();
+    if (session->trigger.shouldInterpret(time, session->stage.getStats().inFlight)) {
+        interpret(session, time);
+    }
+}
+
+void SessionManager::interpret(const SessionRef& session, double time) {
+    session->trigger.reset(time);
+    interpretations++;
+
+    Clock::time_point triggered = Clock::now();
+    InferenceRequest request;
+    request.model = settings.model;
+
+    // Captured here, while the turn owns the drawing; the stage may launch it later from an inference thread
+    if (settings.vectorPayload) {
+        request.prompt = settings.vectorPrompt +
+            session->encoder.encode(session->drawing, settings.canvasSize, settings.canvasSize);
+    }
+    else {
+        vdraw::ViewTransform view;
+        view.zoom = settings.captureSize / settings.canvasSize;
+        session->image.resize(settings.captureSize, settings.captureSize);
+        session->rasterizer.render(session->drawing, view, session->image);
+        vdraw::encodePng(session->image, session->png);
+
+        request.prompt = settings.prompt;
+        request.images.push_back(OllamaStreamClient::encodeBase64(session->png.data(), session->png.size()));
+    }
+    timings.capture.add(toMillis(Clock::now() - triggered));
+
+    SessionRef self = session;
+    session->stage.submit([this, self, request](uint64_t sequence) {
+        {
+            std::lock_guard<std::mutex> lock(self->mutex);
+            self->requests++;
+        }
+
+        inference.submit([this, self, request, sequence]() {
+            Clock::time_point sent = Clock::now();
+            std::string response;
+            std::string error;
+            bool ok = backend->generate(request, nullptr, response, error);
+            Clock::duration elapsed = Clock::now() - sent;
+            timings.model.add(toMillis(elapsed));
+
+            if (ok) self->trigger.interpretationCompleted(std::chrono::duration<double>(elapsed).count());
+            else failures++;
+
+            // Failed requests still complete so the stage moves on, without delivering
+            self->stage.complete(sequence, response, ok);
+
+            std::lock_guard<std::mutex> lock(self->mutex);
+            self->requests--;
+            self->changed.notify_all();
+        });
+    }, [this, self, triggered](const std::string& result) {
+        if (result.empty()) return;
+
+        results++;
+        timings.interpretation.add(toMillis(Clock::now() - triggered));
+
+        ResultCallback deliver;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            deliver = callback;
+        }
+        if (deliver) deliver(self->id, result);
+    });
+}
+
+void SessionManager::schedule(const SessionRef& session) {
+    SessionRef self = session;
+    workers.submit([this, self]() { runTurn(self); });
+}
+
+void SessionManager::tick() {
+    Clock::duration interval = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(settings.tickSeconds));
+    Clock::time_point next = Clock::now();
+
+    while (running) {
+        next += interval;
+        std::this_thread::sleep_until(next);
+
+        // Only sessions with ink waiting to be interpreted, the others have nothing to decide
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& entry : sessions) {
+            Session& session = *entry.second;
+            std::lock_guard<std::mutex> sessionLock(session.mutex);
+            if (session.dirty && !session.scheduled) {
+                session.scheduled = true;
+                schedule(entry.second);
+            }
+        }
+    }
+}
+
+double SessionManager::now() const {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+bool SessionManager::isIdle(Session& session) const {
+    return session.queue.empty() && !session.scheduled && session.requests == 0;
+}
+
+//-------------------------------------------------------------------------
+// SessionListener
+//-------------------------------------------------------------------------
+SessionListener::SessionListener(SessionManager& manager)
+    : manager(manager), listener(tcp::invalidSocket), port(0), running(false), openConnections(0) {
+}
+
+SessionListener::~SessionListener() {
+    stop();
+}
+
+bool SessionListener::start(int port, bool loopbackOnly) {
+    if (running) return true;
+
+    std::string error;
+    listener = tcp::listenOn(port, this->port, error, loopbackOnly);
+    if (listener == tcp::invalidSocket) return false;
+
+    manager.setResultCallback([this](SessionManager::SessionId session, const std::string& result) {
+        deliver(session, result);
+    });
+
+    running = true;
+    acceptThread = std::thread(&SessionListener::acceptLoop, this);
+    return true;
+}
+
+void SessionListener::stop() {
+    if (!running) return;
+
+    // Readers poll running between lines, then close their sessions
+    running = false;
+    acceptThread.join();
+
+    std::unique_lock<std::mutex> lock(connectionsMutex);
+    connectionsClosed.wait(lock, [this]() { return openConnections == 0; });
+    lock.unlock();
+
+    manager.setResultCallback(nullptr);
+    tcp::closeSocket(listener);
+    listener = tcp::invalidSocket;
+}
+
+int SessionListener::getPort() const {
+    return port;
+}
+
+int SessionListener::getConnectionCount() const {
+    std::lock_guard<std::mutex> lock(connectionsMutex);
+    return openConnections;
+}
+
+void SessionListener::acceptLoop() {
+    while (running) {
+        tcp::SocketHandle socket = tcp::acceptConnection(listener, 50);
+        if (socket == tcp::invalidSocket) continue;
+
+        tcp::setTimeout(socket, 10);
+        {
+            std::lock_guard<std::mutex> lock(connectionsMutex);
+            openConnections++;
+        }
+
+        // One reader thread per connection: it waits in post() while its session is full
+        std::thread([this, socket]() {
+            serve(socket);
+            tcp::closeSocket(socket);
+
+            std::lock_guard<std::mutex> lock(connectionsMutex);
+            if (--openConnections == 0) connectionsClosed.notify_all();
+        }).detach();
+    }
+}
+
+void SessionListener::serve(tcp::SocketHandle socket) {
+    SessionManager::SessionId session = manager.openSession();
+    auto connection = std::make_shared<Connection>();
+    connection->socket = socket;
+    {
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        connections[session] = connection;
+    }
+
+    std::string pending;
+    char buffer[4096];
+    while (running) {
+        if (!tcp::waitReadable(socket, 50)) continue;
+
+        int n = tcp::receive(socket, buffer, sizeof(buffer));
+        if (n <= 0) break;
+        pending.append(buffer, n);
+
+        size_t lineStart = 0;
+        size_t lineEnd;
+        while ((lineEnd = pending.find('\n', lineStart)) != std::string::npos) {
+            InputEvent event;
+            if (SessionRecorder::parse(pending.c_str() + lineStart, event)) {
+                manager.post(session, event);
+            }
+            lineStart = lineEnd + 1;
+        }
+        pending.erase(0, lineStart);
+    }
+
+    // No results arrive once the session is closed, so the connection can go
+    manager.closeSession(session);
+    std::lock_guard<std::mutex> lock(connectionsMutex);
+    connections.erase(session);
+}
+
+void SessionListener::deliver(SessionManager::SessionId session, const std::string& result) {
+    std::shared_ptr<Connection> connection;
+    {
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        auto it = connections.find(session);
+        if (it == connections.end()) return;
+        connection = it->second;
+    }
+
+    // One line per result
+    std::string line = "R " + result;
+    std::replace(line.begin(), line.end(), '\n', ' ');
+    line += '\n';
+
+    std::lock_guard<std::mutex> lock(connection->sendMutex);
+    tcp::sendAll(connection->socket, line);
+}
@@ -0,0 +1,216 @@
+#pragma once
+
+#include "InferenceBackend.h"
+#include "InferenceStage.h"
+#include "InterpretationTrigger.h"
+#include "PerfCounters.h"
+#include "SessionRecording.h"
+#include "SoftwareRasterizer.h"
+#include "TcpSocket.h"
+#include "VectorPayload.h"
+#include "WorkStealingPool.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Hosts many independent drawing sessions without a window, each with its own Drawing,
+// interpretation trigger and inference stage, fed with InputEvents from the network or a
+// replay. Sessions share one WorkStealingPool for applying input, rasterizing and encoding
+// captures, and a second pool for the blocking model requests.
+//
+// Fairness: a session is scheduled as one task at a time, which applies at most quantum
+// events and then yields behind the other sessions, so a busy session can't starve the rest.
+// Backpressure: each session buffers at most inputCapacity events; post() then waits (or
+// fails) until the session catches up, rather than queueing without bound. As in the app,
+// each session's inference stage coalesces captures made while the model is busy.
+class SessionManager {
+public:
+    typedef uint32_t SessionId;
+
+    // Receives each session's descriptions in order, from an inference thread
+    typedef std::function<void(SessionId session, const std::string& result)> ResultCallback;
+
+    struct Settings {
+        size_t workerThreads;       // Input, rasterizing and encoding; 0 uses one per hardware thread
+        size_t inferenceThreads;    // Model requests running at once over all sessions
+        size_t inputCapacity;       // Events buffered per session before post() waits
+        size_t quantum;             // Events a session applies per turn before yielding
+        double tickSeconds;         // Trigger checks between input, like the app's frames
+        int captureSize;            // Side of the captured image in pixels
+        float canvasSize;           // Side of the drawing area captured, in drawing units
+        bool vectorPayload;         // Sends the strokes as SVG text instead of a PNG
+        std::string model;
+        std::string prompt;
+        std::string vectorPrompt;
+
+        // Trigger policy of each new session; none uses AdaptiveTriggerPolicy's defaults
+        std::function<std::shared_ptr<TriggerPolicy>()> makePolicy;
+
+        Settings();
+    };
+
+    struct Stats {
+        size_t sessions;
+        uint64_t events;
+        uint64_t rejected;          // Not posted because the session's input was full
+        uint64_t turns;
+        uint64_t interpretations;   // Captures sent to the inference stages
+        uint64_t results;
+        uint64_t failures;
+        uint64_t coalesced;         // Captures replaced while a session's model request ran
+        WorkStealingPool::Stats workers;
+        WorkStealingPool::Stats inference;
+    };
+
+    // Timings in milliseconds, of the most recent samples
+    struct Timings {
+        RingHistogram inputLatency;     // Posted until applied to the drawing
+        RingHistogram turn;             // One session's turn on a worker, including captures
+        RingHistogram capture;          // Rasterizing and encoding, or vectorizing
+        RingHistogram model;            // Model request
+        RingHistogram interpretation;   // Trigger until the description is delivered
+    };
+
+    SessionManager(const InferenceBackendRef& backend, const Settings& settings = Settings());
+
+    // Closes the remaining sessions, waiting for their requests
+    ~SessionManager();
+
+    SessionManager(const SessionManager&) = delete;
+    SessionManager& operator=(const SessionManager&) = delete;
+
+    SessionId openSession();
+
+    // Waits for the session's queued input and model requests; no results arrive afterwards
+    void closeSession(SessionId session);
+
+    // Queues an event for the session. When its input is full, waits if wait is set,
+    // otherwise returns false. Returns false once the session is closed.
+    bool post(SessionId session, const InputEvent& event, bool wait = true);
+
+    // Waits until every session has applied its queued input and has no model requests left
+    void drain();
+
+    void setResultCallback(const ResultCallback& callback);
+
+    const Settings& getSettings() const;
+    size_t getWorkerCount() const;
+    Stats getStats() const;
+    const Timings& getTimings() const;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct PendingEvent {
+        InputEvent event;
+        Clock::time_point posted;
+    };
+
+    struct Session {
+        SessionId id;
+
+        // Owned by the session's turn, which runs on one worker at a time
+        vdraw::Drawing drawing;
+        InterpretationTrigger trigger;
+        InputState input;
+        InferenceStage stage;
+        vdraw::SoftwareRasterizer rasterizer;
+        vdraw::RasterImage image;
+        std::vector<uint8_t> png;
+        vdraw::VectorPayloadEncoder encoder;
+        std::vector<PendingEvent> batch;
+
+        // Guards the fields below
+        std::mutex mutex;
+        std::condition_variable changed;    // Input taken, turn ended or request finished
+        std::deque<PendingEvent> queue;
+        bool scheduled;     // A turn is queued or running
+        bool dirty;         // Ink not yet interpreted, checked on ticks
+        bool closed;
+        int requests;       // Launched model requests not yet completed
+
+        Session(SessionId id);
+    };
+
+    typedef std::shared_ptr<Session> SessionRef;
+
+    void runTurn(const SessionRef& session);
+    void applyEvent(Session& session, const InputEvent& event);
+    void checkTrigger(const SessionRef& session);
+    void interpret(const SessionRef& session, double time);
+    void schedule(const SessionRef& session);
+    void tick();
+    double now() const;
+    bool isIdle(Session& session) const;
+
+    InferenceBackendRef backend;
+    Settings settings;
+    Clock::time_point start;
+
+    WorkStealingPool workers;
+    WorkStealingPool inference;
+
+    mutable std::mutex mutex;   // Guards sessions, nextId and callback
+    std::map<SessionId, SessionRef> sessions;
+    SessionId nextId;
+    ResultCallback callback;
+
+    std::atomic<uint64_t> events;
+    std::atomic<uint64_t> rejected;
+    std::atomic<uint64_t> turns;
+    std::atomic<uint64_t> interpretations;
+    std::atomic<uint64_t> results;
+    std::atomic<uint64_t> failures;
+    std::atomic<uint64_t> closedCoalesced;  // Of sessions already closed
+    Timings timings;
+
+    std::atomic<bool> running;
+    std::thread ticker;
+};
+
+// Accepts TCP connections and hosts one session per connection. Clients send InputEvents as
+// lines of the .vsession format (see SessionRecorder) and receive each description as a line
+// "R <text>". A client sending faster than its session keeps up is slowed by TCP flow control,
+// since the connection's reader waits in post() when the session's input is full.
+class SessionListener {
+public:
+    SessionListener(SessionManager& manager);
+    ~SessionListener();
+
+    // Port 0 picks a free port (see getPort)
+    bool start(int port, bool loopbackOnly = true);
+    void stop();
+    int getPort() const;
+    int getConnectionCount() const;
+
+private:
+    struct Connection {
+        tcp::SocketHandle socket;
+        std::mutex sendMutex;
+    };
+
+    void acceptLoop();
+    void serve(tcp::SocketHandle socket);
+    void deliver(SessionManager::SessionId session, const std::string& result);
+
+    SessionManager& manager;
+    tcp::SocketHandle listener;
+    int port;
+    std::atomic<bool> running;
+    std::thread acceptThread;
+
+    mutable std::mutex connectionsMutex;
+    std::condition_variable connectionsClosed;
+    std::map<SessionManager::SessionId, std::shared_ptr<Connection>> connections;
+    int openConnections;
+};
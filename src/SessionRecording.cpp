@@ -0,0 +1,428 @@
+#include "SessionRecording.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+#include <thread>
+
+namespace {
+
+    typedef std::chrono::steady_clock Clock;
+
+    double millisSince(Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    const char eventCodes[] = { 'D', 'M', 'U', 'K' };
+
+    // Cinder key codes used by DrawingApp
+    const int keyBackspace = 8;
+    const int keyDelete = 127;
+    const int keyPlus = 43;
+    const int keyEquals = 61;
+    const int keyMinus = 45;
+    const int keyLeftBracket = 91;
+    const int keyRightBracket = 93;
+
+}
+
+InputEvent::InputEvent()
+    : time(0), type(MouseDown), x(0), y(0), pressure(1.0f), keyCode(0), modifiers(0) {
+}
+
+InputState::InputState()
+    : strokeWidth(10.0f), smoothing(0), dynamicWidth(false), eraser(false), eraserRadius(12.0f) {
+}
+
+//-------------------------------------------------------------------------
+// SessionRecorder
+//-------------------------------------------------------------------------
+SessionRecorder::SessionRecorder() : recording(false) {
+}
+
+void SessionRecorder::start() {
+    events.clear();
+    recording = true;
+}
+
+void SessionRecorder::stop() {
+    recording = false;
+}
+
+bool SessionRecorder::isRecording() const {
+    return recording;
+}
+
+void SessionRecorder::record(const InputEvent& event) {
+    if (recording) {
+        events.push_back(event);
+    }
+}
+
+const std::vector<InputEvent>& SessionRecorder::getEvents() const {
+    return events;
+}
+
+bool SessionRecorder::save(const std::string& path) const {
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file) {
+        return false;
+    }
+
+    fprintf(file, "# vsession 1\n");
+    for (const auto& event : events) {
+        fputs(format(event).c_str(), file);
+    }
+
+    return fclose(file) == 0;
+}
+
+bool SessionRecorder::load(const std::string& path, std::vector<InputEvent>& events) {
+    FILE* file = fopen(path.c_str(), "r");
+    if (!file) {
+        return false;
+    }
+
+    events.clear();
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        InputEvent event;
+        if (parse(line, event)) {
+            events.push_back(event);
+        }
+    }
+
+    fclose(file);
+    return true;
+}
+
+std::string SessionRecorder::format(const InputEvent& event) {
+    char line[128];
+    snprintf(line, sizeof(line), "%.6f %c %.2f %.2f %.4f %d %d\n", event.time, eventCodes[event.type],
+        event.x, event.y, event.pressure, event.keyCode, event.modifiers);
+    return line;
+}
+
+bool SessionRecorder::parse(const char* line, InputEvent& event) {
+    if (line[0] == '#' || line[0] == '\n') {
+        return false;
+    }
+
+    char code = 0;
+    if (sscanf(line, "%lf %c %f %f %f %d %d", &event.time, &code, &event.x, &event.y,
+        &event.pressure, &event.keyCode, &event.modifiers) != 7) {
+        return false;
+    }
+
+    const char* found = std::find(eventCodes, eventCodes + 4, code);
+    if (found == eventCodes + 4) {
+        return false;
+    }
+
+    event.type = static_cast<InputEvent::Type>(found - eventCodes);
+    return true;
+}
+
+//-------------------------------------------------------------------------
+// ReplayStats
+//-------------------------------------------------------------------------
+StageTiming::StageTiming(const char* name) : name(name), count(0), totalMs(0), maxMs(0) {
+}
+
+void StageTiming::add(double ms) {
+    count++;
+    totalMs += ms;
+    maxMs = std::max(maxMs, ms);
+}
+
+double StageTiming::meanMs() const {
+    return count > 0 ? totalMs / count : 0.0;
+}
+
+ReplayStats::ReplayStats()
+    : events(0), points(0), interpretations(0), wallMs(0), sessionSeconds(0),
+    completed(0), coalesced(0), modelBusySeconds(0), maxInFlight(0), beginStroke("beginStroke"), continueStroke("continueStroke"), endStroke("endStroke"),
+    erase("erase"), keys("keys"), trigger("trigger") {
+}
+
+double ReplayStats::utilization() const {
+    return sessionSeconds > 0 && maxInFlight > 0 ? modelBusySeconds / (sessionSeconds * maxInFlight) : 0.0;
+}
+
+std::string ReplayStats::toString() const {
+    std::ostringstream out;
+    out << events << " events, " << points << " points, " << interpretations << " interpretations, "
+        << sessionSeconds << " s session replayed in " << wallMs << " ms\n";
+
+    if (maxInFlight > 0) {
+        out << "  model: " << completed << " completed, " << coalesced << " coalesced, "
+            << utilization() * 100.0 << "% utilized\n";
+    }
+
+    const StageTiming* stages[] = { &beginStroke, &continueStroke, &endStroke, &erase, &keys, &trigger };
+    for (const StageTiming* stage : stages) {
+        out << "  " << stage->name << ": " << stage->count << " calls, total " << stage->totalMs
+            << " ms, mean " << stage->meanMs() * 1000.0 << " us, max " << stage->maxMs * 1000.0 << " us\n";
+    }
+
+    return out.str();
+}
+
+//-------------------------------------------------------------------------
+// SessionReplayer
+//-------------------------------------------------------------------------
+SessionReplayer::SessionReplayer() : maxInFlight(1), frameRate(60.0) {
+}
+
+bool SessionReplayer::load(const std::string& path) {
+    return SessionRecorder::load(path, events);
+}
+
+void SessionReplayer::setEvents(const std::vector<InputEvent>& events) {
+    this->events = events;
+}
+
+void SessionReplayer::setInterpretationCallback(const std::function<void(double)>& callback) {
+    interpretationCallback = callback;
+}
+
+void SessionReplayer::setSimulatedModel(const std::function<double(size_t)>& serviceSeconds, int maxInFlight) {
+    this->serviceSeconds = serviceSeconds;
+    this->maxInFlight = std::max(1, maxInFlight);
+}
+
+void SessionReplayer::setFrameRate(double framesPerSecond) {
+    frameRate = framesPerSecond;
+}
+
+ReplayStats SessionReplayer::run(vdraw::Drawing& drawing, InterpretationTrigger& trigger, bool realTime) {
+    ReplayStats stats;
+    if (events.empty()) {
+        return stats;
+    }
+
+    // Start from DrawingApp's defaults
+    InputState state;
+    drawing.setColor(vdraw::Color(0, 0, 0));
+    drawing.setStrokeWidth(state.strokeWidth);
+    drawing.setSmoothing(state.smoothing);
+    drawing.setDynamicWidth(state.dynamicWidth);
+
+    Clock::time_point replayStart = Clock::now();
+    double sessionStart = events.front().time;
+
+    drawing.addObserver(&trigger);
+    trigger.reset(sessionStart);
+
+    // Simulated model: running interpretations (finish time, duration) and at most one waiting
+    std::vector<std::pair<double, double>> running;
+    size_t launched = 0;
+    bool waiting = false;
+    if (serviceSeconds) stats.maxInFlight = maxInFlight;
+
+    auto launch = [&](double time) {
+        double duration = serviceSeconds(launched++);
+        running.push_back(std::make_pair(time + duration, duration));
+    };
+
+    // Completes interpretations due by time, in finish order, launching the waiting one
+    auto advanceModel = [&](double time) {
+        while (!running.empty()) {
+            auto next = std::min_element(running.begin(), running.end());
+            double finish = next->first;
+            double duration = next->second;
+            if (finish > time) break;
+
+            running.erase(next);
+            stats.completed++;
+            stats.modelBusySeconds += duration;
+            trigger.interpretationCompleted(duration);
+
+            if (waiting) {
+                waiting = false;
+                launch(finish);
+            }
+        }
+    };
+
+    // Same sequence as AiDrawingApp: draw, update the trigger, interpret when significant
+    auto checkTrigger = [&](double time) {
+        if (serviceSeconds) advanceModel(time);
+
+        Clock::time_point start = Clock::now();
+        bool interpret = trigger.shouldInterpret(time, static_cast<int>(running.size()));
+        if (interpret) {
+            trigger.reset(time);
+        }
+        stats.trigger.add(millisSince(start));
+
+        if (interpret) {
+            stats.interpretations++;
+            if (serviceSeconds) {
+                if (static_cast<int>(running.size()) < maxInFlight) launch(time);
+                else if (waiting) stats.coalesced++;
+                else waiting = true;
+            }
+            if (interpretationCallback) {
+                interpretationCallback(time);
+            }
+        }
+    };
+
+    auto waitUntil = [&](double time) {
+        if (realTime) {
+            auto due = replayStart + std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(time - sessionStart));
+            std::this_thread::sleep_until(due);
+        }
+    };
+
+    double lastTime = sessionStart;
+    for (const auto& event : events) {
+        // Frames between input events
+        if (frameRate > 0) {
+            for (double frame = lastTime + 1.0 / frameRate; frame < event.time; frame += 1.0 / frameRate) {
+                waitUntil(frame);
+                checkTrigger(frame);
+            }
+        }
+        lastTime = std::max(lastTime, event.time);
+
+        waitUntil(event.time);
+
+        vdraw::Vec2 position(event.x, event.y);
+        Clock::time_point start = Clock::now();
+
+        switch (event.type) {
+        case InputEvent::MouseDown:
+            if (state.eraser) {
+                drawing.beginErase(position, state.eraserRadius);
+                stats.erase.add(millisSince(start));
+                break;
+            }
+            drawing.beginStroke(position, event.pressure, event.time);
+            stats.beginStroke.add(millisSince(start));
+            trigger.strokeBegan(position);
+            stats.points++;
+            break;
+
+        case InputEvent::MouseDrag:
+            if (state.eraser) {
+                drawing.continueErase(position);
+                stats.erase.add(millisSince(start));
+                break;
+            }
+            drawing.continueStroke(position, event.pressure, event.time);
+            stats.continueStroke.add(millisSince(start));
+            trigger.strokeMoved(position);
+            checkTrigger(event.time);
+            stats.points++;
+            break;
+
+        case InputEvent::MouseUp:
+            if (state.eraser) {
+                drawing.endErase();
+                stats.erase.add(millisSince(start));
+                checkTrigger(event.time);
+                break;
+            }
+            drawing.endStroke();
+            stats.endStroke.add(millisSince(start));
+            trigger.strokeEnded();
+            checkTrigger(event.time);
+            break;
+
+        case InputEvent::KeyDown:
+            handleKey(drawing, event, state);
+            stats.keys.add(millisSince(start));
+            break;
+        }
+
+        stats.events++;
+    }
+
+    if (serviceSeconds) advanceModel(events.back().time);
+    drawing.removeObserver(&trigger);
+
+    stats.wallMs = millisSince(replayStart);
+    stats.sessionSeconds = events.back().time - sessionStart;
+    return stats;
+}
+
+void SessionReplayer::handleKey(vdraw::Drawing& drawing, const InputEvent& event, InputState& state) {
+    bool command = (event.modifiers & (InputEvent::Control | InputEvent::Meta)) != 0;
+    const float I = 0.8f;
+    const float O = 0.2f;
+
+    if (command) {
+        if (event.keyCode == 'z') drawing.undo();
+        if (event.keyCode == 'y') drawing.redo();
+        return;
+    }
+
+    switch (event.keyCode) {
+    case keyDelete:
+    case keyBackspace: drawing.clearDrawing(); break;
+
+    case 'r': drawing.setColor(vdraw::Color(I, O, O)); break;
+    case 'g': drawing.setColor(vdraw::Color(O, I, O)); break;
+    case 'b': drawing.setColor(vdraw::Color(O, O, I)); break;
+    case 'k':
+    case 'w': drawing.setColor(vdraw::Color(O, O, O)); break;
+
+    case keyPlus:
+    case keyEquals:
+        state.strokeWidth = std::min(state.strokeWidth + 0.5f, 50.0f);
+        drawing.setStrokeWidth(state.strokeWidth);
+        break;
+
+    case keyMinus:
+        state.strokeWidth = std::max(state.strokeWidth - 0.5f, 0.5f);
+        drawing.setStrokeWidth(state.strokeWidth);
+        break;
+
+    case 'e':
+        drawing.endErase();
+        state.eraser = !state.eraser;
+        break;
+
+    case 'd':
+        state.dynamicWidth = !state.dynamicWidth;
+        drawing.setDynamicWidth(state.dynamicWidth);
+        break;
+
+    case 'a':
+        state.smoothing = std::min(state.smoothing + 1, 10);
+        drawing.setSmoothing(state.smoothing);
+        break;
+
+    case 'z':
+        state.smoothing = std::max(state.smoothing - 1, 0);
+        drawing.setSmoothing(state.smoothing);
+        break;
+
+    case 'l':
+        if (event.modifiers & InputEvent::Shift) {
+            drawing.removeLayer(drawing.getActiveLayer());
+        }
+        else {
+            drawing.setActiveLayer(drawing.addLayer("Layer " + std::to_string(drawing.getLayerCount() + 1)));
+        }
+        break;
+
+    case keyLeftBracket:
+        if (drawing.getActiveLayer() > 0) {
+            drawing.setActiveLayer(drawing.getActiveLayer() - 1);
+        }
+        break;
+
+    case keyRightBracket:
+        drawing.setActiveLayer(std::min(drawing.getActiveLayer() + 1, drawing.getLayerCount() - 1));
+        break;
+
+    case 'h':
+        drawing.setLayerVisible(drawing.getActiveLayer(), !drawing.getLayer(drawing.getActiveLayer()).isVisible());
+        break;
+    }
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "VectorDrawing.h"
+#include "InterpretationTrigger.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// One input event as fed into DrawingApp
+struct InputEvent {
+    enum Type { MouseDown, MouseDrag, MouseUp, KeyDown };
+
+    // Modifier flags
+    enum { Shift = 1, Control = 2, Alt = 4, Meta = 8 };
+
+    double time;        // App time in seconds, as passed to vdraw::Drawing
+    Type type;
+    float x, y;
+    float pressure;
+    int keyCode;        // Cinder key code (ASCII for printable keys)
+    int modifiers;
+
+    InputEvent();
+};
+
+// Drawing settings changed by keys, starting from DrawingApp's defaults
+struct InputState {
+    float strokeWidth;
+    int smoothing;
+    bool dynamicWidth;
+    bool eraser;
+    float eraserRadius;
+
+    InputState();
+};
+
+// Captures the input stream of a live session.
+// Events are buffered in memory and written on save(), so recording never blocks on disk.
+//
+// File format (.vsession), one event per line after the header:
+//   # vsession 1
+//   <time> <D|M|U|K> <x> <y> <pressure> <keyCode> <modifiers>
+class SessionRecorder {
+public:
+    SessionRecorder();
+
+    void start();
+    void stop();
+    bool isRecording() const;
+
+    void record(const InputEvent& event);
+
+    const std::vector<InputEvent>& getEvents() const;
+    bool save(const std::string& path) const;
+
+    static bool load(const std::string& path, std::vector<InputEvent>& events);
+
+    // One event line of the file format, also used to stream events over a socket (see SessionListener)
+    static std::string format(const InputEvent& event);
+    static bool parse(const char* line, InputEvent& event);
+
+private:
+    bool recording;
+    std::vector<InputEvent> events;
+};
+
+// Timing of one replay stage
+struct StageTiming {
+    const char* name;
+    size_t count;
+    double totalMs;
+    double maxMs;
+
+    StageTiming(const char* name = "");
+    void add(double ms);
+    double meanMs() const;
+};
+
+struct ReplayStats {
+    size_t events;
+    size_t points;
+    size_t interpretations;
+    double wallMs;
+    double sessionSeconds;
+
+    // With a simulated model (see SessionReplayer::setSimulatedModel)
+    size_t completed;
+    size_t coalesced;           // Replaced while waiting for the model, never run
+    double modelBusySeconds;
+    int maxInFlight;
+    double utilization() const; // Busy fraction of the model's capacity over the session
+
+    StageTiming beginStroke;
+    StageTiming continueStroke;
+    StageTiming endStroke;
+    StageTiming erase;
+    StageTiming keys;
+    StageTiming trigger;
+
+    ReplayStats();
+    std::string toString() const;
+};
+
+// Drives a vdraw::Drawing and the interpretation trigger from a recorded session without
+// a window, either at the recorded pace or as fast as possible, and times each stage.
+class SessionReplayer {
+public:
+    SessionReplayer();
+
+    bool load(const std::string& path);
+    void setEvents(const std::vector<InputEvent>& events);
+
+    // Called with the session time whenever the trigger would interpret the canvas
+    void setInterpretationCallback(const std::function<void(double)>& callback);
+
+    // Simulates the model in session time, so trigger policies can be compared offline: the
+    // n-th interpretation takes serviceSeconds(n), at most maxInFlight run at once and further
+    // requests wait, replacing each other, as in InferenceStage. The trigger sees the in-flight
+    // count and the completions the way it does in the app.
+    void setSimulatedModel(const std::function<double(size_t)>& serviceSeconds, int maxInFlight = 1);
+
+    // The app also checks the trigger every frame, between input events. 0 checks on input only.
+    void setFrameRate(double framesPerSecond);
+
+    ReplayStats run(vdraw::Drawing& drawing, InterpretationTrigger& trigger, bool realTime = false);
+
+    // Mirrors DrawingApp's key bindings that change the drawing
+    static void handleKey(vdraw::Drawing& drawing, const InputEvent& event, InputState& state);
+
+private:
+    std::vector<InputEvent> events;
+    std::function<void(double)> interpretationCallback;
+    std::function<double(size_t)> serviceSeconds;
+    int maxInFlight;
+    double frameRate;
+};
@@ -0,0 +1,332 @@
+// SoftwareRasterizer.cpp
+#include "SoftwareRasterizer.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace vdraw {
+
+    namespace {
+
+        uint8_t toByte(float value) {
+            return static_cast<uint8_t>(std::max(0.0f, std::min(1.0f, value)) * 255.0f + 0.5f);
+        }
+
+        //---------------------------------------------------------------------
+        // Deflate with the fixed Huffman codes (RFC 1951, 3.2.6)
+        //---------------------------------------------------------------------
+        const uint16_t lengthBase[] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99,
+            115, 131, 163, 195, 227, 258 };
+        const uint8_t lengthExtra[] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+        const uint16_t distanceBase[] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025,
+            1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+        const uint8_t distanceExtra[] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11,
+            12, 12, 13, 13 };
+
+        const size_t windowSize = 32768;
+        const size_t hashBits = 15;
+        const size_t maxChain = 16;
+        const size_t minMatch = 3;
+        const size_t maxMatch = 258;
+
+        class BitWriter {
+        public:
+            BitWriter(std::vector<uint8_t>& out) : out(out), buffer(0), count(0) {}
+
+            // Least significant bit first, as deflate packs data elements
+            void write(uint32_t value, int bits) {
+                buffer |= static_cast<uint64_t>(value) << count;
+                count += bits;
+                while (count >= 8) {
+                    out.push_back(static_cast<uint8_t>(buffer));
+                    buffer >>= 8;
+                    count -= 8;
+                }
+            }
+
+            // Huffman codes are packed most significant bit first
+            void writeCode(uint32_t code, int bits) {
+                uint32_t reversed = 0;
+                for (int i = 0; i < bits; ++i) {
+                    reversed = (reversed << 1) | ((code >> i) & 1);
+                }
+                write(reversed, bits);
+            }
+
+            void flush() {
+                if (count > 0) {
+                    out.push_back(static_cast<uint8_t>(buffer));
+                }
+                buffer = 0;
+                count = 0;
+            }
+
+        private:
+            std::vector<uint8_t>& out;
+            uint64_t buffer;
+            int count;
+        };
+
+        void writeLiteral(BitWriter& writer, uint32_t symbol) {
+            if (symbol < 144) writer.writeCode(0x30 + symbol, 8);
+            else if (symbol < 256) writer.writeCode(0x190 + symbol - 144, 9);
+            else if (symbol < 280) writer.writeCode(symbol - 256, 7);
+            else writer.writeCode(0xc0 + symbol - 280, 8);
+        }
+
+        void writeMatch(BitWriter& writer, size_t length, size_t distance) {
+            int code = 28;
+            while (lengthBase[code] > length) code--;
+            writeLiteral(writer, 257 + code);
+            writer.write(static_cast<uint32_t>(length - lengthBase[code]), lengthExtra[code]);
+
+            code = 29;
+            while (distanceBase[code] > distance) code--;
+            writer.writeCode(code, 5);
+            writer.write(static_cast<uint32_t>(distance - distanceBase[code]), distanceExtra[code]);
+        }
+
+        uint32_t hashAt(const uint8_t* data) {
+            uint32_t value = (static_cast<uint32_t>(data[0]) << 16) | (static_cast<uint32_t>(data[1]) << 8) | data[2];
+            return (value * 2654435761u) >> (32 - hashBits);
+        }
+
+        // One final block; greedy matching over hash chains of the last maxChain positions
+        void deflate(const std::vector<uint8_t>& data, std::vector<uint8_t>& out) {
+            BitWriter writer(out);
+            writer.write(1, 1);     // Final block
+            writer.write(1, 2);     // Fixed Huffman codes
+
+            std::vector<int32_t> head(size_t(1) << hashBits, -1);
+            std::vector<int32_t> previous(windowSize, -1);
+            size_t size = data.size();
+
+            auto insert = [&](size_t position) {
+                if (position + minMatch <= size) {
+                    uint32_t hash = hashAt(&data[position]);
+                    previous[position % windowSize] = head[hash];
+                    head[hash] = static_cast<int32_t>(position);
+                }
+            };
+
+            size_t position = 0;
+            while (position < size) {
+                size_t bestLength = 0, bestDistance = 0;
+                if (position + minMatch <= size) {
+                    size_t limit = std::min(maxMatch, size - position);
+                    int32_t candidate = head[hashAt(&data[position])];
+                    for (size_t chain = 0; chain < maxChain && candidate >= 0 && position - candidate <= windowSize; ++chain) {
+                        size_t length = 0;
+                        while (length < limit && data[candidate + length] == data[position + length]) length++;
+                        if (length > bestLength) {
+                            bestLength = length;
+                            bestDistance = position - candidate;
+                            if (length == limit) break;
+                        }
+                        candidate = previous[candidate % windowSize];
+                    }
+                }
+
+                if (bestLength >= minMatch) {
+                    writeMatch(writer, bestLength, bestDistance);
+                    for (size_t i = 0; i < bestLength; ++i) insert(position + i);
+                    position += bestLength;
+                }
+                else {
+                    writeLiteral(writer, data[position]);
+                    insert(position);
+                    position++;
+                }
+            }
+
+            writeLiteral(writer, 256);  // End of block
+            writer.flush();
+        }
+
+        //---------------------------------------------------------------------
+        // PNG container
+        //---------------------------------------------------------------------
+        struct CrcTable {
+            uint32_t entries[256];
+
+            CrcTable() {
+                for (uint32_t n = 0; n < 256; ++n) {
+                    uint32_t c = n;
+                    for (int k = 0; k < 8; ++k) c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                    entries[n] = c;
+                }
+            }
+        };
+
+        uint32_t crc32(const uint8_t* data, size_t size) {
+            static const CrcTable table;
+            uint32_t crc = 0xffffffffu;
+            for (size_t i = 0; i < size; ++i) {
+                crc = table.entries[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+            }
+            return ~crc;
+        }
+
+        uint32_t adler32(const std::vector<uint8_t>& data) {
+            uint32_t a = 1, b = 0;
+            for (uint8_t byte : data) {
+                a = (a + byte) % 65521;
+                b = (b + a) % 65521;
+            }
+            return (b << 16) | a;
+        }
+
+        void putBigEndian(std::vector<uint8_t>& out, uint32_t value) {
+            out.push_back(static_cast<uint8_t>(value >> 24));
+            out.push_back(static_cast<uint8_t>(value >> 16));
+            out.push_back(static_cast<uint8_t>(value >> 8));
+            out.push_back(static_cast<uint8_t>(value));
+        }
+
+        void putChunk(std::vector<uint8_t>& out, const char* type, const std::vector<uint8_t>& data) {
+            putBigEndian(out, static_cast<uint32_t>(data.size()));
+            size_t start = out.size();
+            out.insert(out.end(), type, type + 4);
+            out.insert(out.end(), data.begin(), data.end());
+            putBigEndian(out, crc32(&out[start], out.size() - start));
+        }
+
+    } // namespace
+
+    //-------------------------------------------------------------------------
+    // RasterImage Implementation
+    //-------------------------------------------------------------------------
+    RasterImage::RasterImage() : width(0), height(0) {}
+
+    void RasterImage::resize(int width, int height) {
+        this->width = std::max(0, width);
+        this->height = std::max(0, height);
+        pixels.resize(static_cast<size_t>(this->width) * this->height * 3);
+    }
+
+    void RasterImage::fill(const Color& color) {
+        uint8_t rgb[3] = { toByte(color.r), toByte(color.g), toByte(color.b) };
+        for (size_t i = 0; i < pixels.size(); i += 3) {
+            pixels[i] = rgb[0];
+            pixels[i + 1] = rgb[1];
+            pixels[i + 2] = rgb[2];
+        }
+    }
+
+    //-------------------------------------------------------------------------
+    // SoftwareRasterizer Implementation
+    //-------------------------------------------------------------------------
+    void SoftwareRasterizer::render(const Drawing& drawing, const ViewTransform& view, RasterImage& image) {
+        image.fill(Color(1, 1, 1));
+
+        Bounds area = view.visibleArea(static_cast<float>(image.width), static_cast<float>(image.height));
+        for (size_t i = 0; i < drawing.getLayerCount(); ++i) {
+            const Layer& layer = drawing.getLayer(i);
+            if (!layer.isVisible()) {
+                continue;
+            }
+
+            strokes.clear();
+            layer.queryStrokes(area, strokes);
+            for (const Stroke* stroke : strokes) {
+                drawStroke(*stroke, view, layer.getOpacity(), image);
+            }
+        }
+    }
+
+    void SoftwareRasterizer::drawStroke(const Stroke& stroke, const ViewTransform& view, float opacity, RasterImage& image) const {
+        const auto& points = stroke.getProcessedPoints();
+        if (points.size() < 2) {
+            return;
+        }
+
+        // The points to draw at this scale, or all of them
+        const IndexBuffer* lod = stroke.getLod(lodTolerance(view.zoom));
+        size_t count = lod ? lod->size() : points.size();
+        Color color = stroke.getColor();
+
+        for (size_t k = 1; k < count; ++k) {
+            size_t i = lod ? (*lod)[k] : k;
+            size_t previous = lod ? (*lod)[k - 1] : k - 1;
+            drawSegment(view.toScreen(points[previous].position), view.toScreen(points[i].position),
+                stroke.getWidthAt(previous) * 0.5f * view.zoom, stroke.getWidthAt(i) * 0.5f * view.zoom,
+                color, color.a * opacity, image);
+        }
+    }
+
+    void SoftwareRasterizer::drawSegment(const Vec2& a, const Vec2& b, float radiusA, float radiusB, const Color& color,
+        float alpha, RasterImage& image) const {
+        // Hairlines stay a pixel wide however far the view is zoomed out
+        radiusA = std::max(radiusA, 0.5f);
+        radiusB = std::max(radiusB, 0.5f);
+        float reach = std::max(radiusA, radiusB) + 1.0f;
+
+        int x0 = std::max(0, static_cast<int>(std::floor(std::min(a.x, b.x) - reach)));
+        int y0 = std::max(0, static_cast<int>(std::floor(std::min(a.y, b.y) - reach)));
+        int x1 = std::min(image.width - 1, static_cast<int>(std::ceil(std::max(a.x, b.x) + reach)));
+        int y1 = std::min(image.height - 1, static_cast<int>(std::ceil(std::max(a.y, b.y) + reach)));
+
+        Vec2 direction = b - a;
+        float lengthSquared = direction.x * direction.x + direction.y * direction.y;
+        float rgb[3] = { color.r * 255.0f, color.g * 255.0f, color.b * 255.0f };
+
+        for (int y = y0; y <= y1; ++y) {
+            uint8_t* row = &image.pixels[(static_cast<size_t>(y) * image.width) * 3];
+            for (int x = x0; x <= x1; ++x) {
+                Vec2 center(x + 0.5f, y + 0.5f);
+                Vec2 offset = center - a;
+                float t = lengthSquared > 0 ? (offset.x * direction.x + offset.y * direction.y) / lengthSquared : 0.0f;
+                t = std::max(0.0f, std::min(1.0f, t));
+
+                // Coverage falls off over the pixel straddling the edge
+                float distance = center.distanceTo(a + direction * t);
+                float coverage = radiusA + (radiusB - radiusA) * t + 0.5f - distance;
+                if (coverage <= 0.0f) {
+                    continue;
+                }
+
+                float weight = std::min(coverage, 1.0f) * alpha;
+                uint8_t* pixel = row + x * 3;
+                for (int c = 0; c < 3; ++c) {
+                    pixel[c] = static_cast<uint8_t>(pixel[c] + (std::max(0.0f, std::min(255.0f, rgb[c])) - pixel[c]) * weight + 0.5f);
+                }
+            }
+        }
+    }
+
+    //-------------------------------------------------------------------------
+    // PNG Implementation
+    //-------------------------------------------------------------------------
+    void encodePng(const RasterImage& image, std::vector<uint8_t>& out) {
+        static const uint8_t signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+        out.assign(signature, signature + sizeof(signature));
+
+        std::vector<uint8_t> header;
+        putBigEndian(header, static_cast<uint32_t>(image.width));
+        putBigEndian(header, static_cast<uint32_t>(image.height));
+        header.push_back(8);    // Bits per channel
+        header.push_back(2);    // RGB
+        header.push_back(0);    // Deflate
+        header.push_back(0);    // Adaptive filtering
+        header.push_back(0);    // Not interlaced
+        putChunk(out, "IHDR", header);
+
+        // Each row starts with its filter type, none here
+        size_t stride = static_cast<size_t>(image.width) * 3;
+        std::vector<uint8_t> raw;
+        raw.reserve((stride + 1) * image.height);
+        for (int y = 0; y < image.height; ++y) {
+            raw.push_back(0);
+            raw.insert(raw.end(), image.pixels.begin() + y * stride, image.pixels.begin() + (y + 1) * stride);
+        }
+
+        // zlib stream: header (deflate, 32K window), data, Adler-32
+        std::vector<uint8_t> compressed = { 0x78, 0x01 };
+        deflate(raw, compressed);
+        putBigEndian(compressed, adler32(raw));
+        putChunk(out, "IDAT", compressed);
+
+        putChunk(out, "IEND", std::vector<uint8_t>());
+    }
+
+} // namespace vdraw
@@ -0,0 +1,43 @@
+// SoftwareRasterizer.h
+#pragma once
+
+#include "VectorDrawing.h"
+#include "TiledCanvas.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace vdraw {
+
+    // 8-bit RGB pixels, rows top to bottom
+    struct RasterImage {
+        int width;
+        int height;
+        std::vector<uint8_t> pixels;
+
+        RasterImage();
+        void resize(int width, int height);
+        void fill(const Color& color);
+    };
+
+    // Renders drawings on the CPU, for capturing without a GPU context, e.g. sessions hosted
+    // headless by SessionManager. Each segment is drawn as an antialiased capsule at the
+    // stroke's width, from the level of detail the scale can show; layers blend bottom first
+    // at their opacity. Keeps no state between calls beyond the image, so use one per thread.
+    class SoftwareRasterizer {
+    public:
+        // The view of the drawing on white, at image's size
+        void render(const Drawing& drawing, const ViewTransform& view, RasterImage& image);
+
+    private:
+        std::vector<const Stroke*> strokes;
+
+        void drawStroke(const Stroke& stroke, const ViewTransform& view, float opacity, RasterImage& image) const;
+        void drawSegment(const Vec2& a, const Vec2& b, float radiusA, float radiusB, const Color& color, float alpha,
+            RasterImage& image) const;
+    };
+
+    // PNG (RGB, deflate with fixed Huffman codes), compact for the large flat areas of a sketch
+    void encodePng(const RasterImage& image, std::vector<uint8_t>& out);
+
+} // namespace vdraw
@@ -0,0 +1,342 @@
+// SpatialIndex.cpp
+#include "SpatialIndex.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace vdraw {
+
+    const size_t SpatialIndex::segmentsPerEntry;
+
+    namespace {
+
+        size_t runCountFor(size_t pointCount) {
+            if (pointCount <= 1) {
+                return pointCount;
+            }
+            return (pointCount - 2) / SpatialIndex::segmentsPerEntry + 1;
+        }
+
+        // Upper bound of half the width at each point, see computeWidthAt
+        float halfWidthBound(const Stroke& stroke) {
+            return stroke.getBaseWidth() * (stroke.getDynamicWidth() ? 2.0f : 1.0f) * 0.5f;
+        }
+
+        // Grows bounds by the points from first to end. Hit testing gives a segment the larger
+        // width of its two ends, so each point is included with the larger of its own and its
+        // neighbours' within the run.
+        void includePoints(Bounds& bounds, const PointBuffer& points, size_t runFirst, size_t first, size_t end, float halfWidth) {
+            for (size_t i = first; i < end; ++i) {
+                float pressure = points[i].pressure;
+                if (i > runFirst) pressure = std::max(pressure, points[i - 1].pressure);
+                if (i + 1 < end) pressure = std::max(pressure, points[i + 1].pressure);
+                bounds.include(points[i].position, halfWidth * pressure);
+            }
+        }
+
+    } // namespace
+
+    SpatialIndex::Node::Node(const Vec2& center, float halfSize, int32_t parent)
+        : center(center), halfSize(halfSize), parent(parent), subtreeCount(0) {
+        children[0] = children[1] = children[2] = children[3] = -1;
+    }
+
+    //-------------------------------------------------------------------------
+    // SpatialIndex Implementation
+    //-------------------------------------------------------------------------
+    SpatialIndex::SpatialIndex(float initialSize, float minCellSize)
+        : initialSize(std::max(1.0f, initialSize)), minCellSize(std::max(1.0f, minCellSize)), nextOrder(0), entryCount(0),
+        lastStroke(nullptr), lastRecord(nullptr) {
+        clear();
+    }
+
+    void SpatialIndex::insertStroke(const Stroke& stroke) {
+        insertStroke(stroke, nextOrder++);
+    }
+
+    void SpatialIndex::insertStroke(const Stroke& stroke, uint64_t order) {
+        removeStroke(stroke);
+
+        StrokeRecord& record = strokes[&stroke];
+        record.order = order;
+        lastStroke = &stroke;
+        lastRecord = &record;
+
+        // Room for a typical stroke, which is inserted with its first point and grows from there
+        size_t runCount = runCountFor(stroke.getProcessedPoints().size());
+        record.runs.reserve(std::max<size_t>(runCount, 8));
+        for (size_t run = 0; run < runCount; ++run) {
+            indexRun(stroke, record, run, 0);
+        }
+    }
+
+    void SpatialIndex::updateStroke(const Stroke& stroke, size_t firstChangedPoint) {
+        StrokeRecord* found = find(stroke);
+        if (!found) {
+            insertStroke(stroke);
+            return;
+        }
+
+        StrokeRecord& record = *found;
+        size_t runCount = runCountFor(stroke.getProcessedPoints().size());
+
+        // A changed point moves the segment ending at it as well
+        size_t firstRun = firstChangedPoint > 0 ? (firstChangedPoint - 1) / segmentsPerEntry : 0;
+        firstRun = std::min(firstRun, record.runs.size());
+
+        while (record.runs.size() > runCount) {
+            uint32_t item = record.runs.back();
+            record.runs.pop_back();
+            unplace(item);
+            freeItems.push_back(item);
+            entryCount--;
+        }
+
+        for (size_t run = firstRun; run < runCount; ++run) {
+            indexRun(stroke, record, run, firstChangedPoint);
+        }
+    }
+
+    void SpatialIndex::removeStroke(const Stroke& stroke) {
+        auto found = strokes.find(&stroke);
+        if (found == strokes.end()) {
+            return;
+        }
+
+        for (uint32_t item : found->second.runs) {
+            unplace(item);
+            freeItems.push_back(item);
+        }
+        entryCount -= found->second.runs.size();
+        strokes.erase(found);
+
+        if (lastStroke == &stroke) {
+            lastStroke = nullptr;
+            lastRecord = nullptr;
+        }
+    }
+
+    void SpatialIndex::clear() {
+        nodes.clear();
+        nodes.push_back(Node(Vec2(initialSize * 0.5f, initialSize * 0.5f), initialSize * 0.5f, -1));
+        items.clear();
+        freeItems.clear();
+        strokes.clear();
+        entryCount = 0;
+        lastStroke = nullptr;
+        lastRecord = nullptr;
+    }
+
+    void SpatialIndex::swap(SpatialIndex& other) {
+        std::swap(initialSize, other.initialSize);
+        std::swap(minCellSize, other.minCellSize);
+        nodes.swap(other.nodes);
+        items.swap(other.items);
+        freeItems.swap(other.freeItems);
+        strokes.swap(other.strokes);
+        std::swap(nextOrder, other.nextOrder);
+        std::swap(entryCount, other.entryCount);
+        std::swap(lastStroke, other.lastStroke);
+        std::swap(lastRecord, other.lastRecord);
+    }
+
+    void SpatialIndex::query(const Bounds& rect, std::vector<SpatialEntry>& out) const {
+        visit(rect, [&out](const SpatialEntry& entry) {
+            out.push_back(entry);
+        });
+    }
+
+    bool SpatialIndex::contains(const Stroke& stroke) const {
+        return strokes.find(&stroke) != strokes.end();
+    }
+
+    uint64_t SpatialIndex::getOrder(const Stroke& stroke) const {
+        auto found = strokes.find(&stroke);
+        return found != strokes.end() ? found->second.order : 0;
+    }
+
+    size_t SpatialIndex::getStrokeCount() const {
+        return strokes.size();
+    }
+
+    size_t SpatialIndex::getEntryCount() const {
+        return entryCount;
+    }
+
+    size_t SpatialIndex::getNodeCount() const {
+        return nodes.size();
+    }
+
+    SpatialIndex::StrokeRecord* SpatialIndex::find(const Stroke& stroke) {
+        if (lastStroke == &stroke) {
+            return lastRecord;
+        }
+
+        auto found = strokes.find(&stroke);
+        if (found == strokes.end()) {
+            return nullptr;
+        }
+
+        lastStroke = &stroke;
+        lastRecord = &found->second;
+        return lastRecord;
+    }
+
+    void SpatialIndex::indexRun(const Stroke& stroke, StrokeRecord& record, size_t run, size_t firstChangedPoint) {
+        const PointBuffer& points = stroke.getProcessedPoints();
+        size_t first = run * segmentsPerEntry;
+        size_t end = std::min(first + segmentsPerEntry + 1, points.size());
+        float halfWidth = halfWidthBound(stroke);
+
+        uint32_t item;
+        if (run < record.runs.size()) {
+            // Grow the existing bounds by the changed points and the one before, which gained a
+            // neighbour, and keep the cell while it still holds them
+            item = record.runs[run];
+            SpatialEntry& entry = items[item].entry;
+            size_t changed = std::max(first, firstChangedPoint);
+            includePoints(entry.bounds, points, first, changed > first ? changed - 1 : first, end, halfWidth);
+            entry.pointCount = end - first;
+
+            if (fitsNode(entry.bounds, items[item].node)) {
+                return;
+            }
+            unplace(item);
+            place(item);
+            return;
+        }
+        else {
+            if (freeItems.empty()) {
+                // Not placed yet, or growing the root would place it along with the others
+                item = static_cast<uint32_t>(items.size());
+                items.push_back(Item());
+                items[item].node = -1;
+            }
+            else {
+                item = freeItems.back();
+                freeItems.pop_back();
+            }
+            record.runs.push_back(item);
+            entryCount++;
+        }
+
+        SpatialEntry& entry = items[item].entry;
+        entry.stroke = &stroke;
+        entry.order = record.order;
+        entry.firstPoint = first;
+        entry.pointCount = end - first;
+        entry.bounds = Bounds();
+        includePoints(entry.bounds, points, first, first, end, halfWidth);
+
+        place(item);
+    }
+
+    bool SpatialIndex::fitsNode(const Bounds& bounds, int32_t node) const {
+        if (node < 0) {
+            return false;
+        }
+        if (node == 0) {
+            // Growing the root re-places everything by the strict root bounds
+            return fitsRoot(bounds);
+        }
+
+        const Node& cell = nodes[node];
+        float looseHalf = cell.halfSize * 2.0f;
+        return bounds.min.x >= cell.center.x - looseHalf && bounds.max.x <= cell.center.x + looseHalf &&
+            bounds.min.y >= cell.center.y - looseHalf && bounds.max.y <= cell.center.y + looseHalf;
+    }
+
+    void SpatialIndex::place(uint32_t item) {
+        const Bounds& bounds = items[item].entry.bounds;
+        if (!fitsRoot(bounds)) {
+            growToFit(bounds);
+        }
+
+        Vec2 center((bounds.min.x + bounds.max.x) * 0.5f, (bounds.min.y + bounds.max.y) * 0.5f);
+        float extent = std::max(bounds.getWidth(), bounds.getHeight()) * 0.5f;
+
+        // Down to the smallest cell at least as large as the entry; its loose bounds then hold it wherever its center is
+        int32_t current = 0;
+        while (true) {
+            float childHalf = nodes[current].halfSize * 0.5f;
+            if (extent > childHalf || childHalf * 2.0f < minCellSize) {
+                break;
+            }
+
+            int quadrant = (center.x >= nodes[current].center.x ? 1 : 0) | (center.y >= nodes[current].center.y ? 2 : 0);
+            int32_t child = nodes[current].children[quadrant];
+            if (child < 0) {
+                Vec2 childCenter(nodes[current].center.x + (quadrant & 1 ? childHalf : -childHalf),
+                    nodes[current].center.y + (quadrant & 2 ? childHalf : -childHalf));
+                child = static_cast<int32_t>(nodes.size());
+                nodes.push_back(Node(childCenter, childHalf, current));
+                nodes[current].children[quadrant] = child;
+            }
+            current = child;
+        }
+
+        for (int32_t n = current; n >= 0; n = nodes[n].parent) {
+            nodes[n].subtreeCount++;
+        }
+
+        Node& node = nodes[current];
+        items[item].node = current;
+        items[item].slot = node.items.size();
+        node.items.push_back(item);
+    }
+
+    void SpatialIndex::unplace(uint32_t item) {
+        int32_t current = items[item].node;
+        if (current < 0) {
+            return;
+        }
+
+        Node& node = nodes[current];
+        size_t slot = items[item].slot;
+        node.items[slot] = node.items.back();
+        items[node.items[slot]].slot = slot;
+        node.items.pop_back();
+
+        for (int32_t n = current; n >= 0; n = nodes[n].parent) {
+            nodes[n].subtreeCount--;
+        }
+        items[item].node = -1;
+    }
+
+    bool SpatialIndex::fitsRoot(const Bounds& bounds) const {
+        const Node& root = nodes[0];
+        Vec2 center((bounds.min.x + bounds.max.x) * 0.5f, (bounds.min.y + bounds.max.y) * 0.5f);
+        float extent = std::max(bounds.getWidth(), bounds.getHeight()) * 0.5f;
+
+        return extent <= root.halfSize &&
+            center.x >= root.center.x - root.halfSize && center.x <= root.center.x + root.halfSize &&
+            center.y >= root.center.y - root.halfSize && center.y <= root.center.y + root.halfSize;
+    }
+
+    void SpatialIndex::growToFit(const Bounds& bounds) {
+        // At least double, so a drawing that keeps growing rebuilds a logarithmic number of times
+        const Node& root = nodes[0];
+        Bounds covered;
+        covered.include(root.center, root.halfSize);
+        covered.include(bounds);
+
+        Vec2 center((covered.min.x + covered.max.x) * 0.5f, (covered.min.y + covered.max.y) * 0.5f);
+        float halfSize = std::max(root.halfSize * 2.0f, std::max(covered.getWidth(), covered.getHeight()) * 0.5f);
+
+        std::vector<uint32_t> placed;
+        placed.reserve(entryCount);
+        for (uint32_t i = 0; i < items.size(); ++i) {
+            if (items[i].node >= 0) {
+                placed.push_back(i);
+                items[i].node = -1;
+            }
+        }
+
+        nodes.clear();
+        nodes.push_back(Node(center, halfSize, -1));
+        for (uint32_t item : placed) {
+            place(item);
+        }
+    }
+
+} // namespace vdraw
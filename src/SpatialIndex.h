@@ -0,0 +1,151 @@
+// SpatialIndex.h
+#pragma once
+
+#include "VectorDrawing.h"
+#include "StrokeGeometry.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace vdraw {
+
+    // A run of consecutive segments of one stroke, the unit stored in the index
+    struct SpatialEntry {
+        const Stroke* stroke;
+        uint64_t order;         // Increases with each stroke added, so larger is drawn on top
+        size_t firstPoint;      // Processed points [firstPoint, firstPoint + pointCount)
+        size_t pointCount;
+        Bounds bounds;          // Of the points widened by their half widths, may be slightly larger
+    };
+
+    // Loose quadtree over the processed points of strokes. Each stroke is indexed as runs of
+    // segmentsPerEntry segments, so a point or small rectangle only visits the runs around it.
+    // Cells overlap their neighbours by half their size, which lets every run go straight to
+    // one cell by its size and center: inserting, updating and removing cost O(depth), and
+    // queries visit O(depth) cells plus the cells the query overlaps.
+    //
+    // Bounds are conservative: widths use their upper bound (dynamic width at most doubles it),
+    // and appending only grows a run's bounds, so points moved by smoothing never leave them.
+    // Queries return candidates to test exactly against the segments.
+    //
+    // Drawing keeps its index current as strokes grow and as commands run, undo and redo;
+    // see Drawing::getSpatialIndex().
+    class SpatialIndex {
+    public:
+        static const size_t segmentsPerEntry = 16;
+
+        // The root cell starts at [0, initialSize] and doubles when strokes leave it;
+        // cells are never split below minCellSize
+        SpatialIndex(float initialSize = 2048.0f, float minCellSize = 64.0f);
+
+        void insertStroke(const Stroke& stroke);
+
+        // Inserts with the order of an existing stroke, e.g. for the pieces of a split stroke
+        // to stay at its depth. Strokes sharing an order are drawn in insertion order.
+        void insertStroke(const Stroke& stroke, uint64_t order);
+
+        // Reindexes the runs from firstChangedPoint on, after points were appended or re-smoothed
+        void updateStroke(const Stroke& stroke, size_t firstChangedPoint);
+
+        void removeStroke(const Stroke& stroke);
+        void clear();
+        void swap(SpatialIndex& other);
+
+        // Appends every entry whose bounds intersect rect, in no particular order
+        void query(const Bounds& rect, std::vector<SpatialEntry>& out) const;
+
+        // Calls visitor(const SpatialEntry&) for every entry whose bounds intersect rect, without
+        // allocating. The visitor must not query or modify the index.
+        template <typename Visitor>
+        void visit(const Bounds& rect, Visitor&& visitor) const;
+
+        bool contains(const Stroke& stroke) const;
+
+        // Drawing order of an indexed stroke, larger on top
+        uint64_t getOrder(const Stroke& stroke) const;
+
+        size_t getStrokeCount() const;
+        size_t getEntryCount() const;
+        size_t getNodeCount() const;
+
+    private:
+        struct Node {
+            Vec2 center;
+            float halfSize;         // Of the cell; the loose bounds are twice this
+            int32_t parent;
+            int32_t children[4];
+            std::vector<uint32_t> items;
+            size_t subtreeCount;    // Entries in this node and below, empty subtrees are skipped
+
+            Node(const Vec2& center, float halfSize, int32_t parent);
+        };
+
+        struct Item {
+            SpatialEntry entry;
+            int32_t node;           // -1 when free
+            size_t slot;            // Position in the node's items
+        };
+
+        struct StrokeRecord {
+            uint64_t order;
+            std::vector<uint32_t> runs;
+        };
+
+        float initialSize;
+        float minCellSize;
+        std::vector<Node> nodes;
+        std::vector<Item> items;
+        std::vector<uint32_t> freeItems;
+        std::unordered_map<const Stroke*, StrokeRecord> strokes;
+        uint64_t nextOrder;
+        size_t entryCount;
+        mutable std::vector<int32_t> stack;
+
+        // Strokes are usually updated many times in a row while drawn
+        const Stroke* lastStroke;
+        StrokeRecord* lastRecord;
+
+        StrokeRecord* find(const Stroke& stroke);
+        void indexRun(const Stroke& stroke, StrokeRecord& record, size_t run, size_t firstChangedPoint);
+        bool fitsNode(const Bounds& bounds, int32_t node) const;
+        void place(uint32_t item);
+        void unplace(uint32_t item);
+        void growToFit(const Bounds& bounds);
+        bool fitsRoot(const Bounds& bounds) const;
+    };
+
+    template <typename Visitor>
+    void SpatialIndex::visit(const Bounds& rect, Visitor&& visitor) const {
+        if (rect.isEmpty()) {
+            return;
+        }
+
+        stack.clear();
+        stack.push_back(0);
+        while (!stack.empty()) {
+            const Node& node = nodes[stack.back()];
+            stack.pop_back();
+
+            float looseHalf = node.halfSize * 2.0f;
+            if (node.subtreeCount == 0 ||
+                rect.min.x > node.center.x + looseHalf || rect.max.x < node.center.x - looseHalf ||
+                rect.min.y > node.center.y + looseHalf || rect.max.y < node.center.y - looseHalf) {
+                continue;
+            }
+
+            for (uint32_t item : node.items) {
+                if (items[item].entry.bounds.intersects(rect)) {
+                    visitor(items[item].entry);
+                }
+            }
+
+            for (int32_t child : node.children) {
+                if (child >= 0) {
+                    stack.push_back(child);
+                }
+            }
+        }
+    }
+
+} // namespace vdraw
@@ -0,0 +1,61 @@
+#include "SpscRingBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+SpscRingBuffer::SpscRingBuffer(size_t capacity) : head(0), tail(0) {
+    size_t size = 64;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    buffer.resize(size);
+    mask = size - 1;
+}
+
+bool SpscRingBuffer::write(const void* data, size_t bytes) {
+    uint64_t writePos = head.load(std::memory_order_relaxed);
+    uint64_t readPos = tail.load(std::memory_order_acquire);
+
+    if (buffer.size() - static_cast<size_t>(writePos - readPos) < bytes) {
+        return false;
+    }
+
+    // Copy in up to two pieces when the message wraps around the end
+    size_t start = static_cast<size_t>(writePos) & mask;
+    size_t first = std::min(bytes, buffer.size() - start);
+    memcpy(&buffer[start], data, first);
+    memcpy(&buffer[0], static_cast<const uint8_t*>(data) + first, bytes - first);
+
+    head.store(writePos + bytes, std::memory_order_release);
+    return true;
+}
+
+size_t SpscRingBuffer::read(void* data, size_t maxBytes) {
+    uint64_t readPos = tail.load(std::memory_order_relaxed);
+    uint64_t writePos = head.load(std::memory_order_acquire);
+
+    size_t bytes = std::min(maxBytes, static_cast<size_t>(writePos - readPos));
+    if (bytes == 0) {
+        return 0;
+    }
+
+    size_t start = static_cast<size_t>(readPos) & mask;
+    size_t first = std::min(bytes, buffer.size() - start);
+    memcpy(data, &buffer[start], first);
+    memcpy(static_cast<uint8_t*>(data) + first, &buffer[0], bytes - first);
+
+    tail.store(readPos + bytes, std::memory_order_release);
+    return bytes;
+}
+
+uint64_t SpscRingBuffer::getWritePosition() const {
+    return head.load(std::memory_order_acquire);
+}
+
+uint64_t SpscRingBuffer::getReadPosition() const {
+    return tail.load(std::memory_order_acquire);
+}
+
+size_t SpscRingBuffer::capacity() const {
+    return buffer.size();
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Lock-free single-producer/single-consumer byte ring buffer.
+// The producer either writes a whole message or nothing, so it never waits on the consumer.
+class SpscRingBuffer {
+public:
+    // Capacity is rounded up to a power of two
+    explicit SpscRingBuffer(size_t capacity);
+
+    SpscRingBuffer(const SpscRingBuffer&) = delete;
+    SpscRingBuffer& operator=(const SpscRingBuffer&) = delete;
+
+    // Producer side: returns false (and writes nothing) if there isn't room for all bytes
+    bool write(const void* data, size_t bytes);
+
+    // Consumer side: copies up to maxBytes, returns the number of bytes read
+    size_t read(void* data, size_t maxBytes);
+
+    // Total bytes written / read since construction; the difference is the fill level
+    uint64_t getWritePosition() const;
+    uint64_t getReadPosition() const;
+
+    size_t capacity() const;
+
+private:
+    std::vector<uint8_t> buffer;
+    size_t mask;
+
+    // Padded onto separate cache lines so producer and consumer don't false-share
+    char padding0[64];
+    std::atomic<uint64_t> head;
+    char padding1[64];
+    std::atomic<uint64_t> tail;
+};
@@ -0,0 +1,514 @@
+#include "StreamingInference.h"
+#include "TcpSocket.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+    //-------------------------------------------------------------------------
+    // JSON
+    //-------------------------------------------------------------------------
+    size_t skipSpace(const std::string& json, size_t i) {
+        while (i < json.size() && std::isspace(static_cast<unsigned char>(json[i]))) i++;
+        return i;
+    }
+
+    void appendUtf8(std::string& out, uint32_t codepoint) {
+        if (codepoint < 0x80) {
+            out += static_cast<char>(codepoint);
+        }
+        else if (codepoint < 0x800) {
+            out += static_cast<char>(0xC0 | (codepoint >> 6));
+            out += static_cast<char>(0x80 | (codepoint & 0x3F));
+        }
+        else if (codepoint < 0x10000) {
+            out += static_cast<char>(0xE0 | (codepoint >> 12));
+            out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (codepoint & 0x3F));
+        }
+        else {
+            out += static_cast<char>(0xF0 | (codepoint >> 18));
+            out += static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (codepoint & 0x3F));
+        }
+    }
+
+    // Parses the string starting at json[i] == '"', returns the index after it or npos
+    size_t parseString(const std::string& json, size_t i, std::string* out) {
+        if (i >= json.size() || json[i] != '"') return std::string::npos;
+
+        for (++i; i < json.size(); ++i) {
+            char c = json[i];
+            if (c == '"') return i + 1;
+            if (c != '\\') {
+                if (out) *out += c;
+                continue;
+            }
+
+            if (++i >= json.size()) return std::string::npos;
+            switch (json[i]) {
+            case 'n': if (out) *out += '\n'; break;
+            case 'r': if (out) *out += '\r'; break;
+            case 't': if (out) *out += '\t'; break;
+            case 'b': if (out) *out += '\b'; break;
+            case 'f': if (out) *out += '\f'; break;
+            case 'u': {
+                if (i + 4 >= json.size()) return std::string::npos;
+                uint32_t codepoint = strtoul(json.substr(i + 1, 4).c_str(), nullptr, 16);
+                i += 4;
+
+                // Surrogate pair
+                if (codepoint >= 0xD800 && codepoint < 0xDC00 && i + 6 < json.size() && json[i + 1] == '\\' && json[i + 2] == 'u') {
+                    uint32_t low = strtoul(json.substr(i + 3, 4).c_str(), nullptr, 16);
+                    if (low >= 0xDC00 && low < 0xE000) {
+                        codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+                        i += 6;
+                    }
+                }
+                if (out) appendUtf8(*out, codepoint);
+                break;
+            }
+            default: if (out) *out += json[i]; break;
+            }
+        }
+        return std::string::npos;
+    }
+
+    // Skips the value starting at json[i], returns the index after it or npos
+    size_t skipValue(const std::string& json, size_t i) {
+        i = skipSpace(json, i);
+        if (i >= json.size()) return std::string::npos;
+
+        if (json[i] == '"') return parseString(json, i, nullptr);
+
+        if (json[i] == '{' || json[i] == '[') {
+            int depth = 0;
+            while (i < json.size()) {
+                char c = json[i];
+                if (c == '"') {
+                    i = parseString(json, i, nullptr);
+                    if (i == std::string::npos) return i;
+                    continue;
+                }
+                if (c == '{' || c == '[') depth++;
+                if (c == '}' || c == ']') {
+                    if (--depth == 0) return i + 1;
+                }
+                i++;
+            }
+            return std::string::npos;
+        }
+
+        // Number, true, false or null
+        while (i < json.size() && json[i] != ',' && json[i] != '}' && json[i] != ']' && !std::isspace(static_cast<unsigned char>(json[i]))) i++;
+        return i;
+    }
+
+    // Index of the value for key in the top-level object, or npos
+    size_t findValue(const std::string& json, const char* key) {
+        size_t i = skipSpace(json, 0);
+        if (i >= json.size() || json[i] != '{') return std::string::npos;
+        i++;
+
+        while (true) {
+            i = skipSpace(json, i);
+            std::string name;
+            i = parseString(json, i, &name);
+            if (i == std::string::npos) return i;
+
+            i = skipSpace(json, i);
+            if (i >= json.size() || json[i] != ':') return std::string::npos;
+            i = skipSpace(json, i + 1);
+
+            if (name == key) return i;
+
+            i = skipValue(json, i);
+            if (i == std::string::npos) return i;
+            i = skipSpace(json, i);
+            if (i >= json.size() || json[i] != ',') return std::string::npos;
+            i++;
+        }
+    }
+
+} // namespace
+
+std::string quoteJsonString(const std::string& text) {
+    std::string quoted = "\"";
+    for (char c : text) {
+        switch (c) {
+        case '"': quoted += "\\\""; break;
+        case '\\': quoted += "\\\\"; break;
+        case '\n': quoted += "\\n"; break;
+        case '\r': quoted += "\\r"; break;
+        case '\t': quoted += "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                char escaped[8];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                quoted += escaped;
+            }
+            else {
+                quoted += c;
+            }
+        }
+    }
+    return quoted + "\"";
+}
+
+bool extractJsonString(const std::string& json, const char* key, std::string& value) {
+    size_t i = findValue(json, key);
+    if (i == std::string::npos || json[i] != '"') return false;
+
+    value.clear();
+    return parseString(json, i, &value) != std::string::npos;
+}
+
+bool extractJsonBool(const std::string& json, const char* key, bool& value) {
+    size_t i = findValue(json, key);
+    if (i == std::string::npos) return false;
+
+    if (json.compare(i, 4, "true") == 0) {
+        value = true;
+        return true;
+    }
+    if (json.compare(i, 5, "false") == 0) {
+        value = false;
+        return true;
+    }
+    return false;
+}
+
+//-------------------------------------------------------------------------
+// NdjsonResponseParser
+//-------------------------------------------------------------------------
+NdjsonResponseParser::NdjsonResponseParser()
+    : state(StatusLine), status(0), chunked(false), remaining(0) {
+}
+
+bool NdjsonResponseParser::handleLine(const std::string& line) {
+    switch (state) {
+    case StatusLine:
+        if (line.compare(0, 5, "HTTP/") != 0) return false;
+        status = atoi(line.c_str() + line.find(' ') + 1);
+        state = Headers;
+        return true;
+
+    case Headers:
+        if (line.empty()) {
+            state = chunked ? ChunkSize : Body;
+        }
+        else {
+            std::string lower = line;
+            for (auto& c : lower) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            if (lower.compare(0, 18, "transfer-encoding:") == 0 && lower.find("chunked") != std::string::npos) {
+                chunked = true;
+            }
+        }
+        return true;
+
+    case ChunkSize: {
+        char* end = nullptr;
+        unsigned long size = strtoul(line.c_str(), &end, 16);
+        if (end == line.c_str()) return false;
+
+        // A zero-sized chunk ends the body; trailers are ignored
+        remaining = size;
+        state = size == 0 ? Done : ChunkData;
+        return true;
+    }
+
+    case ChunkDataEnd:
+        if (!line.empty()) return false;
+        state = ChunkSize;
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+bool NdjsonResponseParser::feed(const char* data, size_t size, const LineCallback& onLine) {
+    buffer.append(data, size);
+    size_t position = 0;
+
+    bool progress = true;
+    while (progress && state != Done && state != Failed) {
+        progress = false;
+
+        if (state == ChunkData || state == Body) {
+            size_t available = buffer.size() - position;
+            size_t count = state == ChunkData ? std::min(remaining, available) : available;
+            if (count == 0) break;
+
+            appendBody(buffer.data() + position, count, onLine);
+            position += count;
+            if (state == ChunkData) {
+                remaining -= count;
+                if (remaining == 0) state = ChunkDataEnd;
+            }
+            progress = true;
+            continue;
+        }
+
+        size_t end = buffer.find("\r\n", position);
+        if (end == std::string::npos) break;
+
+        std::string line = buffer.substr(position, end - position);
+        position = end + 2;
+        if (!handleLine(line)) {
+            state = Failed;
+            break;
+        }
+        progress = true;
+    }
+
+    buffer.erase(0, position);
+    return state != Failed;
+}
+
+void NdjsonResponseParser::appendBody(const char* data, size_t size, const LineCallback& onLine) {
+    pendingLine.append(data, size);
+
+    size_t start = 0;
+    size_t end;
+    while ((end = pendingLine.find('\n', start)) != std::string::npos) {
+        size_t length = end - start;
+        if (length > 0 && pendingLine[end - 1] == '\r') length--;
+        if (length > 0) onLine(pendingLine.substr(start, length));
+        start = end + 1;
+    }
+    pendingLine.erase(0, start);
+}
+
+void NdjsonResponseParser::finish(const LineCallback& onLine) {
+    if (!pendingLine.empty()) {
+        onLine(pendingLine);
+        pendingLine.clear();
+    }
+}
+
+int NdjsonResponseParser::getStatus() const {
+    return status;
+}
+
+bool NdjsonResponseParser::isComplete() const {
+    return state == Done;
+}
+
+//-------------------------------------------------------------------------
+// OllamaStreamClient
+//-------------------------------------------------------------------------
+OllamaStreamClient::OllamaStreamClient(const std::string& host, int port)
+    : host(host), port(port), timeoutSeconds(60), streaming(true) {
+}
+
+void OllamaStreamClient::setHost(const std::string& host, int port) {
+    this->host = host;
+    this->port = port;
+}
+
+const std::string& OllamaStreamClient::getHost() const {
+    return host;
+}
+
+int OllamaStreamClient::getPort() const {
+    return port;
+}
+
+void OllamaStreamClient::setTimeout(int seconds) {
+    timeoutSeconds = seconds;
+}
+
+void OllamaStreamClient::setStreaming(bool streaming) {
+    this->streaming = streaming;
+}
+
+bool OllamaStreamClient::isStreaming() const {
+    return streaming;
+}
+
+bool OllamaStreamClient::generate(const std::string& model, const std::string& prompt, const std::vector<std::string>& images,
+    const FragmentCallback& onFragment, std::string& response, std::string& error) const {
+    response.clear();
+    error.clear();
+
+    std::string body = "{\"model\":" + quoteJsonString(model) + ",\"prompt\":" + quoteJsonString(prompt) + ",\"stream\":" + (streaming ? "true" : "false");
+    if (!images.empty()) {
+        body += ",\"images\":[";
+        for (size_t i = 0; i < images.size(); ++i) {
+            body += (i > 0 ? ",\"" : "\"") + images[i] + "\"";
+        }
+        body += "]";
+    }
+    body += "}";
+
+    std::string request =
+        "POST /api/generate HTTP/1.1\r\n"
+        "Host: " + host + ":" + std::to_string(port) + "\r\n"
+        "Content-Type: application/json\r\n"
+        "Content-Length: " + std::to_string(body.size()) + "\r\n"
+        "Connection: close\r\n\r\n" + body;
+
+    tcp::SocketHandle handle = tcp::connectTo(host, port, timeoutSeconds, error);
+    if (handle == tcp::invalidSocket) return false;
+
+    if (!tcp::sendAll(handle, request)) {
+        tcp::closeSocket(handle);
+        error = "Couldn't send request";
+        return false;
+    }
+
+    NdjsonResponseParser parser;
+    bool done = false;
+    std::string lineError;
+
+    auto onLine = [&](const std::string& line) {
+        std::string fragment;
+        if (extractJsonString(line, "error", fragment)) {
+            lineError = fragment;
+            return;
+        }
+        if (extractJsonString(line, "response", fragment) && !fragment.empty()) {
+            response += fragment;
+            if (onFragment) onFragment(fragment);
+        }
+        extractJsonBool(line, "done", done);
+    };
+
+    char buffer[16384];
+    bool valid = true;
+    while (!done && lineError.empty()) {
+        int n = tcp::receive(handle, buffer, sizeof(buffer));
+        if (n <= 0) {
+            parser.finish(onLine);
+            break;
+        }
+        if (!parser.feed(buffer, n, onLine)) {
+            valid = false;
+            break;
+        }
+    }
+    tcp::closeSocket(handle);
+
+    if (!lineError.empty()) {
+        error = lineError;
+    }
+    else if (!valid) {
+        error = "Malformed response";
+    }
+    else if (parser.getStatus() != 200) {
+        error = "HTTP status " + std::to_string(parser.getStatus());
+    }
+    else if (!done) {
+        error = "Connection closed before the response was done";
+    }
+
+    return error.empty();
+}
+
+std::string OllamaStreamClient::encodeBase64(const uint8_t* data, size_t size) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    std::string encoded;
+    encoded.reserve((size + 2) / 3 * 4);
+
+    size_t i = 0;
+    for (; i + 2 < size; i += 3) {
+        uint32_t triple = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+        encoded += alphabet[(triple >> 18) & 0x3F];
+        encoded += alphabet[(triple >> 12) & 0x3F];
+        encoded += alphabet[(triple >> 6) & 0x3F];
+        encoded += alphabet[triple & 0x3F];
+    }
+
+    if (i < size) {
+        uint32_t triple = data[i] << 16;
+        if (i + 1 < size) triple |= data[i + 1] << 8;
+
+        encoded += alphabet[(triple >> 18) & 0x3F];
+        encoded += alphabet[(triple >> 12) & 0x3F];
+        encoded += i + 1 < size ? alphabet[(triple >> 6) & 0x3F] : '=';
+        encoded += '=';
+    }
+
+    return encoded;
+}
+
+std::vector<uint8_t> OllamaStreamClient::decodeBase64(const std::string& encoded) {
+    std::vector<uint8_t> decoded;
+    decoded.reserve(encoded.size() / 4 * 3);
+
+    uint32_t bits = 0;
+    int count = 0;
+    for (char c : encoded) {
+        int value;
+        if (c >= 'A' && c <= 'Z') value = c - 'A';
+        else if (c >= 'a' && c <= 'z') value = c - 'a' + 26;
+        else if (c >= '0' && c <= '9') value = c - '0' + 52;
+        else if (c == '+') value = 62;
+        else if (c == '/') value = 63;
+        else continue;  // Padding and whitespace
+
+        bits = (bits << 6) | value;
+        count += 6;
+        if (count >= 8) {
+            count -= 8;
+            decoded.push_back(static_cast<uint8_t>((bits >> count) & 0xFF));
+        }
+    }
+
+    return decoded;
+}
+
+//-------------------------------------------------------------------------
+// StablePrefixDetector
+//-------------------------------------------------------------------------
+StablePrefixDetector::StablePrefixDetector(size_t minimumWords, size_t maximumWords)
+    : minimumWords(minimumWords), maximumWords(maximumWords) {
+}
+
+bool StablePrefixDetector::find(const std::string& text, std::string& prefix) const {
+    size_t words = 0;
+    bool inWord = false;
+
+    for (size_t i = 0; i < text.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+
+        // Multi-byte UTF-8 sequences count as word characters
+        if (std::isalnum(c) || c == '\'' || c == '-' || c >= 0x80) {
+            inWord = true;
+            continue;
+        }
+
+        // A word is only complete once something follows it
+        if (inWord) {
+            words++;
+            inWord = false;
+        }
+
+        bool boundary = c == ',' || c == ';' || c == ':' || c == '.' || c == '!' || c == '?' || c == '\n';
+        if ((boundary && words >= minimumWords) || words >= maximumWords) {
+            size_t begin = 0;
+            size_t end = i;
+            while (begin < end && (std::isspace(static_cast<unsigned char>(text[begin])) || text[begin] == '"')) begin++;
+            while (end > begin && std::isspace(static_cast<unsigned char>(text[end - 1]))) end--;
+
+            prefix = text.substr(begin, end - begin);
+            return !prefix.empty();
+        }
+    }
+    return false;
+}
+
+void StablePrefixDetector::setMinimumWords(size_t words) {
+    minimumWords = words;
+}
+
+void StablePrefixDetector::setMaximumWords(size_t words) {
+    maximumWords = words;
+}
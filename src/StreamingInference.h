@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Minimal streaming client for Ollama's /api/generate. The response arrives as
+// newline-delimited JSON (usually with chunked transfer encoding); each fragment of
+// generated text is passed on as soon as its line is complete. Blocking, so callers run
+// it on a worker thread.
+class OllamaStreamClient {
+public:
+    // Receives each generated fragment as it arrives
+    typedef std::function<void(const std::string& fragment)> FragmentCallback;
+
+    OllamaStreamClient(const std::string& host = "127.0.0.1", int port = 11434);
+
+    void setHost(const std::string& host, int port);
+    const std::string& getHost() const;
+    int getPort() const;
+    void setTimeout(int seconds);
+
+    // Without streaming the whole response arrives as one line once the model is done
+    void setStreaming(bool streaming);
+    bool isStreaming() const;
+
+    // images are base64 encoded (e.g. PNG). Returns the complete response, or false with error set.
+    bool generate(const std::string& model, const std::string& prompt, const std::vector<std::string>& images,
+        const FragmentCallback& onFragment, std::string& response, std::string& error) const;
+
+    static std::string encodeBase64(const uint8_t* data, size_t size);
+    static std::vector<uint8_t> decodeBase64(const std::string& encoded);
+
+private:
+    std::string host;
+    int port;
+    int timeoutSeconds;
+    bool streaming;
+};
+
+// Incremental parser for the streamed HTTP response: status line, headers, optional
+// chunked framing, then one JSON object per line
+class NdjsonResponseParser {
+public:
+    // Called with each complete JSON line of the body
+    typedef std::function<void(const std::string& line)> LineCallback;
+
+    NdjsonResponseParser();
+
+    // Returns false once the response is malformed
+    bool feed(const char* data, size_t size, const LineCallback& onLine);
+
+    // Flushes a trailing line without a newline when the connection closes
+    void finish(const LineCallback& onLine);
+
+    int getStatus() const;
+    bool isComplete() const;
+
+private:
+    enum State { StatusLine, Headers, ChunkSize, ChunkData, ChunkDataEnd, Body, Done, Failed };
+
+    bool handleLine(const std::string& line);
+    void appendBody(const char* data, size_t size, const LineCallback& onLine);
+
+    State state;
+    std::string buffer;         // Unconsumed header/framing bytes
+    std::string pendingLine;    // Body bytes after the last newline
+    int status;
+    bool chunked;
+    size_t remaining;           // Bytes left in the current chunk
+};
+
+// Quotes and escapes text as a JSON string
+std::string quoteJsonString(const std::string& text);
+
+// Extracts a string or bool field from a flat JSON object, such as one NDJSON response line
+bool extractJsonString(const std::string& json, const char* key, std::string& value);
+bool extractJsonBool(const std::string& json, const char* key, bool& value);
+
+// Decides when a partially generated description is stable enough to use as a prompt:
+// at the first phrase boundary (, ; : . or newline) with at least minimumWords words, or
+// once maximumWords complete words have arrived
+class StablePrefixDetector {
+public:
+    StablePrefixDetector(size_t minimumWords = 2, size_t maximumWords = 6);
+
+    // Returns true with the prefix when text (everything generated so far) has a stable prefix
+    bool find(const std::string& text, std::string& prefix) const;
+
+    void setMinimumWords(size_t words);
+    void setMaximumWords(size_t words);
+
+private:
+    size_t minimumWords;
+    size_t maximumWords;
+};
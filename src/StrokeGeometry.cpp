@@ -0,0 +1,258 @@
+// StrokeGeometry.cpp
+#include "StrokeGeometry.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace vdraw {
+
+    namespace {
+
+        inline const Vec2& positionOf(const Vec2& point) {
+            return point;
+        }
+
+        inline const Vec2& positionOf(const StrokePoint& point) {
+            return point.position;
+        }
+
+    } // namespace
+
+    //-------------------------------------------------------------------------
+    // Bounds Implementation
+    //-------------------------------------------------------------------------
+    Bounds::Bounds()
+        : min(std::numeric_limits<float>::max(), std::numeric_limits<float>::max()),
+        max(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max()) {
+    }
+
+    bool Bounds::isEmpty() const {
+        return min.x > max.x || min.y > max.y;
+    }
+
+    void Bounds::include(const Vec2& point) {
+        include(point, 0.0f);
+    }
+
+    void Bounds::include(const Vec2& point, float radius) {
+        min.x = std::min(min.x, point.x - radius);
+        min.y = std::min(min.y, point.y - radius);
+        max.x = std::max(max.x, point.x + radius);
+        max.y = std::max(max.y, point.y + radius);
+    }
+
+    void Bounds::include(const Bounds& other) {
+        if (!other.isEmpty()) {
+            include(other.min);
+            include(other.max);
+        }
+    }
+
+    float Bounds::getWidth() const {
+        return isEmpty() ? 0.0f : max.x - min.x;
+    }
+
+    float Bounds::getHeight() const {
+        return isEmpty() ? 0.0f : max.y - min.y;
+    }
+
+    bool Bounds::contains(const Vec2& point) const {
+        return point.x >= min.x && point.x <= max.x && point.y >= min.y && point.y <= max.y;
+    }
+
+    bool Bounds::intersects(const Bounds& other) const {
+        return min.x <= other.max.x && other.min.x <= max.x && min.y <= other.max.y && other.min.y <= max.y;
+    }
+
+    Bounds Bounds::expanded(float amount) const {
+        Bounds bounds(*this);
+        if (!isEmpty()) {
+            bounds.min = Vec2(min.x - amount, min.y - amount);
+            bounds.max = Vec2(max.x + amount, max.y + amount);
+        }
+        return bounds;
+    }
+
+    //-------------------------------------------------------------------------
+    // Segment tests
+    //-------------------------------------------------------------------------
+    float distanceToSegmentSquared(const Vec2& point, const Vec2& a, const Vec2& b) {
+        float dx = b.x - a.x;
+        float dy = b.y - a.y;
+        float lengthSquared = dx * dx + dy * dy;
+
+        float t = 0.0f;
+        if (lengthSquared > 0.0f) {
+            t = ((point.x - a.x) * dx + (point.y - a.y) * dy) / lengthSquared;
+            t = std::max(0.0f, std::min(1.0f, t));
+        }
+
+        float ex = a.x + t * dx - point.x;
+        float ey = a.y + t * dy - point.y;
+        return ex * ex + ey * ey;
+    }
+
+    bool clipSegmentToCircle(const Vec2& a, const Vec2& b, const Vec2& center, float radius, float& t0, float& t1) {
+        // |a + (b - a) t - center|^2 = radius^2, as A t^2 + 2 B t + C = 0
+        float dx = b.x - a.x;
+        float dy = b.y - a.y;
+        float fx = a.x - center.x;
+        float fy = a.y - center.y;
+        float A = dx * dx + dy * dy;
+        float B = fx * dx + fy * dy;
+        float C = fx * fx + fy * fy - radius * radius;
+
+        if (A <= 0.0f) {
+            // A point: all or nothing
+            t0 = 0.0f;
+            t1 = 1.0f;
+            return C <= 0.0f;
+        }
+
+        float discriminant = B * B - A * C;
+        if (discriminant < 0.0f) {
+            return false;
+        }
+
+        float root = std::sqrt(discriminant);
+        t0 = std::max(0.0f, (-B - root) / A);
+        t1 = std::min(1.0f, (-B + root) / A);
+        return t0 <= t1;
+    }
+
+    bool segmentIntersects(const Vec2& a, const Vec2& b, const Bounds& bounds) {
+        if (bounds.isEmpty()) {
+            return false;
+        }
+
+        // Liang-Barsky clipping of the parametric segment against each side
+        float t0 = 0.0f, t1 = 1.0f;
+        const float d[] = { b.x - a.x, b.y - a.y };
+        const float p[] = { -d[0], d[0], -d[1], d[1] };
+        const float q[] = { a.x - bounds.min.x, bounds.max.x - a.x, a.y - bounds.min.y, bounds.max.y - a.y };
+
+        for (int i = 0; i < 4; ++i) {
+            if (p[i] == 0.0f) {
+                if (q[i] < 0.0f) return false;
+                continue;
+            }
+
+            float t = q[i] / p[i];
+            if (p[i] < 0.0f) {
+                if (t > t1) return false;
+                t0 = std::max(t0, t);
+            }
+            else {
+                if (t < t0) return false;
+                t1 = std::min(t1, t);
+            }
+        }
+        return true;
+    }
+
+    bool pointInPolygon(const Vec2& point, const Vec2* polygon, size_t count) {
+        bool inside = false;
+        for (size_t i = 0, j = count - 1; i < count; j = i++) {
+            const Vec2& a = polygon[i];
+            const Vec2& b = polygon[j];
+            if ((a.y > point.y) != (b.y > point.y) &&
+                point.x < (b.x - a.x) * (point.y - a.y) / (b.y - a.y) + a.x) {
+                inside = !inside;
+            }
+        }
+        return inside;
+    }
+
+    //-------------------------------------------------------------------------
+    // Simplification
+    //-------------------------------------------------------------------------
+    void simplifyPolyline(const Vec2* points, size_t count, float tolerance, std::vector<size_t>& kept) {
+        PolylineSimplifier().simplify(points, count, tolerance, kept);
+    }
+
+    void simplifyPolyline(const StrokePoint* points, size_t count, float tolerance, std::vector<size_t>& kept) {
+        PolylineSimplifier().simplify(points, count, tolerance, kept);
+    }
+
+    void PolylineSimplifier::simplify(const Vec2* points, size_t count, float tolerance, std::vector<size_t>& kept) {
+        run(points, count, tolerance, kept);
+    }
+
+    void PolylineSimplifier::simplify(const StrokePoint* points, size_t count, float tolerance, std::vector<size_t>& kept) {
+        run(points, count, tolerance, kept);
+    }
+
+    template <typename Point>
+    void PolylineSimplifier::run(const Point* points, size_t count, float tolerance, std::vector<size_t>& kept) {
+        if (count <= 2) {
+            for (size_t i = 0; i < count; ++i) {
+                kept.push_back(i);
+            }
+            return;
+        }
+
+        keep.assign(count, 0);
+        keep[0] = keep[count - 1] = 1;
+        float toleranceSquared = tolerance * tolerance;
+
+        ranges.clear();
+        ranges.push_back(std::make_pair(static_cast<size_t>(0), count - 1));
+
+        while (!ranges.empty()) {
+            size_t first = ranges.back().first;
+            size_t last = ranges.back().second;
+            ranges.pop_back();
+
+            const Vec2& a = positionOf(points[first]);
+            const Vec2& b = positionOf(points[last]);
+
+            float farthest = -1.0f;
+            size_t split = first;
+            for (size_t i = first + 1; i < last; ++i) {
+                float distance = distanceToSegmentSquared(positionOf(points[i]), a, b);
+                if (distance > farthest) {
+                    farthest = distance;
+                    split = i;
+                }
+            }
+
+            if (farthest > toleranceSquared) {
+                keep[split] = 1;
+                if (split - first > 1) ranges.push_back(std::make_pair(first, split));
+                if (last - split > 1) ranges.push_back(std::make_pair(split, last));
+            }
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            if (keep[i]) {
+                kept.push_back(i);
+            }
+        }
+    }
+
+    //-------------------------------------------------------------------------
+    // Bounds of strokes
+    //-------------------------------------------------------------------------
+    Bounds computeBounds(const Stroke& stroke) {
+        Bounds bounds;
+        const PointBuffer& points = stroke.getProcessedPoints();
+        for (size_t i = 0; i < points.size(); ++i) {
+            bounds.include(points[i].position, stroke.getWidthAt(i) * 0.5f);
+        }
+        return bounds;
+    }
+
+    Bounds computeBounds(const Drawing& drawing) {
+        Bounds bounds;
+        for (size_t i = 0; i < drawing.getLayerCount(); ++i) {
+            const Layer& layer = drawing.getLayer(i);
+            if (!layer.isVisible()) continue;
+            for (const Stroke* stroke : layer.getStrokes()) {
+                bounds.include(computeBounds(*stroke));
+            }
+        }
+        return bounds;
+    }
+
+} // namespace vdraw
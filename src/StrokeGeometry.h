@@ -0,0 +1,67 @@
+// StrokeGeometry.h
+#pragma once
+
+#include "VectorDrawing.h"
+
+#include <utility>
+#include <vector>
+
+namespace vdraw {
+
+    // Axis-aligned bounding box, empty until a point is included
+    struct Bounds {
+        Vec2 min, max;
+
+        Bounds();
+
+        bool isEmpty() const;
+        void include(const Vec2& point);
+        void include(const Vec2& point, float radius);
+        void include(const Bounds& other);
+        float getWidth() const;
+        float getHeight() const;
+
+        bool contains(const Vec2& point) const;
+        bool intersects(const Bounds& other) const;
+        Bounds expanded(float amount) const;
+    };
+
+    // Squared distance from point to the segment a-b
+    float distanceToSegmentSquared(const Vec2& point, const Vec2& a, const Vec2& b);
+
+    // Whether any part of the segment a-b lies inside bounds
+    bool segmentIntersects(const Vec2& a, const Vec2& b, const Bounds& bounds);
+
+    // Clips the segment a-b to the disc at center. Returns false if they don't meet, otherwise
+    // the part inside is a + (b - a) * t for t in [t0, t1], within [0, 1].
+    bool clipSegmentToCircle(const Vec2& a, const Vec2& b, const Vec2& center, float radius, float& t0, float& t1);
+
+    // Even-odd test against a closed polygon
+    bool pointInPolygon(const Vec2& point, const Vec2* polygon, size_t count);
+
+    // Douglas-Peucker simplification. Appends the indices of the points to keep, in order,
+    // so that no dropped point is further than tolerance from the simplified line. The first
+    // and last points are always kept. Iterative, so million-point strokes can't overflow the stack.
+    void simplifyPolyline(const Vec2* points, size_t count, float tolerance, std::vector<size_t>& kept);
+    void simplifyPolyline(const StrokePoint* points, size_t count, float tolerance, std::vector<size_t>& kept);
+
+    // simplifyPolyline with scratch buffers kept between calls, so simplifying stroke after
+    // stroke doesn't allocate once the buffers have grown to the longest stroke
+    class PolylineSimplifier {
+    public:
+        void simplify(const Vec2* points, size_t count, float tolerance, std::vector<size_t>& kept);
+        void simplify(const StrokePoint* points, size_t count, float tolerance, std::vector<size_t>& kept);
+
+    private:
+        std::vector<char> keep;
+        std::vector<std::pair<size_t, size_t>> ranges;
+
+        template <typename Point>
+        void run(const Point* points, size_t count, float tolerance, std::vector<size_t>& kept);
+    };
+
+    // Bounds of the processed points, widened by half the stroke width
+    Bounds computeBounds(const Stroke& stroke);
+    Bounds computeBounds(const Drawing& drawing);   // Of the visible layers
+
+} // namespace vdraw
@@ -0,0 +1,132 @@
+// StrokeMemoryPool.cpp
+#include "StrokeMemoryPool.h"
+
+#include <algorithm>
+
+namespace vdraw {
+
+    PoolStats::PoolStats()
+        : chunkAllocations(0), blockAllocations(0), largeAllocations(0),
+        bytesReserved(0), peakBytesReserved(0), bytesInUse(0), peakBytesInUse(0) {
+    }
+
+    StrokeMemoryPool::StrokeMemoryPool(size_t chunkSize)
+        : chunkSize(std::max<size_t>(chunkSize, 4096)), chunkCursor(nullptr), chunkRemaining(0) {
+        // Anything larger than a quarter chunk goes straight to the heap
+        maxBlockSize = this->chunkSize / 4;
+
+        size_t classes = 0;
+        while (blockSizeOf(classes) < maxBlockSize) {
+            classes++;
+        }
+        freeLists.assign(classes + 1, nullptr);
+    }
+
+    StrokeMemoryPool::~StrokeMemoryPool() {
+        for (char* chunk : chunks) {
+            ::operator delete(chunk);
+        }
+    }
+
+    void* StrokeMemoryPool::allocate(size_t bytes) {
+        if (bytes > maxBlockSize) {
+            stats.largeAllocations++;
+            return ::operator new(bytes);
+        }
+
+        size_t sizeClass = sizeClassFor(bytes);
+        size_t blockSize = blockSizeOf(sizeClass);
+
+        stats.blockAllocations++;
+        stats.bytesInUse += blockSize;
+        stats.peakBytesInUse = std::max(stats.peakBytesInUse, stats.bytesInUse);
+
+        FreeBlock* block = freeLists[sizeClass];
+        if (block) {
+            freeLists[sizeClass] = block->next;
+            return block;
+        }
+
+        return carve(blockSize);
+    }
+
+    void StrokeMemoryPool::deallocate(void* pointer, size_t bytes) {
+        if (!pointer) return;
+
+        if (bytes > maxBlockSize) {
+            ::operator delete(pointer);
+            return;
+        }
+
+        size_t sizeClass = sizeClassFor(bytes);
+        stats.bytesInUse -= blockSizeOf(sizeClass);
+
+        FreeBlock* block = static_cast<FreeBlock*>(pointer);
+        block->next = freeLists[sizeClass];
+        freeLists[sizeClass] = block;
+    }
+
+    bool StrokeMemoryPool::release() {
+        if (stats.bytesInUse > 0) {
+            return false;
+        }
+
+        for (char* chunk : chunks) {
+            ::operator delete(chunk);
+        }
+        chunks.clear();
+        std::fill(freeLists.begin(), freeLists.end(), nullptr);
+
+        chunkCursor = nullptr;
+        chunkRemaining = 0;
+        stats.bytesReserved = 0;
+        return true;
+    }
+
+    PoolStats StrokeMemoryPool::getStats() const {
+        return stats;
+    }
+
+    size_t StrokeMemoryPool::sizeClassFor(size_t bytes) const {
+        size_t sizeClass = 0;
+        while (blockSizeOf(sizeClass) < bytes) {
+            sizeClass++;
+        }
+        return sizeClass;
+    }
+
+    size_t StrokeMemoryPool::blockSizeOf(size_t sizeClass) const {
+        return static_cast<size_t>(1) << (minBlockShift + sizeClass);
+    }
+
+    char* StrokeMemoryPool::carve(size_t blockSize) {
+        if (chunkRemaining < blockSize) {
+            // Hand the unused tail of the current chunk to the free lists before moving on
+            while (chunkRemaining >= blockSizeOf(0)) {
+                size_t sizeClass = sizeClassFor(chunkRemaining);
+                if (blockSizeOf(sizeClass) > chunkRemaining) sizeClass--;
+
+                FreeBlock* block = reinterpret_cast<FreeBlock*>(chunkCursor);
+                block->next = freeLists[sizeClass];
+                freeLists[sizeClass] = block;
+
+                chunkCursor += blockSizeOf(sizeClass);
+                chunkRemaining -= blockSizeOf(sizeClass);
+            }
+
+            chunkCursor = static_cast<char*>(::operator new(chunkSize));
+            chunkRemaining = chunkSize;
+            chunks.push_back(chunkCursor);
+
+            stats.chunkAllocations++;
+            stats.bytesReserved += chunkSize;
+            stats.peakBytesReserved = std::max(stats.peakBytesReserved, stats.bytesReserved);
+        }
+
+        char* block = chunkCursor;
+        chunkCursor += blockSize;
+        chunkRemaining -= blockSize;
+        return block;
+    }
+
+} // namespace vdraw
@@ -0,0 +1,113 @@
+// StrokeMemoryPool.h
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <new>
+
+namespace vdraw {
+
+    // Allocation statistics for a StrokeMemoryPool
+    struct PoolStats {
+        size_t chunkAllocations;    // Heap allocations made for chunks
+        size_t blockAllocations;    // Blocks handed out from size classes
+        size_t largeAllocations;    // Requests too large for a size class (served by the heap)
+        size_t bytesReserved;       // Bytes currently held in chunks
+        size_t peakBytesReserved;
+        size_t bytesInUse;          // Bytes currently handed out, rounded up to block size
+        size_t peakBytesInUse;
+
+        PoolStats();
+    };
+
+    // Slab allocator for strokes and their point buffers.
+    // Blocks are carved from large chunks in power-of-two size classes and recycled
+    // through per-class free lists, so a long session reuses the same memory instead
+    // of fragmenting the heap. Chunks go back to the heap in bulk through release().
+    // Not thread-safe: a pool belongs to one Drawing.
+    class StrokeMemoryPool {
+    public:
+        StrokeMemoryPool(size_t chunkSize = 256 * 1024);
+        ~StrokeMemoryPool();
+
+        StrokeMemoryPool(const StrokeMemoryPool&) = delete;
+        StrokeMemoryPool& operator=(const StrokeMemoryPool&) = delete;
+
+        void* allocate(size_t bytes);
+        void deallocate(void* pointer, size_t bytes);
+
+        // Return all chunks to the heap. Only possible when no blocks are in use.
+        bool release();
+
+        PoolStats getStats() const;
+
+    private:
+        struct FreeBlock {
+            FreeBlock* next;
+        };
+
+        static const size_t minBlockShift = 5;  // 32 byte blocks
+
+        size_t chunkSize;
+        size_t maxBlockSize;
+        std::vector<FreeBlock*> freeLists;
+        std::vector<char*> chunks;
+        char* chunkCursor;
+        size_t chunkRemaining;
+        PoolStats stats;
+
+        size_t sizeClassFor(size_t bytes) const;
+        size_t blockSizeOf(size_t sizeClass) const;
+        char* carve(size_t blockSize);
+    };
+
+    // Standard allocator adapter so containers can draw from a StrokeMemoryPool.
+    // A null pool falls back to the global heap.
+    template <typename T>
+    class PoolAllocator {
+    public:
+        typedef T value_type;
+
+        template <typename U>
+        struct rebind {
+            typedef PoolAllocator<U> other;
+        };
+
+        PoolAllocator(StrokeMemoryPool* pool = nullptr) : pool(pool) {}
+
+        template <typename U>
+        PoolAllocator(const PoolAllocator<U>& other) : pool(other.getPool()) {}
+
+        T* allocate(size_t count) {
+            if (pool) {
+                return static_cast<T*>(pool->allocate(count * sizeof(T)));
+            }
+            return static_cast<T*>(::operator new(count * sizeof(T)));
+        }
+
+        void deallocate(T* pointer, size_t count) {
+            if (pool) {
+                pool->deallocate(pointer, count * sizeof(T));
+            }
+            else {
+                ::operator delete(pointer);
+            }
+        }
+
+        StrokeMemoryPool* getPool() const { return pool; }
+
+    private:
+        StrokeMemoryPool* pool;
+    };
+
+    template <typename T, typename U>
+    bool operator==(const PoolAllocator<T>& a, const PoolAllocator<U>& b) {
+        return a.getPool() == b.getPool();
+    }
+
+    template <typename T, typename U>
+    bool operator!=(const PoolAllocator<T>& a, const PoolAllocator<U>& b) {
+        return !(a == b);
+    }
+
+} // namespace vdraw
@@ -0,0 +1,166 @@
+#include "TcpSocket.h"
+
+#include <cstring>
+#include <mutex>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+namespace tcp {
+
+#ifdef _WIN32
+    const SocketHandle invalidSocket = INVALID_SOCKET;
+#else
+    const SocketHandle invalidSocket = -1;
+#endif
+
+    namespace {
+
+        void initialize() {
+#ifdef _WIN32
+            static std::once_flag winsockInitialized;
+            std::call_once(winsockInitialized, []() {
+                WSADATA data;
+                WSAStartup(MAKEWORD(2, 2), &data);
+            });
+#endif
+        }
+
+    } // namespace
+
+    SocketHandle connectTo(const std::string& host, int port, int timeoutSeconds, std::string& error) {
+        initialize();
+
+        addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+
+        addrinfo* addresses = nullptr;
+        if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) != 0) {
+            error = "Couldn't resolve " + host;
+            return invalidSocket;
+        }
+
+        SocketHandle handle = invalidSocket;
+        for (addrinfo* address = addresses; address; address = address->ai_next) {
+            handle = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+            if (handle == invalidSocket) continue;
+
+            if (connect(handle, address->ai_addr, static_cast<int>(address->ai_addrlen)) == 0) break;
+
+            closeSocket(handle);
+            handle = invalidSocket;
+        }
+        freeaddrinfo(addresses);
+
+        if (handle == invalidSocket) {
+            error = "Couldn't connect to " + host + ":" + std::to_string(port);
+            return invalidSocket;
+        }
+
+        // Bounds how long a stalled server can hold the caller
+        setTimeout(handle, timeoutSeconds);
+        return handle;
+    }
+
+    SocketHandle listenOn(int port, int& boundPort, std::string& error, bool loopbackOnly) {
+        initialize();
+
+        SocketHandle handle = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (handle == invalidSocket) {
+            error = "Couldn't create socket";
+            return invalidSocket;
+        }
+
+        int reuse = 1;
+        setsockopt(handle, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+        sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(loopbackOnly ? INADDR_LOOPBACK : INADDR_ANY);
+        address.sin_port = htons(static_cast<unsigned short>(port));
+
+        if (bind(handle, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(handle, 64) != 0) {
+            closeSocket(handle);
+            error = "Couldn't listen on port " + std::to_string(port);
+            return invalidSocket;
+        }
+
+        socklen_t length = sizeof(address);
+        getsockname(handle, reinterpret_cast<sockaddr*>(&address), &length);
+        boundPort = ntohs(address.sin_port);
+        return handle;
+    }
+
+    SocketHandle acceptConnection(SocketHandle listener, int timeoutMillis) {
+        if (!waitReadable(listener, timeoutMillis)) return invalidSocket;
+        return accept(listener, nullptr, nullptr);
+    }
+
+    bool waitReadable(SocketHandle handle, int timeoutMillis) {
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(handle, &readable);
+
+        timeval timeout;
+        timeout.tv_sec = timeoutMillis / 1000;
+        timeout.tv_usec = (timeoutMillis % 1000) * 1000;
+
+        return select(static_cast<int>(handle + 1), &readable, nullptr, nullptr, &timeout) > 0;
+    }
+
+    void setTimeout(SocketHandle handle, int timeoutSeconds) {
+#ifdef _WIN32
+        DWORD timeout = timeoutSeconds * 1000;
+#else
+        timeval timeout;
+        timeout.tv_sec = timeoutSeconds;
+        timeout.tv_usec = 0;
+#endif
+        setsockopt(handle, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+        setsockopt(handle, SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+    }
+
+    bool sendAll(SocketHandle handle, const char* data, size_t size) {
+        size_t sent = 0;
+        while (sent < size) {
+#ifdef MSG_NOSIGNAL
+            int n = send(handle, data + sent, static_cast<int>(size - sent), MSG_NOSIGNAL);
+#else
+            int n = send(handle, data + sent, static_cast<int>(size - sent), 0);
+#endif
+            if (n <= 0) return false;
+            sent += n;
+        }
+        return true;
+    }
+
+    bool sendAll(SocketHandle handle, const std::string& data) {
+        return sendAll(handle, data.data(), data.size());
+    }
+
+    int receive(SocketHandle handle, char* buffer, size_t size) {
+        return recv(handle, buffer, static_cast<int>(size), 0);
+    }
+
+    void closeSocket(SocketHandle handle) {
+#ifdef _WIN32
+        closesocket(handle);
+#else
+        close(handle);
+#endif
+    }
+
+} // namespace tcp
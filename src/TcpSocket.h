@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Thin portable layer over blocking TCP sockets, shared by the streaming inference
+// client and the mock Ollama server
+namespace tcp {
+
+#ifdef _WIN32
+    typedef uintptr_t SocketHandle;    // SOCKET, without pulling winsock2.h into every includer
+#else
+    typedef int SocketHandle;
+#endif
+
+    extern const SocketHandle invalidSocket;
+
+    // Connects to host:port, returns invalidSocket with error set on failure
+    SocketHandle connectTo(const std::string& host, int port, int timeoutSeconds, std::string& error);
+
+    // Listens on the loopback interface, or on all interfaces; port 0 picks a free port, returned in boundPort
+    SocketHandle listenOn(int port, int& boundPort, std::string& error, bool loopbackOnly = true);
+
+    // Waits up to timeoutMillis for a connection, returns invalidSocket on timeout
+    SocketHandle acceptConnection(SocketHandle listener, int timeoutMillis);
+
+    // Waits up to timeoutMillis for data (or the peer closing), so readers can poll a stop flag
+    bool waitReadable(SocketHandle handle, int timeoutMillis);
+
+    void setTimeout(SocketHandle handle, int timeoutSeconds);
+    bool sendAll(SocketHandle handle, const char* data, size_t size);
+    bool sendAll(SocketHandle handle, const std::string& data);
+
+    // Returns the number of bytes read, 0 when the peer closed, negative on error or timeout
+    int receive(SocketHandle handle, char* buffer, size_t size);
+
+    void closeSocket(SocketHandle handle);
+
+} // namespace tcp
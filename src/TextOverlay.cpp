@@ -0,0 +1,137 @@
+#include "TextOverlay.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace ci;
+
+TextOverlay::TextOverlay()
+    : background(0, 0, 0, 0), lineHeight(0.0f), padding(-1.0f), dirty(true), rebuildCount(0) {
+}
+
+void TextOverlay::setFont(const Font& font, float lineSpacing) {
+    textureFont = gl::TextureFont::create(font);
+    lineHeight = font.getSize() * lineSpacing;
+    if (padding < 0.0f) {
+        padding = lineHeight * 0.25f;
+    }
+    dirty = true;
+}
+
+void TextOverlay::setBackground(const ColorA& color) {
+    background = color;
+    dirty = true;
+}
+
+void TextOverlay::setPadding(float padding) {
+    this->padding = padding;
+    dirty = true;
+}
+
+float TextOverlay::getPadding() const {
+    return std::max(padding, 0.0f);
+}
+
+void TextOverlay::setLineCount(size_t count) {
+    if (count != lines.size()) {
+        lines.resize(count);
+        dirty = true;
+    }
+}
+
+void TextOverlay::setLine(size_t index, const char* text, const ColorA& color) {
+    if (index >= lines.size()) {
+        setLineCount(index + 1);
+    }
+
+    Line& line = lines[index];
+    if (strcmp(line.text.c_str(), text) != 0 || line.color != color) {
+        // assign() reuses the string's capacity once it has grown to fit
+        line.text.assign(text);
+        line.color = color;
+        dirty = true;
+    }
+}
+
+void TextOverlay::setLine(size_t index, const std::string& text, const ColorA& color) {
+    setLine(index, text.c_str(), color);
+}
+
+size_t TextOverlay::getLineCount() const {
+    return lines.size();
+}
+
+float TextOverlay::getLineHeight() const {
+    return lineHeight;
+}
+
+bool TextOverlay::isDirty() const {
+    return dirty;
+}
+
+size_t TextOverlay::getRebuildCount() const {
+    return rebuildCount;
+}
+
+void TextOverlay::rebuild() {
+    dirty = false;
+    rebuildCount++;
+
+    if (!textureFont || lines.empty()) {
+        fbo.reset();
+        return;
+    }
+
+    float padding = getPadding();
+    float width = 0.0f;
+    for (const auto& line : lines) {
+        width = std::max(width, textureFont->measureString(line.text).x);
+    }
+
+    ivec2 size(static_cast<int>(width + padding * 2) + 1, static_cast<int>(lines.size() * lineHeight + padding * 2) + 1);
+
+    // Only reallocate when the text outgrows the current texture
+    if (!fbo || fbo->getWidth() < size.x || fbo->getHeight() < size.y || fbo->getWidth() > size.x * 2 || fbo->getHeight() > size.y * 2) {
+        gl::Fbo::Format format;
+        format.colorTexture(gl::Texture2d::Format().internalFormat(GL_RGBA8));
+        fbo = gl::Fbo::create(size.x, size.y, format);
+    }
+
+    gl::ScopedFramebuffer fbScp(fbo);
+    gl::ScopedViewport viewport(ivec2(0), fbo->getSize());
+    gl::ScopedMatrices matrices;
+    gl::setMatricesWindow(fbo->getSize());
+
+    gl::clear(ColorA(0, 0, 0, 0));
+
+    // Write premultiplied color with straight alpha, so the texture composites with premultiplied blending
+    gl::ScopedBlend blend(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+    if (background.a > 0.0f) {
+        gl::color(background);
+        gl::drawSolidRect(Rectf(0, 0, width + padding * 2, lines.size() * lineHeight + padding * 2));
+    }
+
+    float baseline = padding + textureFont->getAscent();
+    for (const auto& line : lines) {
+        if (!line.text.empty()) {
+            gl::color(line.color);
+            textureFont->drawString(line.text, vec2(padding, baseline));
+        }
+        baseline += lineHeight;
+    }
+
+    gl::color(ColorA(1, 1, 1, 1));
+}
+
+void TextOverlay::draw(const vec2& position) {
+    if (dirty) {
+        rebuild();
+    }
+
+    if (!fbo) return;
+
+    gl::ScopedBlendPremult blend;
+    gl::color(ColorA(1, 1, 1, 1));
+    gl::draw(fbo->getColorTexture(), position);
+}
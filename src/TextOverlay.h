@@ -0,0 +1,54 @@
+#pragma once
+
+#include "cinder/gl/gl.h"
+#include "cinder/gl/TextureFont.h"
+#include "cinder/Font.h"
+
+#include <string>
+#include <vector>
+
+// Lines of text rendered through a glyph atlas (gl::TextureFont) into a cached texture.
+// Until a line changes, drawing the overlay is a single textured quad.
+class TextOverlay {
+public:
+    TextOverlay();
+
+    void setFont(const ci::Font& font, float lineSpacing = 1.2f);
+    void setBackground(const ci::ColorA& color);
+
+    // Space around the text inside the texture, a quarter line by default
+    void setPadding(float padding);
+    float getPadding() const;
+
+    // Changing the line count or any text/color marks the texture for rebuilding.
+    // Unchanged text is detected without allocating.
+    void setLineCount(size_t count);
+    void setLine(size_t index, const char* text, const ci::ColorA& color);
+    void setLine(size_t index, const std::string& text, const ci::ColorA& color);
+
+    size_t getLineCount() const;
+    float getLineHeight() const;
+
+    // Rebuilds the texture if needed, then draws it with its top-left corner at position
+    void draw(const ci::vec2& position);
+
+    bool isDirty() const;
+    size_t getRebuildCount() const;
+
+private:
+    struct Line {
+        std::string text;
+        ci::ColorA color;
+    };
+
+    void rebuild();
+
+    ci::gl::TextureFontRef textureFont;
+    ci::gl::FboRef fbo;
+    std::vector<Line> lines;
+    ci::ColorA background;
+    float lineHeight;
+    float padding;
+    bool dirty;
+    size_t rebuildCount;
+};
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
 #include <list>
 #include <mutex>
 #include <vector>
@@ -47,6 +49,10 @@ public:
     // Get size
     size_t size() const;
 
+    // Incremented by every modification, so readers can cheaply tell whether
+    // anything derived from the contents needs rebuilding
+    uint64_t getGeneration() const;
+
     // Apply a function to each element (thread-safe)
     void forEach(const std::function<void(const T&)>& func) const;
 
@@ -71,6 +77,7 @@ public:
 private:
     mutable std::mutex mutex;
     std::list<T> data;
+    std::atomic<uint64_t> generation{ 0 };
 };
 
 // Template implementation
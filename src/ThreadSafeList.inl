@@ -6,24 +6,28 @@ template <typename T>
 void ThreadSafeList<T>::push_back(const T& value) {
     std::lock_guard<std::mutex> lock(mutex);
     data.push_back(value);
+    generation++;
 }
 
 template <typename T>
 void ThreadSafeList<T>::push_back(T&& value) {
     std::lock_guard<std::mutex> lock(mutex);
     data.push_back(std::move(value));
+    generation++;
 }
 
 template <typename T>
 void ThreadSafeList<T>::push_front(const T& value) {
     std::lock_guard<std::mutex> lock(mutex);
     data.push_front(value);
+    generation++;
 }
 
 template <typename T>
 void ThreadSafeList<T>::push_front(T&& value) {
     std::lock_guard<std::mutex> lock(mutex);
     data.push_front(std::move(value));
+    generation++;
 }
 
 template <typename T>
@@ -31,6 +35,7 @@ void ThreadSafeList<T>::pop_front() {
     std::lock_guard<std::mutex> lock(mutex);
     if (!data.empty()) {
         data.pop_front();
+        generation++;
     }
 }
 
@@ -39,6 +44,7 @@ void ThreadSafeList<T>::pop_back() {
     std::lock_guard<std::mutex> lock(mutex);
     if (!data.empty()) {
         data.pop_back();
+        generation++;
     }
 }
 
@@ -57,7 +63,10 @@ std::vector<T> ThreadSafeList<T>::getAllAsVector() const {
 template <typename T>
 void ThreadSafeList<T>::clear() {
     std::lock_guard<std::mutex> lock(mutex);
-    data.clear();
+    if (!data.empty()) {
+        data.clear();
+        generation++;
+    }
 }
 
 template <typename T>
@@ -72,6 +81,11 @@ size_t ThreadSafeList<T>::size() const {
     return data.size();
 }
 
+template <typename T>
+uint64_t ThreadSafeList<T>::getGeneration() const {
+    return generation.load();
+}
+
 template <typename T>
 void ThreadSafeList<T>::forEach(const std::function<void(const T&)>& func) const {
     std::list<T> copy;
@@ -90,7 +104,11 @@ template <typename T>
 template <typename Predicate>
 void ThreadSafeList<T>::removeIf(Predicate pred) {
     std::lock_guard<std::mutex> lock(mutex);
+    size_t before = data.size();
     data.remove_if(pred);
+    if (data.size() != before) {
+        generation++;
+    }
 }
 
 template <typename T>
@@ -0,0 +1,207 @@
+// TiledCanvas.cpp
+#include "TiledCanvas.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace vdraw {
+
+    const int TiledCanvas::minLevel;
+    const int TiledCanvas::maxLevel;
+
+    //-------------------------------------------------------------------------
+    // ViewTransform Implementation
+    //-------------------------------------------------------------------------
+    ViewTransform::ViewTransform() : origin(0.0f, 0.0f), zoom(1.0f) {}
+
+    Vec2 ViewTransform::toScreen(const Vec2& point) const {
+        return (point - origin) * zoom;
+    }
+
+    Vec2 ViewTransform::toDrawing(const Vec2& point) const {
+        return origin + point * (1.0f / zoom);
+    }
+
+    Bounds ViewTransform::visibleArea(float width, float height) const {
+        Bounds area;
+        area.include(origin);
+        area.include(toDrawing(Vec2(width, height)));
+        return area;
+    }
+
+    void ViewTransform::pan(const Vec2& screenDelta) {
+        origin = origin - screenDelta * (1.0f / zoom);
+    }
+
+    void ViewTransform::zoomAt(const Vec2& screenPoint, float factor, float minZoom, float maxZoom) {
+        Vec2 anchor = toDrawing(screenPoint);
+        zoom = std::min(std::max(zoom * factor, minZoom), maxZoom);
+        origin = anchor - screenPoint * (1.0f / zoom);
+    }
+
+    //-------------------------------------------------------------------------
+    // TileKey Implementation
+    //-------------------------------------------------------------------------
+    bool TileKey::operator==(const TileKey& other) const {
+        return x == other.x && y == other.y && level == other.level;
+    }
+
+    size_t TileKeyHash::operator()(const TileKey& key) const {
+        uint64_t packed = (static_cast<uint64_t>(static_cast<uint32_t>(key.x)) << 32) ^
+            static_cast<uint32_t>(key.y) ^ (static_cast<uint64_t>(key.level + 128) << 56);
+        return std::hash<uint64_t>()(packed);
+    }
+
+    //-------------------------------------------------------------------------
+    // TiledCanvas Implementation
+    //-------------------------------------------------------------------------
+    TiledCanvas::TiledCanvas(int tileSize, size_t budgetBytes)
+        : tileSize(std::max(16, tileSize)), budgetBytes(budgetBytes), slotCount(0), evictions(0) {
+    }
+
+    void TiledCanvas::acquire(const ViewTransform& view, float width, float height, std::vector<Tile*>& out) {
+        int level = levelFor(view.zoom);
+        float units = tileUnits(level);
+        Bounds area = view.visibleArea(width, height);
+        if (area.isEmpty()) {
+            return;
+        }
+
+        int32_t x0 = static_cast<int32_t>(std::floor(area.min.x / units));
+        int32_t y0 = static_cast<int32_t>(std::floor(area.min.y / units));
+        int32_t x1 = std::max(x0, static_cast<int32_t>(std::ceil(area.max.x / units)) - 1);
+        int32_t y1 = std::max(y0, static_cast<int32_t>(std::ceil(area.max.y / units)) - 1);
+
+        // Each tile of the view moves to the front as it is reached, so the ones before it
+        // are exactly the first pinned tiles of the list
+        size_t pinned = 0;
+        for (int32_t y = y0; y <= y1; ++y) {
+            for (int32_t x = x0; x <= x1; ++x) {
+                TileKey key = { x, y, level };
+                auto found = lookup.find(key);
+                if (found != lookup.end()) {
+                    tiles.splice(tiles.begin(), tiles, found->second);
+                }
+                else {
+                    Tile tile;
+                    tile.key = key;
+                    tile.slot = takeSlot(pinned);
+                    tile.area = tileArea(key);
+                    tile.scale = std::ldexp(1.0f, level);
+                    tile.dirty = true;
+                    tiles.push_front(tile);
+                    lookup[key] = tiles.begin();
+                }
+                out.push_back(&tiles.front());
+                pinned++;
+            }
+        }
+    }
+
+    void TiledCanvas::invalidate(const Bounds& area) {
+        if (area.isEmpty()) {
+            return;
+        }
+        for (Tile& tile : tiles) {
+            if (tile.area.intersects(area)) {
+                tile.dirty = true;
+            }
+        }
+    }
+
+    void TiledCanvas::invalidate(const Bounds& area, int level, std::vector<Tile*>& drawn) {
+        if (area.isEmpty()) {
+            return;
+        }
+        for (Tile& tile : tiles) {
+            if (!tile.area.intersects(area)) {
+                continue;
+            }
+            if (tile.key.level == level && !tile.dirty) {
+                drawn.push_back(&tile);
+            }
+            else {
+                tile.dirty = true;
+            }
+        }
+    }
+
+    void TiledCanvas::invalidateAll() {
+        for (Tile& tile : tiles) {
+            tile.dirty = true;
+        }
+    }
+
+    void TiledCanvas::clear() {
+        for (const Tile& tile : tiles) {
+            freeSlots.push_back(tile.slot);
+        }
+        tiles.clear();
+        lookup.clear();
+    }
+
+    int TiledCanvas::levelFor(float zoom) {
+        int level = static_cast<int>(std::ceil(std::log2(std::max(zoom, 1e-6f)) - 1e-4f));
+        return std::min(std::max(level, minLevel), maxLevel);
+    }
+
+    Bounds TiledCanvas::tileArea(const TileKey& key) const {
+        float units = tileUnits(key.level);
+        Bounds area;
+        area.include(Vec2(key.x * units, key.y * units));
+        area.include(Vec2((key.x + 1) * units, (key.y + 1) * units));
+        return area;
+    }
+
+    int TiledCanvas::getTileSize() const {
+        return tileSize;
+    }
+
+    size_t TiledCanvas::getTileBytes() const {
+        return static_cast<size_t>(tileSize) * tileSize * 4;
+    }
+
+    size_t TiledCanvas::getBudget() const {
+        return budgetBytes;
+    }
+
+    size_t TiledCanvas::getResidentCount() const {
+        return tiles.size();
+    }
+
+    size_t TiledCanvas::getSlotCount() const {
+        return slotCount;
+    }
+
+    size_t TiledCanvas::getResidentBytes() const {
+        return slotCount * getTileBytes();
+    }
+
+    uint64_t TiledCanvas::getEvictions() const {
+        return evictions;
+    }
+
+    float TiledCanvas::tileUnits(int level) const {
+        return std::ldexp(static_cast<float>(tileSize), -level);
+    }
+
+    size_t TiledCanvas::takeSlot(size_t pinned) {
+        if (!freeSlots.empty()) {
+            size_t slot = freeSlots.back();
+            freeSlots.pop_back();
+            return slot;
+        }
+
+        if ((slotCount + 1) * getTileBytes() <= budgetBytes || tiles.size() <= pinned) {
+            return slotCount++;
+        }
+
+        Tile& victim = tiles.back();
+        size_t slot = victim.slot;
+        lookup.erase(victim.key);
+        tiles.pop_back();
+        evictions++;
+        return slot;
+    }
+
+} // namespace vdraw
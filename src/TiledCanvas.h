@@ -0,0 +1,111 @@
+// TiledCanvas.h
+#pragma once
+
+#include "VectorDrawing.h"
+#include "StrokeGeometry.h"
+
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+namespace vdraw {
+
+    // Maps the drawing to the screen: screen = (drawing - origin) * zoom
+    struct ViewTransform {
+        Vec2 origin;    // Drawing position at the top left of the view
+        float zoom;     // Screen pixels per drawing unit
+
+        ViewTransform();
+
+        Vec2 toScreen(const Vec2& point) const;
+        Vec2 toDrawing(const Vec2& point) const;
+
+        // The drawing area shown in a view of width x height pixels
+        Bounds visibleArea(float width, float height) const;
+
+        void pan(const Vec2& screenDelta);
+
+        // Scales by factor within [minZoom, maxZoom], keeping the drawing under screenPoint in place
+        void zoomAt(const Vec2& screenPoint, float factor, float minZoom, float maxZoom);
+    };
+
+    // A tile of the grid at one level: level l renders 2^l pixels per drawing unit
+    struct TileKey {
+        int32_t x, y, level;
+
+        bool operator==(const TileKey& other) const;
+    };
+
+    struct TileKeyHash {
+        size_t operator()(const TileKey& key) const;
+    };
+
+    struct Tile {
+        TileKey key;
+        size_t slot;    // Raster storage, reused when the tile is evicted
+        Bounds area;    // Drawing area covered
+        float scale;    // Pixels per drawing unit
+        bool dirty;     // Must be rendered from the strokes before it is shown
+    };
+
+    // Pages an unbounded canvas into fixed-size raster tiles, created for the visible area on
+    // demand and kept in least recently used order within a memory budget. The rasters
+    // themselves belong to the renderer, one per slot; an evicted tile's slot is handed to
+    // the next tile created, which starts dirty and is rendered again from the strokes.
+    //
+    // Tiles come from the level just above the zoom, so they are only ever drawn at their
+    // own resolution or reduced, never magnified; tiles of other levels stay resident until
+    // evicted, which keeps zooming back and forth cheap.
+    class TiledCanvas {
+    public:
+        static const int minLevel = -8;
+        static const int maxLevel = 8;
+
+        TiledCanvas(int tileSize = 256, size_t budgetBytes = 64 * 1024 * 1024);
+
+        // Appends the tiles covering the view, marking them most recently used. Tiles of the
+        // view are never evicted for each other: a view larger than the budget goes over it.
+        void acquire(const ViewTransform& view, float width, float height, std::vector<Tile*>& out);
+
+        // Marks the resident tiles overlapping area dirty
+        void invalidate(const Bounds& area);
+
+        // As above, except the clean tiles of level are appended to drawn instead, for the
+        // caller to draw the change into directly
+        void invalidate(const Bounds& area, int level, std::vector<Tile*>& drawn);
+
+        // Marks every resident tile dirty, keeping their slots
+        void invalidateAll();
+
+        // Drops every tile; their slots stay allocated for reuse
+        void clear();
+
+        static int levelFor(float zoom);
+        Bounds tileArea(const TileKey& key) const;
+
+        int getTileSize() const;
+        size_t getTileBytes() const;
+        size_t getBudget() const;
+        size_t getResidentCount() const;
+        size_t getSlotCount() const;
+        size_t getResidentBytes() const;    // Of the allocated slots
+        uint64_t getEvictions() const;
+
+    private:
+        int tileSize;
+        size_t budgetBytes;
+        size_t slotCount;
+        uint64_t evictions;
+
+        std::list<Tile> tiles;  // Most recently used first
+        std::unordered_map<TileKey, std::list<Tile>::iterator, TileKeyHash> lookup;
+        std::vector<size_t> freeSlots;
+
+        float tileUnits(int level) const;
+
+        // A slot for a new tile, evicting the least recently used tile past the first pinned
+        size_t takeSlot(size_t pinned);
+    };
+
+} // namespace vdraw
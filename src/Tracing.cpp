@@ -0,0 +1,272 @@
+#include "Tracing.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <sstream>
+
+namespace {
+
+    typedef std::chrono::steady_clock Clock;
+
+    const Clock::time_point epoch = Clock::now();
+
+    double percentile(const std::vector<int64_t>& sorted, double fraction) {
+        size_t rank = static_cast<size_t>(fraction * (sorted.size() - 1) + 0.5);
+        return sorted[std::min(rank, sorted.size() - 1)] / 1e6;
+    }
+
+    std::string escapeJson(const std::string& text) {
+        std::string escaped;
+        for (char c : text) {
+            if (c == '"' || c == '\\') escaped += '\\';
+            if (static_cast<unsigned char>(c) >= 0x20) escaped += c;
+        }
+        return escaped;
+    }
+
+} // namespace
+
+//-------------------------------------------------------------------------
+// Tracer
+//-------------------------------------------------------------------------
+const size_t Tracer::eventsPerThread;
+
+Tracer& Tracer::get() {
+    // Never destroyed, so worker threads that outlive main can still finish their spans
+    static Tracer* tracer = new Tracer();
+    return *tracer;
+}
+
+Tracer::Tracer() : enabled(true), nextRequestId(1), nextThreadId(1) {
+}
+
+int64_t Tracer::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - epoch).count();
+}
+
+void Tracer::setEnabled(bool enabled) {
+    this->enabled = enabled;
+}
+
+bool Tracer::isEnabled() const {
+    return enabled.load(std::memory_order_relaxed);
+}
+
+void Tracer::setThreadName(const std::string& name) {
+    ThreadBuffer& buffer = threadBuffer();
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    threadNames[buffer.threadId] = name;
+}
+
+uint64_t Tracer::newRequestId() {
+    return nextRequestId.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Tracer::record(const char* name, uint64_t requestId, int64_t startNanos, int64_t endNanos) {
+    if (!isEnabled()) return;
+
+    ThreadBuffer& buffer = threadBuffer();
+    uint64_t written = buffer.written.load(std::memory_order_relaxed);
+
+    // Keeps the slot's stores after the count that published the event before, so a reader
+    // that sees any of them also sees that count and knows to skip the slot
+    std::atomic_thread_fence(std::memory_order_release);
+
+    Slot& slot = buffer.slots[written % eventsPerThread];
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.requestId.store(requestId, std::memory_order_relaxed);
+    slot.startNanos.store(startNanos, std::memory_order_relaxed);
+    slot.durationNanos.store(endNanos - startNanos, std::memory_order_relaxed);
+    slot.threadId.store(buffer.threadId, std::memory_order_relaxed);
+
+    buffer.written.store(written + 1, std::memory_order_release);
+}
+
+Tracer::ThreadBufferLease::ThreadBufferLease() : buffer(nullptr) {
+}
+
+Tracer::ThreadBufferLease::~ThreadBufferLease() {
+    if (buffer) {
+        // Keep the events for export, but let the next new thread reuse the ring
+        std::lock_guard<std::mutex> lock(Tracer::get().buffersMutex);
+        buffer->inUse = false;
+    }
+}
+
+Tracer::ThreadBuffer& Tracer::threadBuffer() {
+    static thread_local ThreadBufferLease lease;
+    if (!lease.buffer) {
+        lease.buffer = acquireBuffer();
+    }
+    return *lease.buffer;
+}
+
+Tracer::ThreadBuffer* Tracer::acquireBuffer() {
+    std::lock_guard<std::mutex> lock(buffersMutex);
+
+    for (auto& buffer : buffers) {
+        if (!buffer->inUse) {
+            buffer->inUse = true;
+            buffer->threadId = nextThreadId++;
+            return buffer.get();
+        }
+    }
+
+    std::unique_ptr<ThreadBuffer> buffer(new ThreadBuffer());
+    buffer->slots.reset(new Slot[eventsPerThread]);
+    buffer->written = 0;
+    buffer->clearedAt = 0;
+    buffer->threadId = nextThreadId++;
+    buffer->inUse = true;
+    buffers.push_back(std::move(buffer));
+    return buffers.back().get();
+}
+
+std::vector<TraceEvent> Tracer::collectEvents(int64_t since, std::vector<uint32_t>* threadIds) const {
+    std::vector<TraceEvent> events;
+    std::lock_guard<std::mutex> lock(buffersMutex);
+
+    for (const auto& buffer : buffers) {
+        uint64_t written = buffer->written.load(std::memory_order_acquire);
+        uint64_t first = std::max(buffer->clearedAt.load(std::memory_order_relaxed),
+            written > eventsPerThread ? written - eventsPerThread : 0);
+        size_t copied = events.size();
+
+        std::vector<uint32_t> ids;
+        for (uint64_t i = first; i < written; ++i) {
+            const Slot& slot = buffer->slots[i % eventsPerThread];
+            TraceEvent event;
+            event.name = slot.name.load(std::memory_order_relaxed);
+            event.requestId = slot.requestId.load(std::memory_order_relaxed);
+            event.startNanos = slot.startNanos.load(std::memory_order_relaxed);
+            event.durationNanos = slot.durationNanos.load(std::memory_order_relaxed);
+            events.push_back(event);
+            ids.push_back(slot.threadId.load(std::memory_order_relaxed));
+        }
+
+        // The writer went on meanwhile: the events it overwrote, and the slot it may be
+        // writing now, are torn
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t rewritten = buffer->written.load(std::memory_order_relaxed);
+        uint64_t valid = rewritten + 1 > eventsPerThread ? rewritten + 1 - eventsPerThread : 0;
+        size_t torn = static_cast<size_t>(std::min(written, std::max(first, valid)) - first);
+
+        size_t kept = copied;
+        for (size_t i = torn; i < ids.size(); ++i) {
+            const TraceEvent& event = events[copied + i];
+            if (event.startNanos + event.durationNanos >= since) {
+                events[kept++] = event;
+                if (threadIds) threadIds->push_back(ids[i]);
+            }
+        }
+        events.resize(kept);
+    }
+    return events;
+}
+
+std::vector<StageStats> Tracer::getStageStats(double windowSeconds) const {
+    int64_t since = now() - static_cast<int64_t>(windowSeconds * 1e9);
+
+    std::map<std::string, std::vector<int64_t>> durations;
+    for (const TraceEvent& event : collectEvents(since, nullptr)) {
+        durations[event.name].push_back(event.durationNanos);
+    }
+
+    std::vector<StageStats> stats;
+    for (auto& stage : durations) {
+        std::vector<int64_t>& sorted = stage.second;
+        std::sort(sorted.begin(), sorted.end());
+
+        StageStats s;
+        s.name = stage.first;
+        s.count = sorted.size();
+        s.p50Ms = percentile(sorted, 0.50);
+        s.p95Ms = percentile(sorted, 0.95);
+        s.p99Ms = percentile(sorted, 0.99);
+        s.maxMs = sorted.back() / 1e6;
+        stats.push_back(s);
+    }
+    return stats;
+}
+
+std::string Tracer::formatStageStats(double windowSeconds) const {
+    std::ostringstream out;
+    char line[160];
+
+    snprintf(line, sizeof(line), "%-18s %7s %9s %9s %9s %9s\n", "stage", "count", "p50 ms", "p95 ms", "p99 ms", "max ms");
+    out << line;
+    for (const StageStats& s : getStageStats(windowSeconds)) {
+        snprintf(line, sizeof(line), "%-18s %7zu %9.2f %9.2f %9.2f %9.2f\n", s.name.c_str(), s.count, s.p50Ms, s.p95Ms, s.p99Ms, s.maxMs);
+        out << line;
+    }
+    return out.str();
+}
+
+bool Tracer::writeChromeTrace(const std::string& path) const {
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file) return false;
+
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+    const char* separator = "\n";
+
+    std::vector<uint32_t> threadIds;
+    std::vector<TraceEvent> events = collectEvents(0, &threadIds);
+
+    // Every thread with events in the rings, including those that have exited
+    std::vector<uint32_t> threads(threadIds);
+    std::sort(threads.begin(), threads.end());
+    threads.erase(std::unique(threads.begin(), threads.end()), threads.end());
+    {
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        for (uint32_t threadId : threads) {
+            auto found = threadNames.find(threadId);
+            std::string name = found != threadNames.end() ? found->second : "thread " + std::to_string(threadId);
+            fprintf(file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": {\"name\": \"%s\"}}",
+                separator, threadId, escapeJson(name).c_str());
+            separator = ",\n";
+        }
+    }
+    for (size_t i = 0; i < events.size(); ++i) {
+        const TraceEvent& event = events[i];
+        fprintf(file, "%s{\"name\": \"%s\", \"cat\": \"aidrawing\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f, \"args\": {\"request\": %llu}}",
+            separator, escapeJson(event.name).c_str(), threadIds[i], event.startNanos / 1000.0, event.durationNanos / 1000.0,
+            static_cast<unsigned long long>(event.requestId));
+        separator = ",\n";
+    }
+
+    fprintf(file, "\n]}\n");
+    return fclose(file) == 0;
+}
+
+void Tracer::clear() {
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    for (auto& buffer : buffers) {
+        buffer->clearedAt.store(buffer->written.load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
+}
+
+//-------------------------------------------------------------------------
+// TraceSpan
+//-------------------------------------------------------------------------
+TraceSpan::TraceSpan(const char* name, uint64_t requestId)
+    : name(name), requestId(requestId), startNanos(0) {
+    // Skip the clock reads entirely while tracing is off
+    if (Tracer::get().isEnabled()) {
+        startNanos = Tracer::now();
+    }
+    else {
+        this->name = nullptr;
+    }
+}
+
+TraceSpan::~TraceSpan() {
+    if (name) {
+        Tracer::get().record(name, requestId, startNanos, Tracer::now());
+    }
+}
+
+void TraceSpan::setRequestId(uint64_t requestId) {
+    this->requestId = requestId;
+}
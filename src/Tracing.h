@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Lightweight latency tracing for the draw -> interpret -> prompt -> image loop.
+// Spans are written to fixed-size per-thread rings on a monotonic clock, tagged with a
+// request id so stages running on different threads can be correlated. The rings can be
+// exported as Chrome trace JSON (chrome://tracing, Perfetto) or summarized as percentiles.
+// Each ring has a single writer and takes no lock; exports skip the slot it may be
+// overwriting meanwhile.
+
+struct TraceEvent {
+    const char* name;       // Must outlive the tracer, normally a string literal
+    uint64_t requestId;     // 0 when the span doesn't belong to a request
+    int64_t startNanos;
+    int64_t durationNanos;
+};
+
+struct StageStats {
+    std::string name;
+    size_t count;
+    double p50Ms;
+    double p95Ms;
+    double p99Ms;
+    double maxMs;
+};
+
+class Tracer {
+public:
+    static const size_t eventsPerThread = 8192;
+
+    static Tracer& get();
+
+    // Monotonic time in nanoseconds since the tracer was created
+    static int64_t now();
+
+    void setEnabled(bool enabled);
+    bool isEnabled() const;
+
+    // Names the calling thread in exported traces
+    void setThreadName(const std::string& name);
+
+    uint64_t newRequestId();
+
+    // Records a completed interval, which may have started on another thread
+    void record(const char* name, uint64_t requestId, int64_t startNanos, int64_t endNanos);
+
+    // Percentiles per stage over the spans recorded in the last windowSeconds
+    std::vector<StageStats> getStageStats(double windowSeconds = 10.0) const;
+    std::string formatStageStats(double windowSeconds = 10.0) const;
+
+    bool writeChromeTrace(const std::string& path) const;
+    void clear();
+
+private:
+    // TraceEvent with its thread, in fields a reader can load while the writer stores them
+    struct Slot {
+        std::atomic<const char*> name;
+        std::atomic<uint64_t> requestId;
+        std::atomic<int64_t> startNanos;
+        std::atomic<int64_t> durationNanos;
+        std::atomic<uint32_t> threadId;
+    };
+
+    struct ThreadBuffer {
+        std::unique_ptr<Slot[]> slots;
+        std::atomic<uint64_t> written;      // Events ever recorded, the next goes to slot written % eventsPerThread
+        std::atomic<uint64_t> clearedAt;    // Events before this were cleared
+        uint32_t threadId;                  // Of the thread writing now, fresh each time the ring is reused
+        bool inUse;                         // Guarded by buffersMutex
+    };
+
+    struct ThreadBufferLease {
+        ThreadBuffer* buffer;
+        ThreadBufferLease();
+        ~ThreadBufferLease();
+    };
+
+    Tracer();
+    ThreadBuffer& threadBuffer();
+    ThreadBuffer* acquireBuffer();
+    std::vector<TraceEvent> collectEvents(int64_t since, std::vector<uint32_t>* threadIds) const;
+
+    std::atomic<bool> enabled;
+    std::atomic<uint64_t> nextRequestId;
+
+    // Buffers are recycled when their thread exits, so short-lived worker threads don't
+    // grow the tracer. The events of the exited thread stay under its own id until overwritten.
+    mutable std::mutex buffersMutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    uint32_t nextThreadId;
+    std::map<uint32_t, std::string> threadNames;   // Also of exited threads, whose events may remain
+};
+
+// Records the lifetime of the enclosing scope
+class TraceSpan {
+public:
+    TraceSpan(const char* name, uint64_t requestId = 0);
+    ~TraceSpan();
+
+    void setRequestId(uint64_t requestId);
+
+private:
+    TraceSpan(const TraceSpan&);
+    TraceSpan& operator=(const TraceSpan&);
+
+    const char* name;
+    uint64_t requestId;
+    int64_t startNanos;
+};
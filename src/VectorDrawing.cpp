@@ -1,5 +1,8 @@
 ﻿// VectorDrawing.cpp
 #include "VectorDrawing.h"
+#include "SpatialIndex.h"
+
+#include <thread>
 
 // Use the namespace for all implementations
 namespace vdraw {
@@ -45,16 +48,64 @@ namespace vdraw {
         : position(pos), pressure(p), timestamp(t) {
     }
 
+    //-------------------------------------------------------------------------
+    // Stroke width
+    //-------------------------------------------------------------------------
+    float computeWidthAt(const StrokePoint* points, size_t count, size_t index, float baseWidth, bool dynamicWidth) {
+        if (index >= count) return baseWidth;
+
+        if (dynamicWidth) {
+            float speed = 1.0f;
+
+            // Calculate speed if we have a previous point
+            if (index > 0 && points[index].timestamp > points[index - 1].timestamp) {
+                float distance = points[index].position.distanceTo(points[index - 1].position);
+                double timeDiff = points[index].timestamp - points[index - 1].timestamp;
+
+                if (timeDiff > 0) {
+                    speed = distance / static_cast<float>(timeDiff);
+                    // Map speed to stroke width (faster → thinner)
+                    speed = std::max(0.1f, std::min(2.0f, 1.0f / (speed * 0.01f)));
+                }
+            }
+
+            return baseWidth * speed * points[index].pressure;
+        }
+        else {
+            return baseWidth * points[index].pressure;
+        }
+    }
+
+    float lodTolerance(float scale) {
+        return scale > 0 ? 0.5f / scale : 0.0f;
+    }
+
     //-------------------------------------------------------------------------
     // Stroke Implementation
     //-------------------------------------------------------------------------
-    Stroke::Stroke(const Color& color, float baseWidth)
-        : color(color), baseWidth(baseWidth), dynamicWidth(false), smoothing(0) {
+    const float Stroke::minLodTolerance = 0.25f;
+    const size_t Stroke::minLodPoints = 16;
+    const size_t Stroke::maxLodLevels = 16;
+
+    Stroke::Stroke(const Color& color, float baseWidth, StrokeMemoryPool* pool)
+        : rawPoints(PoolAllocator<StrokePoint>(pool)), processedPoints(PoolAllocator<StrokePoint>(pool)),
+        color(color), baseWidth(baseWidth), dynamicWidth(false), smoothing(0), lodLevelsBuilt(0), lodBuilding(false) {
     }
 
     void Stroke::addPoint(const StrokePoint& point) {
-        rawPoints.push_back(point);
-        updateProcessedPoints();
+        addPoints(&point, 1);
+    }
+
+    void Stroke::addPoints(const StrokePoint* points, size_t count) {
+        if (count == 0) return;
+
+        size_t firstAppended = rawPoints.size();
+        rawPoints.insert(rawPoints.end(), points, points + count);
+        updateProcessedPoints(firstAppended);
+    }
+
+    void Stroke::addPoints(const std::vector<StrokePoint>& points) {
+        addPoints(points.data(), points.size());
     }
 
     void Stroke::setColor(const Color& color) {
@@ -91,11 +142,11 @@ namespace vdraw {
         return smoothing;
     }
 
-    const std::vector<StrokePoint>& Stroke::getRawPoints() const {
+    const PointBuffer& Stroke::getRawPoints() const {
         return rawPoints;
     }
 
-    const std::vector<StrokePoint>& Stroke::getProcessedPoints() const {
+    const PointBuffer& Stroke::getProcessedPoints() const {
         return processedPoints;
     }
 
@@ -104,52 +155,107 @@ namespace vdraw {
     }
 
     float Stroke::getWidthAt(size_t index) const {
-        if (index >= processedPoints.size()) return baseWidth;
+        return computeWidthAt(processedPoints.data(), processedPoints.size(), index, baseWidth, dynamicWidth);
+    }
 
-        if (dynamicWidth) {
-            float speed = 1.0f;
+    const IndexBuffer* Stroke::getLod(float tolerance) const {
+        if (tolerance < minLodTolerance || processedPoints.size() < minLodPoints) {
+            return nullptr;
+        }
 
-            // Calculate speed if we have a previous point
-            if (index > 0 && processedPoints[index].timestamp > processedPoints[index - 1].timestamp) {
-                float distance = processedPoints[index].position.distanceTo(processedPoints[index - 1].position);
-                double timeDiff = processedPoints[index].timestamp - processedPoints[index - 1].timestamp;
+        size_t level = static_cast<size_t>(std::log2(tolerance / minLodTolerance));
+        level = std::min(level, maxLodLevels - 1);
 
-                if (timeDiff > 0) {
-                    speed = distance / static_cast<float>(timeDiff);
-                    // Map speed to stroke width (faster → thinner)
-                    speed = std::max(0.1f, std::min(2.0f, 1.0f / (speed * 0.01f)));
-                }
-            }
+        // Down to the endpoints, coarser levels would be the same
+        size_t built = lodLevelsBuilt.load(std::memory_order_acquire);
+        if (level < built || (built > 0 && lodLevels[built - 1].size() <= 2)) {
+            return &lodLevels[std::min(level, built - 1)];
+        }
+
+        // Another thread may be building the same levels, then this one only waits for them
+        while (lodBuilding.exchange(true, std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+        built = lodLevels.size();
+        while (built <= level && (built == 0 || lodLevels[built - 1].size() > 2)) {
+            buildLodLevel();
+            lodLevelsBuilt.store(++built, std::memory_order_release);
+        }
+        lodBuilding.store(false, std::memory_order_release);
+        return &lodLevels[std::min(level, built - 1)];
+    }
 
-            return baseWidth * speed * processedPoints[index].pressure;
+    void Stroke::buildLodLevel() const {
+        if (lodLevels.capacity() < maxLodLevels) {
+            lodLevels.reserve(maxLodLevels);
+        }
+
+        size_t level = lodLevels.size();
+        float tolerance = minLodTolerance * static_cast<float>(1u << level);
+
+        // From the heap rather than the stroke's pool, which isn't thread-safe, as getLod is
+        IndexBuffer indices;
+        std::vector<size_t> kept;
+        if (level == 0) {
+            simplifyPolyline(processedPoints.data(), processedPoints.size(), tolerance, kept);
+            indices.assign(kept.begin(), kept.end());
         }
         else {
-            return baseWidth * processedPoints[index].pressure;
+            // The level below is within half this tolerance of the stroke, so simplifying it
+            // by the other half stays within this one, at the cost of the coarser polyline
+            const IndexBuffer& finer = lodLevels.back();
+            std::vector<Vec2> positions;
+            positions.reserve(finer.size());
+            for (uint32_t index : finer) {
+                positions.push_back(processedPoints[index].position);
+            }
+            simplifyPolyline(positions.data(), positions.size(), tolerance * 0.5f, kept);
+            indices.reserve(kept.size());
+            for (size_t index : kept) {
+                indices.push_back(finer[index]);
+            }
         }
+        lodLevels.push_back(std::move(indices));
     }
 
     void Stroke::updateProcessedPoints() {
+        updateProcessedPoints(0);
+    }
+
+    void Stroke::updateProcessedPoints(size_t firstAppended) {
+        lodLevels.clear();
+        lodLevelsBuilt.store(0, std::memory_order_relaxed);
+
         if (rawPoints.empty()) {
             processedPoints.clear();
             return;
         }
 
+        // A point's smoothing window spans +/- smoothing neighbours, and the previous
+        // last point was an unsmoothed endpoint, so everything before this index is unchanged
+        size_t first = firstAppended > static_cast<size_t>(smoothing) ? firstAppended - smoothing : 0;
+        first = std::min(first, processedPoints.size());
+
+        // Let the buffer grow geometrically; reserving the exact size here would reallocate on every append
+        processedPoints.resize(first);
+        if (processedPoints.capacity() < rawPoints.size()) {
+            processedPoints.reserve(std::max(rawPoints.size(), processedPoints.capacity() * 2));
+        }
+
         if (smoothing <= 0) {
-            processedPoints = rawPoints;
+            processedPoints.insert(processedPoints.end(), rawPoints.begin() + first, rawPoints.end());
             return;
         }
 
         // Apply smoothing algorithm
-        processedPoints.clear();
-        processedPoints.reserve(rawPoints.size());
-
-        for (size_t i = 0; i < rawPoints.size(); ++i) {
+        for (size_t i = first; i < rawPoints.size(); ++i) {
             StrokePoint smoothedPoint = rawPoints[i];
 
             if (i > 0 && i < rawPoints.size() - 1) {
                 // Apply smoothing window
-                int windowStart = std::max(0, static_cast<int>(i) - smoothing);
-                int windowEnd = std::min(static_cast<int>(rawPoints.size()) - 1, static_cast<int>(i) + smoothing);
+                int center = static_cast<int>(i);
+                int windowStart = std::max(0, center - smoothing);
+                int windowEnd = std::min(static_cast<int>(rawPoints.size()) - 1, center + smoothing);
 
                 Vec2 avgPos(0, 0);
                 float avgPressure = 0;
@@ -157,7 +263,7 @@ namespace vdraw {
 
                 for (int j = windowStart; j <= windowEnd; ++j) {
                     // Calculate weight based on distance from center
-                    float weight = 1.0f - std::abs(static_cast<float>(j - i)) / (smoothing + 1.0f);
+                    float weight = 1.0f - std::abs(static_cast<float>(j - center)) / (smoothing + 1.0f);
 
                     avgPos = avgPos + (rawPoints[j].position * weight);
                     avgPressure += rawPoints[j].pressure * weight;
@@ -174,23 +280,216 @@ namespace vdraw {
         }
     }
 
+    //-------------------------------------------------------------------------
+    // StrokeDeleter Implementation
+    //-------------------------------------------------------------------------
+    StrokeDeleter::StrokeDeleter(StrokeMemoryPool* pool) : pool(pool) {}
+
+    void StrokeDeleter::operator()(Stroke* stroke) const {
+        if (!stroke) return;
+
+        if (pool) {
+            stroke->~Stroke();
+            pool->deallocate(stroke, sizeof(Stroke));
+        }
+        else {
+            delete stroke;
+        }
+    }
+
+    //-------------------------------------------------------------------------
+    // Layer Implementation
+    //-------------------------------------------------------------------------
+    Layer::Layer(const std::string& name, uint64_t id)
+        : name(name), visible(true), opacity(1.0f), id(id), revision(0), index(std::make_unique<SpatialIndex>()), undoRedoIndex(0) {
+    }
+
+    Layer::~Layer() {
+    }
+
+    const std::string& Layer::getName() const {
+        return name;
+    }
+
+    bool Layer::isVisible() const {
+        return visible;
+    }
+
+    float Layer::getOpacity() const {
+        return opacity;
+    }
+
+    uint64_t Layer::getId() const {
+        return id;
+    }
+
+    uint64_t Layer::getRevision() const {
+        return revision;
+    }
+
+    size_t Layer::getRedoCount() const {
+        return commandHistory.size() - undoRedoIndex;
+    }
+
+    const std::vector<Stroke*>& Layer::getStrokes() const {
+        return strokePtrs;
+    }
+
+    const SpatialIndex& Layer::getSpatialIndex() const {
+        return *index;
+    }
+
+    const Stroke* Layer::hitTest(const Vec2& position, float tolerance) const {
+        Bounds area;
+        area.include(position, tolerance);
+
+        const Stroke* hit = nullptr;
+        uint64_t hitOrder = 0;
+        index->visit(area, [&](const SpatialEntry& entry) {
+            if (hit && entry.order <= hitOrder) {
+                return;
+            }
+
+            const PointBuffer& points = entry.stroke->getProcessedPoints();
+            size_t last = entry.firstPoint + entry.pointCount - 1;
+            // Each segment, or the single point of a dot
+            for (size_t i = entry.firstPoint; i == entry.firstPoint || i < last; ++i) {
+                size_t next = std::min(i + 1, last);
+                float reach = std::max(entry.stroke->getWidthAt(i), entry.stroke->getWidthAt(next)) * 0.5f + tolerance;
+                if (distanceToSegmentSquared(position, points[i].position, points[next].position) <= reach * reach) {
+                    hit = entry.stroke;
+                    hitOrder = entry.order;
+                    return;
+                }
+            }
+        });
+        return hit;
+    }
+
+    void Layer::queryStrokes(const Bounds& rect, std::vector<const Stroke*>& out) const {
+        std::vector<std::pair<uint64_t, const Stroke*>> found;
+        index->visit(rect, [&](const SpatialEntry& entry) {
+            const PointBuffer& points = entry.stroke->getProcessedPoints();
+            size_t last = entry.firstPoint + entry.pointCount - 1;
+            for (size_t i = entry.firstPoint; i == entry.firstPoint || i < last; ++i) {
+                size_t next = std::min(i + 1, last);
+                float halfWidth = std::max(entry.stroke->getWidthAt(i), entry.stroke->getWidthAt(next)) * 0.5f;
+                if (segmentIntersects(points[i].position, points[next].position, rect.expanded(halfWidth))) {
+                    found.push_back(std::make_pair(entry.order, entry.stroke));
+                    return;
+                }
+            }
+        });
+
+        // A stroke is found once per run it has in rect
+        std::sort(found.begin(), found.end());
+        found.erase(std::unique(found.begin(), found.end()), found.end());
+        for (const auto& stroke : found) {
+            out.push_back(stroke.second);
+        }
+    }
+
+    void Layer::queryLasso(const Vec2* polygon, size_t count, std::vector<const Stroke*>& out) const {
+        if (count < 3) {
+            return;
+        }
+
+        Bounds area;
+        for (size_t i = 0; i < count; ++i) {
+            area.include(polygon[i]);
+        }
+
+        std::vector<std::pair<uint64_t, const Stroke*>> candidates;
+        index->visit(area, [&](const SpatialEntry& entry) {
+            candidates.push_back(std::make_pair(entry.order, entry.stroke));
+        });
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+        for (const auto& candidate : candidates) {
+            const PointBuffer& points = candidate.second->getProcessedPoints();
+            bool inside = true;
+            for (size_t i = 0; i < points.size() && inside; ++i) {
+                inside = area.contains(points[i].position) && pointInPolygon(points[i].position, polygon, count);
+            }
+            if (inside) {
+                out.push_back(candidate.second);
+            }
+        }
+    }
+
+    size_t Layer::findStrokes(uint64_t order) const {
+        auto first = std::lower_bound(strokePtrs.begin(), strokePtrs.end(), order,
+            [this](const Stroke* stroke, uint64_t value) { return index->getOrder(*stroke) < value; });
+        return static_cast<size_t>(first - strokePtrs.begin());
+    }
+
+    size_t Layer::countStrokes(size_t position, uint64_t order) const {
+        size_t end = position;
+        while (end < strokePtrs.size() && index->getOrder(*strokePtrs[end]) == order) {
+            end++;
+        }
+        return end - position;
+    }
+
+    void Layer::replaceStrokes(size_t position, size_t count, uint64_t order,
+        const std::vector<Stroke*>& target, std::vector<StrokePtr>& held) {
+        for (size_t i = position; i < position + count; ++i) {
+            index->removeStroke(*strokes[i]);
+            held.push_back(std::move(strokes[i]));
+        }
+
+        std::vector<StrokePtr> incoming;
+        incoming.reserve(target.size());
+        for (Stroke* stroke : target) {
+            auto found = std::find_if(held.begin(), held.end(), [stroke](const StrokePtr& candidate) {
+                return candidate.get() == stroke;
+            });
+            incoming.push_back(std::move(*found));
+            *found = std::move(held.back());
+            held.pop_back();
+            index->insertStroke(*stroke, order);
+        }
+
+        // Reuse the slots, so the rest of the drawing only moves when the stroke count changes
+        size_t reused = std::min(count, incoming.size());
+        for (size_t i = 0; i < reused; ++i) {
+            strokePtrs[position + i] = incoming[i].get();
+            strokes[position + i] = std::move(incoming[i]);
+        }
+
+        if (count > reused) {
+            strokes.erase(strokes.begin() + position + reused, strokes.begin() + position + count);
+            strokePtrs.erase(strokePtrs.begin() + position + reused, strokePtrs.begin() + position + count);
+        }
+        else if (incoming.size() > reused) {
+            strokePtrs.insert(strokePtrs.begin() + position + reused, target.begin() + reused, target.end());
+            strokes.insert(strokes.begin() + position + reused,
+                std::make_move_iterator(incoming.begin() + reused), std::make_move_iterator(incoming.end()));
+        }
+    }
+
     //-------------------------------------------------------------------------
     // Drawing Implementation
     //-------------------------------------------------------------------------
     Drawing::Drawing()
-        : currentColor(0, 0, 0), currentWidth(2.0f),
-        dynamicWidth(false), smoothingLevel(0),
-        activeStroke(nullptr), undoRedoIndex(0) {
+        : active(nullptr), activeIndex(0), nextLayerId(1), revision(0), activeErase(nullptr), eraseRadius(0),
+        currentColor(0, 0, 0), currentWidth(2.0f), dynamicWidth(false), smoothingLevel(0),
+        activeStroke(nullptr), historyLimit(0) {
+        layers.push_back(std::make_unique<Layer>("Layer 1", nextLayerId++));
+        active = layers.back().get();
     }
 
     Drawing::~Drawing() {
-        clearStrokes();
-        clearHistory();
+        // Before the pool the strokes allocate from
+        layers.clear();
     }
 
     void Drawing::beginStroke(const Vec2& position, float pressure, double timestamp) {
+        endErase();
+
         // Create a new stroke with current settings
-        std::unique_ptr<Stroke> stroke = std::make_unique<Stroke>(currentColor, currentWidth);
+        StrokePtr stroke = createStroke();
         stroke->setDynamicWidth(dynamicWidth);
         stroke->setSmoothing(smoothingLevel);
 
@@ -202,130 +501,707 @@ namespace vdraw {
         // Create add stroke command
         auto cmd = std::make_unique<AddStrokeCommand>(this, std::move(stroke));
         executeCommand(std::move(cmd));
+        markChanged();
+
+        for (auto observer : observers) {
+            observer->strokeBegan(*activeStroke);
+        }
     }
 
     void Drawing::continueStroke(const Vec2& position, float pressure, double timestamp) {
-        if (activeStroke) {
-            activeStroke->addPoint(StrokePoint(position, pressure, timestamp));
+        StrokePoint point(position, pressure, timestamp);
+        continueStroke(&point, 1);
+    }
+
+    void Drawing::continueStroke(const StrokePoint* points, size_t count) {
+        if (!activeStroke || count == 0) {
+            return;
+        }
+
+        size_t firstNewPoint = activeStroke->getRawPoints().size();
+        activeStroke->addPoints(points, count);
+
+        // Smoothing also moved the points whose window reaches the new ones
+        size_t smoothing = static_cast<size_t>(activeStroke->getSmoothing());
+        active->index->updateStroke(*activeStroke, firstNewPoint > smoothing ? firstNewPoint - smoothing : 0);
+        markChanged();
+
+        for (auto observer : observers) {
+            observer->strokeContinued(*activeStroke, firstNewPoint);
         }
     }
 
+    void Drawing::continueStroke(const std::vector<StrokePoint>& points) {
+        continueStroke(points.data(), points.size());
+    }
+
     void Drawing::endStroke() {
+        if (activeStroke) {
+            for (auto observer : observers) {
+                observer->strokeEnded(*activeStroke);
+            }
+        }
         activeStroke = nullptr;
     }
 
+    void Drawing::addStroke(const StrokePoint* points, size_t count, const Color& color, float baseWidth,
+        bool dynamicWidth, int smoothing) {
+        if (count == 0) {
+            return;
+        }
+
+        endErase();
+
+        StrokePtr stroke = createStroke();
+        stroke->setColor(color);
+        stroke->setBaseWidth(baseWidth);
+        stroke->setDynamicWidth(dynamicWidth);
+        stroke->setSmoothing(smoothing);
+        stroke->addPoints(points, count);
+
+        Stroke* added = stroke.get();
+        executeCommand(std::make_unique<AddStrokeCommand>(this, std::move(stroke)));
+        markChanged();
+
+        for (auto observer : observers) {
+            observer->strokeBegan(*added);
+            observer->strokeEnded(*added);
+        }
+    }
+
     void Drawing::setColor(const Color& color) {
         currentColor = color;
+        notifyStyleChanged();
     }
 
     void Drawing::setStrokeWidth(float width) {
         currentWidth = std::max(0.1f, width);
+        notifyStyleChanged();
     }
 
     void Drawing::setDynamicWidth(bool enabled) {
         dynamicWidth = enabled;
+        notifyStyleChanged();
     }
 
     void Drawing::setSmoothing(int level) {
         smoothingLevel = std::max(0, level);
+        notifyStyleChanged();
+    }
+
+    Color Drawing::getColor() const {
+        return currentColor;
+    }
+
+    float Drawing::getStrokeWidth() const {
+        return currentWidth;
+    }
+
+    bool Drawing::getDynamicWidth() const {
+        return dynamicWidth;
+    }
+
+    int Drawing::getSmoothing() const {
+        return smoothingLevel;
     }
 
     void Drawing::clearDrawing() {
-        if (strokes.empty()) {
+        endErase();
+
+        if (active->strokes.empty()) {
             return;
         }
 
         auto cmd = std::make_unique<ClearDrawingCommand>(this);
         executeCommand(std::move(cmd));
+        markChanged();
+
+        for (auto observer : observers) {
+            observer->drawingCleared();
+        }
+    }
+
+    bool Drawing::beginErase(const Vec2& position, float radius, Bounds* changed) {
+        endStroke();
+        endErase();
+
+        eraseRadius = std::max(0.5f, radius);
+        pendingErase = std::make_unique<EraseCommand>(this, eraseRadius);
+        activeErase = pendingErase.get();
+        activeErase->extend(position);
+        eraseCenter = position;
+
+        bool erased = eraseAt(position, changed);
+
+        for (auto observer : observers) {
+            observer->eraseBegan(position, eraseRadius);
+        }
+        return erased;
+    }
+
+    bool Drawing::continueErase(const Vec2& position, Bounds* changed) {
+        if (!activeErase) {
+            return false;
+        }
+
+        // Circles half a radius apart, so a fast eraser leaves no gaps between input events
+        float distance = eraseCenter.distanceTo(position);
+        int steps = std::max(1, static_cast<int>(std::ceil(distance / (eraseRadius * 0.5f))));
+
+        bool erased = false;
+        Vec2 from = eraseCenter;
+        for (int i = 1; i <= steps; ++i) {
+            erased |= eraseAt(from + (position - from) * (static_cast<float>(i) / steps), changed);
+        }
+        eraseCenter = position;
+        activeErase->extend(position);
+
+        for (auto observer : observers) {
+            observer->eraseContinued(position);
+        }
+        return erased;
+    }
+
+    void Drawing::endErase() {
+        if (!activeErase) {
+            return;
+        }
+
+        // The command left pendingErase when it entered the history
+        bool erased = !pendingErase;
+        activeErase->finish();
+        activeErase = nullptr;
+        pendingErase.reset();
+
+        for (auto observer : observers) {
+            observer->eraseEnded(erased);
+        }
+    }
+
+    bool Drawing::isErasing() const {
+        return activeErase != nullptr;
+    }
+
+    bool Drawing::eraseAt(const Vec2& center, Bounds* changed) {
+        if (!activeErase->erase(center, eraseRadius, changed)) {
+            return false;
+        }
+        markChanged();
+
+        // A gesture enters the history once it has erased something; the command has
+        // already been applied, so executing it is a no-op
+        if (pendingErase) {
+            executeCommand(std::move(pendingErase));
+        }
+        return true;
     }
 
     void Drawing::undo() {
-        if (undoRedoIndex > 0) {
-            undoRedoIndex--;
-            commandHistory[undoRedoIndex]->undo();
+        endErase();
+
+        if (active->undoRedoIndex > 0) {
+            active->undoRedoIndex--;
+            active->commandHistory[active->undoRedoIndex]->undo();
+            markChanged();
+
+            for (auto observer : observers) {
+                observer->undone();
+            }
         }
     }
 
     void Drawing::redo() {
-        if (undoRedoIndex < commandHistory.size()) {
-            commandHistory[undoRedoIndex]->execute();
-            undoRedoIndex++;
+        endErase();
+
+        if (active->undoRedoIndex < active->commandHistory.size()) {
+            active->commandHistory[active->undoRedoIndex]->execute();
+            active->undoRedoIndex++;
+            markChanged();
+
+            for (auto observer : observers) {
+                observer->redone();
+            }
         }
     }
 
+    void Drawing::setHistoryLimit(size_t maxCommands) {
+        historyLimit = maxCommands;
+        for (auto& layer : layers) {
+            evictHistory(*layer);
+        }
+    }
+
+    size_t Drawing::getHistoryLimit() const {
+        return historyLimit;
+    }
+
+    void Drawing::clearHistory() {
+        for (auto& layer : layers) {
+            // The gesture's command is in the history once it erased something
+            if (activeErase && layer.get() == active) {
+                continue;
+            }
+            layer->commandHistory.clear();
+            layer->undoRedoIndex = 0;
+        }
+        pool.release();
+    }
+
+    void Drawing::forEachHistoryStep(size_t index, const std::function<void(const std::vector<Stroke*>& strokes)>& base,
+        const std::function<void(const HistoryStep& step)>& step) {
+        if (index >= layers.size()) {
+            return;
+        }
+
+        Layer& layer = *layers[index];
+        std::vector<std::unique_ptr<DrawingCommand>>& history = layer.commandHistory;
+
+        // Executing a clear again ends the stroke in progress, which only ended its notifications
+        Stroke* stroke = activeStroke;
+
+        for (size_t i = layer.undoRedoIndex; i > 0; --i) {
+            history[i - 1]->undo();
+        }
+        base(layer.strokePtrs);
+
+        for (size_t i = 0; i < history.size(); ++i) {
+            step(history[i]->describe());
+            if (i < layer.undoRedoIndex) {
+                history[i]->execute();
+            }
+        }
+        activeStroke = stroke;
+    }
+
     const std::vector<Stroke*>& Drawing::getStrokes() const {
-        return strokePtrs;
+        return active->strokePtrs;
     }
 
     void Drawing::forEachStroke(const std::function<void(const Stroke&)>& callback) const {
-        for (const auto& stroke : strokePtrs) {
+        for (const auto& stroke : active->strokePtrs) {
             callback(*stroke);
         }
     }
 
-    void Drawing::clearStrokes() {
-        strokePtrs.clear();
-        strokes.clear();
-        activeStroke = nullptr;
+    const SpatialIndex& Drawing::getSpatialIndex() const {
+        return *active->index;
     }
 
-    void Drawing::clearHistory() {
-        commandHistory.clear();
-        undoRedoIndex = 0;
+    const Stroke* Drawing::hitTest(const Vec2& position, float tolerance) const {
+        return active->hitTest(position, tolerance);
+    }
+
+    void Drawing::queryStrokes(const Bounds& rect, std::vector<const Stroke*>& out) const {
+        active->queryStrokes(rect, out);
+    }
+
+    void Drawing::queryLasso(const Vec2* polygon, size_t count, std::vector<const Stroke*>& out) const {
+        active->queryLasso(polygon, count, out);
+    }
+
+    size_t Drawing::addLayer(const std::string& name) {
+        layers.push_back(std::make_unique<Layer>(name, nextLayerId++));
+        revision++;
+
+        for (auto observer : observers) {
+            observer->layerAdded(*layers.back(), layers.size() - 1);
+        }
+        return layers.size() - 1;
+    }
+
+    void Drawing::removeLayer(size_t index) {
+        if (index >= layers.size() || layers.size() == 1) {
+            return;
+        }
+
+        if (index == activeIndex) {
+            endStroke();
+            endErase();
+        }
+
+        layers.erase(layers.begin() + index);
+        if (activeIndex > index || activeIndex == layers.size()) {
+            activeIndex--;
+        }
+        active = layers[activeIndex].get();
+        revision++;
+
+        for (auto observer : observers) {
+            observer->layerRemoved(index);
+        }
+    }
+
+    void Drawing::setActiveLayer(size_t index) {
+        if (index >= layers.size() || index == activeIndex) {
+            return;
+        }
+
+        endStroke();
+        endErase();
+        activeIndex = index;
+        active = layers[index].get();
+        revision++;
+
+        for (auto observer : observers) {
+            observer->layerSelected(index);
+        }
+    }
+
+    size_t Drawing::getActiveLayer() const {
+        return activeIndex;
+    }
+
+    size_t Drawing::getLayerCount() const {
+        return layers.size();
+    }
+
+    const Layer& Drawing::getLayer(size_t index) const {
+        return *layers[index];
+    }
+
+    void Drawing::setLayerVisible(size_t index, bool visible) {
+        if (index >= layers.size()) {
+            return;
+        }
+
+        layers[index]->visible = visible;
+        revision++;
+
+        for (auto observer : observers) {
+            observer->layerChanged(*layers[index], index);
+        }
+    }
+
+    void Drawing::setLayerOpacity(size_t index, float opacity) {
+        if (index >= layers.size()) {
+            return;
+        }
+
+        layers[index]->opacity = std::min(std::max(opacity, 0.0f), 1.0f);
+        revision++;
+
+        for (auto observer : observers) {
+            observer->layerChanged(*layers[index], index);
+        }
+    }
+
+    uint64_t Drawing::getRevision() const {
+        return revision;
+    }
+
+    void Drawing::addObserver(DrawingObserver* observer) {
+        if (observer && std::find(observers.begin(), observers.end(), observer) == observers.end()) {
+            observers.push_back(observer);
+        }
+    }
+
+    void Drawing::removeObserver(DrawingObserver* observer) {
+        observers.erase(std::remove(observers.begin(), observers.end(), observer), observers.end());
+    }
+
+    PoolStats Drawing::getMemoryStats() const {
+        return pool.getStats();
+    }
+
+    StrokePtr Drawing::createStroke() {
+        void* memory = pool.allocate(sizeof(Stroke));
+        Stroke* stroke = new (memory) Stroke(currentColor, currentWidth, &pool);
+        return StrokePtr(stroke, StrokeDeleter(&pool));
+    }
+
+    void Drawing::notifyStyleChanged() {
+        for (auto observer : observers) {
+            observer->styleChanged(currentColor, currentWidth, dynamicWidth, smoothingLevel);
+        }
+    }
+
+    void Drawing::evictHistory(Layer& layer) {
+        std::vector<std::unique_ptr<DrawingCommand>>& history = layer.commandHistory;
+        if (historyLimit == 0 || history.size() <= historyLimit) {
+            return;
+        }
+
+        // Dropping the oldest commands frees whatever they kept alive, e.g. cleared strokes
+        size_t evicted = history.size() - historyLimit;
+        history.erase(history.begin(), history.begin() + evicted);
+        layer.undoRedoIndex = layer.undoRedoIndex > evicted ? layer.undoRedoIndex - evicted : 0;
+
+        // Hand chunks back to the heap in bulk once nothing references them. The pool is shared by
+        // every layer and release() checks that no block is in use anywhere, so this is a no-op
+        // while any layer or remaining history still holds a stroke.
+        pool.release();
     }
 
     void Drawing::executeCommand(std::unique_ptr<DrawingCommand> cmd) {
+        std::vector<std::unique_ptr<DrawingCommand>>& history = active->commandHistory;
+
         // Remove any redoable commands if we're executing a new command
-        if (undoRedoIndex < commandHistory.size()) {
-            commandHistory.resize(undoRedoIndex);
+        if (active->undoRedoIndex < history.size()) {
+            history.resize(active->undoRedoIndex);
         }
 
         cmd->execute();
-        commandHistory.push_back(std::move(cmd));
-        undoRedoIndex = commandHistory.size();
+        history.push_back(std::move(cmd));
+        active->undoRedoIndex = history.size();
+
+        evictHistory(*active);
+    }
+
+    void Drawing::markChanged() {
+        active->revision++;
+        revision++;
     }
 
     //-------------------------------------------------------------------------
     // Command Implementation
     //-------------------------------------------------------------------------
-    AddStrokeCommand::AddStrokeCommand(Drawing* drawing, std::unique_ptr<Stroke> stroke)
-        : drawing(drawing), stroke(std::move(stroke)) {
+    HistoryStep::HistoryStep(Type type)
+        : type(type), stroke(nullptr), radius(0.0f), path(nullptr) {
+    }
+
+    AddStrokeCommand::AddStrokeCommand(Drawing* drawing, StrokePtr stroke)
+        : drawing(drawing), layer(drawing->active), stroke(std::move(stroke)), order(0), ordered(false) {
     }
 
     void AddStrokeCommand::execute() {
         if (stroke) {
-            drawing->strokePtrs.push_back(stroke.get());
-            drawing->strokes.push_back(std::move(stroke));
+            if (ordered) {
+                layer->index->insertStroke(*stroke, order);
+            }
+            else {
+                layer->index->insertStroke(*stroke);
+                order = layer->index->getOrder(*stroke);
+                ordered = true;
+            }
+            layer->strokePtrs.push_back(stroke.get());
+            layer->strokes.push_back(std::move(stroke));
             stroke = nullptr;
         }
     }
 
+    HistoryStep AddStrokeCommand::describe() const {
+        HistoryStep step(HistoryStep::AddStroke);
+        step.stroke = stroke.get();
+        return step;
+    }
+
     void AddStrokeCommand::undo() {
-        if (!drawing->strokes.empty()) {
-            stroke = std::move(drawing->strokes.back());
-            drawing->strokes.pop_back();
-            drawing->strokePtrs.pop_back();
+        if (!layer->strokes.empty()) {
+            stroke = std::move(layer->strokes.back());
+            layer->strokes.pop_back();
+            layer->strokePtrs.pop_back();
+            layer->index->removeStroke(*stroke);
         }
     }
 
     ClearDrawingCommand::ClearDrawingCommand(Drawing* drawing)
-        : drawing(drawing) {
+        : drawing(drawing), layer(drawing->active), savedIndex(std::make_unique<SpatialIndex>()) {
+    }
+
+    ClearDrawingCommand::~ClearDrawingCommand() {
     }
 
     void ClearDrawingCommand::execute() {
         savedStrokes.clear();
-        std::swap(savedStrokes, drawing->strokes);
+        std::swap(savedStrokes, layer->strokes);
 
         // Also save the pointers
         savedPtrs.clear();
-        std::swap(savedPtrs, drawing->strokePtrs);
+        std::swap(savedPtrs, layer->strokePtrs);
+
+        // The index goes with the strokes, so neither clearing nor undoing it rebuilds anything
+        savedIndex->clear();
+        std::swap(savedIndex, layer->index);
 
         drawing->activeStroke = nullptr;
     }
 
     void ClearDrawingCommand::undo() {
-        std::swap(savedStrokes, drawing->strokes);
-        std::swap(savedPtrs, drawing->strokePtrs);
+        std::swap(savedStrokes, layer->strokes);
+        std::swap(savedPtrs, layer->strokePtrs);
+        std::swap(savedIndex, layer->index);
+    }
+
+    HistoryStep ClearDrawingCommand::describe() const {
+        return HistoryStep(HistoryStep::Clear);
+    }
+
+    EraseCommand::EraseCommand(Drawing* drawing, float gestureRadius)
+        : drawing(drawing), layer(drawing->active), erased(true), gestureRadius(gestureRadius) {
+    }
+
+    EraseCommand::~EraseCommand() {
+    }
+
+    void EraseCommand::execute() {
+        if (erased) {
+            return;
+        }
+
+        for (Change& change : changes) {
+            size_t position = layer->findStrokes(change.order);
+            layer->replaceStrokes(position, change.before.size(), change.order, change.after, change.held);
+        }
+        erased = true;
+    }
+
+    void EraseCommand::undo() {
+        if (!erased) {
+            return;
+        }
+
+        for (Change& change : changes) {
+            size_t position = layer->findStrokes(change.order);
+            size_t count = layer->countStrokes(position, change.order);
+            change.after.assign(layer->strokePtrs.begin() + position, layer->strokePtrs.begin() + position + count);
+            layer->replaceStrokes(position, count, change.order, change.before, change.held);
+        }
+        erased = false;
+    }
+
+    HistoryStep EraseCommand::describe() const {
+        HistoryStep step(HistoryStep::Erase);
+        step.radius = gestureRadius;
+        step.path = &path;
+        return step;
+    }
+
+    void EraseCommand::extend(const Vec2& position) {
+        path.push_back(position);
+    }
+
+    bool EraseCommand::erase(const Vec2& center, float radius, Bounds* changed) {
+        Bounds area;
+        area.include(center, radius);
+
+        // Gather first, the index can't change while it is visited
+        candidates.clear();
+        layer->index->visit(area, [this](const SpatialEntry& entry) {
+            candidates.push_back(entry.stroke);
+        });
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+        bool touched = false;
+        std::vector<StrokePtr> held;
+        std::vector<Stroke*> target;
+        for (const Stroke* stroke : candidates) {
+            float reach = 0;
+            if (!cut(*stroke, center, radius, reach)) {
+                continue;
+            }
+            touched = true;
+
+            if (changed) {
+                changed->include(area.expanded(reach));
+            }
+
+            for (size_t piece = 0; piece < pieceEnds.size(); ++piece) {
+                size_t first = piece > 0 ? pieceEnds[piece - 1] : 0;
+                StrokePtr added = drawing->createStroke();
+                added->setColor(stroke->getColor());
+                added->setBaseWidth(stroke->getBaseWidth());
+                added->setDynamicWidth(stroke->getDynamicWidth());
+                added->addPoints(piecePoints.data() + first, pieceEnds[piece] - first);
+                target.push_back(added.get());
+                held.push_back(std::move(added));
+            }
+
+            uint64_t order = layer->index->getOrder(*stroke);
+            size_t position = layer->findStrokes(order);
+
+            // The first time the gesture reaches this depth, remember what was there
+            auto found = orderChanges.find(order);
+            if (found == orderChanges.end()) {
+                Change change;
+                change.order = order;
+                size_t count = layer->countStrokes(position, order);
+                change.before.assign(layer->strokePtrs.begin() + position, layer->strokePtrs.begin() + position + count);
+                found = orderChanges.insert(std::make_pair(order, changes.size())).first;
+                changes.push_back(std::move(change));
+            }
+            Change& change = changes[found->second];
+
+            while (layer->strokePtrs[position] != stroke) {
+                position++;
+            }
+            layer->replaceStrokes(position, 1, order, target, held);
+
+            // Keep the stroke for undo if it was there before the gesture; a piece it made is dropped
+            if (std::find(change.before.begin(), change.before.end(), stroke) != change.before.end()) {
+                change.held.push_back(std::move(held.back()));
+            }
+            held.clear();
+            target.clear();
+        }
+        return touched;
+    }
+
+    void EraseCommand::finish() {
+        std::unordered_map<uint64_t, size_t>().swap(orderChanges);
+        std::vector<const Stroke*>().swap(candidates);
+        std::vector<StrokePoint>().swap(piecePoints);
+        std::vector<size_t>().swap(pieceEnds);
+    }
+
+    bool EraseCommand::cut(const Stroke& stroke, const Vec2& center, float radius, float& reach) {
+        const PointBuffer& points = stroke.getProcessedPoints();
+        piecePoints.clear();
+        pieceEnds.clear();
+
+        if (points.empty()) {
+            return false;
+        }
+
+        // Ends the piece being built, dropping it if it is no longer than a point
+        auto closePiece = [this]() {
+            size_t first = pieceEnds.empty() ? 0 : pieceEnds.back();
+            if (piecePoints.size() - first < 2) {
+                piecePoints.resize(first);
+            }
+            else {
+                pieceEnds.push_back(piecePoints.size());
+            }
+        };
+
+        auto pointAt = [](const StrokePoint& a, const StrokePoint& b, float t) {
+            return StrokePoint(a.position + (b.position - a.position) * t,
+                a.pressure + (b.pressure - a.pressure) * t, a.timestamp + (b.timestamp - a.timestamp) * t);
+        };
+
+        if (points.size() == 1) {
+            reach = stroke.getWidthAt(0) * 0.5f;
+            return points[0].position.distanceTo(center) <= radius;
+        }
+
+        bool touched = false;
+        if (points[0].position.distanceTo(center) > radius) {
+            piecePoints.push_back(points[0]);
+        }
+
+        for (size_t i = 0; i + 1 < points.size(); ++i) {
+            float t0 = 0, t1 = 0;
+            if (!clipSegmentToCircle(points[i].position, points[i + 1].position, center, radius, t0, t1)) {
+                piecePoints.push_back(points[i + 1]);
+                continue;
+            }
+
+            touched = true;
+            reach = std::max(reach, std::max(stroke.getWidthAt(i), stroke.getWidthAt(i + 1)) * 0.5f);
+
+            if (t0 > 0.0f) {
+                piecePoints.push_back(pointAt(points[i], points[i + 1], t0));
+            }
+            closePiece();
+
+            if (t1 < 1.0f) {
+                piecePoints.push_back(pointAt(points[i], points[i + 1], t1));
+                piecePoints.push_back(points[i + 1]);
+            }
+        }
+        closePiece();
+
+        return touched;
     }
 
 } // namespace vdraw
\ No newline at end of file
@@ -6,7 +6,13 @@
 #include <deque>
 #include <functional>
 #include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <string>
+
+#include "StrokeMemoryPool.h"
 
 // Create a namespace for our drawing classes to avoid conflicts
 namespace vdraw {
@@ -42,13 +48,28 @@ namespace vdraw {
         StrokePoint(const Vec2& pos, float p = 1.0f, double t = 0);
     };
 
+    // Width of a stroke at a processed point, shared by Stroke and read-only stroke views
+    float computeWidthAt(const StrokePoint* points, size_t count, size_t index, float baseWidth, bool dynamicWidth);
+
+    // Point storage for strokes, optionally backed by a StrokeMemoryPool
+    typedef std::vector<StrokePoint, PoolAllocator<StrokePoint>> PointBuffer;
+    typedef std::vector<uint32_t, PoolAllocator<uint32_t>> IndexBuffer;
+
+    // Level-of-detail tolerance for rendering at scale output pixels per drawing unit:
+    // detail finer than half an output pixel is invisible
+    float lodTolerance(float scale);
+
     // A single stroke with its properties
     class Stroke {
     public:
-        Stroke(const Color& color = Color(0, 0, 0), float baseWidth = 1.0f);
+        Stroke(const Color& color = Color(0, 0, 0), float baseWidth = 1.0f, StrokeMemoryPool* pool = nullptr);
 
         void addPoint(const StrokePoint& point);
 
+        // Append a batch of points, reprocessing the stroke once for the whole batch
+        void addPoints(const StrokePoint* points, size_t count);
+        void addPoints(const std::vector<StrokePoint>& points);
+
         void setColor(const Color& color);
         Color getColor() const;
 
@@ -61,23 +82,65 @@ namespace vdraw {
         void setSmoothing(int smoothingLevel);
         int getSmoothing() const;
 
-        const std::vector<StrokePoint>& getRawPoints() const;
-        const std::vector<StrokePoint>& getProcessedPoints() const;
+        const PointBuffer& getRawPoints() const;
+        const PointBuffer& getProcessedPoints() const;
 
         bool isEmpty() const;
 
         // Get width at a specific point index
         float getWidthAt(size_t index) const;
 
+        // Level of detail: the indices of the processed points whose polyline stays within
+        // tolerance (in drawing units) of the full stroke, see lodTolerance. Levels double in
+        // tolerance from minLodTolerance; each is built on first use from the level below and
+        // kept until the points change, and a pointer returned stays valid until then. Returns
+        // nullptr when every point should be drawn. Safe to call from several threads at once,
+        // e.g. SoftwareRasterizer's workers, as long as none modifies the stroke meanwhile.
+        const IndexBuffer* getLod(float tolerance) const;
+
+        static const float minLodTolerance;
+        static const size_t minLodPoints;   // Shorter strokes are always drawn in full
+        static const size_t maxLodLevels;
+
     private:
-        std::vector<StrokePoint> rawPoints;
-        std::vector<StrokePoint> processedPoints;
+        PointBuffer rawPoints;
+        PointBuffer processedPoints;
         Color color;
         float baseWidth;
         bool dynamicWidth;
         int smoothing;
+        mutable std::vector<IndexBuffer> lodLevels;     // Reserved for every level, so building one moves none
+        mutable std::atomic<size_t> lodLevelsBuilt;     // Published to other readers, in order
+        mutable std::atomic<bool> lodBuilding;          // Held by the one thread that builds
+
+        void buildLodLevel() const;
 
         void updateProcessedPoints();
+
+        // Only recompute processed points whose smoothing window reaches firstAppended
+        void updateProcessedPoints(size_t firstAppended);
+    };
+
+    // Destroys strokes allocated from a StrokeMemoryPool (or the heap when pool is null)
+    struct StrokeDeleter {
+        StrokeMemoryPool* pool;
+
+        StrokeDeleter(StrokeMemoryPool* pool = nullptr);
+        void operator()(Stroke* stroke) const;
+    };
+
+    typedef std::unique_ptr<Stroke, StrokeDeleter> StrokePtr;
+
+    // A command of the undo history as the operation that made it, see Drawing::forEachHistoryStep
+    struct HistoryStep {
+        enum Type { AddStroke, Clear, Erase };
+
+        Type type;
+        const Stroke* stroke;           // AddStroke: the stroke it adds
+        float radius;                   // Erase: the gesture, as given to beginErase and continueErase
+        const std::vector<Vec2>* path;
+
+        HistoryStep(Type type = Clear);
     };
 
     // Command interface for undo/redo functionality
@@ -86,37 +149,188 @@ namespace vdraw {
         virtual ~DrawingCommand() {}
         virtual void execute() = 0;
         virtual void undo() = 0;
+
+        // Only while the command is undone, when it holds what it adds
+        virtual HistoryStep describe() const = 0;
     };
 
     // Forward declarations
     class Drawing;
+    class Layer;
+    class SpatialIndex;
+    struct Bounds;
+
+    // Receives change notifications from a Drawing, e.g. to invalidate caches.
+    // Batched input produces one notification per batch rather than per point.
+    class DrawingObserver {
+    public:
+        virtual ~DrawingObserver() {}
+        // A stroke was added along with its initial points
+        virtual void strokeBegan(const Stroke& stroke) {}
+        // Points from firstNewPoint onward were appended to the stroke
+        virtual void strokeContinued(const Stroke& stroke, size_t firstNewPoint) {}
+        virtual void strokeEnded(const Stroke& stroke) {}
+        virtual void drawingCleared() {}
+        // An eraser gesture, see Drawing::beginErase
+        virtual void eraseBegan(const Vec2& position, float radius) {}
+        virtual void eraseContinued(const Vec2& position) {}
+        // erased: whether the gesture changed the drawing
+        virtual void eraseEnded(bool erased) {}
+        virtual void undone() {}
+        virtual void redone() {}
+        // Style applied to strokes begun from now on
+        virtual void styleChanged(const Color& color, float width, bool dynamicWidth, int smoothing) {}
+        // The layer stack, see Drawing::addLayer. Notifications above concern the active layer.
+        virtual void layerAdded(const Layer& layer, size_t index) {}
+        virtual void layerRemoved(size_t index) {}
+        virtual void layerSelected(size_t index) {}
+        // Visibility or opacity
+        virtual void layerChanged(const Layer& layer, size_t index) {}
+    };
 
     // Command to add a stroke
     class AddStrokeCommand : public DrawingCommand {
     public:
-        AddStrokeCommand(Drawing* drawing, std::unique_ptr<Stroke> stroke);
+        AddStrokeCommand(Drawing* drawing, StrokePtr stroke);
         void execute() override;
         void undo() override;
+        HistoryStep describe() const override;
 
     private:
         Drawing* drawing;
-        std::unique_ptr<Stroke> stroke;
+        Layer* layer;
+        StrokePtr stroke;
+        uint64_t order;     // Kept for redo, where later commands expect the stroke at the same depth
+        bool ordered;
     };
 
     // Command to clear all strokes
     class ClearDrawingCommand : public DrawingCommand {
     public:
         ClearDrawingCommand(Drawing* drawing);
+        ~ClearDrawingCommand() override;
         void execute() override;
         void undo() override;
+        HistoryStep describe() const override;
 
     private:
         Drawing* drawing;
-        std::vector<std::unique_ptr<Stroke>> savedStrokes;
+        Layer* layer;
+        std::vector<StrokePtr> savedStrokes;
         std::vector<Stroke*> savedPtrs;
+        std::unique_ptr<SpatialIndex> savedIndex;
+    };
+
+    // Command for one eraser gesture. Each stroke it crosses is replaced by the pieces left
+    // outside the eraser, at the same depth. Only the changed strokes are kept for undo: the
+    // originals while erased, their pieces while undone. A piece cut again by the same gesture
+    // is split in place and dropped, since undo restores the stroke it came from.
+    class EraseCommand : public DrawingCommand {
+    public:
+        EraseCommand(Drawing* drawing, float gestureRadius);
+        ~EraseCommand() override;
+        void execute() override;
+        void undo() override;
+        HistoryStep describe() const override;
+
+        // Records a position of the gesture, so it can be described and repeated
+        void extend(const Vec2& position);
+
+        // Erases the ink within radius of center, returns false if no stroke was touched.
+        // changed, if given, is grown to cover the area whose rendering changed.
+        bool erase(const Vec2& center, float radius, Bounds* changed);
+
+        // Ends the gesture, dropping what was only needed to extend it
+        void finish();
+
+    private:
+        // The strokes at one depth: a stroke, or the pieces earlier erasing left of it
+        struct Change {
+            uint64_t order;
+            std::vector<Stroke*> before;    // In drawing order, before and after the gesture
+            std::vector<Stroke*> after;
+            std::vector<StrokePtr> held;    // Those of the other list not in the drawing
+        };
+
+        Drawing* drawing;
+        Layer* layer;
+        std::vector<Change> changes;
+        bool erased;
+        float gestureRadius;
+        std::vector<Vec2> path;
+
+        // While the gesture runs: the change for each depth it has touched
+        std::unordered_map<uint64_t, size_t> orderChanges;
+
+        // Scratch for cutting one stroke: the points of its pieces and where each ends
+        std::vector<const Stroke*> candidates;
+        std::vector<StrokePoint> piecePoints;
+        std::vector<size_t> pieceEnds;
+
+        bool cut(const Stroke& stroke, const Vec2& center, float radius, float& reach);
+    };
+
+    // One layer of a Drawing, with its own strokes, spatial index and undo history. Commands
+    // act on the layer they were created on, which is active whenever its history runs.
+    class Layer {
+    public:
+        Layer(const std::string& name, uint64_t id);
+        ~Layer();
+
+        const std::string& getName() const;
+        bool isVisible() const;
+        float getOpacity() const;
+
+        // Unique within the drawing and never reused, e.g. to key caches of the layer
+        uint64_t getId() const;
+
+        // Increases with every change to the layer's strokes, so a rendering of the layer is
+        // current while the revision it was made at matches
+        uint64_t getRevision() const;
+
+        // Commands in the history that redo would execute again
+        size_t getRedoCount() const;
+
+        // Strokes in drawing order, and spatial queries over them as on Drawing
+        const std::vector<Stroke*>& getStrokes() const;
+        const SpatialIndex& getSpatialIndex() const;
+        const Stroke* hitTest(const Vec2& position, float tolerance = 0.0f) const;
+        void queryStrokes(const Bounds& rect, std::vector<const Stroke*>& out) const;
+        void queryLasso(const Vec2* polygon, size_t count, std::vector<const Stroke*>& out) const;
+
+    private:
+        std::string name;
+        bool visible;
+        float opacity;
+        uint64_t id;
+        uint64_t revision;
+
+        std::vector<StrokePtr> strokes;
+        std::vector<Stroke*> strokePtrs;  // Non-owning pointers for quick access
+        std::unique_ptr<SpatialIndex> index;
+        std::vector<std::unique_ptr<DrawingCommand>> commandHistory;
+        size_t undoRedoIndex;
+
+        // Position of the first stroke at order; strokes are kept sorted by their index order
+        size_t findStrokes(uint64_t order) const;
+
+        // Number of strokes at order from position
+        size_t countStrokes(size_t position, uint64_t order) const;
+
+        // Replaces count strokes from position with the strokes listed in target, at order.
+        // The strokes are taken from held, which receives the ones replaced, so two lists of
+        // pointers can swap a run of strokes back and forth.
+        void replaceStrokes(size_t position, size_t count, uint64_t order,
+            const std::vector<Stroke*>& target, std::vector<StrokePtr>& held);
+
+        friend class Drawing;
+        friend class AddStrokeCommand;
+        friend class ClearDrawingCommand;
+        friend class EraseCommand;
     };
 
-    // Drawing class that manages strokes and provides drawing functionality
+    // Drawing class that manages strokes and provides drawing functionality.
+    // Strokes live in layers; everything below that doesn't name a layer acts on the active one.
     class Drawing {
     public:
         Drawing();
@@ -124,27 +338,118 @@ namespace vdraw {
 
         void beginStroke(const Vec2& position, float pressure = 1.0f, double timestamp = 0);
         void continueStroke(const Vec2& position, float pressure = 1.0f, double timestamp = 0);
+        void continueStroke(const StrokePoint* points, size_t count);
+        void continueStroke(const std::vector<StrokePoint>& points);
         void endStroke();
 
+        // Add a complete stroke in one step, e.g. when loading a document
+        void addStroke(const StrokePoint* points, size_t count, const Color& color, float baseWidth,
+            bool dynamicWidth = false, int smoothing = 0);
+
         void setColor(const Color& color);
         void setStrokeWidth(float width);
         void setDynamicWidth(bool enabled);
         void setSmoothing(int level);
 
+        Color getColor() const;
+        float getStrokeWidth() const;
+        bool getDynamicWidth() const;
+        int getSmoothing() const;
+
         void clearDrawing();
 
+        // Eraser: removes the ink within radius of the path through the given positions,
+        // splitting the strokes it crosses. The gesture is one command, whose undo restores
+        // only the strokes it changed. Returns whether anything was erased; changed, if given,
+        // is grown to cover the area to redraw.
+        bool beginErase(const Vec2& position, float radius, Bounds* changed = nullptr);
+        bool continueErase(const Vec2& position, Bounds* changed = nullptr);
+        void endErase();
+        bool isErasing() const;
+
+        // Undo and redo within the active layer's history
         void undo();
         void redo();
 
+        // Maximum number of undoable commands per layer; the oldest are evicted (and their
+        // strokes freed) beyond this. 0 keeps the full history.
+        void setHistoryLimit(size_t maxCommands);
+        size_t getHistoryLimit() const;
+
+        // Forgets every layer's undo and redo history, keeping the strokes as they are, e.g. to
+        // replay a saved history on top of strokes loaded without one. An eraser gesture in
+        // progress keeps the active layer's history until it ends.
+        void clearHistory();
+
+        // Walks a layer's undo history, e.g. to save it: base gets the layer's strokes as they
+        // were before the oldest command, then step gets each command in order, the redoable
+        // ones (see Layer::getRedoCount) last. Repeating the steps on those strokes and undoing
+        // the redoable ones rebuilds the layer and its history. The layer is rewound and
+        // restored on the way, with no notifications; not during an eraser gesture.
+        void forEachHistoryStep(size_t layer, const std::function<void(const std::vector<Stroke*>& strokes)>& base,
+            const std::function<void(const HistoryStep& step)>& step);
+
         const std::vector<Stroke*>& getStrokes() const;
 
         // For rendering by external systems
         void forEachStroke(const std::function<void(const Stroke&)>& callback) const;
 
+        // Spatial queries over the processed points. The index is kept current as strokes
+        // grow and as commands execute, undo and redo.
+        const SpatialIndex& getSpatialIndex() const;
+
+        // Topmost stroke whose ink is within tolerance of position, nullptr if none
+        const Stroke* hitTest(const Vec2& position, float tolerance = 0.0f) const;
+
+        // Strokes with ink inside rect, in drawing order
+        void queryStrokes(const Bounds& rect, std::vector<const Stroke*>& out) const;
+
+        // Strokes lying entirely inside the closed polygon, in drawing order
+        void queryLasso(const Vec2* polygon, size_t count, std::vector<const Stroke*>& out) const;
+
+        // Observers are not owned and must outlive the drawing or be removed
+        void addObserver(DrawingObserver* observer);
+        void removeObserver(DrawingObserver* observer);
+
+        // Layers, composited bottom first. A drawing starts with one layer.
+        // Adds a layer on top and returns its index; it becomes active only through setActiveLayer.
+        size_t addLayer(const std::string& name);
+
+        // Drops the layer along with its history; the last layer is never removed
+        void removeLayer(size_t index);
+
+        // Ends the stroke or eraser gesture in progress before switching
+        void setActiveLayer(size_t index);
+        size_t getActiveLayer() const;
+
+        size_t getLayerCount() const;
+        const Layer& getLayer(size_t index) const;
+
+        void setLayerVisible(size_t index, bool visible);
+        void setLayerOpacity(size_t index, float opacity);
+
+        // Increases with every change to any layer's strokes, to the layers or to which is active
+        uint64_t getRevision() const;
+
+        // Memory statistics for stroke and point storage
+        PoolStats getMemoryStats() const;
+
     private:
-        std::vector<std::unique_ptr<Stroke>> strokes;
-        std::vector<Stroke*> strokePtrs;  // Non-owning pointers for quick access
-        std::vector<std::unique_ptr<DrawingCommand>> commandHistory;
+        // Declared first so it outlives every stroke that allocates from it
+        StrokeMemoryPool pool;
+
+        std::vector<std::unique_ptr<Layer>> layers;
+        Layer* active;
+        size_t activeIndex;
+        uint64_t nextLayerId;
+        uint64_t revision;
+        std::vector<DrawingObserver*> observers;
+
+        // The eraser gesture; its command is held here until it first erases something
+        std::unique_ptr<EraseCommand> pendingErase;
+        EraseCommand* activeErase;
+        Vec2 eraseCenter;
+        float eraseRadius;
 
         Color currentColor;
         float currentWidth;
@@ -152,14 +457,20 @@ namespace vdraw {
         int smoothingLevel;
 
         Stroke* activeStroke;
-        size_t undoRedoIndex;
+        size_t historyLimit;
 
-        void clearStrokes();
-        void clearHistory();
+        StrokePtr createStroke();
+        void notifyStyleChanged();
+        void evictHistory(Layer& layer);
         void executeCommand(std::unique_ptr<DrawingCommand> cmd);
+        bool eraseAt(const Vec2& center, Bounds* changed);
+
+        // The active layer's strokes changed
+        void markChanged();
 
         friend class AddStrokeCommand;
         friend class ClearDrawingCommand;
+        friend class EraseCommand;
     };
 
 } // namespace vdraw
\ No newline at end of file
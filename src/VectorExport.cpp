@@ -0,0 +1,490 @@
+// VectorExport.cpp
+#include "VectorExport.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace vdraw {
+
+    namespace {
+
+        const int64_t powersOfTen[] = { 1, 10, 100, 1000, 10000, 100000, 1000000 };
+        const int maxPrecision = 6;
+
+        // PDF user space units per canvas pixel, 72 points per inch at 96 pixels per inch
+        const float pointsPerPixel = 0.75f;
+
+        // Catalog, page tree, page, content stream and its length
+        const size_t pdfObjectCount = 5;
+
+    } // namespace
+
+    //-------------------------------------------------------------------------
+    // BufferedWriter Implementation
+    //-------------------------------------------------------------------------
+    BufferedWriter::BufferedWriter(size_t capacity)
+        : file(nullptr), buffer(std::max<size_t>(capacity, 64)), used(0), offset(0), failed(false) {
+    }
+
+    BufferedWriter::~BufferedWriter() {
+        close();
+    }
+
+    bool BufferedWriter::open(const std::string& path) {
+        close();
+
+        file = fopen(path.c_str(), "wb");
+        used = 0;
+        offset = 0;
+        failed = file == nullptr;
+        return file != nullptr;
+    }
+
+    bool BufferedWriter::close() {
+        if (!file) {
+            return false;
+        }
+
+        flush();
+        if (fclose(file) != 0) {
+            failed = true;
+        }
+        file = nullptr;
+        return !failed;
+    }
+
+    bool BufferedWriter::isOpen() const {
+        return file != nullptr;
+    }
+
+    bool BufferedWriter::hasFailed() const {
+        return failed;
+    }
+
+    void BufferedWriter::write(const char* data, size_t size) {
+        offset += size;
+        if (used + size > buffer.size()) {
+            flush();
+
+            // Larger than the whole buffer, write through
+            if (size > buffer.size()) {
+                if (file && !failed && fwrite(data, 1, size, file) != size) {
+                    failed = true;
+                }
+                return;
+            }
+        }
+
+        memcpy(&buffer[used], data, size);
+        used += size;
+    }
+
+    void BufferedWriter::write(const char* text) {
+        write(text, strlen(text));
+    }
+
+    void BufferedWriter::write(char c) {
+        if (used == buffer.size()) {
+            flush();
+        }
+        buffer[used++] = c;
+        offset++;
+    }
+
+    void BufferedWriter::writeInt(int64_t value) {
+        char digits[24];
+        size_t length = 0;
+
+        uint64_t magnitude = value < 0 ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+        do {
+            digits[sizeof(digits) - 1 - length++] = static_cast<char>('0' + magnitude % 10);
+            magnitude /= 10;
+        } while (magnitude > 0);
+
+        if (value < 0) {
+            digits[sizeof(digits) - 1 - length++] = '-';
+        }
+        write(digits + sizeof(digits) - length, length);
+    }
+
+    void BufferedWriter::writeFixed(int64_t value, int precision) {
+        precision = std::max(0, std::min(maxPrecision, precision));
+        int64_t unit = powersOfTen[precision];
+
+        uint64_t magnitude = value < 0 ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+        uint64_t whole = magnitude / unit;
+        uint64_t fraction = magnitude % unit;
+
+        if (value < 0) {
+            write('-');
+        }
+        writeInt(static_cast<int64_t>(whole));
+        if (fraction == 0) {
+            return;
+        }
+
+        char digits[maxPrecision];
+        for (int i = precision - 1; i >= 0; --i) {
+            digits[i] = static_cast<char>('0' + fraction % 10);
+            fraction /= 10;
+        }
+
+        int length = precision;
+        while (digits[length - 1] == '0') {
+            length--;
+        }
+        write('.');
+        write(digits, length);
+    }
+
+    uint64_t BufferedWriter::getOffset() const {
+        return offset;
+    }
+
+    void BufferedWriter::flush() {
+        if (used > 0 && file && !failed && fwrite(buffer.data(), 1, used, file) != used) {
+            failed = true;
+        }
+        used = 0;
+    }
+
+    //-------------------------------------------------------------------------
+    // VectorExporter Implementation
+    //-------------------------------------------------------------------------
+    VectorExportSettings::VectorExportSettings(float tolerance, int precision, float widthStep, size_t simplifyWindow)
+        : tolerance(tolerance), precision(precision), widthStep(widthStep), simplifyWindow(simplifyWindow) {
+    }
+
+    VectorExporter::VectorExporter(Format format, const VectorExportSettings& settings)
+        : format(format), settings(settings), width(0), height(0), unit(1), contentStart(0), pointsWritten(0),
+        pathOpen(false), pathSegments(0), pathWidth(0), nextWidth(0), lastX(0), lastY(0), pdfColor(-1, -1, -1, -1), pdfWidth(-1) {
+        this->settings.precision = std::max(0, std::min(maxPrecision, settings.precision));
+        this->settings.simplifyWindow = std::max<size_t>(2, settings.simplifyWindow);
+        unit = powersOfTen[this->settings.precision];
+    }
+
+    VectorExporter::~VectorExporter() {
+        if (isOpen()) {
+            close();
+        }
+    }
+
+    bool VectorExporter::open(const std::string& path, float width, float height) {
+        Bounds area;
+        area.min = Vec2(0.0f, 0.0f);
+        area.max = Vec2(width, height);
+        return open(path, area);
+    }
+
+    bool VectorExporter::open(const std::string& path, const Bounds& area) {
+        if (!out.open(path)) {
+            return false;
+        }
+
+        Vec2 origin = area.min;
+        width = area.getWidth();
+        height = area.getHeight();
+        pointsWritten = 0;
+        pdfColor = Color(-1, -1, -1, -1);
+        pdfWidth = -1;
+
+        if (format == Svg) {
+            out.write("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"");
+            out.writeFixed(quantize(width), settings.precision);
+            out.write("\" height=\"");
+            out.writeFixed(quantize(height), settings.precision);
+            out.write("\" viewBox=\"");
+            out.writeFixed(quantize(origin.x), settings.precision);
+            out.write(' ');
+            out.writeFixed(quantize(origin.y), settings.precision);
+            out.write(' ');
+            out.writeFixed(quantize(width), settings.precision);
+            out.write(' ');
+            out.writeFixed(quantize(height), settings.precision);
+            out.write("\">\n<g fill=\"none\" stroke-linecap=\"round\" stroke-linejoin=\"round\">\n");
+        }
+        else {
+            objectOffsets.assign(pdfObjectCount + 1, 0);
+
+            // The binary comment marks the file as binary for transfer tools
+            out.write("%PDF-1.4\n%\xE2\xE3\xCF\xD3\n");
+
+            beginObject(1);
+            out.write("<< /Type /Catalog /Pages 2 0 R >>\nendobj\n");
+            beginObject(2);
+            out.write("<< /Type /Pages /Kids [3 0 R] /Count 1 >>\nendobj\n");
+            beginObject(3);
+            out.write("<< /Type /Page /Parent 2 0 R /MediaBox [0 0 ");
+            out.writeFixed(quantize(width * pointsPerPixel), settings.precision);
+            out.write(' ');
+            out.writeFixed(quantize(height * pointsPerPixel), settings.precision);
+            out.write("] /Contents 4 0 R /Resources << >> >>\nendobj\n");
+
+            // The length isn't known until the strokes are written, so it goes in its own object
+            beginObject(4);
+            out.write("<< /Length 5 0 R >>\nstream\n");
+            contentStart = out.getOffset();
+
+            // Canvas pixels with y down, from the area's origin
+            out.writeFixed(quantize(pointsPerPixel), settings.precision);
+            out.write(" 0 0 ");
+            out.writeFixed(-quantize(pointsPerPixel), settings.precision);
+            out.write(' ');
+            out.writeFixed(quantize(-origin.x * pointsPerPixel), settings.precision);
+            out.write(' ');
+            out.writeFixed(quantize((height + origin.y) * pointsPerPixel), settings.precision);
+            out.write(" cm\n1 J\n1 j\n");
+        }
+
+        return !out.hasFailed();
+    }
+
+    bool VectorExporter::writeStroke(const Stroke& stroke) {
+        const PointBuffer& points = stroke.getProcessedPoints();
+        writePoints(points.data(), points.size(), stroke.getColor(), stroke.getBaseWidth(), stroke.getDynamicWidth());
+        return !out.hasFailed();
+    }
+
+    bool VectorExporter::writeStroke(const StrokeView& stroke) {
+        writePoints(stroke.processedPoints, stroke.processedCount, stroke.color, stroke.baseWidth, stroke.dynamicWidth);
+        return !out.hasFailed();
+    }
+
+    bool VectorExporter::close() {
+        if (!out.isOpen()) {
+            return false;
+        }
+
+        if (format == Svg) {
+            out.write("</g>\n</svg>\n");
+        }
+        else {
+            uint64_t contentLength = out.getOffset() - contentStart;
+            out.write("endstream\nendobj\n");
+            beginObject(5);
+            out.writeInt(static_cast<int64_t>(contentLength));
+            out.write("\nendobj\n");
+
+            uint64_t xrefOffset = out.getOffset();
+            out.write("xref\n0 ");
+            out.writeInt(pdfObjectCount + 1);
+            out.write("\n0000000000 65535 f \n");
+            for (size_t i = 1; i <= pdfObjectCount; ++i) {
+                char entry[24];
+                snprintf(entry, sizeof(entry), "%010llu 00000 n \n", static_cast<unsigned long long>(objectOffsets[i]));
+                out.write(entry);
+            }
+            out.write("trailer\n<< /Size ");
+            out.writeInt(pdfObjectCount + 1);
+            out.write(" /Root 1 0 R >>\nstartxref\n");
+            out.writeInt(static_cast<int64_t>(xrefOffset));
+            out.write("\n%%EOF\n");
+        }
+
+        return out.close();
+    }
+
+    bool VectorExporter::isOpen() const {
+        return out.isOpen();
+    }
+
+    uint64_t VectorExporter::getBytesWritten() const {
+        return out.getOffset();
+    }
+
+    size_t VectorExporter::getPointsWritten() const {
+        return pointsWritten;
+    }
+
+    VectorExporter::Format VectorExporter::formatFor(const std::string& path) {
+        size_t dot = path.find_last_of('.');
+        if (dot == std::string::npos) {
+            return Svg;
+        }
+
+        std::string extension = path.substr(dot + 1);
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) {
+            return static_cast<char>(c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c);
+        });
+        return extension == "pdf" ? Pdf : Svg;
+    }
+
+    bool VectorExporter::save(const Drawing& drawing, const std::string& path, float width, float height,
+        const VectorExportSettings& settings) {
+        Bounds area;
+        area.min = Vec2(0.0f, 0.0f);
+        area.max = Vec2(width, height);
+        return save(drawing, path, area, settings);
+    }
+
+    bool VectorExporter::save(const Drawing& drawing, const std::string& path, const Bounds& area,
+        const VectorExportSettings& settings) {
+        VectorExporter exporter(formatFor(path), settings);
+        if (!exporter.open(path, area)) {
+            return false;
+        }
+
+        // The visible layers, bottom first
+        for (size_t i = 0; i < drawing.getLayerCount(); ++i) {
+            const Layer& layer = drawing.getLayer(i);
+            if (!layer.isVisible()) continue;
+            for (const Stroke* stroke : layer.getStrokes()) {
+                exporter.writeStroke(*stroke);
+            }
+        }
+
+        return exporter.close();
+    }
+
+    int64_t VectorExporter::quantize(float value) const {
+        return static_cast<int64_t>(std::floor(value * unit + 0.5f));
+    }
+
+    void VectorExporter::writeColor(const Color& color) {
+        const float channels[] = { color.r, color.g, color.b };
+
+        if (format == Svg) {
+            char text[8];
+            snprintf(text, sizeof(text), "#%02x%02x%02x",
+                static_cast<int>(std::max(0.0f, std::min(1.0f, channels[0])) * 255.0f + 0.5f),
+                static_cast<int>(std::max(0.0f, std::min(1.0f, channels[1])) * 255.0f + 0.5f),
+                static_cast<int>(std::max(0.0f, std::min(1.0f, channels[2])) * 255.0f + 0.5f));
+            out.write(text);
+        }
+        else {
+            for (float channel : channels) {
+                out.writeFixed(static_cast<int64_t>(std::max(0.0f, std::min(1.0f, channel)) * 1000.0f + 0.5f), 3);
+                out.write(' ');
+            }
+        }
+    }
+
+    void VectorExporter::writePoints(const StrokePoint* points, size_t count, const Color& color, float baseWidth, bool dynamicWidth) {
+        if (count == 0 || !out.isOpen()) {
+            return;
+        }
+
+        // Simplified a window at a time, consecutive windows share their boundary point
+        size_t start = 0;
+        while (true) {
+            size_t end = std::min(start + settings.simplifyWindow - 1, count - 1);
+            kept.clear();
+            simplifier.simplify(points + start, end - start + 1, settings.tolerance, kept);
+
+            for (size_t k = start == 0 ? 0 : 1; k < kept.size(); ++k) {
+                size_t index = start + kept[k];
+                int64_t x = quantize(points[index].position.x);
+                int64_t y = quantize(points[index].position.y);
+
+                float step = settings.widthStep > 0.0f ? settings.widthStep : 1.0f / unit;
+                float width = std::floor(computeWidthAt(points, count, index, baseWidth, dynamicWidth) / step + 0.5f) * step;
+                int64_t pointWidth = std::max<int64_t>(1, quantize(width));
+
+                if (index == 0) {
+                    beginPath(color, pointWidth, x, y);
+                }
+                else if (x != lastX || y != lastY) {
+                    // Each segment has the width of its first point, a change of width starts a new path there
+                    if (!pathOpen) {
+                        beginPath(color, nextWidth, lastX, lastY);
+                    }
+                    lineTo(x, y);
+                    if (pointWidth != pathWidth) {
+                        endPath();
+                        nextWidth = pointWidth;
+                    }
+                }
+                pointsWritten++;
+            }
+
+            if (end == count - 1) {
+                break;
+            }
+            start = end;
+        }
+
+        endPath();
+    }
+
+    void VectorExporter::beginPath(const Color& color, int64_t width, int64_t x, int64_t y) {
+        if (format == Svg) {
+            out.write("<path stroke=\"");
+            writeColor(color);
+            if (color.a < 1.0f) {
+                out.write("\" stroke-opacity=\"");
+                out.writeFixed(static_cast<int64_t>(std::max(0.0f, color.a) * 1000.0f + 0.5f), 3);
+            }
+            out.write("\" stroke-width=\"");
+            out.writeFixed(width, settings.precision);
+            out.write("\" d=\"M");
+            out.writeFixed(x, settings.precision);
+            out.write(' ');
+            out.writeFixed(y, settings.precision);
+            out.write('l');
+        }
+        else {
+            if (color.r != pdfColor.r || color.g != pdfColor.g || color.b != pdfColor.b) {
+                writeColor(color);
+                out.write("RG\n");
+                pdfColor = color;
+            }
+            if (width != pdfWidth) {
+                out.writeFixed(width, settings.precision);
+                out.write(" w\n");
+                pdfWidth = width;
+            }
+            out.writeFixed(x, settings.precision);
+            out.write(' ');
+            out.writeFixed(y, settings.precision);
+            out.write(" m\n");
+        }
+
+        pathOpen = true;
+        pathSegments = 0;
+        pathWidth = width;
+        lastX = x;
+        lastY = y;
+    }
+
+    void VectorExporter::lineTo(int64_t x, int64_t y) {
+        if (format == Svg) {
+            // Relative to the quantized previous point, so rounding never accumulates
+            if (pathSegments > 0) out.write(' ');
+            out.writeFixed(x - lastX, settings.precision);
+            out.write(' ');
+            out.writeFixed(y - lastY, settings.precision);
+        }
+        else {
+            out.writeFixed(x, settings.precision);
+            out.write(' ');
+            out.writeFixed(y, settings.precision);
+            out.write(" l\n");
+        }
+
+        pathSegments++;
+        lastX = x;
+        lastY = y;
+    }
+
+    void VectorExporter::endPath() {
+        if (!pathOpen) {
+            return;
+        }
+
+        // A single point still needs a segment to be drawn with round caps
+        if (pathSegments == 0) {
+            lineTo(lastX, lastY);
+        }
+
+        out.write(format == Svg ? "\"/>\n" : "S\n");
+        pathOpen = false;
+    }
+
+    void VectorExporter::beginObject(size_t number) {
+        objectOffsets[number] = out.getOffset();
+        out.writeInt(static_cast<int64_t>(number));
+        out.write(" 0 obj\n");
+    }
+
+} // namespace vdraw
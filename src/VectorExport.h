@@ -0,0 +1,134 @@
+// VectorExport.h
+#pragma once
+
+#include "VectorDrawing.h"
+#include "DrawingDocument.h"
+#include "StrokeGeometry.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace vdraw {
+
+    // Buffered file output with locale-independent number formatting.
+    // Memory use is the buffer, whatever the size of the file.
+    class BufferedWriter {
+    public:
+        BufferedWriter(size_t capacity = 64 * 1024);
+        ~BufferedWriter();
+
+        BufferedWriter(const BufferedWriter&) = delete;
+        BufferedWriter& operator=(const BufferedWriter&) = delete;
+
+        bool open(const std::string& path);
+
+        // Flushes and closes, false if any write failed
+        bool close();
+
+        bool isOpen() const;
+        bool hasFailed() const;
+
+        void write(const char* data, size_t size);
+        void write(const char* text);
+        void write(char c);
+        void writeInt(int64_t value);
+
+        // value is in units of 10^-precision, trailing zeros are dropped: (1250, 2) writes "12.5"
+        void writeFixed(int64_t value, int precision);
+
+        // Bytes written so far, including those still buffered
+        uint64_t getOffset() const;
+
+    private:
+        FILE* file;
+        std::vector<char> buffer;
+        size_t used;
+        uint64_t offset;
+        bool failed;
+
+        void flush();
+    };
+
+    struct VectorExportSettings {
+        float tolerance;        // Simplification tolerance in pixels, 0 only drops collinear points
+        int precision;          // Decimal places of coordinates, 0 to 6
+        float widthStep;        // Widths are quantized to this step; each change of width starts a new path
+        size_t simplifyWindow;  // Points simplified at once, bounds the time and scratch memory of huge strokes
+
+        VectorExportSettings(float tolerance = 0.25f, int precision = 2, float widthStep = 0.25f, size_t simplifyWindow = 4096);
+    };
+
+    // Streams a drawing to SVG or PDF from the processed points and widths. Like
+    // DrawingDocumentWriter, strokes are written as they come and only the PDF object
+    // offsets are kept until close(), so huge sessions export in linear time and bounded memory.
+    //
+    // Coordinates stay in canvas pixels: SVG gets a matching viewBox, PDF a page of
+    // 0.75 points per pixel (96 dpi), so both scale to any print size without loss.
+    // The page shows an area of the drawing, from the origin unless given, e.g. a panned view.
+    // PDF content is uncompressed and ignores stroke alpha.
+    class VectorExporter {
+    public:
+        enum Format { Svg, Pdf };
+
+        VectorExporter(Format format = Svg, const VectorExportSettings& settings = VectorExportSettings());
+        ~VectorExporter();
+
+        VectorExporter(const VectorExporter&) = delete;
+        VectorExporter& operator=(const VectorExporter&) = delete;
+
+        bool open(const std::string& path, float width, float height);
+        bool open(const std::string& path, const Bounds& area);
+        bool writeStroke(const Stroke& stroke);
+        bool writeStroke(const StrokeView& stroke);
+        bool close();
+
+        bool isOpen() const;
+
+        uint64_t getBytesWritten() const;
+        size_t getPointsWritten() const;
+
+        // Format from the extension: .pdf, anything else is SVG
+        static Format formatFor(const std::string& path);
+
+        // Write every stroke of a drawing to path
+        static bool save(const Drawing& drawing, const std::string& path, float width, float height,
+            const VectorExportSettings& settings = VectorExportSettings());
+        static bool save(const Drawing& drawing, const std::string& path, const Bounds& area,
+            const VectorExportSettings& settings = VectorExportSettings());
+
+    private:
+        Format format;
+        VectorExportSettings settings;
+        BufferedWriter out;
+        float width, height;
+        int64_t unit;                       // 10^precision
+        std::vector<uint64_t> objectOffsets;
+        uint64_t contentStart;
+        size_t pointsWritten;
+
+        // Path state while a stroke is written
+        PolylineSimplifier simplifier;
+        std::vector<size_t> kept;
+        bool pathOpen;
+        size_t pathSegments;
+        int64_t pathWidth;
+        int64_t nextWidth;                  // Width of the path the next segment starts
+        int64_t lastX, lastY;
+
+        // PDF graphics state, only written when it changes
+        Color pdfColor;
+        int64_t pdfWidth;
+
+        int64_t quantize(float value) const;
+        void writeColor(const Color& color);
+        void writePoints(const StrokePoint* points, size_t count, const Color& color, float baseWidth, bool dynamicWidth);
+        void beginPath(const Color& color, int64_t width, int64_t x, int64_t y);
+        void lineTo(int64_t x, int64_t y);
+        void endPath();
+
+        void beginObject(size_t number);
+    };
+
+} // namespace vdraw
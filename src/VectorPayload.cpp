@@ -0,0 +1,221 @@
+// VectorPayload.cpp
+#include "VectorPayload.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace vdraw {
+
+    namespace {
+
+        void appendInt(std::string& out, int value) {
+            char text[16];
+            int length = snprintf(text, sizeof(text), "%d", value);
+            out.append(text, length);
+        }
+
+        std::string styleOf(const Stroke& stroke, float scale) {
+            const Color color = stroke.getColor();
+            int r = static_cast<int>(std::max(0.0f, std::min(1.0f, color.r)) * 255.0f + 0.5f);
+            int g = static_cast<int>(std::max(0.0f, std::min(1.0f, color.g)) * 255.0f + 0.5f);
+            int b = static_cast<int>(std::max(0.0f, std::min(1.0f, color.b)) * 255.0f + 0.5f);
+
+            char text[64];
+            int width = std::max(1, static_cast<int>(stroke.getBaseWidth() * scale + 0.5f));
+            int length = snprintf(text, sizeof(text), "stroke=\"#%02x%02x%02x\" stroke-width=\"%d\"", r, g, b, width);
+            return std::string(text, length);
+        }
+
+    } // namespace
+
+    VectorPayloadSettings::VectorPayloadSettings(size_t maxBytes, float gridSize, float tolerance, float maxTolerance)
+        : maxBytes(maxBytes), gridSize(gridSize), tolerance(tolerance), maxTolerance(maxTolerance) {
+    }
+
+    VectorPayloadStats::VectorPayloadStats()
+        : strokes(0), strokesKept(0), pointsIn(0), pointsOut(0), tolerance(0), bytes(0) {
+    }
+
+    //-------------------------------------------------------------------------
+    // VectorPayloadEncoder Implementation
+    //-------------------------------------------------------------------------
+    VectorPayloadEncoder::VectorPayloadEncoder(const VectorPayloadSettings& settings)
+        : settings(settings) {
+    }
+
+    std::string VectorPayloadEncoder::encode(const Drawing& drawing, float canvasWidth, float canvasHeight, VectorPayloadStats* stats) {
+        Bounds area;
+        if (canvasWidth <= 0.0f || canvasHeight <= 0.0f) {
+            area = computeBounds(drawing);
+            if (area.isEmpty()) {
+                area.min = area.max = Vec2();
+            }
+        }
+        else {
+            area.min = Vec2(0.0f, 0.0f);
+            area.max = Vec2(canvasWidth, canvasHeight);
+        }
+        return encode(drawing, area, stats);
+    }
+
+    std::string VectorPayloadEncoder::encode(const Drawing& drawing, const Bounds& area, VectorPayloadStats* stats) {
+        Vec2 origin = area.min;
+        float width = area.getWidth();
+        float height = area.getHeight();
+
+        float scale = settings.gridSize / std::max(1.0f, std::max(width, height));
+        int gridWidth = std::max(1, static_cast<int>(std::ceil(width * scale)));
+        int gridHeight = std::max(1, static_cast<int>(std::ceil(height * scale)));
+
+        // Quantize once; simplifying on the grid never moves a point by more than the tolerance plus half a step
+        quantized.clear();
+        strokeData.clear();
+        size_t pointsIn = 0;
+        // The strokes of the visible layers that show in the area, bottom first; the ones outside
+        // would only land off the viewBox and take budget from those that don't
+        for (size_t layer = 0; layer < drawing.getLayerCount(); ++layer) {
+            if (!drawing.getLayer(layer).isVisible()) continue;
+            inArea.clear();
+            drawing.getLayer(layer).queryStrokes(area, inArea);
+            for (const Stroke* stroke : inArea) {
+                const PointBuffer& points = stroke->getProcessedPoints();
+                if (points.empty()) continue;
+                pointsIn += points.size();
+
+                StrokeData data;
+                data.style = styleOf(*stroke, scale);
+                data.firstPoint = quantized.size();
+                data.length = 0.0f;
+                data.kept = true;
+
+                for (size_t i = 0; i < points.size(); ++i) {
+                    Vec2 point(std::floor((points[i].position.x - origin.x) * scale + 0.5f),
+                        std::floor((points[i].position.y - origin.y) * scale + 0.5f));
+                    if (quantized.size() > data.firstPoint) {
+                        const Vec2& last = quantized.back();
+                        if (last.x == point.x && last.y == point.y) continue;
+                        data.length += last.distanceTo(point);
+                    }
+                    quantized.push_back(point);
+                }
+
+                data.pointCount = quantized.size() - data.firstPoint;
+                strokeData.push_back(data);
+            }
+        }
+
+        // Coarser simplification first, whole strokes only when that isn't enough
+        std::string document;
+        float tolerance = settings.tolerance;
+        simplifyStrokes(tolerance);
+        writeDocument(gridWidth, gridHeight, document);
+        while (document.size() > settings.maxBytes && tolerance * 2.0f <= settings.maxTolerance) {
+            tolerance *= 2.0f;
+            simplifyStrokes(tolerance);
+            writeDocument(gridWidth, gridHeight, document);
+        }
+
+        if (document.size() > settings.maxBytes) {
+            std::vector<size_t> byLength(strokeData.size());
+            for (size_t i = 0; i < byLength.size(); ++i) {
+                byLength[i] = i;
+            }
+            std::stable_sort(byLength.begin(), byLength.end(), [this](size_t a, size_t b) {
+                return strokeData[a].length < strokeData[b].length;
+            });
+
+            // Estimate from the path data alone, then settle on the exact size
+            size_t excess = document.size() - settings.maxBytes;
+            size_t next = 0;
+            while (next < byLength.size() && excess > 0) {
+                StrokeData& data = strokeData[byLength[next++]];
+                data.kept = false;
+                excess -= std::min(excess, data.path.size());
+            }
+            writeDocument(gridWidth, gridHeight, document);
+            while (document.size() > settings.maxBytes && next < byLength.size()) {
+                strokeData[byLength[next++]].kept = false;
+                writeDocument(gridWidth, gridHeight, document);
+            }
+        }
+
+        if (stats) {
+            stats->strokes = strokeData.size();
+            stats->strokesKept = 0;
+            stats->pointsIn = pointsIn;
+            stats->pointsOut = 0;
+            for (const StrokeData& data : strokeData) {
+                if (data.kept) {
+                    stats->strokesKept++;
+                    stats->pointsOut += data.simplifiedCount;
+                }
+            }
+            stats->tolerance = tolerance;
+            stats->bytes = document.size();
+        }
+
+        return document;
+    }
+
+    void VectorPayloadEncoder::simplifyStrokes(float tolerance) {
+        for (StrokeData& data : strokeData) {
+            keptIndices.clear();
+            simplifier.simplify(&quantized[data.firstPoint], data.pointCount, tolerance, keptIndices);
+            data.simplifiedCount = keptIndices.size();
+
+            const Vec2* points = &quantized[data.firstPoint];
+            data.path.clear();
+            data.path += 'M';
+            appendInt(data.path, static_cast<int>(points[0].x));
+            data.path += ' ';
+            appendInt(data.path, static_cast<int>(points[0].y));
+
+            // A dot still needs a segment to be drawn with round caps
+            data.path += keptIndices.size() > 1 ? "l" : "l0 0";
+            for (size_t i = 1; i < keptIndices.size(); ++i) {
+                const Vec2& from = points[keptIndices[i - 1]];
+                const Vec2& to = points[keptIndices[i]];
+                if (i > 1) data.path += ' ';
+                appendInt(data.path, static_cast<int>(to.x - from.x));
+                data.path += ' ';
+                appendInt(data.path, static_cast<int>(to.y - from.y));
+            }
+        }
+    }
+
+    void VectorPayloadEncoder::writeDocument(int width, int height, std::string& out) const {
+        out.clear();
+        out += "<svg xmlns=\"http://www.w3.org/2000/svg\" viewBox=\"0 0 ";
+        appendInt(out, width);
+        out += ' ';
+        appendInt(out, height);
+        out += "\" fill=\"none\" stroke-linecap=\"round\">";
+
+        const std::string* style = nullptr;
+        for (const StrokeData& data : strokeData) {
+            if (!data.kept) continue;
+
+            if (!style || *style != data.style) {
+                if (style) out += "\"/>";
+                style = &data.style;
+                out += "<path ";
+                out += data.style;
+                out += " d=\"";
+            }
+            out += data.path;
+        }
+        if (style) out += "\"/>";
+
+        out += "</svg>";
+    }
+
+    void VectorPayloadEncoder::setSettings(const VectorPayloadSettings& settings) {
+        this->settings = settings;
+    }
+
+    const VectorPayloadSettings& VectorPayloadEncoder::getSettings() const {
+        return settings;
+    }
+
+} // namespace vdraw
@@ -0,0 +1,78 @@
+// VectorPayload.h
+#pragma once
+
+#include "VectorDrawing.h"
+#include "StrokeGeometry.h"
+
+#include <string>
+#include <vector>
+
+namespace vdraw {
+
+    struct VectorPayloadSettings {
+        size_t maxBytes;        // Size budget of the whole document
+        float gridSize;         // Coordinates are integers on a grid this size along the longer canvas side
+        float tolerance;        // Initial simplification tolerance, in grid units
+        float maxTolerance;     // Tolerance doubles up to this before whole strokes are dropped
+
+        VectorPayloadSettings(size_t maxBytes = 4096, float gridSize = 100.0f, float tolerance = 0.5f, float maxTolerance = 4.0f);
+    };
+
+    struct VectorPayloadStats {
+        size_t strokes;
+        size_t strokesKept;     // Shortest strokes are dropped when simplification alone misses the budget
+        size_t pointsIn;
+        size_t pointsOut;
+        float tolerance;        // Tolerance that met the budget
+        size_t bytes;
+
+        VectorPayloadStats();
+    };
+
+    // Serializes a drawing as a compact SVG document for text models, instead of rendering,
+    // reading back and PNG-encoding the canvas for a vision model. Points are normalized to an
+    // integer grid, simplified with Douglas-Peucker and written as relative path segments, e.g.
+    //
+    //   <svg xmlns="http://www.w3.org/2000/svg" viewBox="0 0 100 75" fill="none" stroke-linecap="round">
+    //   <path stroke="#000000" stroke-width="1" d="M12 40l3 1 4 -2M50 20l0 8"/></svg>
+    //
+    // Consecutive strokes of the same color and width share one path element.
+    // Keeps its scratch buffers between calls, so use one encoder per thread.
+    class VectorPayloadEncoder {
+    public:
+        VectorPayloadEncoder(const VectorPayloadSettings& settings = VectorPayloadSettings());
+
+        // The canvas size sets the normalization, so positions keep their place on the page;
+        // a size of 0 fits the drawing's bounds instead
+        std::string encode(const Drawing& drawing, float canvasWidth, float canvasHeight, VectorPayloadStats* stats = nullptr);
+
+        // Normalizes the area of the drawing, e.g. the one a panned or zoomed view shows, to the
+        // grid. Strokes entirely outside the area are left out.
+        std::string encode(const Drawing& drawing, const Bounds& area, VectorPayloadStats* stats = nullptr);
+
+        void setSettings(const VectorPayloadSettings& settings);
+        const VectorPayloadSettings& getSettings() const;
+
+    private:
+        struct StrokeData {
+            std::string style;          // Attributes shared with neighbouring strokes of the same style
+            size_t firstPoint;          // Range in quantized
+            size_t pointCount;
+            float length;               // In grid units, shorter strokes are dropped first
+            std::string path;           // Path data at the current tolerance
+            size_t simplifiedCount;
+            bool kept;
+        };
+
+        VectorPayloadSettings settings;
+        std::vector<Vec2> quantized;
+        std::vector<StrokeData> strokeData;
+        PolylineSimplifier simplifier;
+        std::vector<size_t> keptIndices;
+        std::vector<const Stroke*> inArea;
+
+        void simplifyStrokes(float tolerance);
+        void writeDocument(int width, int height, std::string& out) const;
+    };
+
+} // namespace vdraw
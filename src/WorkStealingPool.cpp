@@ -0,0 +1,136 @@
+#include "WorkStealingPool.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace {
+
+    typedef std::chrono::steady_clock Clock;
+
+    // The pool and worker the calling thread belongs to
+    thread_local const WorkStealingPool* currentPool = nullptr;
+    thread_local int currentWorker = -1;
+
+}
+
+WorkStealingPool::WorkStealingPool(size_t threads)
+    : nextWorker(0), queued(0), stopping(false), submitted(0), executed(0), stolen(0), busyNanos(0) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (size_t i = 0; i < threads; ++i) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        workers[i]->thread = std::thread(&WorkStealingPool::run, this, i);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (auto& worker : workers) {
+        worker->thread.join();
+    }
+}
+
+void WorkStealingPool::submit(Task task, bool yield) {
+    int self = getCurrentWorker();
+    bool local = self >= 0 && !yield;
+    Worker& worker = *workers[local ? static_cast<size_t>(self) : nextWorker++ % workers.size()];
+
+    // Counted before it can be taken, so a thief's decrement never comes first and wraps the
+    // count; a worker that sees it early only looks again until the push lands
+    submitted++;
+    queued++;
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        (local ? worker.tasks : worker.inbox).push_back(std::move(task));
+    }
+
+    // Taking the lock orders this with a worker checking queued before it sleeps
+    { std::lock_guard<std::mutex> lock(sleepMutex); }
+    wake.notify_one();
+}
+
+size_t WorkStealingPool::getThreadCount() const {
+    return workers.size();
+}
+
+int WorkStealingPool::getCurrentWorker() const {
+    return currentPool == this ? currentWorker : -1;
+}
+
+WorkStealingPool::Stats WorkStealingPool::getStats() const {
+    Stats stats;
+    stats.submitted = submitted;
+    stats.executed = executed;
+    stats.stolen = stolen;
+    stats.busySeconds = busyNanos / 1e9;
+    return stats;
+}
+
+void WorkStealingPool::run(size_t index) {
+    currentPool = this;
+    currentWorker = static_cast<int>(index);
+
+    Task task;
+    for (;;) {
+        if (take(index, task)) {
+            Clock::time_point start = Clock::now();
+            task();
+            task = nullptr;
+            busyNanos += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+            executed++;
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [this] { return queued > 0 || stopping; });
+        if (queued == 0 && stopping) {
+            return;
+        }
+    }
+}
+
+bool WorkStealingPool::take(size_t index, Task& task) {
+    {
+        Worker& own = *workers[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            queued--;
+            return true;
+        }
+        if (!own.inbox.empty()) {
+            task = std::move(own.inbox.front());
+            own.inbox.pop_front();
+            queued--;
+            return true;
+        }
+    }
+
+    // Steal the oldest task, inboxes first, starting past this worker so victims are spread out
+    for (int pass = 0; pass < 2; ++pass) {
+        for (size_t i = 1; i < workers.size(); ++i) {
+            Worker& victim = *workers[(index + i) % workers.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            std::deque<Task>& from = pass == 0 ? victim.inbox : victim.tasks;
+            if (!from.empty()) {
+                task = std::move(from.front());
+                from.pop_front();
+                queued--;
+                stolen++;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
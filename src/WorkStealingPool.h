@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads, each with its own task deque. A worker runs its own newest
+// task first, while its data is still in cache, and once out of work steals the oldest task
+// of another worker, so load spreads without a shared queue every task contends on.
+//
+// Tasks submitted from outside the pool, or yielded by a worker, go to the workers' inboxes
+// in turn instead. Inboxes run first in first out, after the worker's own tasks, so jobs that
+// yield between slices (e.g. one per session) take turns rather than the latest running first.
+//
+// Tasks should not block for long: a worker waiting on the network is a core doing nothing.
+// Blocking calls (e.g. model requests) belong on a pool of their own.
+class WorkStealingPool {
+public:
+    typedef std::function<void()> Task;
+
+    struct Stats {
+        uint64_t submitted;
+        uint64_t executed;
+        uint64_t stolen;        // Run by a worker other than the one it was queued on
+        double busySeconds;     // Time spent running tasks, summed over the workers
+    };
+
+    // 0 threads uses one per hardware thread
+    WorkStealingPool(size_t threads = 0);
+
+    // Runs the tasks still queued, then joins the workers
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    // yield: a worker's task goes behind the other work instead of running next, e.g. to
+    // continue a long job without starving the tasks queued meanwhile
+    void submit(Task task, bool yield = false);
+
+    size_t getThreadCount() const;
+
+    // Index of the calling thread among this pool's workers, or -1
+    int getCurrentWorker() const;
+
+    Stats getStats() const;
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;     // Own tasks run from the back, steals take the front
+        std::deque<Task> inbox;     // Submitted from outside or yielded, oldest first
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<size_t> nextWorker;
+    std::atomic<size_t> queued;     // Tasks in all deques
+
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool stopping;
+
+    std::atomic<uint64_t> submitted;
+    std::atomic<uint64_t> executed;
+    std::atomic<uint64_t> stolen;
+    std::atomic<int64_t> busyNanos;
+
+    void run(size_t index);
+    bool take(size_t index, Task& task);
+};